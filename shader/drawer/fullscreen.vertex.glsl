@@ -0,0 +1,11 @@
+#version 330 core
+
+// 不需要顶点数据，由 gl_VertexID 生成一个覆盖整个屏幕的三角形
+out vec2 uv;
+
+void main()
+{
+   vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+   uv = position;
+   gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+out vec4 fragColor;
+
+// GUI 的绘制结果，与窗口大小相同，颜色已经预乘 alpha
+uniform sampler2D source;
+
+void main()
+{
+   vec4 color = texelFetch(source, ivec2(gl_FragCoord.xy), 0);
+   // 没有 GUI 覆盖的像素保持不变
+   if(color.a == 0.0){
+      discard;
+   }
+   fragColor = color;
+}
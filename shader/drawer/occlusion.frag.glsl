@@ -0,0 +1,9 @@
+#version 330 core
+
+// 颜色写入被关闭，只需要片段通过深度测试的结果
+out vec4 fragColor;
+
+void main()
+{
+   fragColor = vec4(1.0);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+
+out vec4 fragColor;
+
+// 透明物体累加的 颜色 * alpha * 权重，alpha 为背后的颜色透过的比例
+uniform sampler2D accum;
+// 累加的 alpha * 权重
+uniform sampler2D weight;
+// 视口的左下角，透明目标从纹理的 (0, 0) 开始
+uniform vec2 origin;
+
+void main()
+{
+   ivec2 texel = ivec2(gl_FragCoord.xy - origin);
+   vec4 color = texelFetch(accum, texel, 0);
+   float revealage = color.a;
+   // 没有透明物体覆盖的像素保持不变
+   if(revealage >= 1.0){
+      discard;
+   }
+   float total = texelFetch(weight, texel, 0).r;
+   // 输出的 alpha 为透过的比例，由混合方式和背后的颜色混合
+   fragColor = vec4(color.rgb / max(total, 1e-5), revealage);
+}
@@ -0,0 +1,32 @@
+#version 330 core
+
+in vec2 uv;
+out vec4 fragColor;
+
+// 场景只渲染在纹理左下角的一部分中
+uniform sampler2D source;
+// 渲染区域占纹理的比例
+uniform vec2 sourceScale;
+// 纹理中一个像素的大小
+uniform vec2 texelSize;
+// 锐化强度，0 为普通的双线性放大
+uniform float sharpness;
+
+void main()
+{
+   // 每次采样都留出半个像素，避免双线性采样读到渲染区域之外
+   vec2 low = texelSize * 0.5;
+   vec2 high = sourceScale - texelSize * 0.5;
+   vec2 center = clamp(uv * sourceScale, low, high);
+   vec3 color = texture(source, center).rgb;
+   vec3 up = texture(source, clamp(center + vec2(0.0, texelSize.y), low, high)).rgb;
+   vec3 down = texture(source, clamp(center - vec2(0.0, texelSize.y), low, high)).rgb;
+   vec3 left = texture(source, clamp(center - vec2(texelSize.x, 0.0), low, high)).rgb;
+   vec3 right = texture(source, clamp(center + vec2(texelSize.x, 0.0), low, high)).rgb;
+
+   // 反锐化掩模：加上中心与周围平均值的差，并限制在周围的取值范围内以避免光晕
+   vec3 minColor = min(color, min(min(up, down), min(left, right)));
+   vec3 maxColor = max(color, max(max(up, down), max(left, right)));
+   vec3 sharpened = color + (color - (up + down + left + right) * 0.25) * sharpness;
+   fragColor = vec4(clamp(sharpened, minColor, maxColor), 1.0);
+}
@@ -0,0 +1,28 @@
+#version 330 core
+
+layout (location = 0) in vec3 inPos;
+// 顶点所属的 draw 的序号
+layout (location = 3) in float inDrawId;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// 每个 draw 占用 8 个 texel，这里只需要前 4 个：模型矩阵
+uniform samplerBuffer drawData;
+
+// 和 batch.vertex.glsl 保证 gl_Position 的计算结果完全相同
+invariant gl_Position;
+
+void main()
+{
+   int base = int(inDrawId) * 8;
+   mat4 drawModel = mat4(
+      texelFetch(drawData, base),
+      texelFetch(drawData, base + 1),
+      texelFetch(drawData, base + 2),
+      texelFetch(drawData, base + 3)
+   );
+   vec4 fragPos4 = model * drawModel * vec4(inPos, 1.0f);
+   gl_Position = projection * view * fragPos4;
+}
@@ -0,0 +1,53 @@
+#version 330 core
+
+layout (location = 0) in vec3 inPos;
+// 法向量
+layout (location = 1) in vec3 inNormal;
+
+layout (location = 2) in vec2 inCoord;
+// 顶点所属的 draw 的序号
+layout (location = 3) in float inDrawId;
+
+// 法向量的模型矩阵，没有位移变换
+uniform mat3 normalModel;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// 每个 draw 占用 8 个 texel：模型矩阵(4)、法向量的模型矩阵(3)、材质所在层(1)
+uniform samplerBuffer drawData;
+
+// 和深度预渲染的着色器保证 gl_Position 的计算结果完全相同
+invariant gl_Position;
+
+out vec3 normal;
+out vec3 fragPos;
+out vec2 coord;
+flat out int diffuseLayer;
+flat out int specularLayer;
+
+void main()
+{
+   int base = int(inDrawId) * 8;
+   mat4 drawModel = mat4(
+      texelFetch(drawData, base),
+      texelFetch(drawData, base + 1),
+      texelFetch(drawData, base + 2),
+      texelFetch(drawData, base + 3)
+   );
+   mat3 drawNormalModel = mat3(
+      texelFetch(drawData, base + 4).xyz,
+      texelFetch(drawData, base + 5).xyz,
+      texelFetch(drawData, base + 6).xyz
+   );
+   vec4 drawMaterial = texelFetch(drawData, base + 7);
+
+   normal = normalModel * drawNormalModel * inNormal;
+   vec4 fragPos4 = model * drawModel * vec4(inPos, 1.0f);
+   gl_Position = projection * view * fragPos4;
+   fragPos = fragPos4.xyz;
+   coord = inCoord;
+   diffuseLayer = int(drawMaterial.x);
+   specularLayer = int(drawMaterial.y);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+layout (location = 0) in vec3 inPos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// 和 cube.vertex.glsl 保证 gl_Position 的计算结果完全相同
+invariant gl_Position;
+
+void main()
+{
+   vec4 fragPos4 = model * vec4(inPos, 1.0f);
+   gl_Position = projection * view * fragPos4;
+}
@@ -12,6 +12,10 @@ struct Material {
    sampler2D diffuse;
    sampler2D specular;
    float shininess;
+#ifdef OIT
+   // 与漫反射贴图的 alpha 相乘
+   float opacity;
+#endif
 };
 uniform Material material;
 
@@ -68,7 +72,19 @@ uniform int pointLightNum;
 // 摄像机的坐标（世界空间）
 uniform vec3 viewPos;
 
+#ifdef OIT
+// 以 WeightedBlendedOIT 绘制的透明物体
+layout(location = 0) out vec4 accum;
+layout(location = 1) out float weight;
+
+// 深度越大权重越小，使离相机近的表面在合成后占比更大；限制范围避免 16 位浮点数溢出
+float computeWeight(float alpha){
+   float depth = 1.0 - gl_FragCoord.z * 0.9;
+   return clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(depth, 3.0), 1e-2, 3e3);
+}
+#else
 out vec4 fragColor;
+#endif
 
 float computeAttenuation(vec3 position, float constant, float linear, float quadratic){
    float dist = length(position - fragPos);
@@ -147,6 +163,12 @@ vec3 computeDirectionalLight(DirectionalLight light, vec3 viewDir, vec3 normal,
 
 void main()
 {  
+#ifdef ALPHA_TEST
+   // 镂空的贴图：alpha 小于一半的部分不绘制
+   if(texture(material.diffuse, coord).a < 0.5){
+      discard;
+   }
+#endif
    vec3 materialDiffuse = vec3(texture(material.diffuse, coord));
    vec3 materialSpecular = vec3(texture(material.specular, coord));
    vec3 viewDir = normalize(viewPos - fragPos);
@@ -161,5 +183,12 @@ void main()
    for(int i = 0; i < pointLightNum; i++){
       result += computePointLight(pointLights[i], viewDir, norm, materialDiffuse, materialSpecular);
    }
+#ifdef OIT
+   float alpha = texture(material.diffuse, coord).a * material.opacity;
+   float w = computeWeight(alpha);
+   accum = vec4(result * alpha * w, alpha);
+   weight = alpha * w;
+#else
    fragColor = vec4(result, 1.0);
+#endif
 }
\ No newline at end of file
@@ -13,6 +13,9 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// 和深度预渲染的着色器保证 gl_Position 的计算结果完全相同
+invariant gl_Position;
+
 out vec3 normal;
 out vec3 fragPos;
 out vec2 coord;
@@ -0,0 +1,6 @@
+#version 330 core
+
+// 只写入深度
+void main()
+{
+}
@@ -0,0 +1,273 @@
+#ifndef _MINECPP_CAPTURE_H_
+#define _MINECPP_CAPTURE_H_
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "resource.hpp"
+#include "thread.hpp"
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/******************* FRAME CAPTURE *******************/
+/*****************************************************/
+/*****************************************************/
+
+enum class CaptureFormat{
+   // 每帧一个 binary ppm 文件，大多数看图软件都可以打开
+   PPM,
+   // 所有帧依次写入同一个文件，没有文件头，每个像素为 rgba 四个字节、从上到下逐行存储
+   // 可以用 ffmpeg -f rawvideo -pix_fmt rgba -s <宽>x<高> -i <文件> 转换为视频
+   RAW,
+};
+
+// 从窗口的后缓冲读取像素，用于截图和连续录制
+// glReadPixels 先写入轮流使用的 PixelPackBuffer，几帧之后 fence 表明 GPU 已经写完时再 map 读取，
+// 读取时不会等待 GPU；编码和写文件在单独的工作线程中进行
+// GPU 或工作线程跟不上时丢弃新的录制帧，而不是阻塞绘制；截图不会被丢弃，槽被占用时推迟到之后的帧
+//
+// 使用方式：在每帧的 customDraw 的最后（GUI 绘制之后、交换缓冲区之前）调用 process
+//    drawer.draw([&]{ frame.render(); capture.process(); });
+// 请求（screenshot、startRecording 等）可以在其他线程中调用，process 需要在持有 gl 上下文的线程中调用
+class FrameCapture{
+private:
+   struct Request{
+      CaptureFormat format;
+      std::string path;
+      // 录制的帧序号，截图为 -1
+      int frame;
+      // RAW 格式录制时所有帧共用的文件，只在工作线程中写入；停止录制后已经提交的帧写完时自动关闭
+      std::shared_ptr<std::ofstream> stream;
+   };
+   struct Slot{
+      std::unique_ptr<PixelPackBuffer> buffer;
+      GLsync fence = nullptr;
+      int width = 0;
+      int height = 0;
+      Request request;
+   };
+   // 读取到编码之间的帧数上限由槽的数量决定
+   static constexpr int slotNumber = 3;
+   // 等待编码的帧数上限，超过时丢弃新的录制帧
+   static constexpr int maxPendingEncode = 4;
+
+   std::array<Slot, slotNumber> slots;
+   int nextSlot = 0;
+
+   std::mutex mutex;
+   std::optional<std::string> screenshotPath;
+   std::optional<Request> recording;
+
+   std::atomic<int> capturedNumber = 0;
+   std::atomic<int> droppedNumber = 0;
+   std::atomic<int> pendingEncode = 0;
+   // 只有一个工作线程，写入同一个文件的帧保持顺序
+   ThreadPool worker {1};
+
+   void readBack(Slot& slot);
+   // 没有空闲的槽时返回 false
+   bool issue(const Request& request);
+   // 截图没能读取时放回请求，在之后的帧重新读取；期间有新的截图请求时以新的为准
+   void retryScreenshot(const std::string& path){
+      std::lock_guard lock {mutex};
+      if(!screenshotPath.has_value()){
+         screenshotPath = path;
+      }
+   }
+   static void encode(const Request& request, const std::vector<unsigned char>& pixels, int width, int height);
+
+public:
+   FrameCapture() = default;
+   ~FrameCapture();
+   FrameCapture(const FrameCapture&) = delete;
+   FrameCapture& operator=(const FrameCapture&) = delete;
+
+   // 在之后的一帧保存截图为 ppm 文件
+   void screenshot(const std::string& path){
+      std::lock_guard lock {mutex};
+      screenshotPath = path;
+   }
+   // 开始连续录制，PPM 格式时 path 为文件名前缀，每帧保存为 <path>_<序号>.ppm；RAW 格式时 path 为文件名
+   void startRecording(const std::string& path, CaptureFormat format = CaptureFormat::RAW){
+      std::lock_guard lock {mutex};
+      std::shared_ptr<std::ofstream> stream;
+      if(format == CaptureFormat::RAW){
+         stream = std::make_shared<std::ofstream>(path, std::ios::binary);
+         if(!*stream){
+            throwError(fmt::format("can not open {} for recording", path));
+         }
+      }
+      recording = Request{format, path, 0, std::move(stream)};
+   }
+   void stopRecording(){
+      std::lock_guard lock {mutex};
+      recording.reset();
+   }
+   bool isRecording(){
+      std::lock_guard lock {mutex};
+      return recording.has_value();
+   }
+
+   // 读取之前帧已经完成的数据，并按照请求读取本帧
+   void process();
+
+   // 已经交给工作线程编码的帧数
+   int getCapturedNumber() const { return capturedNumber; }
+   // 因为 GPU 或者工作线程跟不上而丢弃的帧数
+   int getDroppedNumber() const { return droppedNumber; }
+   // 等待编码的帧数
+   int getPendingNumber() const { return pendingEncode; }
+};
+
+inline FrameCapture::~FrameCapture(){
+   // 读取所有还在 GPU 中的帧，工作线程在析构时会完成剩下的编码
+   for(int i = 0; i < slotNumber; i++){
+      auto& slot = slots[(nextSlot + i) % slotNumber];
+      if(slot.fence != nullptr){
+         glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+         try{
+            readBack(slot);
+         }catch(...){}
+      }
+   }
+}
+
+inline void FrameCapture::encode(const Request& request, const std::vector<unsigned char>& pixels, int width, int height){
+   // opengl 的第一行是图像的最下面一行，文件中从上到下存储
+   std::size_t rowSize = static_cast<std::size_t>(width) * 4;
+   if(request.format == CaptureFormat::RAW){
+      for(int y = height - 1; y >= 0; y--){
+         request.stream->write(reinterpret_cast<const char*>(pixels.data() + y * rowSize), rowSize);
+      }
+      return;
+   }
+   std::string path = request.frame < 0 ? request.path : fmt::format("{}_{:06}.ppm", request.path, request.frame);
+   std::ofstream file {path, std::ios::binary};
+   if(!file){
+      fmt::println("can not open {} for capture", path);
+      return;
+   }
+   file << fmt::format("P6\n{} {}\n255\n", width, height);
+   std::vector<unsigned char> row(static_cast<std::size_t>(width) * 3);
+   for(int y = height - 1; y >= 0; y--){
+      const unsigned char* source = pixels.data() + y * rowSize;
+      for(int x = 0; x < width; x++){
+         row[x * 3] = source[x * 4];
+         row[x * 3 + 1] = source[x * 4 + 1];
+         row[x * 3 + 2] = source[x * 4 + 2];
+      }
+      file.write(reinterpret_cast<const char*>(row.data()), row.size());
+   }
+}
+
+inline void FrameCapture::readBack(Slot& slot){
+   glDeleteSync(slot.fence);
+   slot.fence = nullptr;
+   bool screenshot = slot.request.frame < 0;
+   // 截图只有一帧，即使工作线程跟不上也交给它编码
+   if(pendingEncode >= maxPendingEncode && !screenshot){
+      droppedNumber++;
+      return;
+   }
+   std::size_t size = static_cast<std::size_t>(slot.width) * slot.height * 4;
+   std::vector<unsigned char> pixels(size);
+   PixelPackBufferContext::getInstance().bindContext(*slot.buffer);
+   void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+   if(data != nullptr){
+      std::memcpy(pixels.data(), data, size);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+   }
+   PixelPackBufferContext::getInstance().unBind();
+   checkGLError();
+   if(data == nullptr){
+      if(screenshot){
+         retryScreenshot(slot.request.path);
+      }else{
+         droppedNumber++;
+      }
+      return;
+   }
+   pendingEncode++;
+   capturedNumber++;
+   worker.submit([this, request = std::move(slot.request), pixels = std::move(pixels), width = slot.width, height = slot.height]{
+      encode(request, pixels, width, height);
+      pendingEncode--;
+   });
+}
+
+inline bool FrameCapture::issue(const Request& request){
+   auto& slot = slots[nextSlot];
+   if(slot.fence != nullptr){
+      // 该槽几帧之前的读取 GPU 还没有完成，不等待
+      return false;
+   }
+   GLint viewport[4];
+   glGetIntegerv(GL_VIEWPORT, viewport);
+   slot.width = viewport[2];
+   slot.height = viewport[3];
+   GLsizeiptr size = static_cast<GLsizeiptr>(slot.width) * slot.height * 4;
+   if(slot.buffer == nullptr || slot.buffer->getSize() != size){
+      slot.buffer = std::make_unique<PixelPackBuffer>(size);
+   }
+   slot.request = request;
+   PixelPackBufferContext::getInstance().bindContext(*slot.buffer);
+   auto& framebufferContext = FramebufferContext::getInstance();
+   framebufferContext.unBind();
+   // 无窗口模式下默认帧缓冲是离屏帧缓冲
+   glReadBuffer(framebufferContext.isOffscreen() ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+   // 绑定了 pixel pack buffer 时最后一个参数是 buffer 中的偏移，调用会立即返回
+   glReadPixels(0, 0, slot.width, slot.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+   PixelPackBufferContext::getInstance().unBind();
+   slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   checkGLError();
+   nextSlot = (nextSlot + 1) % slotNumber;
+   return true;
+}
+
+inline void FrameCapture::process(){
+   // 按提交顺序检查，保证录制的帧按顺序编码
+   for(int i = 0; i < slotNumber; i++){
+      auto& slot = slots[(nextSlot + i) % slotNumber];
+      if(slot.fence == nullptr){
+         continue;
+      }
+      GLenum status = glClientWaitSync(slot.fence, 0, 0);
+      if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED){
+         break;
+      }
+      readBack(slot);
+   }
+
+   std::optional<Request> request;
+   {
+      std::lock_guard lock {mutex};
+      if(screenshotPath.has_value()){
+         request = Request{CaptureFormat::PPM, *screenshotPath, -1, nullptr};
+         screenshotPath.reset();
+      }else if(recording.has_value()){
+         request = *recording;
+         recording->frame++;
+      }
+   }
+   if(request.has_value() && !issue(*request)){
+      // 录制丢弃本帧，截图推迟到之后的帧
+      if(request->frame < 0){
+         retryScreenshot(request->path);
+      }else{
+         droppedNumber++;
+      }
+   }
+}
+
+} // namespace minecpp
+
+#endif // _MINECPP_CAPTURE_H_
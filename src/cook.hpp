@@ -0,0 +1,306 @@
+#ifndef _MINECPP_COOK_H_
+#define _MINECPP_COOK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "exception.hpp"
+#include "tool.hpp"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/******************  COOKED  FILE  *******************/
+/*****************************************************/
+/*****************************************************/
+
+// 只读地把整个文件映射到内存中，读取时由操作系统按页加载，不需要先复制到缓冲区
+class MappedFile{
+private:
+   const unsigned char* data = nullptr;
+   std::size_t size = 0;
+#ifdef _WIN32
+   HANDLE file = INVALID_HANDLE_VALUE;
+   HANDLE mapping = nullptr;
+#endif
+
+   void close(){
+#ifdef _WIN32
+      if(data != nullptr){
+         UnmapViewOfFile(data);
+      }
+      if(mapping != nullptr){
+         CloseHandle(mapping);
+      }
+      if(file != INVALID_HANDLE_VALUE){
+         CloseHandle(file);
+      }
+      file = INVALID_HANDLE_VALUE;
+      mapping = nullptr;
+#else
+      if(data != nullptr){
+         munmap(const_cast<unsigned char*>(data), size);
+      }
+#endif
+      data = nullptr;
+      size = 0;
+   }
+
+public:
+   // 文件不存在或者映射失败时抛出异常；空文件的 getData 为 nullptr
+   explicit MappedFile(const std::filesystem::path& path){
+#ifdef _WIN32
+      file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      LARGE_INTEGER fileSize;
+      if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)){
+         close();
+         throwError("open file failed: " + utf8String(path));
+      }
+      size = static_cast<std::size_t>(fileSize.QuadPart);
+      if(size == 0){
+         return;
+      }
+      mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      data = mapping == nullptr ? nullptr : static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+      int fd = open(path.c_str(), O_RDONLY);
+      struct stat status;
+      if(fd < 0 || fstat(fd, &status) != 0){
+         if(fd >= 0){
+            ::close(fd);
+         }
+         throwError("open file failed: " + utf8String(path));
+      }
+      size = static_cast<std::size_t>(status.st_size);
+      if(size == 0){
+         ::close(fd);
+         return;
+      }
+      void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      // 映射建立之后文件描述符就不再需要了
+      ::close(fd);
+      data = address == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(address);
+#endif
+      if(data == nullptr){
+         close();
+         throwError("map file failed: " + utf8String(path));
+      }
+   }
+   ~MappedFile(){
+      close();
+   }
+   MappedFile(MappedFile&& other) noexcept{
+      *this = std::move(other);
+   }
+   MappedFile& operator=(MappedFile&& other) noexcept{
+      if(this != &other){
+         close();
+         std::swap(data, other.data);
+         std::swap(size, other.size);
+#ifdef _WIN32
+         std::swap(file, other.file);
+         std::swap(mapping, other.mapping);
+#endif
+      }
+      return *this;
+   }
+   MappedFile(const MappedFile&) = delete;
+   MappedFile& operator=(const MappedFile&) = delete;
+
+   const unsigned char* getData() const { return data; }
+   std::size_t getSize() const { return size; }
+};
+
+// 64 位的非加密哈希，每次处理 8 个字节，用于判断源文件是否改变
+class Hasher{
+private:
+   static constexpr std::uint64_t prime = 0x9E3779B97F4A7C15ull;
+   std::uint64_t hash;
+
+   static std::uint64_t mix(std::uint64_t x){
+      x ^= x >> 33;
+      x *= 0xFF51AFD7ED558CCDull;
+      x ^= x >> 33;
+      x *= 0xC4CEB9FE1A85EC53ull;
+      x ^= x >> 33;
+      return x;
+   }
+
+public:
+   explicit Hasher(std::uint64_t seed = 0): hash(mix(seed + prime)){}
+
+   Hasher& add(const void* data, std::size_t size){
+      const unsigned char* bytes = static_cast<const unsigned char*>(data);
+      hash = (hash ^ mix(size)) * prime;
+      std::size_t i = 0;
+      for(; i + 8 <= size; i += 8){
+         std::uint64_t word;
+         std::memcpy(&word, bytes + i, 8);
+         hash = (hash ^ mix(word)) * prime;
+      }
+      if(i < size){
+         std::uint64_t word = 0;
+         std::memcpy(&word, bytes + i, size - i);
+         hash = (hash ^ mix(word)) * prime;
+      }
+      return *this;
+   }
+   template<typename T> requires std::is_trivially_copyable_v<T>
+   Hasher& add(const T& value){
+      return add(&value, sizeof(T));
+   }
+   Hasher& add(const std::string& value){
+      return add(value.data(), value.size());
+   }
+
+   std::uint64_t get() const { return mix(hash); }
+};
+
+// 烘焙文件的开头，key 由调用者依据源文件的内容和导入参数计算，不一致时文件需要重新生成
+struct CookHeader{
+   char magic[8] {'M', 'C', 'P', 'P', 'C', 'O', 'O', 'K'};
+   // 文件格式本身的版本，格式改变时增加
+   // key 只包含源文件和导入参数，烘焙的内容（如 MeshOptimizer 和 lod 简化的结果）改变时也需要增加，否则会读到旧的结果
+   // 2：修复了 MeshOptimizer::optimizeOverdraw 丢失三角形的问题
+   std::uint32_t version = 2;
+   // 用于检查写入和读取的机器字节序相同
+   std::uint32_t byteOrder = 0x01020304;
+   std::uint64_t key = 0;
+};
+
+// 顺序写入烘焙文件：定长的值直接写入，数组按 blockAlignment 对齐，读取时可以直接使用映射的内存
+class CookWriter{
+private:
+   std::vector<char> buffer;
+
+public:
+   static constexpr std::size_t blockAlignment = 16;
+
+   explicit CookWriter(std::uint64_t key){
+      CookHeader header;
+      header.key = key;
+      write(header);
+   }
+
+   template<typename T> requires std::is_trivially_copyable_v<T>
+   void write(const T& value){
+      const char* bytes = reinterpret_cast<const char*>(&value);
+      buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+   }
+   void writeString(const std::string& value){
+      write<std::uint64_t>(value.size());
+      buffer.insert(buffer.end(), value.begin(), value.end());
+   }
+   template<typename T> requires std::is_trivially_copyable_v<T>
+   void writeBlock(std::span<const T> block){
+      write<std::uint64_t>(block.size());
+      buffer.resize((buffer.size() + blockAlignment - 1) / blockAlignment * blockAlignment, 0);
+      const char* bytes = reinterpret_cast<const char*>(block.data());
+      buffer.insert(buffer.end(), bytes, bytes + block.size_bytes());
+   }
+   template<typename T>
+   void writeBlock(const std::vector<T>& block){
+      writeBlock(std::span<const T>(block));
+   }
+
+   // 先写入临时文件再替换，中途失败不会留下不完整的文件
+   void save(const std::filesystem::path& path) const {
+      std::filesystem::path temporary = path;
+      temporary += ".tmp";
+      {
+         std::ofstream file {temporary, std::ios::binary | std::ios::trunc};
+         file.write(buffer.data(), buffer.size());
+         if(!file){
+            throwError("write cooked file failed: " + utf8String(temporary));
+         }
+      }
+      std::error_code error;
+      std::filesystem::rename(temporary, path, error);
+      if(error){
+         std::filesystem::remove(temporary, error);
+         throwError("replace cooked file failed: " + utf8String(path));
+      }
+   }
+   std::size_t size() const { return buffer.size(); }
+};
+
+// 按照与 CookWriter 相同的顺序读取，数组直接指向映射的内存，因此 file 需要比读取到的数组活得长
+class CookReader{
+private:
+   const unsigned char* data;
+   std::size_t size;
+   std::size_t offset = 0;
+
+   const unsigned char* take(std::size_t bytes){
+      if(bytes > size - offset){
+         throwError("cooked file is truncated");
+      }
+      const unsigned char* result = data + offset;
+      offset += bytes;
+      return result;
+   }
+
+public:
+   explicit CookReader(const MappedFile& file): data(file.getData()), size(file.getSize()){}
+
+   // 文件由当前版本的格式写入且 key 一致时才能继续读取
+   bool matches(std::uint64_t key){
+      CookHeader expected;
+      expected.key = key;
+      if(size < sizeof(CookHeader)){
+         return false;
+      }
+      CookHeader header = read<CookHeader>();
+      return std::memcmp(&header, &expected, sizeof(CookHeader)) == 0;
+   }
+
+   template<typename T> requires std::is_trivially_copyable_v<T>
+   T read(){
+      T value;
+      std::memcpy(&value, take(sizeof(T)), sizeof(T));
+      return value;
+   }
+   std::string readString(){
+      auto length = read<std::uint64_t>();
+      const unsigned char* bytes = take(length);
+      return {reinterpret_cast<const char*>(bytes), length};
+   }
+   template<typename T> requires std::is_trivially_copyable_v<T>
+   std::span<const T> readBlock(){
+      auto number = read<std::uint64_t>();
+      take((offset + CookWriter::blockAlignment - 1) / CookWriter::blockAlignment * CookWriter::blockAlignment - offset);
+      if(number > (size - offset) / sizeof(T)){
+         throwError("cooked file is truncated");
+      }
+      const T* block = reinterpret_cast<const T*>(take(number * sizeof(T)));
+      return {block, number};
+   }
+};
+
+} // namespace minecpp
+
+#endif // _MINECPP_COOK_H_
@@ -0,0 +1,217 @@
+#ifndef _MINECPP_CULLING_H_
+#define _MINECPP_CULLING_H_
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+// x86 上 SSE 总是可用的，AVX 需要编译时开启（如 -mavx）
+#if defined(__AVX__) || defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/********************** BOUNDS ***********************/
+/*****************************************************/
+/*****************************************************/
+
+// 轴对齐包围盒，默认构造为空（min > max）
+struct BoundingBox{
+   glm::vec3 min {std::numeric_limits<float>::max()};
+   glm::vec3 max {std::numeric_limits<float>::lowest()};
+
+   bool isEmpty() const {
+      return min.x > max.x || min.y > max.y || min.z > max.z;
+   }
+   void extend(const glm::vec3& point){
+      min = glm::min(min, point);
+      max = glm::max(max, point);
+   }
+   void extend(const BoundingBox& box){
+      if(!box.isEmpty()){
+         extend(box.min);
+         extend(box.max);
+      }
+   }
+   glm::vec3 center() const {
+      return (min + max) * 0.5f;
+   }
+   // 外接球的半径
+   float radius() const {
+      return glm::length(max - min) * 0.5f;
+   }
+   // 变换后重新求轴对齐包围盒（Arvo 的方法），结果仍然包住变换后的原包围盒
+   BoundingBox transform(const glm::mat4& model) const {
+      if(isEmpty()){
+         return *this;
+      }
+      BoundingBox ret;
+      ret.min = ret.max = glm::vec3(model[3]);
+      for(int i = 0; i < 3; i++){
+         for(int j = 0; j < 3; j++){
+            float a = model[j][i] * min[j];
+            float b = model[j][i] * max[j];
+            ret.min[i] += std::min(a, b);
+            ret.max[i] += std::max(a, b);
+         }
+      }
+      return ret;
+   }
+};
+
+struct BoundingSphere{
+   glm::vec3 center;
+   float radius;
+
+   // 由局部空间的包围盒和模型矩阵得到世界空间的包围球，半径按照最大的缩放系数放大
+   static BoundingSphere fromBox(const BoundingBox& box, const glm::mat4& model){
+      float scale = std::max({
+         glm::length(glm::vec3(model[0])),
+         glm::length(glm::vec3(model[1])),
+         glm::length(glm::vec3(model[2]))
+      });
+      return {glm::vec3(model * glm::vec4(box.center(), 1.0f)), box.radius() * scale};
+   }
+};
+
+/*****************************************************/
+/*****************************************************/
+/********************** FRUSTUM **********************/
+/*****************************************************/
+/*****************************************************/
+
+// 视锥体的 6 个平面，法向量朝内，xyz 为单位法向量，w 为距离
+// 点 p 在平面内侧当且仅当 dot(plane.xyz, p) + plane.w >= 0
+struct Frustum{
+   glm::vec4 planes[6];
+
+   // 从 projection * view 矩阵中提取视锥体平面（Gribb-Hartmann 方法），得到的平面位于世界空间
+   static Frustum fromMatrix(const glm::mat4& projectionView){
+      Frustum frustum;
+      // glm 是列主序的，m[col][row]，这里需要取出矩阵的行
+      glm::vec4 rows[4];
+      for(int i = 0; i < 4; i++){
+         rows[i] = glm::vec4(projectionView[0][i], projectionView[1][i], projectionView[2][i], projectionView[3][i]);
+      }
+      // left right bottom top near far
+      frustum.planes[0] = rows[3] + rows[0];
+      frustum.planes[1] = rows[3] - rows[0];
+      frustum.planes[2] = rows[3] + rows[1];
+      frustum.planes[3] = rows[3] - rows[1];
+      frustum.planes[4] = rows[3] + rows[2];
+      frustum.planes[5] = rows[3] - rows[2];
+      for(auto& plane: frustum.planes){
+         plane /= glm::length(glm::vec3(plane));
+      }
+      return frustum;
+   }
+
+   bool isVisible(const BoundingSphere& sphere) const {
+      for(auto& plane: planes){
+         // 与 SphereBatch::cull 中 SIMD 的计算顺序保持一致，保证结果相同
+         float distance = (sphere.center.x * plane.x + sphere.center.y * plane.y) + (sphere.center.z * plane.z + plane.w);
+         if(!(distance >= -sphere.radius)){
+            return false;
+         }
+      }
+      return true;
+   }
+};
+
+// SoA 形式存储的一批包围球，便于使用 SIMD 一次检测多个
+class SphereBatch{
+private:
+   std::vector<float> xs;
+   std::vector<float> ys;
+   std::vector<float> zs;
+   std::vector<float> radiuses;
+public:
+   void clear(){
+      xs.clear();
+      ys.clear();
+      zs.clear();
+      radiuses.clear();
+   }
+   void reserve(std::size_t size){
+      xs.reserve(size);
+      ys.reserve(size);
+      zs.reserve(size);
+      radiuses.reserve(size);
+   }
+   void add(const BoundingSphere& sphere){
+      xs.push_back(sphere.center.x);
+      ys.push_back(sphere.center.y);
+      zs.push_back(sphere.center.z);
+      radiuses.push_back(sphere.radius);
+   }
+   std::size_t size() const { return xs.size(); }
+   BoundingSphere get(std::size_t i) const {
+      return {{xs[i], ys[i], zs[i]}, radiuses[i]};
+   }
+
+   // 逐个检测，作为 SIMD 版本的对照
+   void cullScalar(const Frustum& frustum, std::vector<unsigned char>& visible) const {
+      visible.resize(size());
+      for(std::size_t i = 0; i < size(); i++){
+         visible[i] = frustum.isVisible(get(i));
+      }
+   }
+
+   // visible[i] 为 1 表示第 i 个包围球与视锥体相交
+   void cull(const Frustum& frustum, std::vector<unsigned char>& visible) const {
+      visible.resize(size());
+      std::size_t i = 0;
+#if defined(__AVX__)
+      for(; i + 8 <= size(); i += 8){
+         __m256 x = _mm256_loadu_ps(&xs[i]);
+         __m256 y = _mm256_loadu_ps(&ys[i]);
+         __m256 z = _mm256_loadu_ps(&zs[i]);
+         __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radiuses[i]));
+         __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+         for(auto& plane: frustum.planes){
+            __m256 distance = _mm256_add_ps(
+               _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+               _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w))
+            );
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+         }
+         int mask = _mm256_movemask_ps(inside);
+         for(int j = 0; j < 8; j++){
+            visible[i + j] = (mask >> j) & 1;
+         }
+      }
+#elif defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+      for(; i + 4 <= size(); i += 4){
+         __m128 x = _mm_loadu_ps(&xs[i]);
+         __m128 y = _mm_loadu_ps(&ys[i]);
+         __m128 z = _mm_loadu_ps(&zs[i]);
+         __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radiuses[i]));
+         __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+         for(auto& plane: frustum.planes){
+            __m128 distance = _mm_add_ps(
+               _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+               _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w))
+            );
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+         }
+         int mask = _mm_movemask_ps(inside);
+         for(int j = 0; j < 4; j++){
+            visible[i + j] = (mask >> j) & 1;
+         }
+      }
+#endif
+      // 剩余不足一组的部分
+      for(; i < size(); i++){
+         visible[i] = frustum.isVisible(get(i));
+      }
+   }
+};
+
+} // namespace minecpp
+
+#endif // _MINECPP_CULLING_H_
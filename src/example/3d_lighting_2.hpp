@@ -204,42 +204,44 @@ int run()
          glUseProgram(lightProgram.getId());
          glUniformMatrix4fv(glGetUniformLocation(lightProgram.getId(), "view"), 1, GL_FALSE, glm::value_ptr(view));
       };
-      auto moveSpeed = 0.05f;
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_A, [&](auto _){
-         view = glm::translate(glm::vec3(moveSpeed, 0.0f, 0.0f)) * view.value();
+      // 每秒移动的距离和旋转的角度，变化量按模拟的时间缩放，速度与帧率无关
+      auto moveSpeed = 3.0f;
+      auto rotateSpeed = 60.0f;
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_A, [&](int, float delta){
+         view = glm::translate(glm::vec3(moveSpeed * delta, 0.0f, 0.0f)) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_D, [&](auto _){
-         view = glm::translate(glm::vec3(-moveSpeed, 0.0f, 0.0f)) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_D, [&](int, float delta){
+         view = glm::translate(glm::vec3(-moveSpeed * delta, 0.0f, 0.0f)) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_Z, [&](auto _){
-         view = glm::translate(glm::vec3(0.0f, -moveSpeed, 0.0f)) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_Z, [&](int, float delta){
+         view = glm::translate(glm::vec3(0.0f, -moveSpeed * delta, 0.0f)) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_X, [&](auto _){
-         view = glm::translate(glm::vec3(0.0f, moveSpeed, 0.0f)) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_X, [&](int, float delta){
+         view = glm::translate(glm::vec3(0.0f, moveSpeed * delta, 0.0f)) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_W, [&](auto _){
-         view = glm::translate(glm::vec3(0.0f, 0.0f, moveSpeed)) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_W, [&](int, float delta){
+         view = glm::translate(glm::vec3(0.0f, 0.0f, moveSpeed * delta)) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_S, [&](auto _){
-         view = glm::translate(glm::vec3(0.0f, 0.0f, -moveSpeed)) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_S, [&](int, float delta){
+         view = glm::translate(glm::vec3(0.0f, 0.0f, -moveSpeed * delta)) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_L, [&](auto window){
-         view = glm::mat4_cast(glm::angleAxis(glm::radians(1.0f), glm::vec3(0.0f, 1.0f, 0.0f))) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_L, [&](int, float delta){
+         view = glm::mat4_cast(glm::angleAxis(glm::radians(rotateSpeed * delta), glm::vec3(0.0f, 1.0f, 0.0f))) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_J, [&](auto window){
-         view = glm::mat4_cast(glm::angleAxis(glm::radians(-1.0f), glm::vec3(0.0f, 1.0f, 0.0f))) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_J, [&](int, float delta){
+         view = glm::mat4_cast(glm::angleAxis(glm::radians(-rotateSpeed * delta), glm::vec3(0.0f, 1.0f, 0.0f))) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_I, [&](auto window){
-         view = glm::mat4_cast(glm::angleAxis(glm::radians(-1.0f), glm::vec3(1.0f, 0.0f, 0.0f))) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_I, [&](int, float delta){
+         view = glm::mat4_cast(glm::angleAxis(glm::radians(-rotateSpeed * delta), glm::vec3(1.0f, 0.0f, 0.0f))) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_K, [&](auto window){
-         view = glm::mat4_cast(glm::angleAxis(glm::radians(1.0f), glm::vec3(1.0f, 0.0f, 0.0f))) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_K, [&](int, float delta){
+         view = glm::mat4_cast(glm::angleAxis(glm::radians(rotateSpeed * delta), glm::vec3(1.0f, 0.0f, 0.0f))) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_U, [&](auto window){
-         view = glm::mat4_cast(glm::angleAxis(glm::radians(-1.0f), glm::vec3(0.0f, 0.0f, 1.0f))) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_U, [&](int, float delta){
+         view = glm::mat4_cast(glm::angleAxis(glm::radians(-rotateSpeed * delta), glm::vec3(0.0f, 0.0f, 1.0f))) * view.value();
       });
-      inputProcessor.addKeyHoldHandler(GLFW_KEY_O, [&](auto window){
-         view = glm::mat4_cast(glm::angleAxis(glm::radians(1.0f), glm::vec3(0.0f, 0.0f, 1.0f))) * view.value();
+      inputProcessor.addKeyHoldHandler(GLFW_KEY_O, [&](int, float delta){
+         view = glm::mat4_cast(glm::angleAxis(glm::radians(rotateSpeed * delta), glm::vec3(0.0f, 0.0f, 1.0f))) * view.value();
       });
 
       
@@ -10,7 +10,14 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
 #include <optional>
+#include <set>
+#include <thread>
+#include <tuple>
 
 #include "../resource.hpp"
 #include "../gui.hpp"
@@ -20,6 +27,13 @@
 #include "../vertex.hpp"
 #include "fmt/core.h"
 #include "../input.hpp"
+#include "../render.hpp"
+#include "../resolution.hpp"
+#include "../capture.hpp"
+#include "../optimizer.hpp"
+#include "../thread.hpp"
+#include "../cook.hpp"
+#include "../scheduler.hpp"
 
 
 namespace model
@@ -27,12 +41,19 @@ namespace model
 using namespace minecpp;
 
 class Model;
+class StreamingModel;
 
 class Mesh{
+friend class Model;
+friend class StreamingModel;
 private:
    VertexData<true> vertexData;
+   // 各级细节的索引位于 vertexData 的 ebo 中原始索引之后
+   MeshLod lod;
    Model& model;
    int materialIndex;
+   // 模型的变换再乘上 mesh 所在节点的变换
+   ReactiveValue<glm::mat4, glm::mat4> meshTrans;
 
 public:
    struct LightObjectMetaConstructor{
@@ -43,22 +64,148 @@ public:
       const ObservableValue<glm::mat4>& model;
    };
 public:
-   Mesh(VertexData<true>&& vertexData, Model& model, int materialIndex)
-   :vertexData(std::move(vertexData)), model(model), materialIndex(materialIndex){}
+   Mesh(VertexData<true>&& vertexData, MeshLod lod, Model& model, int materialIndex, const glm::mat4& transform);
    operator LightObjectMeta();
 };
 
+// 导入模型时的选项
+struct ModelOption{
+   // 将所有 mesh 合并到同一组 vbo/ebo 中，整个模型只需要一个 DrawUnit 和一次 multi draw
+   // 材质通过纹理数组的层来区分，每个 mesh 的变换和材质层存放在 texture buffer 中
+   // 合批时所有材质都作为不透明物体绘制
+   bool batch = false;
+   // 将材质和变换都相同的 mesh 合并为一个 mesh，适用于静态的模型
+   bool mergeByMaterial = false;
+   // 整个模型作为软件遮挡剔除的遮挡物
+   bool occluder = false;
+   // 只将这些名字（assimp 中 mesh 的名字）的 mesh 作为遮挡物
+   std::set<std::string> occluderMeshes;
+   // 导入时在工作线程中重新排列三角形和顶点，提高顶点缓存命中率、减少过度绘制，见 MeshOptimizer
+   bool optimize = true;
+   // 导入时在工作线程中为每个 mesh 生成几级更简单的索引，绘制时依据屏幕上的大小选择，见 MeshSimplifier 和 LodSelector
+   // 合批时不生成
+   bool lod = true;
+   // 导入的结果（合并、优化和简化之后的顶点、索引，材质和包围盒）保存在模型文件旁边的 <文件名>.cooked 中
+   // 之后源文件和以上参数都没有改变时直接映射这个文件创建 gl 资源，不再经过 assimp；合批时不使用
+   bool cook = true;
+};
+
 // 禁止移动与拷贝： mesh 含有对 mode 的引用成员，如要移动，则需要将引用变为指针，并且在移动时改变地址
 class Model{
 friend class Mesh;
-private:
+protected:
    float shininess;
+   // 贴图由 TextureCache 共享，其他 Model 使用同一张图片时不会重复解码和上传
    struct Material{
-      Texture2D diffuse;
-      std::optional<Texture2D> specular;
+      std::shared_ptr<Texture2D> diffuse;
+      std::shared_ptr<Texture2D> specular;
+      float opacity;
+   };
+   // 材质贴图的路径，先收集起来，再根据是否合批决定创建什么样的纹理
+   struct MaterialMeta{
+      std::string diffusePath;
+      std::optional<std::string> specularPath;
+      // 小于 1 时（如玻璃）作为透明物体绘制
+      float opacity;
+   };
+   // mesh 在 cpu 中的数据
+   struct MeshMeta{
+      VertexStreams<glm::vec3, glm::vec3, glm::vec2> vertex;
+      int materialIndex;
+      // mesh 所在节点相对于根节点的变换
+      glm::mat4 transform;
+      // 局部空间（不含节点变换）的包围盒
+      BoundingBox bounds;
+      // 是否作为遮挡物
+      bool occluder;
+      // 第 0 级为 vertex.indices，之后各级的索引依次存放在 lodIndices 中
+      MeshLod lod;
+      std::vector<unsigned int> lodIndices;
+   };
+   // 烘焙文件中每个 mesh 的定长部分，之后依次是各级细节、交错排列的顶点、位置和索引（含各级细节）四个数组
+   struct CookedMesh{
+      glm::mat4 transform;
+      BoundingBox bounds;
+      std::int32_t materialIndex;
+      std::uint32_t occluder;
+      // 第 0 级的索引数
+      std::uint64_t indexNumber;
+   };
+   // 从烘焙文件中读出的一个 mesh，数组指向映射的内存
+   struct CookedMeshView{
+      CookedMesh mesh;
+      std::span<const MeshLod::Level> levels;
+      std::span<const char> vertexes;
+      std::span<const glm::vec3> positions;
+      std::span<const unsigned int> indices;
+   };
+   using MeshLayout = VertexLayout<VertexPacking::INTERLEAVED, glm::vec3, glm::vec3, glm::vec2>;
+   static constexpr unsigned int importFlags = aiProcess_Triangulate;
+   // 合批后整个模型的 gl 资源
+   struct MeshBatch{
+      VertexData<true> vertexData;
+      MultiDrawCommand commands;
+      Texture2DArray diffuses;
+      std::optional<Texture2DArray> speculars;
+      TextureBuffer drawData;
+      // 包含各个 mesh 节点变换的包围盒
+      BoundingBox bounds;
+   };
+   // 遮挡物需要在 cpu 中保留一份顶点位置
+   static Occluder createOccluder(std::span<const glm::vec3> vertexes, std::span<const unsigned int> indices, const glm::mat4& transform, const glm::mat4& model){
+      std::vector<glm::vec3> positions;
+      positions.reserve(vertexes.size());
+      for(auto& position: vertexes){
+         positions.push_back(glm::vec3(transform * glm::vec4(position, 1.0f)));
+      }
+      return Occluder {std::move(positions), {indices.begin(), indices.end()}, model};
+   }
+   static Occluder createOccluder(const MeshMeta& mesh, const glm::mat4& transform, const glm::mat4& model){
+      return createOccluder(mesh.vertex.get<0>(), mesh.vertex.indices, transform, model);
+   }
+   // 按照节点顺序收集的 mesh，之后在工作线程中转换为 MeshMeta
+   struct MeshSource{
+      const aiMesh* mesh;
+      glm::mat4 transform;
+      int materialIndex;
+      bool occluder;
+   };
+   // 一张材质贴图：TextureCache 中已有时直接使用，否则在工作线程中解码，回到当前线程后上传并加入缓存
+   // 同一次导入中相同的图片只解码一次；合批时不使用缓存，统一解码为 rgba
+   struct PendingTexture{
+      TextureCache::Key key;
+      std::shared_ptr<Texture2D> texture;
+      std::shared_future<Image> image;
+
+      std::shared_ptr<Texture2D> get(){
+         if(texture == nullptr){
+            texture = TextureCache::getInstance().insert(key, image.get());
+         }
+         return texture;
+      }
+   };
+   struct MaterialImages{
+      PendingTexture diffuse;
+      std::optional<PendingTexture> specular;
+   };
+   // 导入过程中的中间状态
+   struct ImportContext{
+      const aiScene* scene;
+      std::string directory;
+      // key是assimp中的索引，value是Model中的索引
+      std::map<int, int> meshMap;
+      std::vector<MeshSource> sources;
+      //本来想使用assimp的material的索引作为key，但后来发现assimp中, material不是唯一的，即索引不同却可能指向同一个文件
+      // 因此使用文件名（和不透明度）为key
+      std::map<std::tuple<std::string, std::string, float>, int> materialMap;
+      std::vector<MaterialMeta> materials;
+      std::vector<MeshMeta> meshes;
+      const ModelOption& option;
    };
    std::vector<Material> materials;
    std::vector<Mesh> meshes;
+   std::optional<MeshBatch> batch;
+   std::vector<Occluder> occluders;
    ObservableValue<glm::mat4> modelTrans;
    // deleted move semantic
    Model& operator=(Model&&) = delete;
@@ -69,44 +216,48 @@ private:
    
    
    
-   int getMaterialIndex(int materialIndex, const aiScene* scene, std::map<std::pair<std::string, std::string>, int>& materialMap, const std::string& directory){
+   int getMaterialIndex(int materialIndex, ImportContext& ctx){
       // 只拿每个类型贴图中的第一个贴图
-      const aiMaterial* mat = scene->mMaterials[materialIndex];
+      const aiMaterial* mat = ctx.scene->mMaterials[materialIndex];
       aiString diffusePath;
       mat->GetTexture(aiTextureType_DIFFUSE, 0, &diffusePath);
       aiString specularPath;
       mat->GetTexture(aiTextureType_SPECULAR, 0, &specularPath);
-      std::pair key = {std::string{diffusePath.C_Str()}, std::string{specularPath.C_Str()}};
-      if(materialMap.contains(key)){
-         return materialMap[key];
+      float opacity = 1.0f;
+      mat->Get(AI_MATKEY_OPACITY, opacity);
+      std::tuple key = {std::string{diffusePath.C_Str()}, std::string{specularPath.C_Str()}, opacity};
+      if(ctx.materialMap.contains(key)){
+         return ctx.materialMap[key];
       }else{
-         materials.emplace_back(
-            Texture2D {directory + "/" + diffusePath.C_Str()},
+         ctx.materials.push_back({
+            ctx.directory + "/" + diffusePath.C_Str(),
             // 处理 specularPath不存在的情况
-            specularPath.length == 0 ? std::nullopt : std::optional(Texture2D {directory + "/" + specularPath.C_Str()})
-         );
-         materialMap[key] = materials.size() - 1;
-         return materials.size() - 1;
-      }
-   }
-
-   void processMesh(const aiMesh* mesh, const aiScene* scene, std::map<std::pair<std::string, std::string>, int>& materialMap, const std::string& directory){
-      // 处理顶点数据
-      VertexMeta<true, glm::vec3, glm::vec3, glm::vec2> meta;
-      auto& vertexs = meta.vertexes;
-      vertexs.reserve(mesh->mNumVertices);
-      for(int i = 0; i < mesh->mNumVertices; i++){
-         vertexs.push_back({
-            glm::vec3{mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z},
-            glm::vec3{mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z},
-            glm::vec2{mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y},
+            specularPath.length == 0 ? std::nullopt : std::optional(ctx.directory + "/" + specularPath.C_Str()),
+            opacity
          });
+         ctx.materialMap[key] = ctx.materials.size() - 1;
+         return ctx.materials.size() - 1;
       }
+   }
+
+   // 只读取 aiMesh，可以在多个工作线程中同时执行
+   static MeshMeta convertMesh(const MeshSource& source){
+      const aiMesh* mesh = source.mesh;
+      // 处理顶点数据：assimp 的数组本身就是按属性分开存放的，每个属性整块复制
+      static_assert(sizeof(aiVector3D) == sizeof(glm::vec3), "assimp must be built with single precision");
+      VertexStreams<glm::vec3, glm::vec3, glm::vec2> meta;
+      meta.resize(mesh->mNumVertices);
+      auto copy = [&mesh]<typename T>(std::vector<T>& dst, std::type_identity_t<VertexSource<T>> src){
+         src.copyTo(reinterpret_cast<char*>(dst.data()), sizeof(T), mesh->mNumVertices);
+      };
+      copy(meta.get<0>(), mesh->mVertices);
+      copy(meta.get<1>(), mesh->mNormals);
+      copy(meta.get<2>(), mesh->mTextureCoords[0]);
+      BoundingBox bounds = computeBounds(meta);
       
       // 处理索引数据
       auto& indices = meta.indices;
       indices.reserve(3 * mesh->mNumFaces);
-      fmt::println("num face: {}", mesh->mNumFaces);
       for(int i = 0; i < mesh->mNumFaces; i++){
          aiFace face = mesh->mFaces[i];
          if(face.mNumIndices != 3){
@@ -116,71 +267,802 @@ private:
             indices.push_back(face.mIndices[j]);
          }
       }
-
-      // 处理材质
-      int materialIndex = getMaterialIndex(mesh->mMaterialIndex, scene, materialMap, directory);
-
-      meshes.emplace_back(createVertexData(meta), *this, materialIndex);
+      return {std::move(meta), source.materialIndex, source.transform, bounds, source.occluder, {}, {}};
    }
-   void processNode(const aiNode* node, const aiScene* scene, std::map<int, int>& meshMap, std::map<std::pair<std::string, std::string>, int>& materialMap, const std::string& directory){
+   // 材质需要去重，在主线程中按照节点顺序处理，材质和 mesh 的顺序与串行导入时相同
+   void processNode(const aiNode* node, const glm::mat4& parentTransform, ImportContext& ctx){
+      // assimp 的矩阵是行主序的，glm 是列主序的
+      glm::mat4 transform = parentTransform * glm::transpose(glm::make_mat4(&node->mTransformation.a1));
       for(int i = 0; i < node->mNumMeshes; i++){
          int meshIndex = node->mMeshes[i];
-         if(meshMap.contains(meshIndex)){
+         if(ctx.meshMap.contains(meshIndex)){
             continue;
          }
-         processMesh(scene->mMeshes[meshIndex], scene, materialMap, directory);
-         meshMap[meshIndex] = meshes.size() - 1;
+         const aiMesh* mesh = ctx.scene->mMeshes[meshIndex];
+         bool occluder = ctx.option.occluder || ctx.option.occluderMeshes.contains(mesh->mName.C_Str());
+         ctx.sources.push_back({mesh, transform, getMaterialIndex(mesh->mMaterialIndex, ctx), occluder});
+         ctx.meshMap[meshIndex] = ctx.sources.size() - 1;
       }
       for(int i = 0; i < node->mNumChildren; i++){
-         processNode(node->mChildren[i], scene, meshMap, materialMap, directory);
+         processNode(node->mChildren[i], transform, ctx);
+      }
+   }
+   // 大的 mesh 先开始处理，避免最后只剩一个线程在处理最大的 mesh
+   static std::vector<std::size_t> largestFirst(const std::vector<std::size_t>& sizes){
+      std::vector<std::size_t> order(sizes.size());
+      for(std::size_t i = 0; i < order.size(); i++){
+         order[i] = i;
+      }
+      std::stable_sort(order.begin(), order.end(), [&sizes](std::size_t a, std::size_t b){
+         return sizes[a] > sizes[b];
+      });
+      return order;
+   }
+   // 每个 mesh 的结果写入各自的位置，与完成的顺序无关
+   static void convertMeshes(ImportContext& ctx, ThreadPool& pool){
+      std::vector<std::size_t> sizes;
+      for(auto& source: ctx.sources){
+         sizes.push_back(source.mesh->mNumVertices + source.mesh->mNumFaces);
+      }
+      auto order = largestFirst(sizes);
+      std::vector<std::optional<MeshMeta>> converted(ctx.sources.size());
+      pool.parallelForEach(order.size(), [&ctx, &order, &converted](std::size_t i){
+         converted[order[i]].emplace(convertMesh(ctx.sources[order[i]]));
+      });
+      ctx.meshes.reserve(converted.size());
+      for(auto& mesh: converted){
+         ctx.meshes.push_back(std::move(*mesh));
+      }
+   }
+   static std::vector<std::size_t> meshSizes(const ImportContext& ctx){
+      std::vector<std::size_t> sizes;
+      for(auto& mesh: ctx.meshes){
+         sizes.push_back(mesh.vertex.indices.size());
+      }
+      return sizes;
+   }
+   static std::vector<MaterialImages> decodeMaterials(const std::vector<MaterialMeta>& metas, bool batch, ThreadPool& pool){
+      std::map<TextureCache::Key, std::shared_future<Image>> decoding;
+      auto request = [&decoding, &pool, batch](const std::string& path){
+         PendingTexture pending {TextureCache::makeKey(path, batch ? 4 : 0)};
+         if(!batch){
+            pending.texture = TextureCache::getInstance().find(pending.key);
+            if(pending.texture != nullptr){
+               return pending;
+            }
+         }
+         auto found = decoding.find(pending.key);
+         if(found == decoding.end()){
+            found = decoding.emplace(pending.key, pool.submit([path, channels = pending.key.channels]{
+               return Image {path, channels};
+            }).share()).first;
+         }
+         pending.image = found->second;
+         return pending;
+      };
+      std::vector<MaterialImages> images;
+      for(auto& material: metas){
+         images.push_back({
+            request(material.diffusePath),
+            material.specularPath.has_value() ? std::optional(request(*material.specularPath)) : std::nullopt,
+         });
+      }
+      return images;
+   }
+   // 将材质和变换都相同的 mesh 的顶点和索引拼接在一起，合并后的 mesh 按照各组第一次出现的顺序排列
+   void mergeByMaterial(ImportContext& ctx){
+      std::vector<MeshMeta> merged;
+      for(auto& mesh: ctx.meshes){
+         auto target = std::find_if(merged.begin(), merged.end(), [&mesh](const MeshMeta& meta){
+            return meta.materialIndex == mesh.materialIndex && meta.transform == mesh.transform;
+         });
+         if(target == merged.end()){
+            merged.push_back(std::move(mesh));
+         }else{
+            appendVertexStreams(target->vertex, mesh.vertex);
+            target->bounds.extend(mesh.bounds);
+            target->occluder = target->occluder || mesh.occluder;
+         }
+      }
+      ctx.meshes = std::move(merged);
+   }
+   // 每个 mesh 各自优化，输出整个模型优化前后的 ACMR/ATVR
+   void optimizeMeshes(ImportContext& ctx, const std::string& path, ThreadPool& pool){
+      std::vector<MeshOptimizer::Report> reports(ctx.meshes.size());
+      auto order = largestFirst(meshSizes(ctx));
+      pool.parallelForEach(order.size(), [&ctx, &reports, &order](std::size_t i){
+         reports[order[i]] = MeshOptimizer::optimize(ctx.meshes[order[i]].vertex);
+      });
+      MeshOptimizer::Report total;
+      for(auto& report: reports){
+         total.before.add(report.before);
+         total.after.add(report.after);
+      }
+      fmt::println("model {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+         path, total.before.acmr, total.after.acmr, total.before.atvr, total.after.atvr);
+   }
+   // 简化一个 mesh，每一级的索引再重新排列以提高顶点缓存命中率
+   static void generateLod(MeshMeta& mesh){
+      mesh.lod = MeshSimplifier::generateLods(mesh.vertex.get<0>(), mesh.vertex.indices, mesh.lodIndices);
+      for(std::size_t level = 1; level < mesh.lod.size(); level++){
+         auto first = mesh.lodIndices.begin() + (mesh.lod.levels[level].offset - mesh.vertex.indices.size());
+         auto last = first + mesh.lod.levels[level].count;
+         std::vector<unsigned int> optimized = MeshOptimizer::optimizeVertexCache({first, last}, mesh.vertex.size());
+         std::copy(optimized.begin(), optimized.end(), first);
+      }
+   }
+   // 每个 mesh 各自简化
+   void generateLods(ImportContext& ctx, const std::string& path, ThreadPool& pool){
+      auto order = largestFirst(meshSizes(ctx));
+      pool.parallelForEach(order.size(), [&ctx, &order](std::size_t i){
+         generateLod(ctx.meshes[order[i]]);
+      });
+      // 每一级的三角形总数，没有这一级的 mesh 按照最后一级计算
+      std::vector<std::size_t> triangles;
+      for(auto& mesh: ctx.meshes){
+         triangles.resize(std::max(triangles.size(), mesh.lod.size()));
+      }
+      for(auto& mesh: ctx.meshes){
+         for(std::size_t level = 0; level < triangles.size(); level++){
+            triangles[level] += mesh.lod.levels[std::min(level, mesh.lod.size() - 1)].count / 3;
+         }
+      }
+      std::string levels;
+      for(auto number: triangles){
+         levels += (levels.empty() ? "" : " / ") + std::to_string(number);
+      }
+      fmt::println("model {}: lod triangles {}", path, levels);
+   }
+   // 等待工作线程解码完成后上传
+   void createMaterials(const std::vector<MaterialMeta>& metas, std::vector<MaterialImages>& images){
+      for(std::size_t i = 0; i < metas.size(); i++){
+         materials.push_back({
+            images[i].diffuse.get(),
+            images[i].specular.has_value() ? images[i].specular->get() : nullptr,
+            metas[i].opacity,
+         });
       }
    }
-   void buildMeshes(const std::string& path){
+   // 每个 mesh 各自创建 gl 资源；先上传顶点，贴图在这期间继续解码
+   void buildSeparate(ImportContext& ctx, std::vector<MaterialImages>& images){
+      meshes.reserve(ctx.meshes.size());
+      for(auto& mesh: ctx.meshes){
+         meshes.emplace_back(createVertexData(mesh.vertex, mesh.lodIndices), std::move(mesh.lod), *this, mesh.materialIndex, mesh.transform);
+      }
+      createMaterials(ctx.materials, images);
+      // mesh 不会再移动，遮挡物可以引用其变换
+      for(int i = 0; i < ctx.meshes.size(); i++){
+         if(ctx.meshes[i].occluder){
+            occluders.push_back(createOccluder(ctx.meshes[i], glm::mat4(1.0f), meshes[i].meshTrans.get()));
+         }
+      }
+   }
+   // 所有 mesh 共用一组 gl 资源
+   void buildBatch(ImportContext& ctx, std::vector<MaterialImages>& images){
+      // 额外的 float 属性是顶点所属 draw 的序号，用于在着色器中查找该 draw 的数据
+      VertexStreams<glm::vec3, glm::vec3, glm::vec2, float> meta;
+      auto& [positions, normals, coords, drawIds] = meta.attributes;
+      MultiDrawCommand commands;
+      for(float drawId = 0; auto& mesh: ctx.meshes){
+         // 每段索引保留原本从 0 开始的值，通过 baseVertex 定位到合并后的顶点
+         commands.add(mesh.vertex.indices.size(), meta.indices.size(), meta.size());
+         positions.insert(positions.end(), mesh.vertex.get<0>().begin(), mesh.vertex.get<0>().end());
+         normals.insert(normals.end(), mesh.vertex.get<1>().begin(), mesh.vertex.get<1>().end());
+         coords.insert(coords.end(), mesh.vertex.get<2>().begin(), mesh.vertex.get<2>().end());
+         drawIds.insert(drawIds.end(), mesh.vertex.size(), drawId);
+         meta.indices.insert(meta.indices.end(), mesh.vertex.indices.begin(), mesh.vertex.indices.end());
+         drawId++;
+      }
+
+      std::vector<const Image*> diffuses;
+      std::vector<const Image*> speculars;
+      // 每个材质的镜面反射贴图所在的层，-1 表示没有
+      std::vector<int> specularLayers;
+      for(auto& material: images){
+         diffuses.push_back(&material.diffuse.image.get());
+         if(material.specular.has_value()){
+            specularLayers.push_back(speculars.size());
+            speculars.push_back(&material.specular->image.get());
+         }else{
+            specularLayers.push_back(-1);
+         }
+      }
+
+      std::vector<BatchDrawData> drawDatas;
+      BoundingBox bounds;
+      for(auto& mesh: ctx.meshes){
+         drawDatas.push_back(BatchDrawData::create(mesh.transform, mesh.materialIndex, specularLayers[mesh.materialIndex]));
+         bounds.extend(mesh.bounds.transform(mesh.transform));
+         // 合批时各个 mesh 没有单独的模型矩阵，遮挡物的顶点预先乘上节点变换
+         if(mesh.occluder){
+            occluders.push_back(createOccluder(mesh, mesh.transform, modelTrans.get()));
+         }
+      }
+
+      batch.emplace(MeshBatch{
+         createVertexData(meta),
+         std::move(commands),
+         Texture2DArray {diffuses},
+         speculars.empty() ? std::nullopt : std::optional<Texture2DArray>(std::in_place, speculars),
+         TextureBuffer {drawDatas},
+         bounds,
+      });
+      fmt::println("batch {} meshes with {} materials into one draw unit", ctx.meshes.size(), ctx.materials.size());
+   }
+   // 源文件的内容和影响导入结果的参数，任何一个改变时烘焙文件都需要重新生成
+   static std::uint64_t computeCookKey(const std::string& path, const ModelOption& option){
+      MappedFile source {utf8Path(path)};
+      Hasher hasher;
+      hasher.add(source.getData(), source.getSize());
+      hasher.add(importFlags).add(option.mergeByMaterial).add(option.optimize).add(option.lod).add(option.occluder);
+      for(auto& name: option.occluderMeshes){
+         hasher.add(name);
+      }
+      return hasher.get();
+   }
+   // 保存 buildSeparate 之前的导入结果，顶点按照 createVertexData 的布局打包好
+   static void writeCooked(const ImportContext& ctx, const std::string& cookPath, std::uint64_t key){
+      CookWriter writer {key};
+      writer.write<std::uint64_t>(ctx.materials.size());
+      for(auto& material: ctx.materials){
+         writer.writeString(material.diffusePath);
+         writer.write<std::uint8_t>(material.specularPath.has_value());
+         writer.writeString(material.specularPath.value_or(""));
+         writer.write(material.opacity);
+      }
+      writer.write<std::uint64_t>(ctx.meshes.size());
+      std::vector<char> vertexes;
+      std::vector<unsigned int> indices;
+      for(auto& mesh: ctx.meshes){
+         writer.write(CookedMesh{mesh.transform, mesh.bounds, mesh.materialIndex, mesh.occluder, mesh.vertex.indices.size()});
+         writer.writeBlock(mesh.lod.levels);
+         vertexes.resize(MeshLayout::size(mesh.vertex.size()));
+         std::apply([&mesh, &vertexes](auto&... attribute){
+            MeshLayout::pack(vertexes.data(), mesh.vertex.size(), attribute...);
+         }, mesh.vertex.attributes);
+         writer.writeBlock(vertexes);
+         writer.writeBlock(mesh.vertex.get<0>());
+         indices.assign(mesh.vertex.indices.begin(), mesh.vertex.indices.end());
+         indices.insert(indices.end(), mesh.lodIndices.begin(), mesh.lodIndices.end());
+         writer.writeBlock(indices);
+      }
+      writer.save(utf8Path(cookPath));
+   }
+   // 读取并检查整个烘焙文件，不创建 gl 资源，可以在工作线程中执行；key 不一致时返回 false
+   static bool readCooked(const MappedFile& file, std::uint64_t key, std::vector<MaterialMeta>& materialMetas, std::vector<CookedMeshView>& views){
+      CookReader reader {file};
+      if(!reader.matches(key)){
+         return false;
+      }
+      materialMetas.resize(reader.read<std::uint64_t>());
+      for(auto& material: materialMetas){
+         material.diffusePath = reader.readString();
+         bool specular = reader.read<std::uint8_t>();
+         std::string specularPath = reader.readString();
+         material.specularPath = specular ? std::optional(specularPath) : std::nullopt;
+         material.opacity = reader.read<float>();
+      }
+      views.resize(reader.read<std::uint64_t>());
+      for(auto& view: views){
+         view.mesh = reader.read<CookedMesh>();
+         view.levels = reader.readBlock<MeshLod::Level>();
+         view.vertexes = reader.readBlock<char>();
+         view.positions = reader.readBlock<glm::vec3>();
+         view.indices = reader.readBlock<unsigned int>();
+         if(view.mesh.materialIndex < 0 || static_cast<std::size_t>(view.mesh.materialIndex) >= materialMetas.size()){
+            throwError("invalid material index in cooked file");
+         }
+         if(view.vertexes.size() != MeshLayout::size(view.positions.size()) || view.mesh.indexNumber > view.indices.size()){
+            throwError("invalid mesh size in cooked file");
+         }
+         // 索引直接上传到 ebo，越界的索引会让 gl 读取 vbo 之外的内存
+         for(unsigned int index: view.indices){
+            if(index >= view.positions.size()){
+               throwError("invalid vertex index in cooked file");
+            }
+         }
+         for(auto& level: view.levels){
+            if(level.offset + level.count > view.indices.size()){
+               throwError("invalid level of detail in cooked file");
+            }
+         }
+      }
+      return true;
+   }
+   void emplaceCookedMesh(const CookedMeshView& view){
+      meshes.emplace_back(
+         createPackedVertexData<MeshLayout>(view.vertexes, view.positions, view.indices, view.mesh.indexNumber, view.mesh.bounds),
+         MeshLod{{view.levels.begin(), view.levels.end()}}, *this, view.mesh.materialIndex, view.mesh.transform
+      );
+   }
+   // 从烘焙文件创建材质和 mesh，顶点和索引直接从映射的内存上传，key 不一致时返回 false
+   bool buildCooked(const std::string& cookPath, std::uint64_t key, ThreadPool& pool){
+      if(!std::filesystem::exists(utf8Path(cookPath))){
+         return false;
+      }
+      MappedFile file {utf8Path(cookPath)};
+      std::vector<MaterialMeta> materialMetas;
+      std::vector<CookedMeshView> views;
+      if(!readCooked(file, key, materialMetas, views)){
+         return false;
+      }
+      // 顶点上传的同时在工作线程中解码贴图
+      auto images = decodeMaterials(materialMetas, false, pool);
+      meshes.reserve(views.size());
+      for(auto& view: views){
+         emplaceCookedMesh(view);
+      }
+      createMaterials(materialMetas, images);
+      // mesh 不会再移动，遮挡物可以引用其变换
+      for(std::size_t i = 0; i < views.size(); i++){
+         if(views[i].mesh.occluder){
+            occluders.push_back(createOccluder(views[i].positions, views[i].indices.first(views[i].mesh.indexNumber), glm::mat4(1.0f), meshes[i].meshTrans.get()));
+         }
+      }
+      return true;
+   }
+   void buildMeshes(const std::string& path, const ModelOption& option){
+      auto start = std::chrono::steady_clock::now();
+      auto elapsed = [&start]{
+         return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      };
+      bool cook = option.cook && !option.batch;
+      std::string cookPath = path + ".cooked";
+      std::uint64_t key = 0;
+      // CPU 上的工作（转换、优化、简化 mesh 和解码贴图）都在工作线程中进行，gl 资源只在当前线程中创建
+      ThreadPool pool;
+      if(cook){
+         key = computeCookKey(path, option);
+         try{
+            if(buildCooked(cookPath, key, pool)){
+               fmt::println("model {}: loaded {} meshes from {} in {:.1f} ms", path, meshes.size(), cookPath, elapsed());
+               return;
+            }
+         }catch(const std::string& e){
+            // 文件损坏时丢弃已经创建的部分，重新导入
+            fmt::println("model {}: ignore cooked file: {}", path, e);
+            occluders.clear();
+            meshes.clear();
+            materials.clear();
+         }
+      }
       Assimp::Importer importer;
       // aiProcess_Triangulate：将所有图元转换为三角形（如果不是的话）
       // aiProcess_FlipUVs 翻转y轴纹理坐标
-      const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate );
+      const aiScene *scene = importer.ReadFile(path, importFlags);
 
       if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode){
          throwError(std::string("assimp import model failed:") + importer.GetErrorString());
       }
-      const aiNode* node = scene->mRootNode;
-      // key是assimp中的索引，value是Model中的索引
-      std::map<int, int> meshMap; 
-      //本来想使用assimp的material的索引作为key，但后来发现assimp中, material不是唯一的，即索引不同却可能指向同一个文件
-      // 因此使用文件名为key
-      std::map<std::pair<std::string, std::string>, int> materialMap;
-      std::string directory = path.substr(0, path.find_last_of('/'));
-      processNode(node, scene, meshMap, materialMap, directory);
+      ImportContext ctx {
+         .scene = scene,
+         .directory = path.substr(0, path.find_last_of('/')),
+         .option = option,
+      };
+      processNode(scene->mRootNode, glm::mat4(1.0f), ctx);
+      // 贴图的解码和 mesh 的转换同时进行
+      auto images = decodeMaterials(ctx.materials, option.batch, pool);
+      convertMeshes(ctx, pool);
+      if(option.mergeByMaterial){
+         int meshNumber = ctx.meshes.size();
+         mergeByMaterial(ctx);
+         fmt::println("model {}: {} meshes merged into {} meshes by material", path, meshNumber, ctx.meshes.size());
+      }
+      if(option.optimize){
+         optimizeMeshes(ctx, path, pool);
+      }
+      if(option.lod && !option.batch){
+         generateLods(ctx, path, pool);
+      }
+      if(option.batch){
+         buildBatch(ctx, images);
+      }else{
+         buildSeparate(ctx, images);
+      }
+      fmt::println("model {}: imported in {:.1f} ms", path, elapsed());
+      if(cook){
+         // 只影响下一次的加载时间，失败时不影响本次导入
+         try{
+            writeCooked(ctx, cookPath, key);
+         }catch(const std::string& e){
+            fmt::println("model {}: {}", path, e);
+         }
+      }
    }
+
+   // 只初始化变换和材质参数，不导入，由 StreamingModel 在之后逐步填充
+   Model(const glm::mat4& modelTrans, float shininess): modelTrans(modelTrans), shininess(shininess){}
    
 public:
-   Model(const std::string& path, const glm::mat4& modelTrans = newModel(), float shininess = 64.0f): modelTrans(modelTrans), shininess(shininess){
+   Model(const std::string& path, const glm::mat4& modelTrans = newModel(), float shininess = 64.0f, const ModelOption& option = {}): modelTrans(modelTrans), shininess(shininess){
       try{
-         buildMeshes(path);
+         buildMeshes(path, option);
       }catch(std::string e){
          throwError(fmt::format("import model from {} failed: {}", path, e));
       }
    }
 
    std::vector<LightObject> lightObjects;
+   std::optional<LightBatch> lightBatch;
    void addInLightScene(LightScene& lightScene){
+      if(batch.has_value()){
+         lightBatch.emplace(LightBatchMeta{
+            batch->vertexData.vao, batch->commands, batch->diffuses, 
+            batch->speculars.has_value() ? &batch->speculars.value() : nullptr, 
+            batch->drawData, modelTrans, shininess, &batch->bounds,
+         }, lightScene);
+         return;
+      }
       for(auto& mesh: meshes){
          lightObjects.emplace_back(static_cast<LightObjectMeta>(mesh), lightScene);
       }
    }
 };
 
+inline Mesh::Mesh(VertexData<true>&& vertexData, MeshLod lod, Model& model, int materialIndex, const glm::mat4& transform)
+:vertexData(std::move(vertexData)), lod(std::move(lod)), model(model), materialIndex(materialIndex),
+meshTrans([transform](const glm::mat4& modelTrans){return modelTrans * transform;}, model.modelTrans){}
+
 inline Mesh::operator LightObjectMeta(){
    auto& material = model.materials[materialIndex];
-   Texture2D* specularp = nullptr;
-   if(material.specular.has_value()){
-      specularp = &material.specular.value();
-   }
    return {
-      vertexData.vao, material.diffuse, specularp, model.modelTrans, model.shininess,
+      vertexData.vao, *material.diffuse, material.specular.get(), meshTrans, model.shininess, &vertexData.bounds, material.opacity, &lod,
    };
 }
+
+// StreamingModel 发布的加载事件
+struct StreamingEvent{
+   enum class Type{
+      // 模型文件解析完成，mesh 和贴图的数量已知，材质先使用占位贴图
+      LAYOUT,
+      // 一个 mesh 加入了场景，index 为它在模型中的序号（按加入的顺序）
+      MESH,
+      // 一张贴图加载完成，使用它的 mesh 换上了这张贴图，index 为贴图的序号
+      TEXTURE,
+      // 所有 mesh 和贴图都已经加入场景
+      COMPLETE,
+      // 后台导入失败，message 为错误信息，已经加入场景的 mesh 保持不变
+      FAILED,
+   };
+   Type type;
+   int index = -1;
+   std::string message;
+};
+
+// 渐进加载的模型：构造时只提交后台任务并立即返回，第一帧的时间与模型的大小无关
+// 工作线程解析模型、转换（优化、简化）每个 mesh、解码贴图，每完成一项就向 FrameScheduler 加入一个上传任务，
+// 上传任务在之后的帧中创建 gl 资源并加入 LightScene，每帧花在上传上的时间受 scheduler 的预算限制
+// 贴图加载完成之前材质使用灰色的占位贴图，加载的进度通过 Observable<const StreamingEvent> 发布
+// 合批和按材质合并都需要全部的 mesh，流式加载时忽略 option 中的这两项；烘焙文件与 Model 通用
+//
+// 使用方式：
+//    FrameScheduler scheduler;
+//    StreamingModel model {"../model/可莉/可莉.pmx", scene, scheduler};
+//    Observer<const StreamingEvent> observer {[](const StreamingEvent& event){ ... }, model};
+//    ctx.startLoop([&]{ scheduler.run(); drawer.draw(); });
+// 注意：
+// 1. scheduler.run 需要在持有 gl 上下文的线程中调用，使用 RenderThread 时通过 execute 调用
+// 2. 模型析构后 scheduler 中剩下的上传任务什么都不做，scheduler 可以比模型活得长
+// 3. 事件在上传任务中发布，即在调用 scheduler.run 的线程中通知观察者；使用 RenderThread 时是渲染线程，
+//    此时主线程阻塞在 execute 中，观察者可以读写主线程的数据，但不能调用只能在主线程中调用的函数（如 glfw 的窗口函数、ImGui）
+// 4. 需要完整场景的场合（如无窗口模式的性能测试）在开始绘制之前调用 waitComplete
+class StreamingModel: public Model, public Observable<const StreamingEvent>{
+private:
+   // 后台导入的中间状态，由工作线程和上传任务共享
+   struct ImportState{
+      Assimp::Importer importer;
+      ImportContext ctx;
+      // 还没有转换完成的 mesh 数，最后完成的线程写入烘焙文件
+      std::atomic<std::size_t> remaining = 0;
+      std::uint64_t key = 0;
+
+      explicit ImportState(const ModelOption& option): ctx{.scene = nullptr, .option = option}{}
+   };
+   // 一张贴图和使用它的材质：(材质的序号, 是否是镜面反射贴图)
+   struct TextureRequest{
+      std::string path;
+      std::vector<std::pair<int, bool>> users;
+   };
+   // 同一帧中先确定布局，再上传 mesh，最后上传贴图
+   static constexpr int layoutPriority = 2;
+   static constexpr int meshPriority = 1;
+   static constexpr int texturePriority = 0;
+
+   std::string path;
+   ModelOption option;
+   LightScene& scene;
+   FrameScheduler& scheduler;
+   // 所有材质在贴图加载完成之前共用的占位贴图
+   std::shared_ptr<Texture2D> placeholder;
+   // 与 meshes 一一对应，mesh 的贴图改变时重新创建
+   std::vector<std::optional<LightObject>> objects;
+   // 模型文件解析完成之前为 -1
+   int meshNumber = -1;
+   int textureNumber = -1;
+   int loadedTextureNumber = 0;
+   bool failed = false;
+   std::chrono::steady_clock::time_point start;
+   // 上传任务持有它的 weak_ptr，模型析构之后任务不再执行
+   std::shared_ptr<bool> alive = std::make_shared<bool>(true);
+   // 为 true 时还没有开始的后台任务直接返回
+   std::atomic<bool> cancelled = false;
+   // 最后声明、最先析构：等待工作线程结束之后其他成员才能析构
+   ThreadPool pool;
+
+   double elapsed() const {
+      return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+   }
+   void publish(StreamingEvent::Type type, int index = -1, const std::string& message = ""){
+      notify(StreamingEvent{type, index, message});
+   }
+
+   // 任意线程：加入一个在 scheduler 所在线程中执行的上传任务
+   template<typename Callable>
+   void upload(int priority, Callable&& callable){
+      scheduler.enqueue([token = std::weak_ptr<bool>(alive), callable = std::forward<Callable>(callable)]() mutable {
+         if(!token.expired()){
+            callable();
+         }
+      }, priority);
+   }
+   void uploadFailure(const std::string& message){
+      upload(layoutPriority, [this, message]{
+         fail(message);
+      });
+   }
+
+   /********************** gl 线程 **********************/
+
+   void fail(const std::string& message){
+      if(failed){
+         return;
+      }
+      failed = true;
+      cancelled = true;
+      fmt::println("model {}: streaming failed: {}", path, message);
+      publish(StreamingEvent::Type::FAILED, -1, message);
+   }
+   void mayComplete(){
+      if(isComplete()){
+         fmt::println("model {}: streamed {} meshes and {} textures in {:.1f} ms", path, meshNumber, textureNumber, elapsed());
+         publish(StreamingEvent::Type::COMPLETE);
+      }
+   }
+   void setLayout(const std::vector<MaterialMeta>& metas, std::size_t meshNumber, std::size_t textureNumber){
+      for(auto& material: metas){
+         materials.push_back({placeholder, nullptr, material.opacity});
+      }
+      // 之后加入的 mesh 和物体不会再移动，DrawUnit 和遮挡物可以引用它们
+      meshes.reserve(meshNumber);
+      objects.reserve(meshNumber);
+      this->meshNumber = meshNumber;
+      this->textureNumber = textureNumber;
+      publish(StreamingEvent::Type::LAYOUT);
+      mayComplete();
+   }
+   // 新的 mesh 已经放在 meshes 的最后，为它创建遮挡物和物体
+   void addMesh(std::span<const glm::vec3> positions, std::span<const unsigned int> indices, bool occluder){
+      auto& mesh = meshes.back();
+      if(occluder){
+         occluders.push_back(createOccluder(positions, indices, glm::mat4(1.0f), mesh.meshTrans.get()));
+      }
+      objects.emplace_back(std::in_place, static_cast<LightObjectMeta>(mesh), scene);
+      scene.appendDrawUnit(*objects.back());
+      if(meshes.size() == 1){
+         fmt::println("model {}: first mesh ready in {:.1f} ms", path, elapsed());
+      }
+      publish(StreamingEvent::Type::MESH, meshes.size() - 1);
+      mayComplete();
+   }
+   void setTexture(int index, const std::shared_ptr<Texture2D>& texture, const std::vector<std::pair<int, bool>>& users){
+      for(auto [materialIndex, specular]: users){
+         (specular ? materials[materialIndex].specular : materials[materialIndex].diffuse) = texture;
+      }
+      // 已经加入场景的 mesh 换上新的贴图，DrawUnit 引用的是贴图本身，需要重新生成
+      for(std::size_t i = 0; i < meshes.size(); i++){
+         bool used = std::any_of(users.begin(), users.end(), [&mesh = meshes[i]](auto& user){
+            return user.first == mesh.materialIndex;
+         });
+         if(used){
+            scene.removeDrawUnit(*objects[i]);
+            objects[i].emplace(static_cast<LightObjectMeta>(meshes[i]), scene);
+            scene.appendDrawUnit(*objects[i]);
+         }
+      }
+      loadedTextureNumber++;
+      publish(StreamingEvent::Type::TEXTURE, index);
+      mayComplete();
+   }
+
+   /********************* 工作线程 *********************/
+
+   // 先加入布局的任务，再为每张贴图加入任务：缓存中已有的直接上传，否则先解码
+   void requestTextures(const std::vector<MaterialMeta>& metas, std::size_t meshNumber){
+      // 相同的图片只加载一次
+      std::map<TextureCache::Key, TextureRequest> requests;
+      auto add = [&requests](const std::string& path, int materialIndex, bool specular){
+         auto& request = requests[TextureCache::makeKey(path)];
+         request.path = path;
+         request.users.emplace_back(materialIndex, specular);
+      };
+      for(int i = 0; i < metas.size(); i++){
+         add(metas[i].diffusePath, i, false);
+         if(metas[i].specularPath.has_value()){
+            add(*metas[i].specularPath, i, true);
+         }
+      }
+      upload(layoutPriority, [this, metas, meshNumber, textureNumber = requests.size()]{
+         setLayout(metas, meshNumber, textureNumber);
+      });
+      for(int index = 0; auto& [key, request]: requests){
+         if(auto texture = TextureCache::getInstance().find(key)){
+            upload(texturePriority, [this, index, texture, users = request.users]{
+               setTexture(index, texture, users);
+            });
+         }else{
+            pool.submit([this, index, key, request]{
+               if(cancelled){
+                  return;
+               }
+               try{
+                  auto image = std::make_shared<Image>(request.path, key.channels);
+                  upload(texturePriority, [this, index, key, image, users = request.users]{
+                     setTexture(index, TextureCache::getInstance().insert(key, *image), users);
+                  });
+               }catch(const std::string& e){
+                  uploadFailure(e);
+               }
+            });
+         }
+         index++;
+      }
+   }
+   // 转换（优化、简化）一个 mesh，完成后加入上传任务
+   void convert(const std::shared_ptr<ImportState>& state, std::size_t index){
+      if(cancelled){
+         return;
+      }
+      try{
+         auto& mesh = state->ctx.meshes[index];
+         mesh = convertMesh(state->ctx.sources[index]);
+         if(option.optimize){
+            MeshOptimizer::optimize(mesh.vertex);
+         }
+         if(option.lod){
+            generateLod(mesh);
+         }
+         upload(meshPriority, [this, state, index]{
+            // 烘焙文件可能还在读取同一份数据，这里只能复制
+            auto& mesh = state->ctx.meshes[index];
+            meshes.emplace_back(createVertexData(mesh.vertex, mesh.lodIndices), mesh.lod, *this, mesh.materialIndex, mesh.transform);
+            addMesh(mesh.vertex.get<0>(), mesh.vertex.indices, mesh.occluder);
+         });
+         // 最后一个完成的线程写入烘焙文件，只影响下一次的加载时间
+         if(--state->remaining == 0 && option.cook){
+            try{
+               writeCooked(state->ctx, path + ".cooked", state->key);
+            }catch(const std::string& e){
+               fmt::println("model {}: {}", path, e);
+            }
+         }
+      }catch(const std::string& e){
+         uploadFailure(e);
+      }
+   }
+   // 烘焙文件可用时直接映射，每个 mesh 作为一个上传任务；文件不存在、key 不一致或者损坏时返回 false
+   bool streamCooked(std::uint64_t key){
+      std::string cookPath = path + ".cooked";
+      if(!std::filesystem::exists(utf8Path(cookPath))){
+         return false;
+      }
+      auto file = std::make_shared<MappedFile>(utf8Path(cookPath));
+      std::vector<MaterialMeta> materialMetas;
+      auto views = std::make_shared<std::vector<CookedMeshView>>();
+      try{
+         if(!readCooked(*file, key, materialMetas, *views)){
+            return false;
+         }
+      }catch(const std::string& e){
+         fmt::println("model {}: ignore cooked file: {}", path, e);
+         return false;
+      }
+      requestTextures(materialMetas, views->size());
+      for(std::size_t i = 0; i < views->size(); i++){
+         upload(meshPriority, [this, file, views, i]{
+            auto& view = (*views)[i];
+            emplaceCookedMesh(view);
+            addMesh(view.positions, view.indices.first(view.mesh.indexNumber), view.mesh.occluder);
+         });
+      }
+      return true;
+   }
+   // 解析模型文件，之后每个 mesh 和贴图各自作为一个后台任务
+   void import(){
+      if(cancelled){
+         return;
+      }
+      try{
+         std::uint64_t key = 0;
+         if(option.cook){
+            key = computeCookKey(path, option);
+            if(streamCooked(key)){
+               return;
+            }
+         }
+         auto state = std::make_shared<ImportState>(option);
+         state->key = key;
+         const aiScene* scene = state->importer.ReadFile(path, importFlags);
+         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode){
+            throwError(std::string("assimp import model failed:") + state->importer.GetErrorString());
+         }
+         auto& ctx = state->ctx;
+         ctx.scene = scene;
+         ctx.directory = path.substr(0, path.find_last_of('/'));
+         processNode(scene->mRootNode, glm::mat4(1.0f), ctx);
+         ctx.meshes.resize(ctx.sources.size());
+         state->remaining = ctx.sources.size();
+         requestTextures(ctx.materials, ctx.sources.size());
+         // 大的 mesh 先开始处理，模型的主体最先出现，总的时间也最短
+         std::vector<std::size_t> sizes;
+         for(auto& source: ctx.sources){
+            sizes.push_back(source.mesh->mNumVertices + source.mesh->mNumFaces);
+         }
+         for(auto index: largestFirst(sizes)){
+            pool.submit([this, state, index]{
+               convert(state, index);
+            });
+         }
+      }catch(const std::string& e){
+         uploadFailure(fmt::format("import model from {} failed: {}", path, e));
+      }
+   }
+
+public:
+   // 构造和析构都需要 gl 上下文（创建占位贴图、移除 DrawUnit）
+   StreamingModel(const std::string& path, LightScene& scene, FrameScheduler& scheduler,
+      const glm::mat4& modelTrans = newModel(), float shininess = 64.0f, const ModelOption& option = {}):
+      Model(modelTrans, shininess), path(path), option(option), scene(scene), scheduler(scheduler),
+      placeholder(std::make_shared<Texture2D>(Image {1, 1, {128, 128, 128, 255}})),
+      start(std::chrono::steady_clock::now()){
+      this->option.batch = false;
+      this->option.mergeByMaterial = false;
+      pool.submit([this]{
+         import();
+      });
+   }
+   ~StreamingModel(){
+      cancelled = true;
+      for(auto& object: objects){
+         if(object.has_value()){
+            scene.removeDrawUnit(*object);
+         }
+      }
+   }
+
+   // 物体在加载的过程中自动加入构造时的场景
+   void addInLightScene(LightScene& lightScene) = delete;
+
+   // 模型文件解析完成之前为 -1
+   int getMeshNumber() const { return meshNumber; }
+   int getLoadedMeshNumber() const { return meshes.size(); }
+   int getTextureNumber() const { return textureNumber; }
+   int getLoadedTextureNumber() const { return loadedTextureNumber; }
+   bool isComplete() const {
+      return meshNumber >= 0 && getLoadedMeshNumber() == meshNumber && loadedTextureNumber == textureNumber;
+   }
+   bool isFailed() const { return failed; }
+   // 在当前线程中执行上传任务，直到加载完成或者失败
+   // 需要在持有 gl 上下文的线程中调用，不能同时有其他线程执行同一个 scheduler
+   void waitComplete(){
+      while(!isComplete() && !failed){
+         if(scheduler.empty()){
+            // 等待工作线程准备好下一个上传任务
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         }
+         scheduler.run();
+      }
+   }
+};
    
 inline int run(){
    try{
@@ -189,32 +1071,194 @@ inline int run(){
       Drawer drawer;
       GuiContext guiCtx;
       BasicData basicData {.viewModel = newViewModel(glm::vec3(3.0f, 0.0f, 3.0f))};
+      // 固定步长模式下相机在两步模拟之间插值
+      FramePacer& pacer = processor.getPacer();
+      InterpolatedTransform camera {basicData.viewModel, pacer};
 
       LightContext lightCtx;
       LightScene scene {basicData};
+      // 上传后台准备好的 mesh 和贴图，每帧至多使用 2 ms
+      FrameScheduler scheduler {2.0f};
+      // 模型在后台加载，第一帧不需要等待，mesh 和贴图准备好之后逐个加入场景
+      StreamingModel model {"../model/可莉/可莉.pmx", scene, scheduler};
+      // 在调用 scheduler.run 的线程（使用 RenderThread 时为渲染线程）中通知
+      Observer<const StreamingEvent> streamingObserver {[&model](const StreamingEvent& event){
+         if(event.type == StreamingEvent::Type::LAYOUT){
+            fmt::println("model layout: {} meshes, {} textures", model.getMeshNumber(), model.getTextureNumber());
+         }
+      }, model};
+      // 阻塞加载，构造之后需要调用 model.addInLightScene(scene)
       // 对于nanosuit，贴图是反转的，需要去掉 aiProcess_FlipUVs flag
       // Model model {"../model/nanosuit/nanosuit.obj"};
       // Model model {"../model/backpack/backpack.obj"};
-      Model model {"../model/可莉/可莉.pmx"};
+      // 合批绘制整个模型
+      // Model model {"../model/可莉/可莉.pmx", newModel(), 64.0f, {.batch = true}};
+      // 静态模型可以在导入时按材质合并 mesh
+      // Model model {"../model/英招2.0/武器左.pmx", newModel(), 64.0f, {.mergeByMaterial = true}};
       // Model model {"../model/英招2.0/英招2.0.pmx"};
+      // 作为软件遮挡剔除的遮挡物
+      // Model model {"../model/英招2.0/英招2.0.pmx", newModel(), 64.0f, {.occluder = true}};
       // Model model {"../model/英招2.0/武器左.pmx"};
-      model.addInLightScene(scene);
 
       DirectionalLightData directionalLightData;
       DirectionalLight directionalLight {directionalLightData, scene};
       DirectionalLightUIController directionalLightController = directionalLightData;
 
       scene.generateDrawUnits();
+      // 无窗口模式测量的是完整场景的帧时间，先等待模型加载完成
+      if(ctx.isHeadless()){
+         model.waitComplete();
+      }
 
-      ctx.startLoop([&]{
-         GuiFrame frame;
+      // 场景的分辨率随 GPU 时间调整，GUI 仍然以窗口分辨率绘制
+      DynamicResolution dynamicResolution {drawer, {.minScale = 0.5f, .maxScale = 1.0f, .targetFrameTime = 12.0f}};
+      // 截图和录制，需要在渲染线程之前创建，保证析构时主线程持有 gl 上下文
+      FrameCapture capture;
+      int screenshotNumber = 0;
+      // 同样需要在渲染线程之前创建，查询对象在渲染线程中创建、在主线程中析构
+      GpuProfiler profiler;
+      drawer.setProfiler(&profiler);
+      // 面板静止时只合成缓存的 GUI 纹理
+      RetainedGui retainedGui;
+
+      auto showPanel = [&]{
          if(ImGui::Begin("controller")){
             directionalLightController.showControllerPanel();
+            ImGui::SeparatorText("culling");
+            bool occlusion = drawer.isOcclusionCulling();
+            if(ImGui::Checkbox("occlusion culling", &occlusion)){
+               drawer.enableOcclusionCulling(occlusion);
+            }
+            bool softwareOcclusion = drawer.isSoftwareOcclusionCulling();
+            if(ImGui::Checkbox("software occlusion culling", &softwareOcclusion)){
+               drawer.enableSoftwareOcclusionCulling(softwareOcclusion);
+            }
+            ImGui::Text("frustum culled: %d, software occluded: %d", drawer.getCulledNumber(), drawer.getSoftwareOccludedNumber());
+            ImGui::Text("occluded: %d, conditional: %d", drawer.getOccludedNumber(), drawer.getConditionalNumber());
+            ImGui::SeparatorText("level of detail");
+            bool lodSelection = drawer.isLodSelection();
+            if(ImGui::Checkbox("lod selection", &lodSelection)){
+               drawer.enableLodSelection(lodSelection);
+            }
+            ImGui::Text("reduced lod: %d", drawer.getReducedLodNumber());
+            ImGui::SeparatorText("depth pre-pass");
+            bool depthPrePass = drawer.isDepthPrePass();
+            if(ImGui::Checkbox("depth pre-pass", &depthPrePass)){
+               drawer.enableDepthPrePass(depthPrePass);
+            }
+            ImGui::Text("overdraw: %.2f", drawer.getOverdraw());
+            ImGui::Text("transparent draw units: %d", drawer.getTransparentNumber());
+            ImGui::SeparatorText("streaming");
+            ImGui::Text("meshes: %d / %d, textures: %d / %d", model.getLoadedMeshNumber(), model.getMeshNumber(),
+               model.getLoadedTextureNumber(), model.getTextureNumber());
+            auto scheduled = scheduler.getStatistics();
+            ImGui::Text("upload: %.2f / %.2f ms, queued: %d", scheduled.usedTime, scheduled.budget, scheduled.queueDepth);
+            ImGui::SeparatorText("frame statistics");
+            auto statistics = FrameStatistics::getLastFrame();
+            ImGui::Text("draw calls: %d, triangles: %llu", statistics.drawCalls, static_cast<unsigned long long>(statistics.triangles));
+            ImGui::Text("binds: program %d, vao %d, texture %d", statistics.programBinds, statistics.vertexArrayBinds, statistics.textureBinds);
+            ImGui::Text("uniforms: %d (%llu bytes)", statistics.uniformUploads, static_cast<unsigned long long>(statistics.uniformBytes));
+            ImGui::Text("buffer uploads: %d (%llu bytes), glGetError: %d", statistics.bufferUploads,
+               static_cast<unsigned long long>(statistics.bufferBytes), statistics.glErrorChecks);
+            auto textures = TextureCache::getInstance().getStatistics();
+            ImGui::Text("texture cache: %d (%llu bytes), hit %d, miss %d", textures.textureNumber,
+               static_cast<unsigned long long>(textures.bytes), textures.hitNumber, textures.missNumber);
+            ImGui::SeparatorText("dynamic resolution");
+            bool dynamic = dynamicResolution.isEnabled();
+            if(ImGui::Checkbox("dynamic resolution", &dynamic)){
+               dynamicResolution.enable(dynamic);
+            }
+            auto option = dynamicResolution.getOption();
+            bool changed = ImGui::SliderFloat("min scale", &option.minScale, 0.25f, 1.0f);
+            changed |= ImGui::SliderFloat("max scale", &option.maxScale, 0.25f, 2.0f);
+            changed |= ImGui::SliderFloat("target time (ms)", &option.targetFrameTime, 1.0f, 33.0f);
+            changed |= ImGui::SliderFloat("sharpness", &option.sharpness, 0.0f, 1.0f);
+            if(changed){
+               dynamicResolution.setOption(option);
+            }
+            ImGui::Text("scale: %.2f (%d x %d), gpu: %.2f ms", dynamicResolution.getScale(),
+               dynamicResolution.getRenderWidth(), dynamicResolution.getRenderHeight(), dynamicResolution.getGpuTime());
+            ImGui::SeparatorText("capture");
+            if(ImGui::Button("screenshot")){
+               capture.screenshot(fmt::format("screenshot_{}.ppm", screenshotNumber++));
+            }
+            ImGui::SameLine();
+            bool recording = capture.isRecording();
+            if(ImGui::Checkbox("record (capture.rgba)", &recording)){
+               if(recording){
+                  capture.startRecording("capture.rgba");
+               }else{
+                  capture.stopRecording();
+               }
+            }
+            ImGui::Text("captured: %d, dropped: %d, encoding: %d", capture.getCapturedNumber(), capture.getDroppedNumber(), capture.getPendingNumber());
+            ImGui::SeparatorText("frame pacing");
+            int pacingMode = static_cast<int>(pacer.getMode());
+            bool pacingChanged = ImGui::RadioButton("vsync", &pacingMode, static_cast<int>(FramePacingMode::VSYNC));
+            ImGui::SameLine();
+            pacingChanged |= ImGui::RadioButton("uncapped", &pacingMode, static_cast<int>(FramePacingMode::UNCAPPED));
+            ImGui::SameLine();
+            pacingChanged |= ImGui::RadioButton("fixed timestep", &pacingMode, static_cast<int>(FramePacingMode::FIXED_TIMESTEP));
+            if(pacingChanged){
+               pacer.setMode(static_cast<FramePacingMode>(pacingMode));
+            }
+            auto& pacing = pacer.getStatistics();
+            ImGui::Text("frame: %.2f ms, steps: %d, alpha: %.2f", pacing.frameTime, pacing.steps, pacing.alpha);
+            ImGui::SeparatorText("gui");
+            bool retained = retainedGui.isEnabled();
+            if(ImGui::Checkbox("retained gui", &retained)){
+               retainedGui.enable(retained);
+            }
+            // 面板中的统计数字每帧都在变化，没有输入时以这个间隔更新，其余帧复用缓存
+            float refreshInterval = retainedGui.getRefreshInterval();
+            if(ImGui::SliderFloat("refresh interval (s)", &refreshInterval, 0.0f, 1.0f)){
+               retainedGui.setRefreshInterval(refreshInterval);
+            }
+            ImGui::Text("re-rendered: %d, cached: %d", retainedGui.getRenderedNumber(), retainedGui.getCachedNumber());
          }
          ImGui::End();
-         drawer.draw([&]{frame.render();});
-         processor.processInput();
-      });
+         if(ImGui::Begin("gpu profiler")){
+            showGpuProfiler(profiler);
+         }
+         ImGui::End();
+      };
+
+      // 在单独的渲染线程中绘制，主线程构建下一帧的同时渲染线程绘制上一帧；MINECPP_RENDER_THREAD=0 时在主线程中绘制
+      if(RenderThread::isEnabledByEnvironment()){
+         GuiDrawData guiDrawDatas[2];
+         RenderThread renderThread {[&](int slot){
+            drawer.drawSnapshot(slot, [&]{
+               guiDrawDatas[slot].render(retainedGui);
+               capture.process();
+            });
+         }};
+         ctx.startLoop([&]{
+            processor.processInput();
+            // 上传需要 gl 上下文，只在有任务时打断渲染线程的流水线
+            if(!scheduler.empty()){
+               renderThread.execute([&]{
+                  scheduler.run();
+               });
+            }
+            GuiFrame frame;
+            showPanel();
+            int slot = renderThread.acquire();
+            frame.render(guiDrawDatas[slot]);
+            drawer.takeSnapshot(slot);
+            renderThread.submit();
+         });
+      }else{
+         ctx.startLoop([&]{
+            scheduler.run();
+            GuiFrame frame;
+            showPanel();
+            drawer.draw([&]{
+               frame.render(retainedGui);
+               capture.process();
+            });
+            processor.processInput();
+         });
+      }
       
    }catch(std::string e){
       fmt::println("{}", e);
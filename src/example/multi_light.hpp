@@ -15,6 +15,7 @@
 #include "../controller.hpp"
 #include "../vertex.hpp"
 #include "../input.hpp"
+#include "../scheduler.hpp"
 
 
 namespace multi_light
@@ -70,6 +71,7 @@ struct ObjectInfo {
    static VertexArray* vao;
    static Texture2D* diffuse;
    static Texture2D* specular;
+   static BoundingBox* bounds;
    ObservableValue<glm::mat4> model;
    float shininess;
 
@@ -91,13 +93,14 @@ struct ObjectInfo {
    // }
    ObjectInfo(const glm::mat4& model = newModel(), float shininess = 64.0f): model(model), shininess(shininess){}
    operator LightObjectMeta(){
-      return {*vao, *diffuse, specular, this->model, shininess};
+      return {*vao, *diffuse, specular, this->model, shininess, bounds};
    }
 };
 
 inline VertexArray* ObjectInfo::vao;
 inline Texture2D* ObjectInfo::diffuse;
 inline Texture2D* ObjectInfo::specular;
+inline BoundingBox* ObjectInfo::bounds;
 
 class ObjectUIController: private ObservableValue<ObjectInfo*>, public AbstractObserver<ObjectInfo*const>{
 private:
@@ -185,6 +188,7 @@ inline int run(){
       VertexData vertexData {createVertexData(meta)};
 
       ObjectInfo::vao = &vertexData.vao;
+      ObjectInfo::bounds = &vertexData.bounds;
 
       Texture2D texture {"../image/container2.png"};
       Texture2D specular {"../image/container2_specular.png"};
@@ -199,6 +203,8 @@ inline int run(){
       };
 
       LightScene lightScene {basicData};
+      // 场景重建分摊到多帧中，每帧最多使用 2ms
+      FrameScheduler scheduler {2.0f};
 
       // DirectionalLightData directionalLight {
       //    .color = glm::vec3(1.0f, 1.0f, 1.0f),
@@ -227,7 +233,7 @@ inline int run(){
          for(auto& data: objectDatas){
             objects.emplace_back(data, lightScene);
          }
-         lightScene.generateDrawUnits();
+         scheduler.enqueue(lightScene.generateDrawUnitsTask(), 0, 0.1f, "draw units");
       };
       auto pointLightChangeHandler = [&] (auto&& changer) {
          pointLightController.reset();
@@ -236,7 +242,7 @@ inline int run(){
          for(auto& data: pointLightDatas){
             pointLights.emplace_back(data, lightScene);
          }
-         lightScene.generateDrawUnits();
+         scheduler.enqueue(lightScene.generateDrawUnitsTask(), 0, 0.1f, "draw units");
       };
       auto spotLightChangeHandler = [&] (auto&& changer) {
          spotLightController.reset();
@@ -245,7 +251,7 @@ inline int run(){
          for(auto& data: spotLightDatas){
             spotLights.emplace_back(data, lightScene);
          }
-         lightScene.generateDrawUnits();
+         scheduler.enqueue(lightScene.generateDrawUnitsTask(), 0, 0.1f, "draw units");
       };
 
       // objectDatas.emplace_back();
@@ -319,6 +325,10 @@ inline int run(){
                spotLightController = spotLightDatas[spotLightSelect];
                spotLightController.showControllerPanel();
             }
+            ImGui::SeparatorText("scheduler");
+            auto statistics = scheduler.getStatistics();
+            ImGui::Text("used: %.2f / %.2f ms, steps: %d", statistics.usedTime, statistics.budget, statistics.executedNumber);
+            ImGui::Text("queue depth: %d, queued cost: %.2f ms", statistics.queueDepth, statistics.queuedCost);
          }
          ImGui::End();
          
@@ -377,6 +387,7 @@ inline int run(){
 
          
 
+         scheduler.run();
          drawer.draw([&]{frame.render();});
          processor.processInput();
       });
@@ -37,6 +37,14 @@ inline void checkError(
       }
 }
 
+} // namespace minecpp
+
+// statistics.hpp 中的 FrameStatistics::startCsv 需要 throwError，因此在 throwError 定义之后才 include
+#include "statistics.hpp"
+
+namespace minecpp
+{
+
 inline std::optional<std::string> getGlfwError(){
    std::string error;
    char description[512];
@@ -58,8 +66,10 @@ inline std::optional<std::string> getGlError(){
    std::string error;
    bool isError = false;
    GLenum errorCode;
+   FrameStatistics::getCurrent().glErrorChecks++;
    while ((errorCode = glGetError()) != GL_NO_ERROR)
    {
+      FrameStatistics::getCurrent().glErrorChecks++;
       isError = true;
       switch (errorCode)
       {
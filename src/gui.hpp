@@ -2,8 +2,14 @@
 #define _MINECPP_GUI_H_
 
 #include "resource.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
 #include <map>
+#include <optional>
 #include <string>
+#include <vector>
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_glfw.h>
 #include <imgui/imgui_impl_opengl3.h>
@@ -21,10 +27,17 @@ public:
       // call ImGui::CreateContext()
       // call ImGui_ImplXXXX_Init() for each backend
       ImGui::CreateContext();
+      if(ctx.isHeadless()){
+         // 无窗口模式下没有用户交互，不保存窗口布局，也不修改鼠标样式
+         ImGui::GetIO().IniFilename = nullptr;
+         ImGui::GetIO().ConfigFlags |= ImGuiConfigFlags_NoMouseCursorChange;
+      }
       // install_callbacks: 如果为true，则imgui会设置glfw的相关callback, 原来的callback（如果有）的函数指针会保存，imgui的callback会先调用
       ImGui_ImplGlfw_InitForOpenGL(ctx.getWindow(), true);
       std::string glslVersion = fmt::format("#version {}{}0", ctx.getMajorVersion(), ctx.getMinorVersion());
       ImGui_ImplOpenGL3_Init(glslVersion.c_str());
+      // 默认在第一次 NewFrame 时才创建着色器和字体纹理，提前创建以便 NewFrame 可以在没有 gl 上下文的线程中调用
+      ImGui_ImplOpenGL3_CreateDeviceObjects();
    }
    ~GuiContext(){
       // 销毁阶段: 
@@ -36,6 +49,237 @@ public:
    }
 };
 
+// 限制 RetainedGui 因为绘制数据变化而重新绘制的频率，不调用 gl
+// 面板中每帧变化的统计数字使绘制数据每帧都不同，不加限制时缓存永远不会命中；
+// 没有输入时两次重新绘制之间至少间隔 interval 秒，数字以较低的频率更新
+class GuiRefreshLimiter{
+private:
+   // 距离上一次重新绘制的时间，单位为秒
+   float elapsed = std::numeric_limits<float>::infinity();
+
+public:
+   // deltaTime：距离上一次调用的时间；changed：绘制数据是否和缓存的不同；
+   // immediate：需要立即重新绘制（GUI 接收输入、尺寸变化、没有缓存等）；返回本帧是否重新绘制
+   bool update(float deltaTime, float interval, bool changed, bool immediate){
+      elapsed += deltaTime;
+      if(immediate || (changed && elapsed >= interval)){
+         elapsed = 0.0f;
+         return true;
+      }
+      return false;
+   }
+};
+
+// 保留模式的 GUI 层：ImGui 的绘制结果缓存在纹理中，每帧只用一个全屏三角形合成到当前帧缓冲
+// 只有绘制数据（顶点、索引和绘制命令）的哈希或显示尺寸变化、GUI 接收输入或者调用了 invalidate 时才重新绘制纹理，
+// 面板静止时省去 ImGui_ImplOpenGL3_RenderDrawData 上传顶点和逐个命令绘制的开销
+// 没有输入时只是绘制数据变化（如统计数字）的重新绘制受 setRefreshInterval 限制，见 GuiRefreshLimiter
+// ImGui 对颜色使用 (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)、对 alpha 使用 (GL_ONE, GL_ONE_MINUS_SRC_ALPHA) 混合，
+// 绘制到清除为 0 的纹理中得到预乘 alpha 的颜色，所以合成时使用 (GL_ONE, GL_ONE_MINUS_SRC_ALPHA)
+// 需要在 gl 上下文所在的线程中创建和绘制；开关和统计可以在其他线程中读写
+class RetainedGui{
+private:
+   FullscreenPass compositePass;
+   std::optional<RenderTexture> texture;
+   std::optional<Framebuffer> framebuffer;
+   std::uint64_t hash = 0;
+   // 纹理中是否有可以复用的结果
+   bool valid = false;
+   GuiRefreshLimiter limiter;
+   std::optional<std::chrono::steady_clock::time_point> lastRender;
+
+   std::atomic<bool> enabled = true;
+   std::atomic<bool> dirty = false;
+   std::atomic<float> refreshInterval = 0.25f;
+   std::atomic<int> renderedNumber = 0;
+   std::atomic<int> cachedNumber = 0;
+
+   static std::uint64_t hashBytes(std::uint64_t hash, const void* data, std::size_t size){
+      // FNV-1a
+      auto bytes = static_cast<const unsigned char*>(data);
+      for(std::size_t i = 0; i < size; i++){
+         hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+      }
+      return hash;
+   }
+   template<typename T>
+   static std::uint64_t hashValue(std::uint64_t hash, const T& value){
+      return hashBytes(hash, &value, sizeof(T));
+   }
+   void redraw(ImDrawData* data, int width, int height);
+   void composite(int width, int height);
+
+public:
+   RetainedGui():
+      compositePass("../shader/drawer/gui.composite.frag.glsl"){}
+   RetainedGui(const RetainedGui&) = delete;
+   RetainedGui& operator=(const RetainedGui&) = delete;
+
+   // 绘制数据的哈希，包括显示区域、所有顶点和索引，以及每个绘制命令的裁剪矩形、纹理和范围
+   static std::uint64_t hashDrawData(const ImDrawData& data);
+   // 在 ImGui::NewFrame 之后、下一次 NewFrame 之前调用：本帧鼠标或键盘是否交给了 GUI 处理
+   // 鼠标在 GUI 之外时的移动和点击（如控制相机）不算作 GUI 的输入
+   static bool hasInput();
+
+   // 绘制数据没有变化时只合成缓存的纹理；关闭时直接绘制到当前帧缓冲
+   void render(ImDrawData* data, bool input);
+   // 下一帧强制重新绘制，用于绘制数据之外的变化（如修改了字体纹理）
+   void invalidate(){
+      dirty = true;
+   }
+   void enable(bool enable){
+      enabled = enable;
+   }
+   bool isEnabled() const { return enabled; }
+   // 没有输入时因为绘制数据变化而重新绘制的最小间隔，单位为秒，为 0 时每次变化都重新绘制
+   void setRefreshInterval(float seconds){
+      refreshInterval = seconds;
+   }
+   float getRefreshInterval() const { return refreshInterval; }
+   // 重新绘制到纹理的帧数和直接复用纹理的帧数
+   int getRenderedNumber() const { return renderedNumber; }
+   int getCachedNumber() const { return cachedNumber; }
+};
+
+inline std::uint64_t RetainedGui::hashDrawData(const ImDrawData& data){
+   std::uint64_t hash = 0xcbf29ce484222325ull;
+   hash = hashValue(hash, data.DisplayPos);
+   hash = hashValue(hash, data.DisplaySize);
+   hash = hashValue(hash, data.FramebufferScale);
+   for(int i = 0; i < data.CmdListsCount; i++){
+      const ImDrawList* list = data.CmdLists[i];
+      hash = hashBytes(hash, list->VtxBuffer.Data, list->VtxBuffer.size_in_bytes());
+      hash = hashBytes(hash, list->IdxBuffer.Data, list->IdxBuffer.size_in_bytes());
+      // 逐个字段计算，避免结构体中的填充字节
+      for(const ImDrawCmd& cmd: list->CmdBuffer){
+         hash = hashValue(hash, cmd.ClipRect);
+         hash = hashValue(hash, cmd.TextureId);
+         hash = hashValue(hash, cmd.VtxOffset);
+         hash = hashValue(hash, cmd.IdxOffset);
+         hash = hashValue(hash, cmd.ElemCount);
+         hash = hashValue(hash, cmd.UserCallback);
+      }
+   }
+   return hash;
+}
+
+inline bool RetainedGui::hasInput(){
+   const ImGuiIO& io = ImGui::GetIO();
+   bool mouse = io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f || io.MouseWheel != 0.0f || io.MouseWheelH != 0.0f || ImGui::IsAnyMouseDown();
+   return (io.WantCaptureMouse && mouse) || io.WantCaptureKeyboard || !io.InputQueueCharacters.empty();
+}
+
+inline void RetainedGui::redraw(ImDrawData* data, int width, int height){
+   GLint previous = 0;
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+   if(!texture.has_value() || texture->getWidth() != width || texture->getHeight() != height){
+      // 帧缓冲引用纹理，需要先于纹理销毁
+      framebuffer.reset();
+      texture.emplace(width, height, GL_RGBA8);
+      framebuffer.emplace(std::vector<const RenderTexture*>{&*texture}, nullptr);
+   }
+   FramebufferContext::getInstance().bindContext(*framebuffer);
+   const GLfloat clear[] = {0.0f, 0.0f, 0.0f, 0.0f};
+   glClearBufferfv(GL_COLOR, 0, clear);
+   // ImGui 会保存并恢复它修改的 gl 状态，但不会修改帧缓冲的绑定
+   ImGui_ImplOpenGL3_RenderDrawData(data);
+   glBindFramebuffer(GL_FRAMEBUFFER, previous);
+   checkGLError();
+}
+
+inline void RetainedGui::composite(int width, int height){
+   GLint viewport[4];
+   glGetIntegerv(GL_VIEWPORT, viewport);
+   glViewport(0, 0, width, height);
+   glEnable(GL_BLEND);
+   glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+   TextureUnit::getInstance().bindUnit(0, *texture);
+   compositePass.use().setUniform("source", 0);
+   compositePass.draw();
+   glDisable(GL_BLEND);
+   glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+inline void RetainedGui::render(ImDrawData* data, bool input){
+   if(data == nullptr || !data->Valid){
+      return;
+   }
+   int width = static_cast<int>(data->DisplaySize.x * data->FramebufferScale.x);
+   int height = static_cast<int>(data->DisplaySize.y * data->FramebufferScale.y);
+   if(width <= 0 || height <= 0){
+      return;
+   }
+   if(!enabled){
+      valid = false;
+      ImGui_ImplOpenGL3_RenderDrawData(data);
+      return;
+   }
+   auto now = std::chrono::steady_clock::now();
+   float deltaTime = lastRender.has_value() ? std::chrono::duration<float>(now - *lastRender).count() : 0.0f;
+   lastRender = now;
+   std::uint64_t current = hashDrawData(*data);
+   bool forced = dirty.exchange(false);
+   bool resized = !texture.has_value() || texture->getWidth() != width || texture->getHeight() != height;
+   if(limiter.update(deltaTime, refreshInterval, current != hash, !valid || forced || resized || input)){
+      redraw(data, width, height);
+      hash = current;
+      valid = true;
+      renderedNumber++;
+   }else{
+      cachedNumber++;
+   }
+   composite(width, height);
+}
+
+// ImGui 的绘制数据属于 ImGui 的上下文，下一次 NewFrame 时就会被覆盖
+// 交给渲染线程绘制之前需要复制一份
+class GuiDrawData{
+private:
+   ImDrawData data {};
+   std::vector<ImDrawList*> lists;
+   // 复制时 GUI 是否接收了输入，ImGui 的 io 只能在主线程中读取
+   bool input = false;
+
+   void clear(){
+      for(auto list: lists){
+         IM_DELETE(list);
+      }
+      lists.clear();
+      data = ImDrawData{};
+   }
+public:
+   GuiDrawData() = default;
+   ~GuiDrawData(){
+      clear();
+   }
+   GuiDrawData(const GuiDrawData&) = delete;
+   GuiDrawData& operator=(const GuiDrawData&) = delete;
+
+   // 复制 ImGui::Render 之后的绘制数据
+   void capture(){
+      clear();
+      const ImDrawData* source = ImGui::GetDrawData();
+      if(source == nullptr){
+         return;
+      }
+      input = RetainedGui::hasInput();
+      data = *source;
+      for(int i = 0; i < source->CmdListsCount; i++){
+         lists.push_back(source->CmdLists[i]->CloneOutput());
+      }
+      data.CmdLists = lists.data();
+   }
+   // 需要在 gl 上下文所在的线程中调用
+   void render(){
+      if(data.Valid){
+         ImGui_ImplOpenGL3_RenderDrawData(&data);
+      }
+   }
+   void render(RetainedGui& gui){
+      gui.render(&data, input);
+   }
+};
+
 // need gui context first
 class GuiFrame{
 public:
@@ -53,6 +297,18 @@ public:
       ImGui::Render();
       ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
    }
+
+   // 通过 RetainedGui 绘制，绘制数据不变时只合成上一次的结果
+   void render(RetainedGui& gui){
+      ImGui::Render();
+      gui.render(ImGui::GetDrawData(), RetainedGui::hasInput());
+   }
+
+   // 只生成绘制数据并复制到 drawData 中，由渲染线程调用 drawData.render() 绘制
+   void render(GuiDrawData& drawData){
+      ImGui::Render();
+      drawData.capture();
+   }
 };
 
 inline void slider(const std::string& name, float& value, const float min = -50, const float max = 50){
@@ -75,6 +331,60 @@ inline void slider(const std::string& name, ObservableValue<glm::vec3>& value, c
 }
 
 
+// 显示 GpuProfiler 的统计：上方为最近一帧的火焰图，每行一层嵌套，宽度按根区间的时间缩放；下方为各区间的时间表
+inline void showGpuProfiler(const GpuProfiler& profiler){
+   auto scopes = profiler.getStatistics();
+   if(scopes.empty()){
+      ImGui::TextUnformatted("waiting for gpu timings...");
+      return;
+   }
+   float total = std::max(scopes.front().last, 1e-3f);
+   int maxDepth = 0;
+   for(auto& scope: scopes){
+      maxDepth = std::max(maxDepth, scope.depth);
+   }
+   ImDrawList* drawList = ImGui::GetWindowDrawList();
+   ImVec2 origin = ImGui::GetCursorScreenPos();
+   float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+   float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+   ImVec2 mouse = ImGui::GetIO().MousePos;
+   for(auto& scope: scopes){
+      ImVec2 min {origin.x + scope.start / total * width, origin.y + scope.depth * rowHeight};
+      ImVec2 max {min.x + std::max(scope.last / total * width, 1.0f), min.y + rowHeight - 1.0f};
+      // 同名区间的颜色相同
+      float hue = static_cast<float>(std::hash<std::string>{}(scope.name) % 360) / 360.0f;
+      drawList->AddRectFilled(min, max, ImColor::HSV(hue, 0.5f, 0.7f));
+      drawList->PushClipRect(min, max, true);
+      drawList->AddText({min.x + 2.0f, min.y}, IM_COL32_WHITE, scope.name.c_str());
+      drawList->PopClipRect();
+      if(ImGui::IsWindowHovered() && mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y){
+         ImGui::SetTooltip("%s\nlast %.3f ms, average %.3f ms", scope.path.c_str(), scope.last, scope.average);
+      }
+   }
+   ImGui::Dummy({width, (maxDepth + 1) * rowHeight});
+
+   if(ImGui::BeginTable("gpu scopes", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchProp)){
+      ImGui::TableSetupColumn("scope", ImGuiTableColumnFlags_WidthStretch, 3.0f);
+      for(const char* column: {"avg", "p50", "p95", "max"}){
+         ImGui::TableSetupColumn(column);
+      }
+      ImGui::TableHeadersRow();
+      for(auto& scope: scopes){
+         ImGui::TableNextRow();
+         ImGui::TableNextColumn();
+         ImGui::Text("%*s%s", scope.depth * 2, "", scope.name.c_str());
+         for(float time: {scope.average, scope.median, scope.p95, scope.max}){
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", time);
+         }
+      }
+      ImGui::EndTable();
+   }
+   if(int dropped = profiler.getDroppedNumber(); dropped > 0){
+      ImGui::Text("skipped frames: %d", dropped);
+   }
+}
+
 template<typename T>
 void showPopup(T& t, std::map<T, std::string> elements){
    if (ImGui::Button("Select..")){
@@ -2,7 +2,9 @@
 #define _MINECPP_INPUT_H_
 #include "tool.hpp"
 #include "resource.hpp"
+#include "pacing.hpp"
 #include <chrono>
+#include <type_traits>
 
 namespace minecpp {
 
@@ -24,16 +26,26 @@ public:
     KeyDownHandler(int key, auto&& callable): AutoLoader<KeyDownHandler>(getContainer(key)), handler(std::forward<decltype(callable)>(callable)){}
 };
 
+// 按住按键时每一步模拟调用一次，delta 为这一步模拟的时间（秒），见 FramePacer
+// 只接受 holdMilli 的处理函数每步的变化量固定，只有在固定步长模式下才与帧率无关
 class KeyHoldHandler: public AutoLoader<KeyHoldHandler>{
 private:
-    std::function<void(int holdMilli)> handler;
+    std::function<void(int holdMilli, float delta)> handler;
     RefContainer<KeyHoldHandler>& getContainer(int key);
+    template<typename Callable>
+    static std::function<void(int, float)> wrap(Callable&& callable){
+        if constexpr(std::is_invocable_v<Callable, int, float>){
+            return std::forward<Callable>(callable);
+        }else{
+            return [callable = std::forward<Callable>(callable)](int holdMilli, float) mutable {callable(holdMilli);};
+        }
+    }
 public:
-    void operator()(int holdMilli){
-        handler(holdMilli);
+    void operator()(int holdMilli, float delta){
+        handler(holdMilli, delta);
     }
 public:
-    KeyHoldHandler(int key, auto&& callable): AutoLoader<KeyHoldHandler>(getContainer(key)), handler(std::forward<decltype(callable)>(callable)){}
+    KeyHoldHandler(int key, auto&& callable): AutoLoader<KeyHoldHandler>(getContainer(key)), handler(wrap(std::forward<decltype(callable)>(callable))){}
 };
 
 class KeyReleaseHandler: public AutoLoader<KeyReleaseHandler>{
@@ -58,10 +70,16 @@ private:
    std::map<int, RefContainer<KeyDownHandler>> keyDownHandlers;
    std::map<int, RefContainer<KeyReleaseHandler>> keyReleaseHandlers;
    std::map<int, RefContainer<KeyHoldHandler>> keyHoldHandlers;
+   FramePacer pacer;
    
 public:
    InputProcessor(){
+      if(Context::getInstance().isHeadless()){
+         // 无窗口模式用于性能测试，模拟与实际时间无关
+         pacer.setDeterministic(true);
+      }
       // 须在创建窗口后、开始渲染前注册回调函数
+      // 无窗口模式下窗口不可见，不会收到按键事件，processInput 只处理窗口事件
       glfwSetKeyCallback(Context::getInstance().getWindow(), [](GLFWwindow *window, int key, int scancode, int action, int mods){
          auto& processor = InputProcessor::getInstance();
          if(action == GLFW_PRESS){
@@ -92,36 +110,25 @@ public:
       });
    };
 
-private:
-   std::chrono::high_resolution_clock::time_point lastTime {std::chrono::high_resolution_clock::now()};
 public:
+   // 帧的节奏和模拟的步长，默认为垂直同步
+   FramePacer& getPacer() { return pacer; }
+
+   // 每帧调用一次：处理窗口事件，再按照 FramePacer 的步长推进按住按键的处理函数
    void processInput(){
       glfwPollEvents();
-
-      auto _nowTime = std::chrono::high_resolution_clock::now();
-      auto _duration = std::chrono::duration_cast<std::chrono::milliseconds>(_nowTime - lastTime);
-      if(_duration.count() < 16.7){
-         return;
-      }else{
-         lastTime = std::chrono::high_resolution_clock::now();
-      }
-
-      bool hasAny = false;
-      for(const auto& pair: pressedKeys){
-         auto _key = pair.first;
-         std::chrono::_V2::system_clock::time_point endTime;
-         if(keyHoldHandlers.contains(_key)){
-            if(!hasAny){
-               endTime = std::chrono::high_resolution_clock::now();
-               hasAny = true;
+      pacer.simulate([this](float delta){
+         auto now = std::chrono::high_resolution_clock::now();
+         for(const auto& [key, startTime]: pressedKeys){
+            if(!keyHoldHandlers.contains(key)){
+               continue;
             }
-            auto startTime = pair.second;
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-            for(auto& handler : keyHoldHandlers[_key]){
-               handler(duration.count());
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime);
+            for(auto& handler : keyHoldHandlers[key]){
+               handler(duration.count(), delta);
             }
          }
-      }
+      });
    }
 };
 
@@ -64,6 +64,15 @@ inline std::array<glm::vec3, 36> vertices = {
 class LightContext: public ProactiveSingleton<LightContext>{
 public:
    Program objectProgram;
+   // 透明物体使用的 program，输出 WeightedBlendedOIT 的两个目标
+   Program objectTransparentProgram;
+   // 漫反射贴图为镂空贴图的物体使用的 program，进行 alpha 测试
+   Program objectCutoutProgram;
+   // 合批绘制使用的 program，材质来自纹理数组，每个 draw 的数据来自 texture buffer
+   Program batchProgram;
+   // 深度预渲染使用的 program，只计算 gl_Position
+   Program objectDepthProgram;
+   Program batchDepthProgram;
    Program lightProgram;
    VertexData<false> lightVertex;
    glm::mat4 scale;
@@ -73,6 +82,26 @@ public:
          VertexShader::fromFile("../shader/multi_light/cube.vertex.glsl"),
          FragmentShader::fromFile("../shader/multi_light/cube.frag.glsl")
       }, 
+      objectTransparentProgram{
+         VertexShader::fromFile("../shader/multi_light/cube.vertex.glsl"),
+         FragmentShader::fromFile("../shader/multi_light/cube.frag.glsl", {"OIT"})
+      }, 
+      objectCutoutProgram{
+         VertexShader::fromFile("../shader/multi_light/cube.vertex.glsl"),
+         FragmentShader::fromFile("../shader/multi_light/cube.frag.glsl", {"ALPHA_TEST"})
+      }, 
+      batchProgram{
+         VertexShader::fromFile("../shader/multi_light/batch.vertex.glsl"),
+         FragmentShader::fromFile("../shader/multi_light/batch.frag.glsl")
+      }, 
+      objectDepthProgram{
+         VertexShader::fromFile("../shader/multi_light/cube.depth.vertex.glsl"),
+         FragmentShader::fromFile("../shader/multi_light/depth.frag.glsl")
+      }, 
+      batchDepthProgram{
+         VertexShader::fromFile("../shader/multi_light/batch.depth.vertex.glsl"),
+         FragmentShader::fromFile("../shader/multi_light/depth.frag.glsl")
+      }, 
       lightProgram{
          VertexShader::fromFile("../shader/multi_light/light.vertex.glsl"),
          FragmentShader::fromFile("../shader/multi_light/light.frag.glsl")
@@ -187,9 +216,49 @@ struct LightObjectMeta{
    Texture2D* specularTexture;
    const ObservableValue<glm::mat4>& model;
    const float& shininess;
+   // 局部空间的包围盒，为空则不参与剔除
+   const BoundingBox* bounds = nullptr;
+   // 小于 1 或漫反射贴图是半透明贴图时作为透明物体绘制，见 WeightedBlendedOIT；镂空贴图只进行 alpha 测试
+   float opacity = 1.0f;
+   // 各级细节在 vao 的 ebo 中的索引段，为空则总是绘制全部索引；需要同时设置 bounds
+   const MeshLod* lod = nullptr;
+};
+
+// 合批中每个 draw 在 texture buffer 中的数据，对应 batch.vertex.glsl 中的 8 个 texel
+struct BatchDrawData{
+   glm::vec4 model[4];
+   glm::vec4 normalModel[3];
+   // x: 漫反射贴图所在层，y: 镜面反射贴图所在层（-1 表示没有）
+   glm::vec4 material;
+
+   static BatchDrawData create(const glm::mat4& model, int diffuseLayer, int specularLayer){
+      BatchDrawData data;
+      glm::mat3 normalModel = glm::mat3(glm::transpose(glm::inverse(model)));
+      for(int i = 0; i < 4; i++){
+         data.model[i] = model[i];
+      }
+      for(int i = 0; i < 3; i++){
+         data.normalModel[i] = glm::vec4(normalModel[i], 0.0f);
+      }
+      data.material = glm::vec4(diffuseLayer, specularLayer, 0.0f, 0.0f);
+      return data;
+   }
+};
+
+// 多个 mesh 合并后的元数据：一个 vao 加上多条绘制命令，通过一次 multi draw 完成绘制
+struct LightBatchMeta{
+   VertexArray& vao;
+   const MultiDrawCommand& commands;
+   Texture2DArray& diffuseTextures;
+   Texture2DArray* specularTextures;
+   TextureBuffer& drawData;
+   const ObservableValue<glm::mat4>& model;
+   const float& shininess;
+   const BoundingBox* bounds = nullptr;
 };
 
 class LightObject;
+class LightBatch;
 class SpotLight;
 class PointLight;
 class DirectionalLight;
@@ -214,16 +283,25 @@ friend class DirectionalLight;
 friend class SpotLight;
 friend class PointLight;
 friend class LightObject;
+friend class LightBatch;
 private:
    std::vector<DrawUnit> drawUnits;
    RefContainer<DirectionalLight> directionalLights;
    // DirectionalLight directionalLight;
    RefContainer<LightObject> lightObjects;
+   RefContainer<LightBatch> lightBatches;
    RefContainer<PointLight> pointLights;
    RefContainer<SpotLight> spotLights;
    const glm::mat4& projection;
    const ObservableValue<glm::mat4>& viewModel;
    ReactiveValue<glm::vec3, glm::mat4> viewPos;
+
+   // 所有光源相关的 uniform，被光照物体共享
+   void addLightUniforms(std::vector<DrawUnit::UniformParam>& uniforms);
+   // 为单个物体、合批物体或光源本身生成 DrawUnit
+   void addDrawUnit(LightObject& lightObject);
+   void addDrawUnit(LightBatch& lightBatch);
+   void addDrawUnit(const glm::mat4& model, const ObservableValue<glm::vec3>& color);
    
 public:
    LightScene(const glm::mat4& projection, const ObservableValue<glm::mat4>& viewModel): 
@@ -238,6 +316,15 @@ public:
    LightScene(BasicData& basicData): LightScene(basicData.projectionCoord.projection, basicData.viewModel){}
 
    void generateDrawUnits();
+   // 分步生成 DrawUnit 的任务，每次调用生成至多 step 个，全部生成后返回 true，可以交给 FrameScheduler 分摊到多帧
+   // 调用时立即清除已有的 DrawUnit；任务完成前不能增删场景中的物体和光源，否则需要重新生成任务
+   std::function<bool(void)> generateDrawUnitsTask(std::size_t step = 8);
+   // 为生成 DrawUnit 之后才加入场景的物体单独生成 DrawUnit，已有的 DrawUnit 不变
+   void appendDrawUnit(LightObject& lightObject){
+      addDrawUnit(lightObject);
+   }
+   // 移除物体的 DrawUnit（依据 vao 查找），物体的贴图等改变后可以再次 appendDrawUnit
+   void removeDrawUnit(const LightObject& lightObject);
    void clear() {
       drawUnits.clear();
    }
@@ -296,6 +383,17 @@ public:
    AutoLoader<LightObject>(lightScene.lightObjects){}
 };
 
+class LightBatch: public AutoLoader<LightBatch>{
+friend class LightScene;
+private:
+   LightBatchMeta meta;
+   ReactiveValue<glm::mat3, glm::mat4> normalModel;
+public:
+   LightBatch(const LightBatchMeta& meta, LightScene& lightScene): meta(meta), 
+   normalModel([](const glm::mat4& model){return ModelComputer::computeNormalModel(model);}, this->meta.model), 
+   AutoLoader<LightBatch>(lightScene.lightBatches){}
+};
+
 //存储元数据的原始值的结构体，用于构造对应的元数据结构体
 struct DirectionalLightData{
    ObservableValue<glm::vec3> color {glm::vec3(1.0f, 1.0f, 1.0f)};
@@ -329,102 +427,195 @@ struct SpotLightData{
 };
 
 
-inline void LightScene::generateDrawUnits(){
-   Drawer& drawer = Drawer::getInstance(); 
-   drawUnits.clear();
-   for(auto& lightObject: lightObjects){
-      std::vector<DrawUnit::TextureParam> textures;
-      std::vector<DrawUnit::UniformParam> uniforms;
-      // DrawUnit drawUnit {lightObject.meta.vao, LightContext::getInstance().objectProgram};
+inline void LightScene::addLightUniforms(std::vector<DrawUnit::UniformParam>& uniforms){
+   uniforms.emplace_back("directionalLightNum", static_cast<int>(directionalLights.size()));
+   for(int i = 0; auto& directionalLight: directionalLights){
+      uniforms.emplace_back(fmt::format("directionalLights[{}].direction", i), directionalLight.directionNormalized.get());
+      uniforms.emplace_back(fmt::format("directionalLights[{}].ambient", i), directionalLight.material->ambient);
+      uniforms.emplace_back(fmt::format("directionalLights[{}].diffuse", i), directionalLight.material->diffuse);
+      uniforms.emplace_back(fmt::format("directionalLights[{}].specular", i), directionalLight.material->specular);
+      i++;
+   }
 
-      uniforms.emplace_back("model", lightObject.meta.model.get());
-      uniforms.emplace_back("view", viewModel.get());
-      uniforms.emplace_back("projection", projection);
+   uniforms.emplace_back("pointLightNum", static_cast<int>(pointLights.size()));
+   for(int i = 0; auto& pointLight: pointLights){
+      uniforms.emplace_back(fmt::format("pointLights[{}].position", i), pointLight.meta.position.get());
+      uniforms.emplace_back(fmt::format("pointLights[{}].ambient", i), pointLight.material->ambient);
+      uniforms.emplace_back(fmt::format("pointLights[{}].diffuse", i), pointLight.material->diffuse);
+      uniforms.emplace_back(fmt::format("pointLights[{}].specular", i), pointLight.material->specular);
+      uniforms.emplace_back(fmt::format("pointLights[{}].constant", i), pointLight.attenuation->constant);
+      uniforms.emplace_back(fmt::format("pointLights[{}].linear", i), pointLight.attenuation->linear);
+      uniforms.emplace_back(fmt::format("pointLights[{}].quadratic", i), pointLight.attenuation->quadratic);
+      i++;
+   }
 
+   uniforms.emplace_back("spotLightNum", static_cast<int>(spotLights.size()));
+   for(int i = 0; auto& spotLight :spotLights){
+      uniforms.emplace_back(fmt::format("spotLights[{}].position", i), spotLight.meta.position.get());
+      uniforms.emplace_back(fmt::format("spotLights[{}].direction", i), spotLight.directionNormalized.get());
+      uniforms.emplace_back(fmt::format("spotLights[{}].outerCutOff", i), spotLight.outerCutOff.get());
+      uniforms.emplace_back(fmt::format("spotLights[{}].innerCutOff", i), spotLight.innerCutOff.get());
+      uniforms.emplace_back(fmt::format("spotLights[{}].ambient", i), spotLight.material->ambient);
+      uniforms.emplace_back(fmt::format("spotLights[{}].diffuse", i), spotLight.material->diffuse);
+      uniforms.emplace_back(fmt::format("spotLights[{}].specular", i), spotLight.material->specular);
+      uniforms.emplace_back(fmt::format("spotLights[{}].constant", i), spotLight.attenuation->constant);
+      uniforms.emplace_back(fmt::format("spotLights[{}].linear", i), spotLight.attenuation->linear);
+      uniforms.emplace_back(fmt::format("spotLights[{}].quadratic", i), spotLight.attenuation->quadratic);
+      i++;
+   }
+}
 
-      uniforms.emplace_back("viewPos", viewPos.get());
-      uniforms.emplace_back("normalModel", lightObject.normalModel.get());
+inline void LightScene::addDrawUnit(LightObject& lightObject){
+   std::vector<DrawUnit::TextureParam> textures;
+   std::vector<DrawUnit::UniformParam> uniforms;
+   // DrawUnit drawUnit {lightObject.meta.vao, LightContext::getInstance().objectProgram};
 
-      textures.emplace_back(0, "material.diffuse", lightObject.meta.diffuseTexture);
-      if(lightObject.meta.specularTexture != nullptr){
-         textures.emplace_back(1, "material.specular", *lightObject.meta.specularTexture);
-      }else{
-         uniforms.emplace_back("material.specular", 1);
-      }
-      uniforms.emplace_back("material.shininess", lightObject.meta.shininess);
-      
-      uniforms.emplace_back("directionalLightNum", static_cast<int>(directionalLights.size()));
-      for(int i = 0; auto& directionalLight: directionalLights){
-         uniforms.emplace_back(fmt::format("directionalLights[{}].direction", i), directionalLight.directionNormalized.get());
-         uniforms.emplace_back(fmt::format("directionalLights[{}].ambient", i), directionalLight.material->ambient);
-         uniforms.emplace_back(fmt::format("directionalLights[{}].diffuse", i), directionalLight.material->diffuse);
-         uniforms.emplace_back(fmt::format("directionalLights[{}].specular", i), directionalLight.material->specular);
-         i++;
-      }
+   uniforms.emplace_back("model", lightObject.meta.model.get());
+   uniforms.emplace_back("view", viewModel.get());
+   uniforms.emplace_back("projection", projection);
 
-      uniforms.emplace_back("pointLightNum", static_cast<int>(pointLights.size()));
-      for(int i = 0; auto& pointLight: pointLights){
-         uniforms.emplace_back(fmt::format("pointLights[{}].position", i), pointLight.meta.position.get());
-         uniforms.emplace_back(fmt::format("pointLights[{}].ambient", i), pointLight.material->ambient);
-         uniforms.emplace_back(fmt::format("pointLights[{}].diffuse", i), pointLight.material->diffuse);
-         uniforms.emplace_back(fmt::format("pointLights[{}].specular", i), pointLight.material->specular);
-         uniforms.emplace_back(fmt::format("pointLights[{}].constant", i), pointLight.attenuation->constant);
-         uniforms.emplace_back(fmt::format("pointLights[{}].linear", i), pointLight.attenuation->linear);
-         uniforms.emplace_back(fmt::format("pointLights[{}].quadratic", i), pointLight.attenuation->quadratic);
-         i++;
-      }
 
-      uniforms.emplace_back("spotLightNum", static_cast<int>(spotLights.size()));
-      for(int i = 0; auto& spotLight :spotLights){
-         uniforms.emplace_back(fmt::format("spotLights[{}].position", i), spotLight.meta.position.get());
-         uniforms.emplace_back(fmt::format("spotLights[{}].direction", i), spotLight.directionNormalized.get());
-         uniforms.emplace_back(fmt::format("spotLights[{}].outerCutOff", i), spotLight.outerCutOff.get());
-         uniforms.emplace_back(fmt::format("spotLights[{}].innerCutOff", i), spotLight.innerCutOff.get());
-         uniforms.emplace_back(fmt::format("spotLights[{}].ambient", i), spotLight.material->ambient);
-         uniforms.emplace_back(fmt::format("spotLights[{}].diffuse", i), spotLight.material->diffuse);
-         uniforms.emplace_back(fmt::format("spotLights[{}].specular", i), spotLight.material->specular);
-         uniforms.emplace_back(fmt::format("spotLights[{}].constant", i), spotLight.attenuation->constant);
-         uniforms.emplace_back(fmt::format("spotLights[{}].linear", i), spotLight.attenuation->linear);
-         uniforms.emplace_back(fmt::format("spotLights[{}].quadratic", i), spotLight.attenuation->quadratic);
-         i++;
-      }
-      
-      drawUnits.emplace_back(
-         lightObject.meta.vao, 
-         LightContext::getInstance().objectProgram, 
-         uniforms,
-         textures
-      );
+   uniforms.emplace_back("viewPos", viewPos.get());
+   uniforms.emplace_back("normalModel", lightObject.normalModel.get());
+
+   textures.emplace_back(0, "material.diffuse", lightObject.meta.diffuseTexture);
+   if(lightObject.meta.specularTexture != nullptr){
+      textures.emplace_back(1, "material.specular", *lightObject.meta.specularTexture);
+   }else{
+      uniforms.emplace_back("material.specular", 1);
+   }
+   uniforms.emplace_back("material.shininess", lightObject.meta.shininess);
+   AlphaMode alphaMode = lightObject.meta.diffuseTexture.getAlphaMode();
+   bool transparent = lightObject.meta.opacity < 1.0f || alphaMode == AlphaMode::TRANSLUCENT;
+   bool cutout = !transparent && alphaMode == AlphaMode::CUTOUT;
+   if(transparent){
+      uniforms.emplace_back("material.opacity", lightObject.meta.opacity);
+   }
+   
+   addLightUniforms(uniforms);
+   
+   drawUnits.emplace_back(
+      lightObject.meta.vao, 
+      transparent ? LightContext::getInstance().objectTransparentProgram :
+         cutout ? LightContext::getInstance().objectCutoutProgram : LightContext::getInstance().objectProgram, 
+      uniforms,
+      textures
+   );
+   if(lightObject.meta.bounds != nullptr){
+      drawUnits.back().setBounds(*lightObject.meta.bounds, lightObject.meta.model.get());
    }
+   if(lightObject.meta.lod != nullptr){
+      drawUnits.back().setLod(*lightObject.meta.lod);
+   }
+   if(transparent){
+      // 透明物体不写入深度，也就不参与深度预渲染
+      drawUnits.back().setTransparent(true);
+   }else if(!cutout){
+      // 只写深度的 program 不读取贴图，镂空的部分也会写入深度，所以镂空的物体不参与深度预渲染
+      drawUnits.back().setDepthPrePass(LightContext::getInstance().objectDepthProgram);
+   }
+}
+
+inline void LightScene::addDrawUnit(LightBatch& lightBatch){
+   std::vector<DrawUnit::TextureParam> textures;
+   std::vector<DrawUnit::UniformParam> uniforms;
+
+   uniforms.emplace_back("model", lightBatch.meta.model.get());
+   uniforms.emplace_back("view", viewModel.get());
+   uniforms.emplace_back("projection", projection);
+
+   uniforms.emplace_back("viewPos", viewPos.get());
+   uniforms.emplace_back("normalModel", lightBatch.normalModel.get());
+
+   textures.emplace_back(0, "material.diffuse", lightBatch.meta.diffuseTextures);
+   if(lightBatch.meta.specularTextures != nullptr){
+      textures.emplace_back(1, "material.specular", *lightBatch.meta.specularTextures);
+   }else{
+      uniforms.emplace_back("material.specular", 1);
+   }
+   textures.emplace_back(2, "drawData", lightBatch.meta.drawData);
+   uniforms.emplace_back("material.shininess", lightBatch.meta.shininess);
+
+   addLightUniforms(uniforms);
+
+   drawUnits.emplace_back(
+      lightBatch.meta.vao, 
+      lightBatch.meta.commands,
+      LightContext::getInstance().batchProgram, 
+      uniforms,
+      textures
+   );
+   if(lightBatch.meta.bounds != nullptr){
+      drawUnits.back().setBounds(*lightBatch.meta.bounds, lightBatch.meta.model.get());
+   }
+   // 需要顶点属性中 draw 的序号，不能使用只含位置的 vao
+   drawUnits.back().setDepthPrePass(LightContext::getInstance().batchDepthProgram, false);
+}
+
+inline void LightScene::addDrawUnit(const glm::mat4& model, const ObservableValue<glm::vec3>& color){
    auto& context = LightContext::getInstance();
+   std::vector<DrawUnit::UniformParam> uniforms;
+   uniforms.emplace_back("model", model);
+   uniforms.emplace_back("view", viewModel.get());
+   uniforms.emplace_back("projection", projection);
+   uniforms.emplace_back("color", color.get());
+   drawUnits.emplace_back(
+      context.lightVertex.vao, 
+      context.lightProgram, 
+      uniforms,
+      std::vector<DrawUnit::TextureParam>{}
+   );
+   drawUnits.back().setBounds(context.lightVertex.bounds, model);
+}
+
+inline void LightScene::removeDrawUnit(const LightObject& lightObject){
+   std::erase_if(drawUnits, [&lightObject](const DrawUnit& drawUnit){
+      return &drawUnit.getVertexArray() == &lightObject.meta.vao;
+   });
+}
+
+inline void LightScene::generateDrawUnits(){
+   Drawer& drawer = Drawer::getInstance(); 
+   drawer.setCullingCamera(projection, viewModel.get());
+   drawUnits.clear();
+   for(auto& lightObject: lightObjects){
+      addDrawUnit(lightObject);
+   }
+   for(auto& lightBatch: lightBatches){
+      addDrawUnit(lightBatch);
+   }
    for(auto& pointLight : pointLights){
-      std::vector<DrawUnit::UniformParam> uniforms;
-      uniforms.emplace_back("model", pointLight.model.get());
-      uniforms.emplace_back("view", viewModel.get());
-      uniforms.emplace_back("projection", projection);
-      uniforms.emplace_back("color", pointLight.meta.color.get());
-      drawUnits.emplace_back(
-         context.lightVertex.vao, 
-         context.lightProgram, 
-         uniforms,
-         std::vector<DrawUnit::TextureParam>{}
-      );
+      addDrawUnit(pointLight.model.get(), pointLight.meta.color);
    }
+   for(auto& spotLight: spotLights){
+      addDrawUnit(spotLight.model.get(), spotLight.meta.color);
+   }
+}
 
+inline std::function<bool(void)> LightScene::generateDrawUnitsTask(std::size_t step){
+   Drawer::getInstance().setCullingCamera(projection, viewModel.get());
+   drawUnits.clear();
+   // 先记录需要生成的对象，任务中每次生成一部分
+   auto adds = std::make_shared<std::vector<std::function<void(void)>>>();
+   for(auto& lightObject: lightObjects){
+      adds->push_back([this, &lightObject]{addDrawUnit(lightObject);});
+   }
+   for(auto& lightBatch: lightBatches){
+      adds->push_back([this, &lightBatch]{addDrawUnit(lightBatch);});
+   }
+   for(auto& pointLight : pointLights){
+      adds->push_back([this, &pointLight]{addDrawUnit(pointLight.model.get(), pointLight.meta.color);});
+   }
    for(auto& spotLight: spotLights){
-      std::vector<DrawUnit::UniformParam> uniforms;
-      uniforms.emplace_back("model", spotLight.model.get());
-      uniforms.emplace_back("view", viewModel.get());
-      uniforms.emplace_back("projection", projection);
-      uniforms.emplace_back("color", spotLight.meta.color.get());
-      drawUnits.emplace_back(
-         context.lightVertex.vao, 
-         context.lightProgram, 
-         uniforms,
-         std::vector<DrawUnit::TextureParam>{}
-      );
+      adds->push_back([this, &spotLight]{addDrawUnit(spotLight.model.get(), spotLight.meta.color);});
    }
-   
+   drawUnits.reserve(adds->size());
+   return [adds, step, index = std::size_t(0)]() mutable {
+      for(std::size_t end = std::min(adds->size(), index + step); index < end; index++){
+         (*adds)[index]();
+      }
+      return index == adds->size();
+   };
 }
 
 } // namespace minecpp
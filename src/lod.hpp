@@ -0,0 +1,475 @@
+#ifndef _MINECPP_LOD_H_
+#define _MINECPP_LOD_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "culling.hpp"
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/****************** LEVEL OF DETAIL ******************/
+/*****************************************************/
+/*****************************************************/
+
+// 一个 mesh 的各级细节，所有等级共用同一组 vbo 和 ebo
+// 第 0 级是原始的 mesh，之后每一级的三角形更少
+struct MeshLod{
+   struct Level{
+      // 在 ebo 中的第一个索引的位置和索引数
+      std::size_t offset;
+      std::size_t count;
+      // 相对于原始 mesh 的几何误差，为局部空间的距离
+      float error;
+   };
+   std::vector<Level> levels;
+
+   std::size_t size() const { return levels.size(); }
+};
+
+// 生成各级细节的参数，见 MeshSimplifier::generateLods
+struct LodOption{
+   // 每一级的目标索引数相对于上一级的比例
+   float ratio = 0.35f;
+   // 最多生成的等级数（不含第 0 级）
+   int maxLevels = 4;
+   // 允许的最大误差，相对于包围盒对角线的一半
+   float maxError = 0.05f;
+   // 三角形少于这个数量时不再简化
+   std::size_t minTriangles = 32;
+};
+
+// 用二次误差度量（Garland 和 Heckbert，1997）简化 mesh
+// 每次把一条边的一个顶点合并到另一个顶点上（half-edge collapse），不产生新的顶点，所以简化后的索引可以和原始的 mesh 共用顶点
+// 纹理坐标或法线的接缝上的两个顶点沿着接缝成对合并，开放的边界上的顶点只沿着边界合并，避免出现裂缝；更多顶点共用位置时不移动
+class MeshSimplifier{
+private:
+   // 对称的 4x4 矩阵，只存储上三角的 10 个值，误差为 v^T Q v；weight 为累计的面积，用于把误差换算为平均距离
+   struct Quadric{
+      double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+      double weight = 0;
+
+      // plane 的 xyz 为单位法向量
+      static Quadric fromPlane(const glm::dvec4& plane, double weight){
+         Quadric q;
+         q.xx = plane.x * plane.x * weight; q.xy = plane.x * plane.y * weight; q.xz = plane.x * plane.z * weight; q.xw = plane.x * plane.w * weight;
+         q.yy = plane.y * plane.y * weight; q.yz = plane.y * plane.z * weight; q.yw = plane.y * plane.w * weight;
+         q.zz = plane.z * plane.z * weight; q.zw = plane.z * plane.w * weight;
+         q.ww = plane.w * plane.w * weight;
+         q.weight = weight;
+         return q;
+      }
+      Quadric& operator+=(const Quadric& other){
+         xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+         yy += other.yy; yz += other.yz; yw += other.yw;
+         zz += other.zz; zw += other.zw;
+         ww += other.ww;
+         weight += other.weight;
+         return *this;
+      }
+      // 到各个平面的距离的平方的加权平均
+      double error(const glm::vec3& v) const {
+         double x = v.x, y = v.y, z = v.z;
+         double result = xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x
+            + yy * y * y + 2 * yz * y * z + 2 * yw * y
+            + zz * z * z + 2 * zw * z
+            + ww;
+         return weight > 0 ? std::abs(result) / weight : 0.0;
+      }
+   };
+
+   enum class VertexKind: std::uint8_t{
+      // 可以合并到任意相邻的顶点上
+      MANIFOLD,
+      // 在开放的边界上，只能沿着边界合并
+      BORDER,
+      // 同一位置上恰好有两个顶点（纹理坐标或法线的接缝），两个顶点沿着接缝一起合并
+      SEAM,
+      // 更多顶点共用位置或者非流形的顶点，不会被合并
+      LOCKED,
+   };
+
+   // from 合并到 to 上；接缝上的合并同时把 from 的另一个顶点合并到 to 的另一个顶点上
+   struct Collapse{
+      unsigned int from;
+      unsigned int to;
+      double cost;
+   };
+
+   static std::uint64_t edgeKey(unsigned int a, unsigned int b){
+      if(a > b){
+         std::swap(a, b);
+      }
+      return (static_cast<std::uint64_t>(a) << 32) | b;
+   }
+
+   static glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c){
+      return glm::cross(b - a, c - a);
+   }
+
+   struct Topology{
+      std::vector<VertexKind> kinds;
+      // 相同位置的顶点合并后的序号，用于判断边界
+      std::vector<unsigned int> welded;
+      // 接缝上同一位置的另一个顶点
+      std::vector<unsigned int> siblings;
+      // 每条边（以 welded 的序号表示）所在的三角形数，只有一个三角形的边在开放的边界上
+      std::unordered_map<std::uint64_t, int> edgeCounts;
+      // 每条边（以原本的序号表示）所在的三角形数
+      std::unordered_map<std::uint64_t, int> wedgeEdgeCounts;
+
+      int count(const std::unordered_map<std::uint64_t, int>& counts, unsigned int a, unsigned int b) const {
+         auto found = counts.find(edgeKey(a, b));
+         return found == counts.end() ? 0 : found->second;
+      }
+      bool isBorderEdge(unsigned int a, unsigned int b) const {
+         return count(edgeCounts, welded[a], welded[b]) == 1;
+      }
+      // 位置上两侧都有三角形，但两侧使用不同的顶点
+      bool isSeamEdge(unsigned int a, unsigned int b) const {
+         return count(edgeCounts, welded[a], welded[b]) == 2 && count(wedgeEdgeCounts, a, b) == 1;
+      }
+   };
+
+   static Topology analyze(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices){
+      constexpr unsigned int none = std::numeric_limits<unsigned int>::max();
+      Topology topology;
+      std::size_t vertexNumber = positions.size();
+      topology.welded.resize(vertexNumber);
+      topology.siblings.assign(vertexNumber, none);
+      std::vector<int> wedges(vertexNumber, 0);
+      // 按位置排序后，位置相同的顶点相邻
+      std::vector<unsigned int> order(vertexNumber);
+      for(unsigned int i = 0; i < vertexNumber; i++){
+         order[i] = i;
+      }
+      auto less = [&positions](unsigned int a, unsigned int b){
+         const glm::vec3& p = positions[a];
+         const glm::vec3& q = positions[b];
+         return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+      };
+      std::sort(order.begin(), order.end(), less);
+      for(std::size_t i = 0; i < vertexNumber; i++){
+         bool same = i > 0 && positions[order[i]] == positions[order[i - 1]];
+         topology.welded[order[i]] = same ? topology.welded[order[i - 1]] : order[i];
+         wedges[topology.welded[order[i]]]++;
+         if(same){
+            topology.siblings[order[i]] = order[i - 1];
+            topology.siblings[order[i - 1]] = order[i];
+         }
+      }
+      for(std::size_t i = 0; i < indices.size(); i += 3){
+         for(int j = 0; j < 3; j++){
+            unsigned int a = indices[i + j];
+            unsigned int b = indices[i + (j + 1) % 3];
+            topology.edgeCounts[edgeKey(topology.welded[a], topology.welded[b])]++;
+            topology.wedgeEdgeCounts[edgeKey(a, b)]++;
+         }
+      }
+      topology.kinds.assign(vertexNumber, VertexKind::MANIFOLD);
+      for(unsigned int i = 0; i < vertexNumber; i++){
+         int number = wedges[topology.welded[i]];
+         topology.kinds[i] = number == 1 ? VertexKind::MANIFOLD : number == 2 ? VertexKind::SEAM : VertexKind::LOCKED;
+      }
+      for(std::size_t i = 0; i < indices.size(); i += 3){
+         for(int j = 0; j < 3; j++){
+            unsigned int a = indices[i + j];
+            unsigned int b = indices[i + (j + 1) % 3];
+            int count = topology.count(topology.edgeCounts, topology.welded[a], topology.welded[b]);
+            for(unsigned int v: {a, b}){
+               if(count > 2 || (count == 1 && topology.kinds[v] == VertexKind::SEAM)){
+                  topology.kinds[v] = VertexKind::LOCKED;
+               }else if(count == 1 && topology.kinds[v] == VertexKind::MANIFOLD){
+                  topology.kinds[v] = VertexKind::BORDER;
+               }
+            }
+         }
+      }
+      // 接缝的两个顶点需要一起合并，其中一个被锁定时另一个也不能合并
+      for(unsigned int i = 0; i < vertexNumber; i++){
+         if(topology.kinds[i] == VertexKind::SEAM && topology.kinds[topology.siblings[i]] != VertexKind::SEAM){
+            topology.kinds[i] = VertexKind::LOCKED;
+         }
+      }
+      return topology;
+   }
+
+   static std::vector<Quadric> computeQuadrics(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, const Topology& topology){
+      std::vector<Quadric> quadrics(positions.size());
+      for(std::size_t i = 0; i < indices.size(); i += 3){
+         const glm::vec3& a = positions[indices[i]];
+         const glm::vec3& b = positions[indices[i + 1]];
+         const glm::vec3& c = positions[indices[i + 2]];
+         glm::dvec3 normal = triangleNormal(a, b, c);
+         double length = glm::length(normal);
+         if(length == 0.0){
+            continue;
+         }
+         normal /= length;
+         Quadric quadric = Quadric::fromPlane(glm::dvec4(normal, -glm::dot(normal, glm::dvec3(a))), length * 0.5);
+         for(int j = 0; j < 3; j++){
+            quadrics[indices[i + j]] += quadric;
+         }
+         // 边界的边上加一个垂直于三角形的平面，使边界上的顶点尽量不偏离原来的轮廓
+         for(int j = 0; j < 3; j++){
+            unsigned int from = indices[i + j];
+            unsigned int to = indices[i + (j + 1) % 3];
+            if(!topology.isBorderEdge(from, to)){
+               continue;
+            }
+            glm::dvec3 edge = glm::dvec3(positions[to]) - glm::dvec3(positions[from]);
+            double edgeLength = glm::length(edge);
+            if(edgeLength == 0.0){
+               continue;
+            }
+            glm::dvec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+            Quadric border = Quadric::fromPlane(glm::dvec4(edgeNormal, -glm::dot(edgeNormal, glm::dvec3(positions[from]))), edgeLength * edgeLength * 10.0);
+            // 只增加误差，不改变用于平均的权重
+            border.weight = 0.0;
+            quadrics[from] += border;
+            quadrics[to] += border;
+         }
+      }
+      return quadrics;
+   }
+
+   static bool canCollapse(unsigned int from, unsigned int to, const Topology& topology){
+      switch(topology.kinds[from]){
+      // to 和 from 在同一个三角形中，from 周围的纹理坐标是连续的，所以即使 to 在接缝上，这个 to 也属于同一侧
+      case VertexKind::MANIFOLD: return true;
+      case VertexKind::BORDER: return topology.kinds[to] == VertexKind::BORDER && topology.isBorderEdge(from, to);
+      // 另一侧也要存在对应的边
+      case VertexKind::SEAM: return topology.kinds[to] == VertexKind::SEAM && topology.isSeamEdge(from, to)
+         && topology.isSeamEdge(topology.siblings[from], topology.siblings[to]);
+      default: return false;
+      }
+   }
+
+   // 检查把 from 合并到 to 之后 from 周围的三角形是否翻转，返回因为退化而去掉的三角形数，翻转时返回 -1
+   static long long checkCollapse(unsigned int from, unsigned int to, const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+      const std::vector<unsigned int>& adjacencyOffsets, const std::vector<unsigned int>& adjacency){
+      long long removed = 0;
+      for(unsigned int k = adjacencyOffsets[from]; k < adjacencyOffsets[from + 1]; k++){
+         const unsigned int* triangle = &indices[adjacency[k] * 3];
+         if(triangle[0] == to || triangle[1] == to || triangle[2] == to){
+            removed++;
+            continue;
+         }
+         glm::vec3 corners[3];
+         for(int j = 0; j < 3; j++){
+            corners[j] = triangle[j] == from ? positions[to] : positions[triangle[j]];
+         }
+         glm::vec3 before = triangleNormal(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]]);
+         glm::vec3 after = triangleNormal(corners[0], corners[1], corners[2]);
+         if(glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after)){
+            return -1;
+         }
+      }
+      return removed;
+   }
+
+public:
+   // 把 indices 简化到不多于 targetIndexNumber 个索引，或者误差达到 maxError（局部空间距离）为止
+   // error 为实际的最大误差
+   static std::vector<unsigned int> simplify(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+      std::size_t targetIndexNumber, float maxError, float* error = nullptr){
+      Topology topology = analyze(positions, indices);
+      std::vector<Quadric> quadrics = computeQuadrics(positions, indices, topology);
+      std::vector<unsigned int> result = indices;
+      std::vector<unsigned int> remap(positions.size());
+      std::vector<bool> touched(positions.size());
+      std::vector<unsigned int> adjacencyOffsets;
+      std::vector<unsigned int> adjacency;
+      std::vector<Collapse> collapses;
+      double maxCost = static_cast<double>(maxError) * maxError;
+      double resultCost = 0.0;
+
+      while(result.size() > targetIndexNumber){
+         // 每个顶点所在的三角形
+         adjacencyOffsets.assign(positions.size() + 1, 0);
+         for(auto index: result){
+            adjacencyOffsets[index + 1]++;
+         }
+         for(std::size_t i = 1; i < adjacencyOffsets.size(); i++){
+            adjacencyOffsets[i] += adjacencyOffsets[i - 1];
+         }
+         adjacency.resize(result.size());
+         std::vector<unsigned int> fill {adjacencyOffsets.begin(), adjacencyOffsets.end() - 1};
+         for(std::size_t i = 0; i < result.size(); i++){
+            adjacency[fill[result[i]]++] = i / 3;
+         }
+
+         collapses.clear();
+         for(std::size_t i = 0; i < result.size(); i += 3){
+            for(int j = 0; j < 3; j++){
+               unsigned int a = result[i + j];
+               unsigned int b = result[i + (j + 1) % 3];
+               for(auto [from, to]: {std::pair{a, b}, std::pair{b, a}}){
+                  if(canCollapse(from, to, topology)){
+                     Quadric quadric = quadrics[from];
+                     quadric += quadrics[to];
+                     if(topology.kinds[from] == VertexKind::SEAM){
+                        quadric += quadrics[topology.siblings[from]];
+                        quadric += quadrics[topology.siblings[to]];
+                     }
+                     collapses.push_back({from, to, quadric.error(positions[to])});
+                  }
+               }
+            }
+         }
+         if(collapses.empty()){
+            break;
+         }
+         std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b){
+            return a.cost < b.cost;
+         });
+
+         // 每一轮中每个顶点至多参与一次合并，合并之间互不影响
+         for(unsigned int i = 0; i < remap.size(); i++){
+            remap[i] = i;
+         }
+         std::fill(touched.begin(), touched.end(), false);
+         std::size_t triangles = result.size() / 3;
+         std::size_t targetTriangles = targetIndexNumber / 3;
+         bool collapsed = false;
+         for(auto& collapse: collapses){
+            if(triangles <= targetTriangles || collapse.cost > maxCost){
+               break;
+            }
+            bool seam = topology.kinds[collapse.from] == VertexKind::SEAM;
+            unsigned int siblingFrom = seam ? topology.siblings[collapse.from] : collapse.from;
+            unsigned int siblingTo = seam ? topology.siblings[collapse.to] : collapse.to;
+            if(touched[collapse.from] || touched[collapse.to] || touched[siblingFrom] || touched[siblingTo]){
+               continue;
+            }
+            long long removed = checkCollapse(collapse.from, collapse.to, positions, result, adjacencyOffsets, adjacency);
+            long long siblingRemoved = seam ? checkCollapse(siblingFrom, siblingTo, positions, result, adjacencyOffsets, adjacency) : 0;
+            if(removed < 0 || siblingRemoved < 0){
+               continue;
+            }
+            for(auto [from, to]: {std::pair{collapse.from, collapse.to}, std::pair{siblingFrom, siblingTo}}){
+               if(from != to){
+                  remap[from] = to;
+                  quadrics[to] += quadrics[from];
+                  touched[from] = touched[to] = true;
+               }
+               if(!seam){
+                  break;
+               }
+            }
+            triangles -= std::min<std::size_t>(triangles, removed + siblingRemoved);
+            resultCost = std::max(resultCost, collapse.cost);
+            collapsed = true;
+         }
+         if(!collapsed){
+            break;
+         }
+
+         // 替换合并掉的顶点，去掉退化的三角形
+         std::size_t write = 0;
+         for(std::size_t i = 0; i < result.size(); i += 3){
+            unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if(a != b && b != c && c != a){
+               result[write++] = a;
+               result[write++] = b;
+               result[write++] = c;
+            }
+         }
+         result.resize(write);
+      }
+      if(error != nullptr){
+         *error = static_cast<float>(std::sqrt(resultCost));
+      }
+      return result;
+   }
+
+   // 依次生成各级细节：第 i 级由第 i - 1 级简化得到，简化效果不明显或误差过大时停止
+   // 返回的第 0 级为 indices 本身，之后各级的索引依次追加到 lodIndices 中，offset 从 indices.size() 开始计算
+   static MeshLod generateLods(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+      std::vector<unsigned int>& lodIndices, const LodOption& option = {}){
+      MeshLod lod;
+      lod.levels.push_back({0, indices.size(), 0.0f});
+      BoundingBox bounds;
+      for(auto index: indices){
+         bounds.extend(positions[index]);
+      }
+      if(bounds.isEmpty()){
+         return lod;
+      }
+      float maxError = option.maxError * bounds.radius();
+      // 每一级以上一级为起点简化，误差累加上一级的误差
+      std::vector<unsigned int> previous = indices;
+      for(int i = 0; i < option.maxLevels && previous.size() / 3 >= option.minTriangles; i++){
+         float error = 0.0f;
+         std::size_t target = static_cast<std::size_t>(previous.size() / 3 * option.ratio) * 3;
+         std::vector<unsigned int> level = simplify(positions, previous, target, maxError, &error);
+         // 至少减少 10% 的三角形才值得多一级
+         if(level.size() > previous.size() * 0.9f){
+            break;
+         }
+         lod.levels.push_back({indices.size() + lodIndices.size(), level.size(), lod.levels.back().error + error});
+         lodIndices.insert(lodIndices.end(), level.begin(), level.end());
+         previous = std::move(level);
+      }
+      return lod;
+   }
+};
+
+// 依据包围球投影到屏幕上的大小选择细节等级
+// 投影的大小在两级的分界附近来回变化时，只有越过分界一定比例才切换，避免每帧来回跳变
+class LodSelector{
+private:
+   // 第 i 级（i >= 1）在包围球的直径小于屏幕高度的 screenSizes[i - 1] 倍时使用
+   std::vector<float> screenSizes {0.5f, 0.25f, 0.12f, 0.06f};
+   float hysteresis = 0.15f;
+
+public:
+   // 包围球的直径相对于屏幕高度的比例，相机在包围球内部时返回无穷大
+   static float projectedSize(const BoundingSphere& sphere, const glm::mat4& projection, const glm::mat4& view){
+      // 正交投影
+      if(projection[3][3] == 1.0f){
+         return sphere.radius * projection[1][1];
+      }
+      float distance = glm::length(glm::vec3(view * glm::vec4(sphere.center, 1.0f)));
+      if(distance <= sphere.radius){
+         return std::numeric_limits<float>::infinity();
+      }
+      return sphere.radius * projection[1][1] / distance;
+   }
+
+   void setScreenSizes(std::vector<float> screenSizes){
+      this->screenSizes = std::move(screenSizes);
+   }
+   const std::vector<float>& getScreenSizes() const { return screenSizes; }
+   // 越过分界的比例，如 0.15 表示需要比分界小 15% 才切换到更粗的一级，比分界大 15% 才切换回更细的一级
+   void setHysteresis(float hysteresis){
+      this->hysteresis = hysteresis;
+   }
+   float getHysteresis() const { return hysteresis; }
+
+   // 从当前的等级出发选择新的等级，levelNumber 为 mesh 的等级数
+   int select(float size, int current, int levelNumber) const {
+      int maxLevel = std::min<int>(levelNumber, screenSizes.size() + 1) - 1;
+      int level = std::clamp(current, 0, std::max(0, maxLevel));
+      while(level < maxLevel && size < screenSizes[level] * (1.0f - hysteresis)){
+         level++;
+      }
+      while(level > 0 && size > screenSizes[level - 1] * (1.0f + hysteresis)){
+         level--;
+      }
+      return level;
+   }
+};
+
+} // namespace minecpp
+
+#endif // _MINECPP_LOD_H_
@@ -0,0 +1,315 @@
+#ifndef _MINECPP_OCCLUSION_H_
+#define _MINECPP_OCCLUSION_H_
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "culling.hpp"
+#include "exception.hpp"
+#include "thread.hpp"
+#if defined(__AVX__) || defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace minecpp
+{
+
+// 一个遮挡物在某一帧中的数据：局部空间的三角形和模型矩阵
+struct OccluderMesh{
+   const std::vector<glm::vec3>* positions;
+   const std::vector<unsigned int>* indices;
+   glm::mat4 model;
+};
+
+// 软件光栅化的遮挡剔除，不需要从 GPU 读回任何数据
+// 1. 将少量遮挡物的三角形光栅化到低分辨率的深度缓冲区中（按行分段多线程，每行用 SIMD 一次处理多个像素）
+// 2. 由深度缓冲区建立层级深度（Hi-Z）金字塔，每一层的像素为上一层 2x2 像素中的最大（最远）深度
+// 3. 被测物体包围盒投影到屏幕上的矩形内，只要有一个像素的最远深度不小于包围盒的最近深度，就视为可见
+// 深度为 [0, 1] 范围的 NDC 深度，1 表示远平面
+class HiZCuller{
+private:
+   // 屏幕空间的三角形，已经转换为边函数和深度平面方程：value = a * x + b * y + c
+   struct ScreenTriangle{
+      float edgeA[3], edgeB[3], edgeC[3];
+      float depthA, depthB, depthC;
+      int minX, maxX, minY, maxY;
+   };
+
+   int width;
+   int height;
+   ThreadPool pool;
+   // levels[0] 为深度缓冲区，按行存储
+   std::vector<std::vector<float>> levels;
+   std::vector<int> levelWidths;
+   std::vector<int> levelHeights;
+   glm::mat4 projectionView {1.0f};
+   // 每个遮挡物的三角形分别存放，避免多线程写同一个容器
+   std::vector<std::vector<ScreenTriangle>> triangles;
+
+   // 近平面之后的顶点的 w 的下限，穿过近平面的三角形直接丢弃（少画遮挡物只会让剔除变保守）
+   static constexpr float minW = 1e-5f;
+
+   void setupTriangles(const OccluderMesh& mesh, std::vector<ScreenTriangle>& output) const {
+      output.clear();
+      glm::mat4 transform = projectionView * mesh.model;
+      auto& positions = *mesh.positions;
+      auto& indices = *mesh.indices;
+      for(std::size_t i = 0; i + 2 < indices.size(); i += 3){
+         glm::vec3 screen[3];
+         bool clipped = false;
+         for(int j = 0; j < 3; j++){
+            glm::vec4 clip = transform * glm::vec4(positions[indices[i + j]], 1.0f);
+            if(clip.w < minW){
+               clipped = true;
+               break;
+            }
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screen[j] = {(ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f};
+         }
+         if(clipped){
+            continue;
+         }
+         float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+         if(std::abs(area) < 1e-8f){
+            continue;
+         }
+         // 统一为逆时针，使三角形内部的边函数都为正；遮挡物不做背面剔除
+         if(area < 0){
+            std::swap(screen[1], screen[2]);
+            area = -area;
+         }
+         ScreenTriangle triangle;
+         triangle.minX = std::max(0, static_cast<int>(std::floor(std::min({screen[0].x, screen[1].x, screen[2].x}))));
+         triangle.maxX = std::min(width - 1, static_cast<int>(std::ceil(std::max({screen[0].x, screen[1].x, screen[2].x}))));
+         triangle.minY = std::max(0, static_cast<int>(std::floor(std::min({screen[0].y, screen[1].y, screen[2].y}))));
+         triangle.maxY = std::min(height - 1, static_cast<int>(std::ceil(std::max({screen[0].y, screen[1].y, screen[2].y}))));
+         if(triangle.minX > triangle.maxX || triangle.minY > triangle.maxY){
+            continue;
+         }
+         // 第 j 条边从顶点 j 指向顶点 j + 1，其边函数为对面顶点（j + 2）的重心坐标乘以面积
+         for(int j = 0; j < 3; j++){
+            auto& a = screen[j];
+            auto& b = screen[(j + 1) % 3];
+            triangle.edgeA[j] = a.y - b.y;
+            triangle.edgeB[j] = b.x - a.x;
+            triangle.edgeC[j] = -(triangle.edgeA[j] * a.x + triangle.edgeB[j] * a.y);
+         }
+         // 深度平面使用原本的边函数计算，放宽只影响覆盖判断
+         float z[3] = {screen[2].z / area, screen[0].z / area, screen[1].z / area};
+         triangle.depthA = triangle.edgeA[0] * z[0] + triangle.edgeA[1] * z[1] + triangle.edgeA[2] * z[2];
+         triangle.depthB = triangle.edgeB[0] * z[0] + triangle.edgeB[1] * z[1] + triangle.edgeB[2] * z[2];
+         triangle.depthC = triangle.edgeC[0] * z[0] + triangle.edgeC[1] * z[1] + triangle.edgeC[2] * z[2];
+         // 共享边上的像素中心会恰好落在边上，由于浮点误差可能两个三角形都判断为外部而产生裂缝
+         // 这里将每条边向外放宽极小的距离（约 1e-4 像素）
+         for(int j = 0; j < 3; j++){
+            triangle.edgeC[j] += (std::abs(triangle.edgeA[j]) + std::abs(triangle.edgeB[j])) * 1e-4f;
+         }
+         output.push_back(triangle);
+      }
+   }
+
+   // 光栅化一个三角形在 [beginY, endY) 行中的部分，深度取较小值
+   // 只有像素中心位于三角形内部时才写入
+   void rasterize(const ScreenTriangle& triangle, int beginY, int endY){
+      auto& depth = levels[0];
+      int minY = std::max(triangle.minY, beginY);
+      int maxY = std::min(triangle.maxY, endY - 1);
+      for(int y = minY; y <= maxY; y++){
+         float py = y + 0.5f;
+         float rowEdge[3];
+         for(int j = 0; j < 3; j++){
+            rowEdge[j] = triangle.edgeB[j] * py + triangle.edgeC[j];
+         }
+         float rowDepth = triangle.depthB * py + triangle.depthC;
+         float* row = &depth[y * width];
+         int x = triangle.minX;
+#if defined(__AVX__)
+         // width 为 8 的倍数，对齐后一组 8 个像素不会越过行尾
+         x -= x % 8;
+         const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+         const __m256 zero = _mm256_setzero_ps();
+         for(; x <= triangle.maxX; x += 8){
+            __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), offsets);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for(int j = 0; j < 3; j++){
+               __m256 edge = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(triangle.edgeA[j])), _mm256_set1_ps(rowEdge[j]));
+               inside = _mm256_and_ps(inside, _mm256_cmp_ps(edge, zero, _CMP_GT_OQ));
+            }
+            __m256 z = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(triangle.depthA)), _mm256_set1_ps(rowDepth));
+            __m256 old = _mm256_loadu_ps(row + x);
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, z), inside));
+         }
+#elif defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+         x -= x % 4;
+         const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+         const __m128 zero = _mm_setzero_ps();
+         for(; x <= triangle.maxX; x += 4){
+            __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for(int j = 0; j < 3; j++){
+               __m128 edge = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(triangle.edgeA[j])), _mm_set1_ps(rowEdge[j]));
+               inside = _mm_and_ps(inside, _mm_cmpgt_ps(edge, zero));
+            }
+            __m128 z = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(triangle.depthA)), _mm_set1_ps(rowDepth));
+            __m128 old = _mm_loadu_ps(row + x);
+            // SSE2 没有 blendv，用位运算选择
+            __m128 result = _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, z)), _mm_andnot_ps(inside, old));
+            _mm_storeu_ps(row + x, result);
+         }
+#endif
+         for(; x <= triangle.maxX; x++){
+            float px = x + 0.5f;
+            bool inside = true;
+            for(int j = 0; j < 3; j++){
+               inside = inside && triangle.edgeA[j] * px + rowEdge[j] > 0;
+            }
+            if(inside){
+               row[x] = std::min(row[x], triangle.depthA * px + rowDepth);
+            }
+         }
+      }
+   }
+
+   void buildPyramid(){
+      for(std::size_t level = 1; level < levels.size(); level++){
+         auto& src = levels[level - 1];
+         auto& dst = levels[level];
+         int srcWidth = levelWidths[level - 1];
+         int srcHeight = levelHeights[level - 1];
+         int dstWidth = levelWidths[level];
+         int dstHeight = levelHeights[level];
+         for(int y = 0; y < dstHeight; y++){
+            int y0 = std::min(y * 2, srcHeight - 1);
+            int y1 = std::min(y * 2 + 1, srcHeight - 1);
+            for(int x = 0; x < dstWidth; x++){
+               int x0 = std::min(x * 2, srcWidth - 1);
+               int x1 = std::min(x * 2 + 1, srcWidth - 1);
+               dst[y * dstWidth + x] = std::max({
+                  src[y0 * srcWidth + x0], src[y0 * srcWidth + x1],
+                  src[y1 * srcWidth + x0], src[y1 * srcWidth + x1],
+               });
+            }
+         }
+      }
+   }
+
+public:
+   // width 需要是 8 的倍数；threadNumber 为 0 时只使用调用线程
+   HiZCuller(int width = 256, int height = 128, std::size_t threadNumber = std::max(1u, std::thread::hardware_concurrency()) - 1)
+   :width(width), height(height), pool(threadNumber){
+      if(width <= 0 || height <= 0 || width % 8 != 0){
+         throwError(fmt::format("invalid hi-z buffer size {}x{}, width must be a positive multiple of 8", width, height));
+      }
+      for(int w = width, h = height; ; w = (w + 1) / 2, h = (h + 1) / 2){
+         levelWidths.push_back(w);
+         levelHeights.push_back(h);
+         levels.emplace_back(w * h, 1.0f);
+         if(w == 1 && h == 1){
+            break;
+         }
+      }
+   }
+
+   // 清空深度缓冲区并光栅化本帧的所有遮挡物，随后重建金字塔
+   void render(const std::vector<OccluderMesh>& occluders, const glm::mat4& projectionView){
+      this->projectionView = projectionView;
+      std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+      triangles.resize(occluders.size());
+      pool.parallelFor(occluders.size(), [&](std::size_t begin, std::size_t end){
+         for(std::size_t i = begin; i < end; i++){
+            setupTriangles(occluders[i], triangles[i]);
+         }
+      });
+      // 按行分段，各线程只写自己的行
+      std::size_t bandNumber = std::min<std::size_t>(height, (pool.size() + 1) * 4);
+      int bandHeight = (height + bandNumber - 1) / bandNumber;
+      pool.parallelFor(bandNumber, [&](std::size_t begin, std::size_t end){
+         for(std::size_t band = begin; band < end; band++){
+            int beginY = band * bandHeight;
+            int endY = std::min(height, beginY + bandHeight);
+            for(auto& meshTriangles: triangles){
+               for(auto& triangle: meshTriangles){
+                  if(triangle.maxY >= beginY && triangle.minY < endY){
+                     rasterize(triangle, beginY, endY);
+                  }
+               }
+            }
+         }
+      });
+      buildPyramid();
+   }
+
+   // 包围盒是否可能可见，需要在 render 之后调用
+   bool isVisible(const BoundingBox& bounds, const glm::mat4& model) const {
+      if(bounds.isEmpty()){
+         return true;
+      }
+      glm::mat4 transform = projectionView * model;
+      glm::vec2 minScreen {std::numeric_limits<float>::max()};
+      glm::vec2 maxScreen {std::numeric_limits<float>::lowest()};
+      float minDepth = std::numeric_limits<float>::max();
+      for(int i = 0; i < 8; i++){
+         glm::vec3 corner {
+            (i & 1) ? bounds.max.x : bounds.min.x,
+            (i & 2) ? bounds.max.y : bounds.min.y,
+            (i & 4) ? bounds.max.z : bounds.min.z,
+         };
+         glm::vec4 clip = transform * glm::vec4(corner, 1.0f);
+         if(clip.w < minW){
+            // 包围盒穿过近平面，无法可靠地投影
+            return true;
+         }
+         glm::vec3 ndc = glm::vec3(clip) / clip.w;
+         glm::vec2 screen {(ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height};
+         minScreen = glm::min(minScreen, screen);
+         maxScreen = glm::max(maxScreen, screen);
+         minDepth = std::min(minDepth, ndc.z * 0.5f + 0.5f);
+      }
+      int minX = std::max(0, static_cast<int>(std::floor(minScreen.x)));
+      int maxX = std::min(width - 1, static_cast<int>(std::floor(maxScreen.x)));
+      int minY = std::max(0, static_cast<int>(std::floor(minScreen.y)));
+      int maxY = std::min(height - 1, static_cast<int>(std::floor(maxScreen.y)));
+      if(minX > maxX || minY > maxY){
+         // 完全在屏幕外，交给视锥体剔除处理
+         return true;
+      }
+      // 选择使矩形最多覆盖 2x2 个像素左右的层级
+      int size = std::max(maxX - minX, maxY - minY);
+      int level = 0;
+      while(size > 1 && level + 1 < static_cast<int>(levels.size())){
+         size /= 2;
+         level++;
+      }
+      auto& depth = levels[level];
+      int levelWidth = levelWidths[level];
+      for(int y = minY >> level; y <= (maxY >> level); y++){
+         for(int x = minX >> level; x <= (maxX >> level); x++){
+            if(depth[y * levelWidth + x] >= minDepth){
+               return true;
+            }
+         }
+      }
+      return false;
+   }
+
+   // 多线程检测一批包围盒，visible[i] 为 1 表示第 i 个包围盒可能可见
+   void test(const std::vector<BoundingBox>& bounds, const std::vector<glm::mat4>& models, std::vector<unsigned char>& visible){
+      visible.resize(bounds.size());
+      pool.parallelFor(bounds.size(), [&](std::size_t begin, std::size_t end){
+         for(std::size_t i = begin; i < end; i++){
+            visible[i] = isVisible(bounds[i], models[i]);
+         }
+      });
+   }
+
+   int getWidth() const { return width; }
+   int getHeight() const { return height; }
+   // 第 level 层金字塔，level 为 0 时即为深度缓冲区
+   const std::vector<float>& getDepth(int level = 0) const { return levels[level]; }
+};
+
+} // namespace minecpp
+
+#endif // _MINECPP_OCCLUSION_H_
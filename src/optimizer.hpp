@@ -0,0 +1,358 @@
+#ifndef _MINECPP_OPTIMIZER_H_
+#define _MINECPP_OPTIMIZER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <glm/glm.hpp>
+#include "vertex.hpp"
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/****************** MESH OPTIMIZER *******************/
+/*****************************************************/
+/*****************************************************/
+
+// 以先进先出的后变换顶点缓存（post-transform cache）模拟绘制一组索引的结果
+struct VertexCacheStatistics{
+   // 缓存未命中（需要运行一次顶点着色器）的次数
+   std::size_t misses = 0;
+   std::size_t triangles = 0;
+   // 被索引引用的不同顶点数
+   std::size_t vertexes = 0;
+   // average cache miss ratio：每个三角形平均未命中的次数，范围为 [0.5, 3]，越小越好
+   float acmr = 0.0f;
+   // average transformed vertex ratio：每个顶点平均被变换的次数，最优为 1
+   float atvr = 0.0f;
+
+   // 累加另一组索引的结果，用于统计整个模型
+   void add(const VertexCacheStatistics& other){
+      misses += other.misses;
+      triangles += other.triangles;
+      vertexes += other.vertexes;
+      acmr = triangles == 0 ? 0.0f : static_cast<float>(misses) / triangles;
+      atvr = vertexes == 0 ? 0.0f : static_cast<float>(misses) / vertexes;
+   }
+};
+
+// 导入模型时调整三角形和顶点的顺序，不改变绘制的结果：
+// 1. 顶点缓存：按 Tipsify（Sander 等，2007）以顶点为中心成扇形输出三角形，使相邻三角形尽量共用缓存中的顶点
+// 2. 过度绘制：在不明显降低缓存命中率的位置把三角形分成若干簇，朝外的簇先绘制，以便遮挡之后绘制的簇
+// 3. 顶点读取：按索引第一次引用的顺序重新排列顶点，顺序读取顶点数据，同时去掉没有被引用的顶点
+// 所有函数只读写传入的数据，不同的 mesh 可以在不同的线程中优化，见 Model::optimizeMeshes
+class MeshOptimizer{
+public:
+   // 优化前后的缓存统计
+   struct Report{
+      VertexCacheStatistics before;
+      VertexCacheStatistics after;
+   };
+
+   // 大多数 GPU 的后变换缓存相当于 16 到 32 个顶点的先进先出队列，取较小值作为估计
+   static constexpr std::size_t defaultCacheSize = 16;
+   // 分簇时允许的缓存未命中率变差的比例
+   static constexpr float defaultOverdrawThreshold = 1.05f;
+
+private:
+   // 每个顶点所在的三角形：顶点 v 的三角形为 triangles[offsets[v]] 到 triangles[offsets[v + 1]] 之前
+   struct Adjacency{
+      std::vector<unsigned int> offsets;
+      std::vector<unsigned int> triangles;
+   };
+
+   static Adjacency buildAdjacency(const std::vector<unsigned int>& indices, std::size_t vertexNumber){
+      Adjacency adjacency;
+      adjacency.offsets.assign(vertexNumber + 1, 0);
+      for(auto index: indices){
+         adjacency.offsets[index + 1]++;
+      }
+      std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+      adjacency.triangles.resize(indices.size());
+      std::vector<unsigned int> fill {adjacency.offsets.begin(), adjacency.offsets.end() - 1};
+      for(std::size_t i = 0; i < indices.size(); i++){
+         adjacency.triangles[fill[indices[i]]++] = i / 3;
+      }
+      return adjacency;
+   }
+
+   // 与 Tipsify 相同的近似先进先出缓存：顶点进入缓存时记录时间，之后 cacheSize 次未命中内仍在缓存中
+   // 比逐个比较缓存中的顶点快，分簇时需要对每个三角形模拟
+   struct TimestampCache{
+      std::vector<std::size_t> times;
+      std::size_t cacheSize;
+      std::size_t time;
+
+      TimestampCache(std::size_t vertexNumber, std::size_t cacheSize):
+         times(vertexNumber, 0), cacheSize(cacheSize), time(cacheSize + 1){}
+
+      // 返回是否未命中
+      bool access(unsigned int vertex){
+         if(time - times[vertex] > cacheSize){
+            times[vertex] = time++;
+            return true;
+         }
+         return false;
+      }
+      void flush(){
+         time += cacheSize + 1;
+      }
+   };
+
+   // 先在三个顶点都未命中的三角形处分簇（硬边界），这些位置之后的三角形本来就不与之前的共用缓存，调整簇的顺序不影响命中率
+   // 再在每个簇内，当簇开头到当前三角形的未命中率不超过整个簇的 threshold 倍时，再分出一个簇
+   // 分出的簇以清空的缓存开始，所以整体的未命中率最多变差 threshold 倍
+   static std::vector<std::size_t> splitClusters(const std::vector<unsigned int>& indices, std::size_t vertexNumber,
+      std::size_t cacheSize, float threshold){
+      std::size_t triangleNumber = indices.size() / 3;
+      TimestampCache cache {vertexNumber, cacheSize};
+      auto simulate = [&](std::size_t begin, std::size_t end){
+         std::size_t misses = 0;
+         for(std::size_t i = begin * 3; i < end * 3; i++){
+            misses += cache.access(indices[i]);
+         }
+         return misses;
+      };
+      // 第一个簇总是从第一个三角形开始，它可能是退化的三角形（重复的顶点只会未命中一次）
+      std::vector<std::size_t> hardClusters;
+      for(std::size_t i = 0; i < triangleNumber; i++){
+         if(simulate(i, i + 1) == 3 || i == 0){
+            hardClusters.push_back(i);
+         }
+      }
+      std::vector<std::size_t> clusters;
+      for(std::size_t c = 0; c < hardClusters.size(); c++){
+         std::size_t begin = hardClusters[c];
+         std::size_t end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : triangleNumber;
+         cache.flush();
+         float clusterAcmr = static_cast<float>(simulate(begin, end)) / (end - begin);
+         cache.flush();
+         clusters.push_back(begin);
+         std::size_t last = begin;
+         std::size_t misses = 0;
+         for(std::size_t i = begin; i + 1 < end; i++){
+            misses += simulate(i, i + 1);
+            if(static_cast<float>(misses) / (i + 1 - last) <= clusterAcmr * threshold){
+               clusters.push_back(i + 1);
+               last = i + 1;
+               misses = 0;
+               cache.flush();
+            }
+         }
+      }
+      return clusters;
+   }
+
+public:
+   // 以精确的先进先出缓存模拟
+   static VertexCacheStatistics analyzeVertexCache(const std::vector<unsigned int>& indices, std::size_t vertexNumber,
+      std::size_t cacheSize = defaultCacheSize){
+      VertexCacheStatistics statistics;
+      std::vector<unsigned int> cache(cacheSize, std::numeric_limits<unsigned int>::max());
+      std::size_t head = 0;
+      std::vector<bool> used(vertexNumber, false);
+      for(auto index: indices){
+         if(std::find(cache.begin(), cache.end(), index) == cache.end()){
+            cache[head] = index;
+            head = (head + 1) % cacheSize;
+            statistics.misses++;
+         }
+         if(!used[index]){
+            used[index] = true;
+            statistics.vertexes++;
+         }
+      }
+      statistics.triangles = indices.size() / 3;
+      statistics.acmr = statistics.triangles == 0 ? 0.0f : static_cast<float>(statistics.misses) / statistics.triangles;
+      statistics.atvr = statistics.vertexes == 0 ? 0.0f : static_cast<float>(statistics.misses) / statistics.vertexes;
+      return statistics;
+   }
+
+   // 返回重新排列后的索引
+   static std::vector<unsigned int> optimizeVertexCache(const std::vector<unsigned int>& indices, std::size_t vertexNumber,
+      std::size_t cacheSize = defaultCacheSize){
+      std::size_t triangleNumber = indices.size() / 3;
+      Adjacency adjacency = buildAdjacency(indices, vertexNumber);
+      // 每个顶点还没有输出的三角形数
+      std::vector<unsigned int> live(vertexNumber);
+      for(std::size_t i = 0; i < vertexNumber; i++){
+         live[i] = adjacency.offsets[i + 1] - adjacency.offsets[i];
+      }
+      std::vector<std::size_t> cacheTimes(vertexNumber, 0);
+      std::size_t time = cacheSize + 1;
+      std::vector<bool> emitted(triangleNumber, false);
+      // 最近输出的顶点，扇形无法继续时从中寻找下一个中心
+      std::vector<unsigned int> deadEnd;
+      std::vector<unsigned int> candidates;
+      std::size_t cursor = 0;
+      auto skipDeadEnd = [&]() -> long long {
+         while(!deadEnd.empty()){
+            unsigned int vertex = deadEnd.back();
+            deadEnd.pop_back();
+            if(live[vertex] > 0){
+               return vertex;
+            }
+         }
+         for(; cursor < vertexNumber; cursor++){
+            if(live[cursor] > 0){
+               return cursor;
+            }
+         }
+         return -1;
+      };
+
+      std::vector<unsigned int> result;
+      result.reserve(triangleNumber * 3);
+      long long fan = skipDeadEnd();
+      while(fan >= 0){
+         // 输出中心顶点所有剩余的三角形
+         candidates.clear();
+         for(unsigned int i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; i++){
+            unsigned int triangle = adjacency.triangles[i];
+            if(emitted[triangle]){
+               continue;
+            }
+            emitted[triangle] = true;
+            for(std::size_t j = triangle * 3; j < triangle * 3 + 3; j++){
+               unsigned int vertex = indices[j];
+               result.push_back(vertex);
+               deadEnd.push_back(vertex);
+               candidates.push_back(vertex);
+               live[vertex]--;
+               if(time - cacheTimes[vertex] > cacheSize){
+                  cacheTimes[vertex] = time++;
+               }
+            }
+         }
+         // 下一个中心：输出其剩余三角形之后仍在缓存中的顶点里，最早进入缓存的一个
+         long long next = -1;
+         long long best = -1;
+         for(auto vertex: candidates){
+            if(live[vertex] == 0){
+               continue;
+            }
+            long long priority = 0;
+            if(time - cacheTimes[vertex] + 2 * live[vertex] <= cacheSize){
+               priority = time - cacheTimes[vertex];
+            }
+            if(priority > best){
+               best = priority;
+               next = vertex;
+            }
+         }
+         fan = next < 0 ? skipDeadEnd() : next;
+      }
+      return result;
+   }
+
+   // indices 是 optimizeVertexCache 的结果
+   // 把簇按照朝外的程度（簇的中心相对于整个 mesh 中心的偏移在簇的法线上的投影）从大到小排列
+   static std::vector<unsigned int> optimizeOverdraw(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+      std::size_t cacheSize = defaultCacheSize, float threshold = defaultOverdrawThreshold){
+      std::size_t triangleNumber = indices.size() / 3;
+      if(triangleNumber == 0){
+         return indices;
+      }
+      std::vector<std::size_t> clusters = splitClusters(indices, positions.size(), cacheSize, threshold);
+
+      // 以面积加权的中心和法线
+      struct Cluster{
+         std::size_t begin;
+         std::size_t end;
+         glm::vec3 centroid {0.0f};
+         glm::vec3 normal {0.0f};
+         float area = 0.0f;
+         float sortKey = 0.0f;
+      };
+      std::vector<Cluster> infos;
+      glm::vec3 meshCentroid {0.0f};
+      float meshArea = 0.0f;
+      for(std::size_t i = 0; i < clusters.size(); i++){
+         Cluster& cluster = infos.emplace_back();
+         cluster.begin = clusters[i];
+         cluster.end = i + 1 < clusters.size() ? clusters[i + 1] : triangleNumber;
+         for(std::size_t t = cluster.begin; t < cluster.end; t++){
+            const glm::vec3& a = positions[indices[t * 3]];
+            const glm::vec3& b = positions[indices[t * 3 + 1]];
+            const glm::vec3& c = positions[indices[t * 3 + 2]];
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float area = glm::length(normal);
+            cluster.centroid += (a + b + c) * (area / 3.0f);
+            cluster.normal += normal;
+            cluster.area += area;
+         }
+         meshCentroid += cluster.centroid;
+         meshArea += cluster.area;
+         if(cluster.area > 0.0f){
+            cluster.centroid /= cluster.area;
+         }
+      }
+      if(meshArea > 0.0f){
+         meshCentroid /= meshArea;
+      }
+      for(auto& cluster: infos){
+         float length = glm::length(cluster.normal);
+         cluster.sortKey = length > 0.0f ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / length) : 0.0f;
+      }
+      std::stable_sort(infos.begin(), infos.end(), [](const Cluster& a, const Cluster& b){
+         return a.sortKey > b.sortKey;
+      });
+
+      std::vector<unsigned int> result;
+      result.reserve(indices.size());
+      for(auto& cluster: infos){
+         result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+      }
+      return result;
+   }
+
+   // 按索引第一次引用的顺序重新排列所有属性，返回剩余的顶点数
+   template<typename... DataTypes>
+   static std::size_t optimizeVertexFetch(VertexStreams<DataTypes...>& streams){
+      constexpr unsigned int unused = std::numeric_limits<unsigned int>::max();
+      std::vector<unsigned int> remap(streams.size(), unused);
+      unsigned int next = 0;
+      for(auto& index: streams.indices){
+         if(remap[index] == unused){
+            remap[index] = next++;
+         }
+         index = remap[index];
+      }
+      auto reorder = [&remap, next](auto& attribute){
+         std::remove_reference_t<decltype(attribute)> result(next);
+         for(std::size_t i = 0; i < attribute.size(); i++){
+            if(remap[i] != unused){
+               result[remap[i]] = attribute[i];
+            }
+         }
+         attribute = std::move(result);
+      };
+      std::apply([&reorder](auto&... attribute){ (reorder(attribute), ...); }, streams.attributes);
+      return next;
+   }
+
+   // 依次进行三种优化；第一个属性是 glm::vec3（位置）时才进行过度绘制的优化
+   template<typename... DataTypes>
+   static Report optimize(VertexStreams<DataTypes...>& streams, std::size_t cacheSize = defaultCacheSize,
+      float threshold = defaultOverdrawThreshold){
+      Report report;
+      report.before = analyzeVertexCache(streams.indices, streams.size(), cacheSize);
+      streams.indices = optimizeVertexCache(streams.indices, streams.size(), cacheSize);
+      if constexpr (std::same_as<std::tuple_element_t<0, std::tuple<DataTypes...>>, glm::vec3>){
+         streams.indices = optimizeOverdraw(streams.indices, streams.template get<0>(), cacheSize, threshold);
+      }
+      optimizeVertexFetch(streams);
+      report.after = analyzeVertexCache(streams.indices, streams.size(), cacheSize);
+      return report;
+   }
+};
+
+} // namespace minecpp
+
+#endif // _MINECPP_OPTIMIZER_H_
@@ -0,0 +1,224 @@
+#ifndef _MINECPP_PACING_H_
+#define _MINECPP_PACING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "tool.hpp"
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/******************* FRAME PACING ********************/
+/*****************************************************/
+/*****************************************************/
+
+enum class FramePacingMode{
+   // 等待垂直同步，每帧以实际经过的时间推进一次模拟
+   VSYNC,
+   // 不等待垂直同步，帧率只受绘制速度限制，每帧以实际经过的时间推进一次模拟
+   UNCAPPED,
+   // 不等待垂直同步，模拟以固定的步长推进，每帧推进的次数由累计的时间决定；
+   // 绘制时 InterpolatedTransform 在最近两步的结果之间插值，帧率高于模拟频率时运动仍然平滑
+   FIXED_TIMESTEP,
+};
+
+class FramePacer;
+
+// 由模拟（如 ModelMoveSetter 控制的相机）修改、在固定步长模式下绘制时需要插值的变换
+// 模拟之前 value 恢复为最近一步的结果，模拟之后 value 被设置为插值的结果，所以 DrawUnit 可以直接引用 value
+// 模拟之外对 value 的修改（如 GUI）会直接生效，不参与插值
+// 变换只能包含平移、旋转和缩放
+class InterpolatedTransform: public AutoLoader<InterpolatedTransform>{
+friend class FramePacer;
+private:
+   ObservableValue<glm::mat4>& value;
+   // 最近两步模拟的结果
+   glm::mat4 previous;
+   glm::mat4 current;
+   // 上一帧设置的值，用于判断模拟之外是否修改了 value
+   glm::mat4 shown;
+public:
+   // value 的生命周期需要比 InterpolatedTransform 长
+   InterpolatedTransform(ObservableValue<glm::mat4>& value, FramePacer& pacer);
+   InterpolatedTransform(const InterpolatedTransform&) = delete;
+   InterpolatedTransform& operator=(const InterpolatedTransform&) = delete;
+
+   // 分别插值平移、缩放和旋转（球面插值）
+   static glm::mat4 interpolate(const glm::mat4& from, const glm::mat4& to, float alpha);
+};
+
+// 控制帧的节奏：垂直同步、不限帧率，或者固定步长的模拟加上绘制时的插值
+// 每帧调用一次 simulate，它按照模式把经过的时间分成若干步交给模拟函数，见 InputProcessor::processInput
+// 交换间隔由 Drawer 在交换缓冲区之前设置，因为 glfwSwapInterval 需要在持有 gl 上下文的线程中调用
+//
+// 使用方式：
+//    FramePacer& pacer = processor.getPacer();
+//    pacer.setMode(FramePacingMode::FIXED_TIMESTEP);
+//    InterpolatedTransform camera {basicData.viewModel, pacer};
+class FramePacer{
+public:
+   // 返回以毫秒计的当前时间
+   using Clock = std::function<double(void)>;
+
+   struct Statistics{
+      // 上一帧的实际时间，单位为毫秒
+      float frameTime = 0.0f;
+      // 上一帧推进模拟的次数和每次的时间（秒）
+      int steps = 0;
+      float delta = 0.0f;
+      // 固定步长模式下绘制时的插值系数
+      float alpha = 1.0f;
+      // 因为落后太多而丢弃的模拟时间，单位为毫秒
+      float droppedTime = 0.0f;
+   };
+
+   static double steadyClock(){
+      using namespace std::chrono;
+      return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+   }
+
+private:
+   FramePacingMode mode;
+   // 固定步长，单位为秒
+   double step;
+   // 每帧最多推进的次数，避免模拟本身太慢时越积越多
+   int maxSteps = 5;
+   bool deterministic = false;
+   Clock clock;
+   double lastTime = -1.0;
+   double accumulator = 0.0;
+   Statistics statistics;
+   RefContainer<InterpolatedTransform> transforms;
+
+   // 需要设置的交换间隔，-1 表示没有变化
+   static inline std::atomic<int> pendingSwapInterval = -1;
+
+public:
+   explicit FramePacer(FramePacingMode mode = FramePacingMode::VSYNC, double step = 1.0 / 60.0, Clock clock = steadyClock):
+      step(step), clock(std::move(clock)){
+      setMode(mode);
+   }
+   FramePacer(const FramePacer&) = delete;
+   FramePacer& operator=(const FramePacer&) = delete;
+
+   void setMode(FramePacingMode mode){
+      this->mode = mode;
+      pendingSwapInterval = mode == FramePacingMode::VSYNC ? 1 : 0;
+      accumulator = 0.0;
+   }
+   FramePacingMode getMode() const { return mode; }
+   void setStep(double step){
+      this->step = step;
+   }
+   double getStep() const { return step; }
+   void setMaxSteps(int maxSteps){
+      this->maxSteps = std::max(1, maxSteps);
+   }
+   // 每帧视为恰好经过了一个步长，与实际时间无关；用于无窗口的性能测试，使每次运行的模拟结果相同
+   void setDeterministic(bool deterministic){
+      this->deterministic = deterministic;
+   }
+   bool isDeterministic() const { return deterministic; }
+   const Statistics& getStatistics() const { return statistics; }
+
+   // 推进本帧的模拟：以每一步的时间（秒）调用 step 若干次，之后更新插值的变换
+   void simulate(const std::function<void(float delta)>& stepFunc);
+
+   // 在持有 gl 上下文的线程中调用，设置之前 setMode 请求的交换间隔
+   static void applySwapInterval(){
+      int interval = pendingSwapInterval.exchange(-1);
+      if(interval >= 0){
+         glfwSwapInterval(interval);
+      }
+   }
+
+   RefContainer<InterpolatedTransform>& getTransformContainer() { return transforms; }
+};
+
+inline InterpolatedTransform::InterpolatedTransform(ObservableValue<glm::mat4>& value, FramePacer& pacer):
+   value(value), previous(value.get()), current(value.get()), shown(value.get()),
+   AutoLoader<InterpolatedTransform>(pacer.getTransformContainer()){}
+
+inline glm::mat4 InterpolatedTransform::interpolate(const glm::mat4& from, const glm::mat4& to, float alpha){
+   auto decompose = [](const glm::mat4& matrix, glm::vec3& translation, glm::vec3& scale, glm::quat& rotation){
+      translation = glm::vec3(matrix[3]);
+      scale = {glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))};
+      rotation = glm::quat_cast(glm::mat3(glm::vec3(matrix[0]) / scale.x, glm::vec3(matrix[1]) / scale.y, glm::vec3(matrix[2]) / scale.z));
+   };
+   glm::vec3 fromTranslation, toTranslation, fromScale, toScale;
+   glm::quat fromRotation, toRotation;
+   decompose(from, fromTranslation, fromScale, fromRotation);
+   decompose(to, toTranslation, toScale, toRotation);
+   glm::mat4 result = glm::mat4_cast(glm::slerp(fromRotation, toRotation, alpha));
+   glm::vec3 scale = glm::mix(fromScale, toScale, alpha);
+   result[0] *= scale.x;
+   result[1] *= scale.y;
+   result[2] *= scale.z;
+   result[3] = glm::vec4(glm::mix(fromTranslation, toTranslation, alpha), 1.0f);
+   return result;
+}
+
+inline void FramePacer::simulate(const std::function<void(float delta)>& stepFunc){
+   double now = clock();
+   double elapsed = lastTime < 0.0 ? 0.0 : (now - lastTime) / 1000.0;
+   lastTime = now;
+   if(deterministic){
+      elapsed = step;
+   }
+   statistics.frameTime = elapsed * 1000.0;
+   statistics.droppedTime = 0.0f;
+
+   // 恢复为模拟的结果；上一帧之后被其他代码修改过的变换以修改后的值为准
+   for(InterpolatedTransform& transform: transforms){
+      if(transform.value.get() != transform.shown){
+         transform.previous = transform.current = transform.value.get();
+      }else{
+         *transform.value = transform.current;
+      }
+   }
+
+   int steps = 1;
+   double delta = elapsed;
+   if(mode == FramePacingMode::FIXED_TIMESTEP){
+      accumulator += elapsed;
+      int available = static_cast<int>(accumulator / step);
+      accumulator -= available * step;
+      steps = std::min(available, maxSteps);
+      statistics.droppedTime = (available - steps) * step * 1000.0;
+      delta = step;
+   }else{
+      // 长时间的停顿（如拖动窗口）不应让模拟一次跳得太远
+      delta = std::min(elapsed, step * maxSteps);
+   }
+   for(int i = 0; i < steps; i++){
+      for(InterpolatedTransform& transform: transforms){
+         transform.previous = transform.value.get();
+      }
+      stepFunc(static_cast<float>(delta));
+   }
+
+   float alpha = mode == FramePacingMode::FIXED_TIMESTEP ? static_cast<float>(accumulator / step) : 1.0f;
+   for(InterpolatedTransform& transform: transforms){
+      transform.current = transform.value.get();
+      transform.shown = mode == FramePacingMode::FIXED_TIMESTEP ?
+         InterpolatedTransform::interpolate(transform.previous, transform.current, alpha) : transform.current;
+      *transform.value = transform.shown;
+      transform.value.mayNotify();
+   }
+   statistics.steps = steps;
+   statistics.delta = static_cast<float>(delta);
+   statistics.alpha = alpha;
+}
+
+} // namespace minecpp
+
+#endif // _MINECPP_PACING_H_
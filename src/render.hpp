@@ -0,0 +1,141 @@
+#ifndef _MINECPP_RENDER_H_
+#define _MINECPP_RENDER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <string>
+#include <thread>
+#include "resource.hpp"
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/******************* RENDER THREAD *******************/
+/*****************************************************/
+/*****************************************************/
+
+// 持有 gl 上下文的渲染线程
+// 主线程处理输入、构建 GUI、更新场景，然后将状态复制到一个快照槽中提交；渲染线程依据快照绘制
+// 快照有两个槽，主线程构建第 n 帧的同时渲染线程绘制第 n - 1 帧，一帧的耗时接近 max(主线程, 渲染线程)
+// 同步只使用原子变量的 wait/notify，没有锁
+//
+// 使用方式：
+//    RenderThread renderThread {[&](int slot){ drawer.drawSnapshot(slot); }};
+//    int slot = renderThread.acquire();
+//    drawer.takeSnapshot(slot);
+//    renderThread.submit();
+// 注意：
+// 1. 创建后主线程不再持有 gl 上下文，需要 gl 的操作（创建资源、增删 DrawUnit 等）通过 execute 在渲染线程中执行
+// 2. 主线程在 acquire 和 submit 之间写入的槽不会被渲染线程读取
+class RenderThread{
+private:
+   // 主线程提交的帧数（包括 execute 的任务）
+   std::atomic<std::uint64_t> submitted {0};
+   // 渲染线程完成的帧数
+   std::atomic<std::uint64_t> rendered {0};
+   std::atomic<bool> stopped {false};
+   std::function<void(int)> render;
+   // 不为空时，下一次提交执行该任务而不是绘制
+   const std::function<void(void)>* task = nullptr;
+   std::exception_ptr error;
+   std::thread thread;
+
+   void run(){
+      glfwMakeContextCurrent(Context::getInstance().getWindow());
+      std::uint64_t frame = 0;
+      try{
+         while(true){
+            submitted.wait(frame);
+            if(stopped){
+               break;
+            }
+            if(task != nullptr){
+               (*task)();
+               task = nullptr;
+            }else{
+               render(frame % 2);
+            }
+            frame++;
+            rendered = frame;
+            rendered.notify_all();
+         }
+      }catch(...){
+         // 异常交给主线程重新抛出
+         error = std::current_exception();
+         rendered = std::numeric_limits<std::uint64_t>::max();
+         rendered.notify_all();
+      }
+      glfwMakeContextCurrent(nullptr);
+   }
+
+   void waitRendered(std::uint64_t frame){
+      auto current = rendered.load();
+      while(current < frame){
+         rendered.wait(current);
+         current = rendered.load();
+      }
+      // 渲染线程已经退出，之后的每次等待都重新抛出同一个异常，而不是假装绘制了
+      if(error){
+         std::rethrow_exception(error);
+      }
+   }
+
+public:
+   // render(slot)：在渲染线程中绘制 slot 中的快照
+   RenderThread(std::function<void(int slot)> render): render(std::move(render)){
+      // 一个上下文同一时刻只能是一个线程的当前上下文
+      glfwMakeContextCurrent(nullptr);
+      thread = std::thread([this]{run();});
+   }
+   ~RenderThread(){
+      try{
+         synchronize();
+      }catch(...){}
+      stopped = true;
+      submitted++;
+      submitted.notify_all();
+      thread.join();
+      glfwMakeContextCurrent(Context::getInstance().getWindow());
+   }
+   RenderThread(const RenderThread&) = delete;
+   RenderThread& operator=(const RenderThread&) = delete;
+
+   // 环境变量 MINECPP_RENDER_THREAD 为 0 时不使用渲染线程，在主线程中绘制，便于调试
+   static bool isEnabledByEnvironment(){
+      const char* value = std::getenv("MINECPP_RENDER_THREAD");
+      return value == nullptr || std::string(value) != "0";
+   }
+
+   // 返回本帧可以写入的快照槽，必要时等待渲染线程读完该槽上一次的内容（即等待上上一帧绘制完成）
+   int acquire(){
+      auto frame = submitted.load();
+      waitRendered(frame > 0 ? frame - 1 : 0);
+      return frame % 2;
+   }
+   // 提交 acquire 得到的槽
+   void submit(){
+      submitted++;
+      submitted.notify_one();
+   }
+   // 等待所有已提交的帧绘制完成
+   void synchronize(){
+      waitRendered(submitted.load());
+   }
+   // 在渲染线程中执行 func 并等待其完成，期间渲染线程不会绘制
+   void execute(const std::function<void(void)>& func){
+      synchronize();
+      task = &func;
+      submit();
+      synchronize();
+   }
+};
+
+} // namespace minecpp
+
+#endif // _MINECPP_RENDER_H_
@@ -0,0 +1,550 @@
+#ifndef _MINECPP_RENDERGRAPH_H_
+#define _MINECPP_RENDERGRAPH_H_
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "resource.hpp"
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/******************* RENDER GRAPH ********************/
+/*****************************************************/
+/*****************************************************/
+
+// 渲染图中纹理的格式和大小；width 和 height 为 0 时使用视口大小乘以 scale
+struct RenderTextureDesc{
+   GLenum format = GL_RGBA8;
+   float scale = 1.0f;
+   int width = 0;
+   int height = 0;
+   // 第一次写入前清除成的颜色，深度纹理总是清除为 1
+   std::array<float, 4> clearColor {};
+};
+
+// 由若干 pass 组成的一帧的绘制流程，每个 pass 声明自己读取和写入的纹理
+// compile 根据声明：
+// 1. 推导 pass 的执行顺序：同一纹理的写入按声明顺序进行，读取在它的所有写入之后
+// 2. 剔除对输出没有贡献的 pass，输出为窗口（importBackbuffer）以及 markOutput 标记的纹理
+// 3. 计算每个临时纹理的生命周期（第一次和最后一次被使用的 pass），
+//    格式和大小相同、生命周期不重叠的纹理共用同一张实际的纹理
+// compile 只进行 CPU 上的计算，实际的纹理和帧缓冲在 execute 中第一次用到时创建
+//
+// 使用方式：
+//    RenderGraph graph;
+//    auto color = graph.createTexture("color", {GL_RGBA16F});
+//    auto depth = graph.createTexture("depth", {GL_DEPTH_COMPONENT24});
+//    auto backbuffer = graph.importBackbuffer();
+//    graph.addPass("scene", [&](auto& builder){ builder.write(color); builder.write(depth); },
+//       [&](auto& ctx){ drawer.drawScene(); });
+//    graph.addPass("tonemap", [&](auto& builder){ builder.read(color); builder.write(backbuffer); },
+//       [&](auto& ctx){ TextureUnit::getInstance().bindUnit(0, ctx.getTexture(color)); ... });
+//    drawer.setPipeline([&](int width, int height){ graph.execute(width, height); });
+// 注意：
+// 1. 临时纹理在第一个写入它的 pass 执行前被清除（颜色为 0，深度为 1），之前的内容是未定义的
+// 2. 写入窗口的 pass 不能同时写入其他纹理，窗口也不能被读取
+class RenderGraph{
+public:
+   using Handle = int;
+
+   class PassBuilder{
+   private:
+      RenderGraph& graph;
+      int pass;
+   public:
+      PassBuilder(RenderGraph& graph, int pass): graph(graph), pass(pass){}
+      // 作为纹理读取
+      void read(Handle texture){
+         graph.checkHandle(texture);
+         graph.passes[pass].reads.push_back(texture);
+      }
+      // 作为帧缓冲的附件写入，颜色附件的顺序即调用 write 的顺序
+      void write(Handle texture){
+         graph.checkHandle(texture);
+         graph.passes[pass].writes.push_back(texture);
+      }
+   };
+
+   class PassContext{
+   private:
+      RenderGraph& graph;
+      int pass;
+      int width;
+      int height;
+   public:
+      PassContext(RenderGraph& graph, int pass, int width, int height): graph(graph), pass(pass), width(width), height(height){}
+      // 获取本 pass 声明读取或写入的纹理
+      const RenderTexture& getTexture(Handle texture) const {
+         return graph.getTexture(pass, texture);
+      }
+      // 本 pass 渲染目标的大小，已经设置为视口
+      int getWidth() const { return width; }
+      int getHeight() const { return height; }
+   };
+
+   struct Statistics{
+      int passNumber = 0;
+      int culledPassNumber = 0;
+      // 执行的 pass 用到的临时纹理数
+      int textureNumber = 0;
+      // 实际创建的纹理数
+      int physicalTextureNumber = 0;
+      // 不共用纹理时需要的显存和实际需要的显存，单位为字节
+      std::size_t requiredBytes = 0;
+      std::size_t allocatedBytes = 0;
+
+      std::size_t getSavedBytes() const { return requiredBytes - allocatedBytes; }
+   };
+
+private:
+   struct TextureNode{
+      std::string name;
+      RenderTextureDesc desc;
+      bool backbuffer = false;
+      bool output = false;
+      // 以下在 compile 中计算
+      int width = 0;
+      int height = 0;
+      int physical = -1;
+      int firstUse = -1;
+      int lastUse = -1;
+   };
+   struct PassNode{
+      std::string name;
+      std::vector<Handle> reads;
+      std::vector<Handle> writes;
+      std::function<void(PassContext&)> execute;
+      bool culled = false;
+   };
+   struct PhysicalTexture{
+      int width;
+      int height;
+      GLenum format;
+      // 最后一个使用它的 pass 在执行顺序中的位置
+      int lastUse;
+      std::unique_ptr<RenderTexture> texture;
+   };
+
+   std::vector<TextureNode> textures;
+   std::vector<PassNode> passes;
+   // 按执行顺序排列的未被剔除的 pass
+   std::vector<int> order;
+   std::vector<PhysicalTexture> physicalTextures;
+   // 以颜色附件和深度附件对应的实际纹理为键
+   std::map<std::vector<int>, Framebuffer> framebuffers;
+   Statistics statistics;
+   bool compiled = false;
+   int compiledWidth = 0;
+   int compiledHeight = 0;
+
+   void checkHandle(Handle texture) const {
+      if(texture < 0 || texture >= static_cast<int>(textures.size())){
+         throwError(fmt::format("invalid render graph texture handle {}", texture));
+      }
+   }
+
+   const RenderTexture& getTexture(int pass, Handle texture){
+      checkHandle(texture);
+      auto& node = passes[pass];
+      if(std::find(node.reads.begin(), node.reads.end(), texture) == node.reads.end() &&
+         std::find(node.writes.begin(), node.writes.end(), texture) == node.writes.end()){
+         throwError(fmt::format("pass {} does not declare texture {}", node.name, textures[texture].name));
+      }
+      if(textures[texture].backbuffer){
+         throwError("backbuffer can not be used as a texture");
+      }
+      return getPhysicalTexture(textures[texture].physical);
+   }
+
+   const RenderTexture& getPhysicalTexture(int physical){
+      auto& texture = physicalTextures[physical];
+      if(texture.texture == nullptr){
+         texture.texture = std::make_unique<RenderTexture>(texture.width, texture.height, texture.format);
+      }
+      return *texture.texture;
+   }
+
+   void validate() const;
+   void sortPasses(std::vector<int>& sorted) const;
+   void cullPasses();
+   void allocateTextures(int viewportWidth, int viewportHeight);
+   void executePass(int index, int viewportWidth, int viewportHeight);
+
+public:
+   RenderGraph() = default;
+   // 纹理和帧缓冲之间有引用关系，不能移动和拷贝
+   RenderGraph(const RenderGraph&) = delete;
+   RenderGraph& operator=(const RenderGraph&) = delete;
+
+   // 创建临时纹理，它的内容只在一帧之内有效
+   Handle createTexture(const std::string& name, const RenderTextureDesc& desc){
+      getPixelFormat(desc.format);
+      textures.push_back({name, desc});
+      compiled = false;
+      return textures.size() - 1;
+   }
+   // 修改纹理的格式或大小，下一次 execute 时重新 compile
+   void setTextureDesc(Handle texture, const RenderTextureDesc& desc){
+      checkHandle(texture);
+      getPixelFormat(desc.format);
+      textures[texture].desc = desc;
+      compiled = false;
+   }
+   // 窗口的默认帧缓冲，写入它的 pass 总是会执行
+   Handle importBackbuffer(){
+      for(int i = 0; i < static_cast<int>(textures.size()); i++){
+         if(textures[i].backbuffer){
+            return i;
+         }
+      }
+      textures.push_back({"backbuffer", {}, true, true});
+      compiled = false;
+      return textures.size() - 1;
+   }
+   // 标记为输出的纹理在帧结束时仍然有效（可以在之后通过 getTexture 获取），写入它的 pass 总是会执行
+   void markOutput(Handle texture){
+      checkHandle(texture);
+      textures[texture].output = true;
+      compiled = false;
+   }
+   // setup 中通过 PassBuilder 声明读写的纹理，execute 在执行时调用，此时已经绑定好帧缓冲和视口
+   void addPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, std::function<void(PassContext&)> execute){
+      passes.push_back({name, {}, {}, std::move(execute)});
+      PassBuilder builder {*this, static_cast<int>(passes.size() - 1)};
+      setup(builder);
+      compiled = false;
+   }
+
+   // 按照视口大小推导执行顺序、剔除 pass 并分配纹理，不调用 gl
+   void compile(int viewportWidth, int viewportHeight);
+   // 需要时重新 compile，然后依次执行 pass；结束时绑定默认帧缓冲并恢复视口
+   void execute(int viewportWidth, int viewportHeight);
+
+   // 按执行顺序排列的 pass 名
+   std::vector<std::string> getPassOrder() const {
+      std::vector<std::string> names;
+      for(int pass: order){
+         names.push_back(passes[pass].name);
+      }
+      return names;
+   }
+   std::vector<std::string> getCulledPasses() const {
+      std::vector<std::string> names;
+      for(auto& pass: passes){
+         if(pass.culled){
+            names.push_back(pass.name);
+         }
+      }
+      return names;
+   }
+   // 纹理对应的实际纹理的编号，相同表示两者共用显存；窗口和没有用到的纹理为 -1
+   int getPhysicalIndex(Handle texture) const {
+      checkHandle(texture);
+      return textures[texture].physical;
+   }
+   // 获取标记为输出的纹理
+   const RenderTexture& getTexture(Handle texture){
+      checkHandle(texture);
+      if(!textures[texture].output || textures[texture].physical < 0){
+         throwError(fmt::format("texture {} is not an output", textures[texture].name));
+      }
+      return getPhysicalTexture(textures[texture].physical);
+   }
+   const Statistics& getStatistics() const { return statistics; }
+};
+
+inline void RenderGraph::validate() const {
+   for(auto& pass: passes){
+      bool backbuffer = false;
+      int depthNumber = 0;
+      for(Handle texture: pass.writes){
+         if(textures[texture].backbuffer){
+            backbuffer = true;
+         }else if(getPixelFormat(textures[texture].desc.format).depth){
+            depthNumber++;
+         }
+         if(std::find(pass.reads.begin(), pass.reads.end(), texture) != pass.reads.end()){
+            throwError(fmt::format("pass {} reads and writes texture {} at the same time", pass.name, textures[texture].name));
+         }
+      }
+      if(backbuffer && pass.writes.size() > 1){
+         throwError(fmt::format("pass {} writes backbuffer together with other textures", pass.name));
+      }
+      if(depthNumber > 1){
+         throwError(fmt::format("pass {} writes more than one depth texture", pass.name));
+      }
+      for(Handle texture: pass.reads){
+         if(textures[texture].backbuffer){
+            throwError(fmt::format("pass {} reads backbuffer", pass.name));
+         }
+      }
+   }
+}
+
+inline void RenderGraph::sortPasses(std::vector<int>& sorted) const {
+   // 每个纹理的写入者，按声明顺序
+   std::vector<std::vector<int>> writers(textures.size());
+   for(int i = 0; i < static_cast<int>(passes.size()); i++){
+      for(Handle texture: passes[i].writes){
+         writers[texture].push_back(i);
+      }
+   }
+   // 依赖关系：同一纹理的写入者按声明顺序依次依赖，读取者依赖所有写入者
+   std::vector<std::set<int>> successors(passes.size());
+   for(auto& list: writers){
+      for(int i = 1; i < static_cast<int>(list.size()); i++){
+         successors[list[i - 1]].insert(list[i]);
+      }
+   }
+   for(int i = 0; i < static_cast<int>(passes.size()); i++){
+      for(Handle texture: passes[i].reads){
+         if(writers[texture].empty()){
+            throwError(fmt::format("pass {} reads texture {} which is never written", passes[i].name, textures[texture].name));
+         }
+         for(int writer: writers[texture]){
+            successors[writer].insert(i);
+         }
+      }
+   }
+   std::vector<int> inDegree(passes.size(), 0);
+   for(auto& list: successors){
+      for(int next: list){
+         inDegree[next]++;
+      }
+   }
+   // 可以执行的 pass 中总是选择最先声明的，没有依赖关系的 pass 保持声明顺序
+   std::set<int> ready;
+   for(int i = 0; i < static_cast<int>(passes.size()); i++){
+      if(inDegree[i] == 0){
+         ready.insert(i);
+      }
+   }
+   sorted.clear();
+   while(!ready.empty()){
+      int pass = *ready.begin();
+      ready.erase(ready.begin());
+      sorted.push_back(pass);
+      for(int next: successors[pass]){
+         if(--inDegree[next] == 0){
+            ready.insert(next);
+         }
+      }
+   }
+   if(sorted.size() != passes.size()){
+      throwError("render graph has a dependency cycle");
+   }
+}
+
+inline void RenderGraph::cullPasses(){
+   // 从写入输出的 pass 开始，沿着读取关系反向标记需要执行的 pass
+   std::vector<std::vector<int>> writers(textures.size());
+   for(int i = 0; i < static_cast<int>(passes.size()); i++){
+      for(Handle texture: passes[i].writes){
+         writers[texture].push_back(i);
+      }
+   }
+   std::vector<int> stack;
+   for(auto& pass: passes){
+      pass.culled = true;
+   }
+   for(int i = 0; i < static_cast<int>(textures.size()); i++){
+      if(textures[i].output){
+         stack.insert(stack.end(), writers[i].begin(), writers[i].end());
+      }
+   }
+   while(!stack.empty()){
+      int pass = stack.back();
+      stack.pop_back();
+      if(!passes[pass].culled){
+         continue;
+      }
+      passes[pass].culled = false;
+      // 读取的纹理，以及写入的纹理中之前的内容（如混合到之前 pass 的结果上）
+      for(auto list: {&passes[pass].reads, &passes[pass].writes}){
+         for(Handle texture: *list){
+            for(int writer: writers[texture]){
+               if(writer != pass && (list == &passes[pass].reads || writer < pass)){
+                  stack.push_back(writer);
+               }
+            }
+         }
+      }
+   }
+}
+
+inline void RenderGraph::allocateTextures(int viewportWidth, int viewportHeight){
+   for(auto& texture: textures){
+      texture.physical = -1;
+      texture.firstUse = -1;
+      texture.lastUse = -1;
+      if(texture.desc.width > 0 && texture.desc.height > 0){
+         texture.width = texture.desc.width;
+         texture.height = texture.desc.height;
+      }else{
+         texture.width = std::max(1, static_cast<int>(viewportWidth * texture.desc.scale));
+         texture.height = std::max(1, static_cast<int>(viewportHeight * texture.desc.scale));
+      }
+   }
+   for(int i = 0; i < static_cast<int>(order.size()); i++){
+      auto& pass = passes[order[i]];
+      for(auto list: {&pass.reads, &pass.writes}){
+         for(Handle texture: *list){
+            auto& node = textures[texture];
+            if(node.firstUse < 0){
+               node.firstUse = i;
+            }
+            node.lastUse = i;
+         }
+      }
+   }
+   // 按第一次使用的顺序分配，优先复用已经不再使用的相同规格的纹理
+   std::vector<int> sorted;
+   for(int i = 0; i < static_cast<int>(textures.size()); i++){
+      if(!textures[i].backbuffer && textures[i].firstUse >= 0){
+         sorted.push_back(i);
+      }
+   }
+   std::stable_sort(sorted.begin(), sorted.end(), [this](int a, int b){
+      return textures[a].firstUse < textures[b].firstUse;
+   });
+   physicalTextures.clear();
+   for(int index: sorted){
+      auto& texture = textures[index];
+      int lastUse = texture.output ? std::numeric_limits<int>::max() : texture.lastUse;
+      for(int i = 0; i < static_cast<int>(physicalTextures.size()); i++){
+         auto& physical = physicalTextures[i];
+         if(physical.lastUse < texture.firstUse && physical.width == texture.width &&
+            physical.height == texture.height && physical.format == texture.desc.format){
+            texture.physical = i;
+            physical.lastUse = lastUse;
+            break;
+         }
+      }
+      if(texture.physical < 0){
+         texture.physical = physicalTextures.size();
+         physicalTextures.push_back({texture.width, texture.height, texture.desc.format, lastUse, nullptr});
+      }
+      std::size_t bytes = static_cast<std::size_t>(texture.width) * texture.height * getPixelFormat(texture.desc.format).bytes;
+      statistics.requiredBytes += bytes;
+      statistics.textureNumber++;
+   }
+   for(auto& physical: physicalTextures){
+      statistics.allocatedBytes += static_cast<std::size_t>(physical.width) * physical.height * getPixelFormat(physical.format).bytes;
+   }
+   statistics.physicalTextureNumber = physicalTextures.size();
+}
+
+inline void RenderGraph::compile(int viewportWidth, int viewportHeight){
+   validate();
+   std::vector<int> sorted;
+   sortPasses(sorted);
+   cullPasses();
+   order.clear();
+   for(int pass: sorted){
+      if(!passes[pass].culled){
+         order.push_back(pass);
+      }
+   }
+   statistics = {};
+   statistics.passNumber = order.size();
+   statistics.culledPassNumber = passes.size() - order.size();
+   allocateTextures(viewportWidth, viewportHeight);
+   // 实际纹理重新分配了，之前的帧缓冲也随之失效
+   framebuffers.clear();
+   compiled = true;
+   compiledWidth = viewportWidth;
+   compiledHeight = viewportHeight;
+}
+
+inline void RenderGraph::executePass(int index, int viewportWidth, int viewportHeight){
+   auto& pass = passes[order[index]];
+   GpuScope scope {pass.name};
+   int width = viewportWidth;
+   int height = viewportHeight;
+   if(!pass.writes.empty() && textures[pass.writes[0]].backbuffer){
+      FramebufferContext::getInstance().unBind();
+   }else if(!pass.writes.empty()){
+      std::vector<int> key;
+      int depth = -1;
+      for(Handle texture: pass.writes){
+         if(getPixelFormat(textures[texture].desc.format).depth){
+            depth = texture;
+         }else{
+            key.push_back(textures[texture].physical);
+         }
+      }
+      // 颜色附件和深度附件之间用 -1 分隔
+      key.push_back(-1);
+      if(depth >= 0){
+         key.push_back(textures[depth].physical);
+      }
+      auto it = framebuffers.find(key);
+      if(it == framebuffers.end()){
+         std::vector<const RenderTexture*> colors;
+         for(Handle texture: pass.writes){
+            if(texture != depth){
+               colors.push_back(&getPhysicalTexture(textures[texture].physical));
+            }
+         }
+         const RenderTexture* depthTexture = depth >= 0 ? &getPhysicalTexture(textures[depth].physical) : nullptr;
+         it = framebuffers.emplace(key, Framebuffer(colors, depthTexture)).first;
+      }
+      FramebufferContext::getInstance().bindContext(it->second);
+      width = textures[pass.writes[0]].width;
+      height = textures[pass.writes[0]].height;
+   }
+   glViewport(0, 0, width, height);
+
+   // 第一次写入的临时纹理需要清除，共用的纹理中还留着之前的内容
+   int colorIndex = 0;
+   for(Handle texture: pass.writes){
+      auto& node = textures[texture];
+      bool depth = !node.backbuffer && getPixelFormat(node.desc.format).depth;
+      if(!node.backbuffer && node.firstUse == index){
+         if(depth){
+            glDepthMask(GL_TRUE);
+            if(getPixelFormat(node.desc.format).stencil){
+               glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+            }else{
+               const GLfloat one = 1.0f;
+               glClearBufferfv(GL_DEPTH, 0, &one);
+            }
+         }else{
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glClearBufferfv(GL_COLOR, colorIndex, node.desc.clearColor.data());
+         }
+      }
+      if(!depth){
+         colorIndex++;
+      }
+   }
+   checkGLError();
+
+   PassContext context {*this, order[index], width, height};
+   pass.execute(context);
+}
+
+inline void RenderGraph::execute(int viewportWidth, int viewportHeight){
+   if(!compiled || compiledWidth != viewportWidth || compiledHeight != viewportHeight){
+      compile(viewportWidth, viewportHeight);
+   }
+   for(int i = 0; i < static_cast<int>(order.size()); i++){
+      executePass(i, viewportWidth, viewportHeight);
+   }
+   FramebufferContext::getInstance().unBind();
+   glViewport(0, 0, viewportWidth, viewportHeight);
+   checkGLError();
+}
+
+} // namespace minecpp
+
+#endif // _MINECPP_RENDERGRAPH_H_
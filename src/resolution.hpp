@@ -0,0 +1,217 @@
+#ifndef _MINECPP_RESOLUTION_H_
+#define _MINECPP_RESOLUTION_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include "resource.hpp"
+#include "rendergraph.hpp"
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/**************** DYNAMIC RESOLUTION *****************/
+/*****************************************************/
+/*****************************************************/
+
+struct DynamicResolutionOption{
+   // 渲染分辨率相对窗口大小的缩放范围
+   float minScale = 0.5f;
+   float maxScale = 1.0f;
+   // 场景绘制的 GPU 时间目标，单位为毫秒
+   float targetFrameTime = 12.0f;
+   // 放大时的锐化强度，0 为普通的双线性放大
+   float sharpness = 0.5f;
+};
+
+// 根据测得的 GPU 时间调整渲染分辨率的缩放，不调用 gl
+class ResolutionController{
+private:
+   float scale = 1.0f;
+   // 平滑后的 GPU 时间，小于 0 表示还没有数据
+   float smoothedTime = -1.0f;
+   // 改变缩放后的几帧内测得的时间还是之前的分辨率的，跳过这些帧
+   int cooldown = 0;
+
+public:
+   static constexpr float smoothing = 0.2f;
+   // 只在预期的缩放变化超过 step 时调整，避免来回抖动
+   static constexpr float step = 0.05f;
+   // 每次调整的最大幅度
+   static constexpr float maxChange = 0.1f;
+   // 目标留出的余量
+   static constexpr float headroom = 0.9f;
+   static constexpr int cooldownFrames = 4;
+
+   float getScale() const { return scale; }
+
+   // gpuTime：最近一帧场景绘制的 GPU 时间，单位为毫秒；返回新的缩放
+   float update(float gpuTime, float minScale, float maxScale, float targetTime){
+      scale = std::clamp(scale, minScale, maxScale);
+      if(cooldown > 0){
+         cooldown--;
+         return scale;
+      }
+      smoothedTime = smoothedTime < 0.0f ? gpuTime : smoothedTime + (gpuTime - smoothedTime) * smoothing;
+      if(smoothedTime <= 0.0f){
+         return scale;
+      }
+      // 片段着色的开销大致和像素数，也就是缩放的平方成正比
+      float desired = scale * std::sqrt(targetTime * headroom / smoothedTime);
+      desired = std::clamp(desired, minScale, maxScale);
+      if(std::abs(desired - scale) >= step || (desired != scale && (desired == minScale || desired == maxScale))){
+         scale += std::clamp(desired - scale, -maxChange, maxChange);
+         // 新分辨率下的时间需要重新测量
+         smoothedTime = -1.0f;
+         cooldown = cooldownFrames;
+      }
+      return scale;
+   }
+};
+
+// 动态分辨率：场景绘制到离屏纹理中，分辨率的缩放每帧由 GPU 计时器测得的时间调整，
+// 再经过锐化放大到窗口；Drawer::draw 的 customDraw（GUI）仍然以窗口的分辨率直接绘制
+// 离屏纹理按最大缩放分配，较低的分辨率只使用它左下角的一部分，因此调整缩放时不需要重新创建纹理
+// 创建时需要 gl 上下文，创建后会替换 drawer 的 pipeline；选项和统计可以在主线程中读写
+class DynamicResolution{
+private:
+   Drawer& drawer;
+   RenderGraph graph;
+   RenderGraph::Handle color;
+   RenderGraph::Handle depth;
+   FullscreenPass upscalePass;
+
+   // 延迟几帧读取计时结果，轮流使用多个查询对象
+   static constexpr int timerQueryNumber = 3;
+   std::array<Query<GL_TIME_ELAPSED>, timerQueryNumber> timerQueries;
+   std::array<bool, timerQueryNumber> timerPending {};
+   int timerIndex = 0;
+   ResolutionController controller;
+
+   std::atomic<float> minScale;
+   std::atomic<float> maxScale;
+   std::atomic<float> targetFrameTime;
+   std::atomic<float> sharpness;
+   std::atomic<bool> enabled = true;
+   // 分配离屏纹理时使用的最大缩放
+   float allocatedScale;
+   std::atomic<float> scale;
+   std::atomic<float> gpuTime = 0.0f;
+   std::atomic<int> renderWidth = 0;
+   std::atomic<int> renderHeight = 0;
+
+   void render(int width, int height);
+   void drawScene(RenderGraph::PassContext& context);
+   void upscale(RenderGraph::PassContext& context);
+
+public:
+   DynamicResolution(Drawer& drawer, const DynamicResolutionOption& option = {});
+   ~DynamicResolution(){
+      drawer.setPipeline(nullptr);
+   }
+   DynamicResolution(const DynamicResolution&) = delete;
+   DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+   void setOption(const DynamicResolutionOption& option){
+      minScale = std::max(0.1f, option.minScale);
+      maxScale = std::max(minScale.load(), option.maxScale);
+      targetFrameTime = option.targetFrameTime;
+      sharpness = option.sharpness;
+   }
+   DynamicResolutionOption getOption() const {
+      return {minScale, maxScale, targetFrameTime, sharpness};
+   }
+   // 关闭时以最大缩放绘制
+   void enable(bool enable){
+      enabled = enable;
+   }
+   bool isEnabled() const { return enabled; }
+
+   float getScale() const { return scale; }
+   // 最近一次测得的场景绘制（包括放大）的 GPU 时间，单位为毫秒
+   float getGpuTime() const { return gpuTime; }
+   int getRenderWidth() const { return renderWidth; }
+   int getRenderHeight() const { return renderHeight; }
+};
+
+inline DynamicResolution::DynamicResolution(Drawer& drawer, const DynamicResolutionOption& option):
+   drawer(drawer),
+   upscalePass("../shader/drawer/upscale.frag.glsl")
+{
+   setOption(option);
+   allocatedScale = maxScale;
+   scale = maxScale.load();
+   color = graph.createTexture("scene color", {GL_RGBA8, allocatedScale, 0, 0, Drawer::clearColor});
+   depth = graph.createTexture("scene depth", {GL_DEPTH_COMPONENT24, allocatedScale});
+   auto backbuffer = graph.importBackbuffer();
+   graph.addPass("scene", [&](auto& builder){
+      builder.write(color);
+      builder.write(depth);
+   }, [this](auto& context){drawScene(context);});
+   graph.addPass("upscale", [&](auto& builder){
+      builder.read(color);
+      builder.write(backbuffer);
+   }, [this](auto& context){upscale(context);});
+   drawer.setPipeline([this](int width, int height){render(width, height);});
+}
+
+inline void DynamicResolution::render(int width, int height){
+   auto& query = timerQueries[timerIndex];
+   if(timerPending[timerIndex] && query.isAvailable()){
+      gpuTime = query.getResult() / 1e6f;
+      timerPending[timerIndex] = false;
+      if(enabled){
+         scale = controller.update(gpuTime, minScale, maxScale, targetFrameTime);
+      }
+   }
+   if(!enabled){
+      scale = maxScale.load();
+   }
+   if(allocatedScale != maxScale){
+      allocatedScale = maxScale;
+      graph.setTextureDesc(color, {GL_RGBA8, allocatedScale, 0, 0, Drawer::clearColor});
+      graph.setTextureDesc(depth, {GL_DEPTH_COMPONENT24, allocatedScale});
+   }
+   scale = std::min<float>(scale, allocatedScale);
+   renderWidth = std::max(1, static_cast<int>(std::round(width * scale)));
+   renderHeight = std::max(1, static_cast<int>(std::round(height * scale)));
+
+   // 还没有读取的查询不能重新开始，跳过这一帧的计时
+   bool measure = !timerPending[timerIndex];
+   if(measure){
+      query.begin();
+   }
+   graph.execute(width, height);
+   if(measure){
+      query.end();
+      timerPending[timerIndex] = true;
+   }
+   timerIndex = (timerIndex + 1) % timerQueryNumber;
+}
+
+inline void DynamicResolution::drawScene(RenderGraph::PassContext& context){
+   // 纹理已经被清除，只在左下角绘制
+   glViewport(0, 0, std::min<int>(renderWidth, context.getWidth()), std::min<int>(renderHeight, context.getHeight()));
+   drawer.drawScene();
+}
+
+inline void DynamicResolution::upscale(RenderGraph::PassContext& context){
+   auto& source = context.getTexture(color);
+   TextureUnit::getInstance().bindUnit(0, source);
+   auto& program = upscalePass.use();
+   program.setUniform("source", 0);
+   program.setUniform("sourceScale", glm::vec2(
+      std::min<float>(renderWidth, source.getWidth()) / source.getWidth(),
+      std::min<float>(renderHeight, source.getHeight()) / source.getHeight()
+   ));
+   program.setUniform("texelSize", glm::vec2(1.0f / source.getWidth(), 1.0f / source.getHeight()));
+   program.setUniform("sharpness", sharpness.load());
+   upscalePass.draw();
+}
+
+} // namespace minecpp
+
+#endif // _MINECPP_RESOLUTION_H_
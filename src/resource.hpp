@@ -4,8 +4,11 @@
 // gl.h的include必须在glfw之前
 #include <cinttypes>
 #include <concepts>
+#ifdef _WIN32
 #include <corecrt.h>
+#endif
 #include <cstddef>
+#include <cstdlib>
 #include <gl.h>
 #include <GLFW/glfw3.h>
 #include <initializer_list>
@@ -23,11 +26,23 @@
 #include <variant>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <memory>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <algorithm>
+#include <numeric>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include "glm/fwd.hpp"
 #include "tool.hpp"
+#include "culling.hpp"
+#include "lod.hpp"
+#include "occlusion.hpp"
+#include "trace.hpp"
+#include "pacing.hpp"
 #include <type_traits>
 
 namespace minecpp{
@@ -49,7 +64,7 @@ namespace minecpp{
 /*****************************************************/
 
 enum class ResourceType{
-   BUFFER, VERTEXARRAY, TEXTURE, PROGRAM, SHADER
+   BUFFER, VERTEXARRAY, TEXTURE, PROGRAM, SHADER, QUERY, FRAMEBUFFER
 };
 
 // subType：一些资源的子类型，如buffer还有 vbo, ebo
@@ -75,6 +90,14 @@ private:
          return glCreateProgram();
       }else if constexpr(type == ResourceType::SHADER){
          return glCreateShader(subType);
+      }else if constexpr(type == ResourceType::QUERY){
+         GLuint id;
+         glGenQueries(1, &id);
+         return id;
+      }else if constexpr(type == ResourceType::FRAMEBUFFER){
+         GLuint id;
+         glGenFramebuffers(1, &id);
+         return id;
       }else {
          // 如果直接使用static_assert，则不管编译后还有没有这个blcok，还是会报错
          // 如果将static_assert包装在lambda中调用，则只有进来这个block后才会进行实例化，从而才会报错
@@ -93,6 +116,10 @@ private:
          glDeleteProgram(id);
       }else if constexpr(type == ResourceType::SHADER){
          glDeleteShader(id);
+      }else if constexpr(type == ResourceType::QUERY){
+         glDeleteQueries(1, &id);
+      }else if constexpr(type == ResourceType::FRAMEBUFFER){
+         glDeleteFramebuffers(1, &id);
       }else{
          []<bool flag = false>(){static_assert(flag);}();
       }
@@ -137,6 +164,8 @@ template<GLenum bufferType>
 using BufferRsc = Resource<ResourceType::BUFFER, bufferType>;
 using VertexBufferRsc = BufferRsc<GL_ARRAY_BUFFER>;
 using ElementBufferRsc = BufferRsc<GL_ELEMENT_ARRAY_BUFFER>;
+using TexelBufferRsc = BufferRsc<GL_TEXTURE_BUFFER>;
+using PixelPackBufferRsc = BufferRsc<GL_PIXEL_PACK_BUFFER>;
 
 using VertexArrayRsc = Resource<ResourceType::VERTEXARRAY>;
 
@@ -150,9 +179,16 @@ using ProgramRsc = Resource<ResourceType::PROGRAM>;
 template<GLenum textureType>
 using TextureRsc = Resource<ResourceType::TEXTURE, textureType>;
 using Texture2DRsc = TextureRsc<GL_TEXTURE_2D>;
+using Texture2DArrayRsc = TextureRsc<GL_TEXTURE_2D_ARRAY>;
+using TextureBufferRsc = TextureRsc<GL_TEXTURE_BUFFER>;
+
+template<GLenum queryType>
+using QueryRsc = Resource<ResourceType::QUERY, queryType>;
+
+using FramebufferRsc = Resource<ResourceType::FRAMEBUFFER, GL_FRAMEBUFFER>;
 
 enum class ContextType{
-   BUFFER, VERTEXARRAY, TEXTURE, PROGRAM
+   BUFFER, VERTEXARRAY, TEXTURE, PROGRAM, FRAMEBUFFER
 };
 
 template<ContextType type, GLenum subType = 0>
@@ -161,14 +197,20 @@ private:
    GLuint contextTarget = 0;
 
    void bind(GLuint resourceId)  {
+      auto& statistics = FrameStatistics::getCurrent();
       if constexpr(type == ContextType::BUFFER){
          glBindBuffer(subType, resourceId);
       }else if constexpr(type == ContextType::VERTEXARRAY){
          glBindVertexArray(resourceId);
+         statistics.vertexArrayBinds++;
       }else if constexpr(type == ContextType::TEXTURE){
          glBindTexture(subType, resourceId);
+         statistics.textureBinds++;
       }else if constexpr(type == ContextType::PROGRAM){
          glUseProgram(resourceId);
+         statistics.programBinds++;
+      }else if constexpr(type == ContextType::FRAMEBUFFER){
+         glBindFramebuffer(subType, resourceId);
       }else{
          []<bool flag = false>(){static_assert(flag);}();
       }
@@ -181,6 +223,7 @@ private:
       case ContextType::VERTEXARRAY: return ResourceType::VERTEXARRAY;
       case ContextType::TEXTURE: return ResourceType::TEXTURE;
       case ContextType::PROGRAM: return ResourceType::PROGRAM;
+      case ContextType::FRAMEBUFFER: return ResourceType::FRAMEBUFFER;
       default: throw "unsupported";
       };
    }
@@ -206,6 +249,21 @@ public:
    using BufferContext<GL_ARRAY_BUFFER>::bindContext;
 };
 
+// texture buffer 的数据来源，和 GL_TEXTURE_BUFFER 类型的纹理上下文是两回事
+class TexelBufferContext: private BufferContext<GL_TEXTURE_BUFFER>, public ProactiveSingleton<TexelBufferContext>{
+public:
+   TexelBufferContext() = default;
+   using BufferContext<GL_TEXTURE_BUFFER>::bindContext;
+};
+
+// glReadPixels 的写入目标，绑定后 glReadPixels 的数据参数为 buffer 中的偏移
+class PixelPackBufferContext: private BufferContext<GL_PIXEL_PACK_BUFFER>, public ProactiveSingleton<PixelPackBufferContext>{
+public:
+   PixelPackBufferContext() = default;
+   using BufferContext<GL_PIXEL_PACK_BUFFER>::bindContext;
+   using BufferContext<GL_PIXEL_PACK_BUFFER>::unBind;
+};
+
 class VertexArrayContext: private ResourceContext<ContextType::VERTEXARRAY>, public ProactiveSingleton<VertexArrayContext>{
 public:
    VertexArrayContext() = default;
@@ -238,9 +296,46 @@ public:
    using ResourceContext<ContextType::PROGRAM>::bindContext;
 };
 
+// unBind 即绑定默认帧缓冲：通常是窗口，无窗口模式下是 Context 创建的离屏帧缓冲
+class FramebufferContext: private ResourceContext<ContextType::FRAMEBUFFER, GL_FRAMEBUFFER>, public ProactiveSingleton<FramebufferContext>{
+private:
+   const FramebufferRsc* defaultFramebuffer = nullptr;
+public:
+   FramebufferContext() = default;
+   using ResourceContext<ContextType::FRAMEBUFFER, GL_FRAMEBUFFER>::bindContext;
+   void unBind(){
+      if(defaultFramebuffer != nullptr){
+         bindContext(*defaultFramebuffer);
+      }else{
+         ResourceContext<ContextType::FRAMEBUFFER, GL_FRAMEBUFFER>::unBind();
+      }
+   }
+   // 代替窗口作为默认帧缓冲，为空时恢复为窗口
+   void setDefault(const FramebufferRsc* framebuffer){
+      defaultFramebuffer = framebuffer;
+      unBind();
+   }
+   // 默认帧缓冲是否为离屏帧缓冲，此时读取像素需要使用 GL_COLOR_ATTACHMENT0 而不是 GL_BACK
+   bool isOffscreen() const { return defaultFramebuffer != nullptr; }
+};
+
 template<GLenum textureType>
 using TextureContext = ResourceContext<ContextType::TEXTURE, textureType>;
 
+// 当前激活的纹理单元：glActiveTexture 是全局状态，所有类型的纹理共用同一个缓存
+class ActiveTextureUnit{
+private:
+   GLint activeUnit = 0;
+public:
+   void activate(GLint unit) {
+      if(unit != activeUnit){
+         glActiveTexture(GL_TEXTURE0 + unit);
+         checkGLError();
+         activeUnit = unit;
+      }
+   }
+};
+
 // 存储某个具体类型纹理在所有纹理单元中的状态
 template<GLenum textureType>
 class TextureUnitFor: public ProactiveSingleton<TextureUnitFor<textureType>>{
@@ -251,30 +346,31 @@ private:
       using TextureContext<textureType>::bindContext;
    };
    MTextureContext context[GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS];
-   
-   GLint activeUnit = 0;
-   void activateUnit(GLint unit) {
-      if(unit != activeUnit){
-         glActiveTexture(GL_TEXTURE0 + unit);
-         checkGLError();
-         activeUnit = unit;
-      }
-   }
+   ActiveTextureUnit& activeUnit;
 public:
+   explicit TextureUnitFor(ActiveTextureUnit& activeUnit): activeUnit(activeUnit){}
    void bindUnit(GLint unit, const TextureRsc<textureType>& texture){
-      activateUnit(unit);
+      activeUnit.activate(unit);
       context[unit].bindContext(texture);
    }
 };
 
 class TextureUnit: public ProactiveSingleton<TextureUnit> {
 private:
-   TextureUnitFor<GL_TEXTURE_2D> texture2DUnit;
+   // 需要在各个类型的 TextureUnitFor 之前构造
+   ActiveTextureUnit activeUnit;
+   TextureUnitFor<GL_TEXTURE_2D> texture2DUnit {activeUnit};
+   TextureUnitFor<GL_TEXTURE_2D_ARRAY> texture2DArrayUnit {activeUnit};
+   TextureUnitFor<GL_TEXTURE_BUFFER> textureBufferUnit {activeUnit};
 
    template<GLenum textureType>
    TextureUnitFor<textureType>& getSpecificContext(){
       if constexpr (textureType == GL_TEXTURE_2D){
          return texture2DUnit;
+      }else if constexpr (textureType == GL_TEXTURE_2D_ARRAY){
+         return texture2DArrayUnit;
+      }else if constexpr (textureType == GL_TEXTURE_BUFFER){
+         return textureBufferUnit;
       }else{
          throw "unsupported";
       }
@@ -304,6 +400,10 @@ private:
          VertexBufferContext::getInstance().bindContext(*this);
       }else if constexpr (std::same_as<BaseRsc, ElementBufferRsc>) {
          GlobalElementBufferContext::getInstance().bindContext(*this);
+      }else if constexpr (std::same_as<BaseRsc, TexelBufferRsc>) {
+         TexelBufferContext::getInstance().bindContext(*this);
+      }else if constexpr (std::same_as<BaseRsc, PixelPackBufferRsc>) {
+         PixelPackBufferContext::getInstance().bindContext(*this);
       }
    }
 
@@ -314,16 +414,49 @@ private:
       // GL_STATIC_DRAW：数据只设置一次，使用多次
       // GL_DYNAMIC_DRAW：数据变化很大，使用次数也很多
       glBufferData(bufferType, size, data, usage);
+      if(data != nullptr){
+         FrameStatistics::countBuffer(size);
+      }
       checkGLError();
    }
 protected:
    Buffer(const ContiguousContainer auto& data, GLenum usage): 
       Buffer(dataAddress(data), sizeOfData(data), usage){}
+   // 只分配存储空间，内容未定义
+   Buffer(GLsizeiptr size, GLenum usage): Buffer(nullptr, size, usage){}
+public:
+   // 更新 buffer 中从 offset（字节）开始的一段数据，不会重新分配存储空间
+   void setSubData(const ContiguousContainer auto& data, GLintptr offset = 0){
+      dataSettingContext();
+      glBufferSubData(bufferType, offset, sizeOfData(data), dataAddress(data));
+      FrameStatistics::countBuffer(sizeOfData(data));
+      checkGLError();
+   }
+   // 把从 offset（字节）开始的 length 字节映射到内存中，写入时不需要先准备一份中间数组
+   // 返回 nullptr 表示映射失败；使用完之后调用 unmap，期间不能用于绘制
+   void* map(GLintptr offset, GLsizeiptr length, GLbitfield access){
+      dataSettingContext();
+      void* data = glMapBufferRange(bufferType, offset, length, access);
+      if(access & GL_MAP_WRITE_BIT){
+         FrameStatistics::countBuffer(length);
+      }
+      checkGLError();
+      return data;
+   }
+   // 返回 false 表示映射期间数据被破坏（如显示模式改变），需要重新写入
+   bool unmap(){
+      dataSettingContext();
+      bool result = glUnmapBuffer(bufferType) == GL_TRUE;
+      checkGLError();
+      return result;
+   }
 };
 
 class VertexBuffer: public Buffer<GL_ARRAY_BUFFER>{
 public:
    VertexBuffer(const ContiguousContainer auto& data, GLenum usage = GL_STATIC_DRAW): Buffer<GL_ARRAY_BUFFER>(data, usage){}
+   // 只分配存储空间，之后通过 setSubData 或 map 写入
+   explicit VertexBuffer(GLsizeiptr size, GLenum usage = GL_STATIC_DRAW): Buffer<GL_ARRAY_BUFFER>(size, usage){}
 };
 
 class ElementBuffer: public Buffer<GL_ELEMENT_ARRAY_BUFFER>{
@@ -336,6 +469,25 @@ public:
    int getNumber() const { return number; }
 };
 
+// 作为 texture buffer 数据来源的 buffer，数据通常每帧都可能更新
+class TexelBuffer: public Buffer<GL_TEXTURE_BUFFER>{
+public:
+   TexelBuffer(const ContiguousContainer auto& data, GLenum usage = GL_DYNAMIC_DRAW): Buffer<GL_TEXTURE_BUFFER>(data, usage){}
+};
+
+// 从帧缓冲读取像素的 buffer，glReadPixels 写入其中时不需要等待 GPU 完成绘制
+// 数据在 GPU 写入完成后（见 glFenceSync）再 map 读取
+class PixelPackBuffer: public Buffer<GL_PIXEL_PACK_BUFFER>{
+private:
+   GLsizeiptr size;
+public:
+   PixelPackBuffer(GLsizeiptr size): Buffer<GL_PIXEL_PACK_BUFFER>(size, GL_STREAM_READ), size(size){
+      PixelPackBufferContext::getInstance().unBind();
+   }
+
+   GLsizeiptr getSize() const { return size; }
+};
+
 /*****************************************************/
 /*****************************************************/
 /******************  VERTEX ARRAY  *******************/
@@ -354,6 +506,8 @@ private:
    bool bindEBO = false;
    // 顶点的数量
    int number = 0;
+   // 只含位置属性（location 0）的 vao，用于只写深度的绘制；第一次需要时才创建
+   mutable std::unique_ptr<VertexArray> positionArray;
 
 private:
    void attributeContext(const VertexBuffer& vbo) const {
@@ -388,7 +542,9 @@ private:
 
    template<typename Type>
    constexpr std::pair<GLint, GLenum> getTypeInfo(){
-      if(std::is_same_v<Type, glm::vec3>){
+      if(std::is_same_v<Type, float>){
+         return {1, GL_FLOAT};
+      }else if(std::is_same_v<Type, glm::vec3>){
          return {3, GL_FLOAT};
       }else if(std::is_same_v<Type, glm::vec2>){
          return {2, GL_FLOAT};
@@ -425,8 +581,53 @@ public:
       return number;
    }
 
+   // 只含位置的 vao 与本 vao 使用相同的索引，数量也一起设置
    void setNumber(int number){
       this->number = number;
+      if(positionArray != nullptr){
+         positionArray->setNumber(number);
+      }
+   }
+
+   // 创建只含位置的 vao：沿用本 vao 中 location 0 的 vbo、格式、步长和偏移以及 ebo，不复制顶点数据
+   // 需要在所有属性和 ebo 设置完成之后调用；没有启用 location 0 时不创建
+   void createPositionArray() const {
+      if(positionArray != nullptr){
+         return;
+      }
+      VertexArrayContext::getInstance().bindContext(*this);
+      GLint enabled = 0;
+      glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+      if(!enabled){
+         return;
+      }
+      GLint buffer, size, type, normalized, stride, ebo;
+      void* pointer;
+      glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+      glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
+      glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+      glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &normalized);
+      glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+      glGetVertexAttribPointerv(0, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+      glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &ebo);
+
+      auto array = std::make_unique<VertexArray>();
+      VertexArrayContext::getInstance().bindContext(*array);
+      // 上下文只在绑定时记录，直接绑定 id 不会使其失效
+      glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      glVertexAttribPointer(0, size, type, normalized, stride, pointer);
+      glEnableVertexAttribArray(0);
+      if(bindEBO){
+         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+      }
+      checkGLError();
+      array->bindEBO = bindEBO;
+      array->number = number;
+      positionArray = std::move(array);
+   }
+   // 没有创建时返回自身
+   const VertexArray& getPositionArray() const {
+      return positionArray != nullptr ? *positionArray : *this;
    }
 };
 
@@ -439,7 +640,8 @@ public:
 template<GLenum shaderType>
 class Shader: public ShaderRsc<shaderType>{
 public:
-   Shader(const std::string& str, bool isContent){
+   // defines 中的每一项在 #version 之后插入一行 #define，用于从同一个文件编译着色器的不同变体
+   Shader(const std::string& str, bool isContent, const std::vector<std::string>& defines = {}){
       GLuint shader = this->getId();
       std::string content;
       if(!isContent){
@@ -455,6 +657,16 @@ public:
       }else{
          content = std::move(str);
       }
+      if(!defines.empty()){
+         std::string lines;
+         for(const auto& define: defines){
+            lines += fmt::format("#define {}\n", define);
+         }
+         // #version 必须是第一行
+         std::size_t position = content.find("#version");
+         position = position == std::string::npos ? 0 : content.find('\n', position);
+         content.insert(position == std::string::npos ? content.size() : position + 1, lines);
+      }
       const char* c_content = content.c_str();
       // 第二个参数是字符串的数量
       glShaderSource(shader, 1, &c_content, nullptr);
@@ -476,8 +688,8 @@ public:
          throwError(fmt::format("compile shader failure: {}", (char*)logInfo));
       }
    }
-   static Shader fromFile(const std::string& path){return Shader(path, false);};
-   static Shader fromContent(const std::string& content){return Shader(content, true);};
+   static Shader fromFile(const std::string& path, const std::vector<std::string>& defines = {}){return Shader(path, false, defines);};
+   static Shader fromContent(const std::string& content, const std::vector<std::string>& defines = {}){return Shader(content, true, defines);};
 };
 
 class VertexShader:public Shader<GL_VERTEX_SHADER>{};
@@ -553,10 +765,13 @@ private:
 
    template<UniformType DataType>
    void setUniformFunc(GLint location, const DataType& value) {
+      FrameStatistics::countUniform(sizeof(DataType));
       if constexpr (std::same_as<DataType, glm::mat4>){
          glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
       } else if constexpr (std::same_as<DataType, glm::vec3>){
          glUniform3fv(location, 1, glm::value_ptr(value));
+      } else if constexpr (std::same_as<DataType, glm::vec2>){
+         glUniform2fv(location, 1, glm::value_ptr(value));
       } else if constexpr (std::same_as<DataType, glm::mat3>){
          glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
       } else if constexpr (std::same_as<DataType, GLint>){
@@ -567,6 +782,11 @@ private:
    }
 
 public:
+   // 不会抛出异常，用于判断 program 是否使用了某个 uniform
+   bool hasUniform(const std::string& name) const {
+      return uniforms.contains(name) || glGetUniformLocation(getId(), name.c_str()) != -1;
+   }
+
    template<UniformType DataType>
    void setUniform(const std::string& name, const DataType& value){
       ProgramContext::getInstance().bindContext(*this);
@@ -581,19 +801,120 @@ public:
 /*****************************************************/
 /*****************************************************/
 
+// 在 CPU 中解码的图片，不需要 gl 上下文，可以在工作线程中解码之后再交给 Texture2D 或 Texture2DArray 上传
+class Image{
+private:
+   unsigned char* data = nullptr;
+   // 不是由 stb 解码的图片的数据，此时 data 指向其中
+   std::vector<unsigned char> pixels;
+   int width = 0;
+   int height = 0;
+   int channels = 0;
+public:
+   // channels 为 0 时保留图片本身的通道数，否则转换为指定的通道数
+   explicit Image(const std::string& filepath, int channels = 0){
+      int fileChannels;
+      // opengl的纹理坐标的y轴是从底向上从0到1的，但是stb默认加载是从上向下加载的，因此需要翻转一下y轴
+      // 只设置当前线程，多个线程可以同时解码
+      stbi_set_flip_vertically_on_load_thread(true);
+      // 读取图片并返回数据、图片的宽高和通道数
+      data = stbi_load(filepath.c_str(), &width, &height, &fileChannels, channels);
+      if(data == nullptr){
+         throwError(fmt::format("load image from {} failed", filepath));
+      }
+      fmt::print("the channel number of image {} : {}\n", filepath, fileChannels);
+      this->channels = channels == 0 ? fileChannels : channels;
+   }
+   // 纯色的 rgba 图片，如贴图加载完成之前的占位图
+   Image(int width, int height, const std::array<unsigned char, 4>& color): width(width), height(height), channels(4){
+      pixels.reserve(static_cast<std::size_t>(width) * height * 4);
+      for(int i = 0; i < width * height; i++){
+         pixels.insert(pixels.end(), color.begin(), color.end());
+      }
+      data = pixels.data();
+   }
+   ~Image(){
+      if(data != nullptr && pixels.empty()){
+         stbi_image_free(data);
+      }
+   }
+   Image(Image&& other) noexcept{
+      *this = std::move(other);
+   }
+   Image& operator=(Image&& other) noexcept{
+      // vector 交换后数据的地址不变，data 仍然有效
+      std::swap(data, other.data);
+      std::swap(pixels, other.pixels);
+      std::swap(width, other.width);
+      std::swap(height, other.height);
+      std::swap(channels, other.channels);
+      return *this;
+   }
+   Image(const Image&) = delete;
+   Image& operator=(const Image&) = delete;
+
+   const unsigned char* getData() const { return data; }
+   int getWidth() const { return width; }
+   int getHeight() const { return height; }
+   int getChannels() const { return channels; }
+};
+
+// 贴图的 alpha 通道的用法，决定使用它的物体如何绘制
+enum class AlphaMode{
+   // 没有 alpha 通道或者所有像素都不透明
+   NONE,
+   // alpha 基本只有完全透明和完全不透明两种（如镂空的头发、树叶），绘制时进行 alpha 测试，仍然作为不透明物体
+   CUTOUT,
+   // 有足够多半透明的像素（如玻璃、薄纱），作为透明物体由 WeightedBlendedOIT 绘制
+   TRANSLUCENT,
+};
+
+// 根据 rgba 像素的 alpha 判断贴图的用法：只有边缘抗锯齿的少量半透明像素时仍然是镂空贴图
+// 半透明像素占不完全透明的像素的比例达到 translucentCoverage 时才作为半透明贴图
+inline AlphaMode classifyAlpha(const unsigned char* rgba, std::size_t pixelNumber){
+   // alpha 在这个范围之外的像素视为完全透明或者完全不透明
+   constexpr unsigned char transparentAlpha = 16;
+   constexpr unsigned char opaqueAlpha = 239;
+   constexpr float translucentCoverage = 0.1f;
+   std::size_t visible = 0;
+   std::size_t translucent = 0;
+   bool opaque = true;
+   for(std::size_t i = 0; i < pixelNumber; i++){
+      unsigned char alpha = rgba[i * 4 + 3];
+      opaque = opaque && alpha == 255;
+      if(alpha >= transparentAlpha){
+         visible++;
+         if(alpha <= opaqueAlpha){
+            translucent++;
+         }
+      }
+   }
+   if(opaque){
+      return AlphaMode::NONE;
+   }
+   return translucent >= translucentCoverage * visible && translucent > 0 ? AlphaMode::TRANSLUCENT : AlphaMode::CUTOUT;
+}
+
 class Texture2D: public Texture2DRsc{
+private:
+   AlphaMode alphaMode = AlphaMode::NONE;
 public:
    // opengl 默认的unit就是GL_TEXTURE0
-   Texture2D(const std::string& filepath, GLint unit = 0): Texture2D(unit, filepath, GL_REPEAT, GL_REPEAT, GL_LINEAR, GL_NEAREST, nullptr) {}
+   Texture2D(const std::string& filepath, GLint unit = 0): Texture2D(unit, Image {filepath}, GL_REPEAT, GL_REPEAT, GL_LINEAR, GL_NEAREST, nullptr) {}
+   // 上传已经解码的图片
+   explicit Texture2D(const Image& image, GLint unit = 0): Texture2D(unit, image, GL_REPEAT, GL_REPEAT, GL_LINEAR, GL_NEAREST, nullptr) {}
+
+   Texture2D(GLint unit, const std::string& filepath, GLenum horizonType, GLenum verticalType, GLenum minFilterType, GLenum magFilterType, glm::vec4* borderColor):
+      Texture2D(unit, Image {filepath}, horizonType, verticalType, minFilterType, magFilterType, borderColor) {}
    
    // 在指定的纹理单元中创建2D纹理
-   // filepath: 图片文件
+   // image: 解码后的图片，需要是 3 或 4 个通道
    // horizonType, verticalType: 横向、纵向扩展类型
    // 可选 GL_REPEAT, GL_MIRRRED_REREPEAT, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_BORDER
    // minFilterType, magFilterType: 纹理缩小/放大过滤方式
    // 可选GL_[NEAREST|LINEAR]、 GL_[NEAREST|LINEAR]_MIPMAP_[NEAREST|LINEAR]（仅magFilterType）
    // borderColor：当设置为 GL_CLAMP_TO_BORDER 时的颜色，需要大小为4的数组(rgba)
-   Texture2D(GLint unit, const std::string& filepath, GLenum horizonType, GLenum verticalType, GLenum minFilterType, GLenum magFilterType, glm::vec4* borderColor){
+   Texture2D(GLint unit, const Image& image, GLenum horizonType, GLenum verticalType, GLenum minFilterType, GLenum magFilterType, glm::vec4* borderColor){
       GLuint texture = this->getId();
 
       // 每个 texture unit 都可以同时绑定每个类型的纹理对象各一个；但是一个着色器只允许绑定一个sampler
@@ -614,15 +935,8 @@ public:
          glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(*borderColor));
       }
       
-      int width, height, nrChannels;
-      // opengl的纹理坐标的y轴是从底向上从0到1的，但是stb默认加载是从上向下加载的，因此需要翻转一下y轴
-      stbi_set_flip_vertically_on_load(true);
-      // 读取图片并返回数据、图片的宽高和通道数
-      unsigned char *data = stbi_load(filepath.c_str(), &width, &height, &nrChannels, 0);
-      if(data == nullptr){
-         throwError(fmt::format("load image from {} failed", filepath));
-      }
-      fmt::print("the channel number of image {} : {}\n", filepath, nrChannels);
+      int width = image.getWidth(), height = image.getHeight(), nrChannels = image.getChannels();
+      const unsigned char* data = image.getData();
       if(nrChannels == 3){
          // 源数据的通道数为3，说明类型是rgb
          // jpg格式通常是rgb
@@ -637,13 +951,12 @@ public:
          // pixels：数据
          glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
       }else if(nrChannels == 4){
-         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+         // 保留 alpha 通道，镂空的贴图进行 alpha 测试，半透明的贴图在 Drawer 的透明阶段绘制
+         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+         alphaMode = classifyAlpha(data, static_cast<std::size_t>(width) * height);
       }else{
-         stbi_image_free(data);
          throwError(fmt::format("the channel of image is not 3 nor 4, is {}", nrChannels));
       }
-
-      stbi_image_free(data);
       
       // 如果过滤方式需要mipmap，则生成mipmap
       if(magFilterType == GL_LINEAR_MIPMAP_LINEAR ||
@@ -655,6 +968,303 @@ public:
 
       checkGLError();
    }
+
+   AlphaMode getAlphaMode() const {return alphaMode;}
+};
+
+// 由多张图片组成的 2D 纹理数组，每张图片占一层
+// 纹理数组要求每层的尺寸相同，因此所有图片都会被（双线性）缩放到其中最大的宽高，纹理坐标的含义保持不变
+class Texture2DArray: public Texture2DArrayRsc{
+private:
+   int width = 0;
+   int height = 0;
+   int layers = 0;
+
+   static void resizeImage(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight){
+      constexpr int channel = 4;
+      for(int y = 0; y < dstHeight; y++){
+         float fy = std::max((y + 0.5f) * srcHeight / dstHeight - 0.5f, 0.0f);
+         int y0 = std::min(static_cast<int>(fy), srcHeight - 1);
+         int y1 = std::min(y0 + 1, srcHeight - 1);
+         float wy = fy - y0;
+         for(int x = 0; x < dstWidth; x++){
+            float fx = std::max((x + 0.5f) * srcWidth / dstWidth - 0.5f, 0.0f);
+            int x0 = std::min(static_cast<int>(fx), srcWidth - 1);
+            int x1 = std::min(x0 + 1, srcWidth - 1);
+            float wx = fx - x0;
+            for(int c = 0; c < channel; c++){
+               float top = src[(y0 * srcWidth + x0) * channel + c] * (1 - wx) + src[(y0 * srcWidth + x1) * channel + c] * wx;
+               float bottom = src[(y1 * srcWidth + x0) * channel + c] * (1 - wx) + src[(y1 * srcWidth + x1) * channel + c] * wx;
+               dst[(y * dstWidth + x) * channel + c] = static_cast<unsigned char>(top * (1 - wy) + bottom * wy + 0.5f);
+            }
+         }
+      }
+   }
+   static std::vector<Image> loadImages(const std::vector<std::string>& filepaths){
+      std::vector<Image> images;
+      for(auto& filepath: filepaths){
+         // 统一加载为 rgba，方便各层使用同一种格式
+         images.emplace_back(filepath, 4);
+      }
+      return images;
+   }
+   static std::vector<const Image*> addressOf(const std::vector<Image>& images){
+      std::vector<const Image*> addresses;
+      for(auto& image: images){
+         addresses.push_back(&image);
+      }
+      return addresses;
+   }
+public:
+   Texture2DArray(const std::vector<std::string>& filepaths, GLint unit = 0): Texture2DArray(loadImages(filepaths), unit){}
+   Texture2DArray(const std::vector<Image>& images, GLint unit = 0): Texture2DArray(addressOf(images), unit){}
+   // images 需要都是 rgba 的；同一张图片可以出现在多层中
+   Texture2DArray(const std::vector<const Image*>& images, GLint unit = 0){
+      if(images.empty()){
+         throwError("texture array needs at least one image");
+      }
+      for(auto image: images){
+         if(image->getChannels() != 4){
+            throwError(fmt::format("texture array needs rgba images, got {} channels", image->getChannels()));
+         }
+         width = std::max(width, image->getWidth());
+         height = std::max(height, image->getHeight());
+      }
+      layers = images.size();
+
+      TextureUnit::getInstance().bindUnit(unit, *this);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      // 先分配所有层的存储空间，再逐层上传数据
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+      std::vector<unsigned char> resized;
+      for(int layer = 0; auto image: images){
+         const unsigned char* data = image->getData();
+         if(image->getWidth() != width || image->getHeight() != height){
+            resized.resize(width * height * 4);
+            resizeImage(image->getData(), image->getWidth(), image->getHeight(), resized.data(), width, height);
+            data = resized.data();
+         }
+         glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+         layer++;
+      }
+      checkGLError();
+   }
+
+   int getLayers() const { return layers; }
+};
+
+// 进程内共享的 Texture2D：同一个文件以相同的采样参数和通道数只解码、上传一次，多个 Model 使用同一个纹理
+// 缓存只持有 weak_ptr，最后一个使用者释放 shared_ptr 时纹理随之释放，因此纹理不会活得比 gl 上下文长
+class TextureCache: public Singleton<TextureCache>{
+public:
+   struct Key{
+      // 规范化的绝对路径，相对路径和 ../ 不同的写法指向同一个文件
+      std::string path;
+      GLenum wrapS = GL_REPEAT;
+      GLenum wrapT = GL_REPEAT;
+      GLenum minFilter = GL_LINEAR;
+      GLenum magFilter = GL_NEAREST;
+      // 解码时转换的通道数，0 表示保留图片本身的通道数
+      int channels = 0;
+
+      auto operator<=>(const Key&) const = default;
+   };
+   struct Statistics{
+      // 仍在使用的纹理数和它们的数据量（不含 mipmap）
+      int textureNumber = 0;
+      std::uint64_t bytes = 0;
+      // find 找到和没有找到的次数
+      int hitNumber = 0;
+      int missNumber = 0;
+   };
+
+private:
+   struct Entry{
+      std::weak_ptr<Texture2D> texture;
+      std::uint64_t bytes;
+   };
+   // 工作线程中会调用 find
+   std::mutex mutex;
+   std::map<Key, Entry> entries;
+   int hitNumber = 0;
+   int missNumber = 0;
+
+   // 需要持有 mutex
+   void purge(){
+      std::erase_if(entries, [](const auto& entry){
+         return entry.second.texture.expired();
+      });
+   }
+
+public:
+   // 不支持 GL_CLAMP_TO_BORDER（需要边框颜色）
+   static Key makeKey(const std::string& filepath, int channels = 0){
+      std::error_code error;
+      auto path = std::filesystem::weakly_canonical(utf8Path(filepath), error);
+      if(error){
+         path = std::filesystem::absolute(utf8Path(filepath), error).lexically_normal();
+      }
+      return {.path = utf8String(path), .channels = channels};
+   }
+
+   // 已经缓存且仍在使用时返回，否则返回空；可以在任意线程中调用
+   std::shared_ptr<Texture2D> find(const Key& key){
+      std::lock_guard lock {mutex};
+      auto found = entries.find(key);
+      std::shared_ptr<Texture2D> texture = found == entries.end() ? nullptr : found->second.texture.lock();
+      (texture != nullptr ? hitNumber : missNumber)++;
+      return texture;
+   }
+   // 上传 image 并加入缓存，已经存在时（如同时请求了同一张图片）返回已有的纹理；需要在 gl 上下文所在的线程中调用
+   std::shared_ptr<Texture2D> insert(const Key& key, const Image& image){
+      if(key.wrapS == GL_CLAMP_TO_BORDER || key.wrapT == GL_CLAMP_TO_BORDER){
+         throwError("texture cache does not support GL_CLAMP_TO_BORDER");
+      }
+      std::lock_guard lock {mutex};
+      auto& entry = entries[key];
+      if(auto texture = entry.texture.lock()){
+         return texture;
+      }
+      auto texture = std::make_shared<Texture2D>(0, image, key.wrapS, key.wrapT, key.minFilter, key.magFilter, nullptr);
+      entry = {texture, static_cast<std::uint64_t>(image.getWidth()) * image.getHeight() * image.getChannels()};
+      purge();
+      return texture;
+   }
+   // 需要 gl 上下文
+   std::shared_ptr<Texture2D> load(const std::string& filepath){
+      Key key = makeKey(filepath);
+      if(auto texture = find(key)){
+         return texture;
+      }
+      return insert(key, Image {filepath, key.channels});
+   }
+
+   Statistics getStatistics(){
+      std::lock_guard lock {mutex};
+      purge();
+      Statistics statistics {.hitNumber = hitNumber, .missNumber = missNumber};
+      for(auto& [key, entry]: entries){
+         statistics.textureNumber++;
+         statistics.bytes += entry.bytes;
+      }
+      return statistics;
+   }
+};
+
+// 以 TexelBuffer 为数据来源的纹理，着色器中通过 samplerBuffer 和 texelFetch 按下标读取
+// 适合存放每个 draw 各自的数据（如变换矩阵、材质索引），数据量可以远大于 uniform 的限制
+class TextureBuffer: public TextureBufferRsc{
+private:
+   TexelBuffer buffer;
+public:
+   // internalFormat 决定一个 texel 的格式，默认每个 texel 为 4 个 float
+   TextureBuffer(const ContiguousContainer auto& data, GLenum internalFormat = GL_RGBA32F, GLint unit = 0): buffer(data){
+      TextureUnit::getInstance().bindUnit(unit, *this);
+      glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, buffer.getId());
+      checkGLError();
+   }
+
+   // 更新数据，但不能超过构造时的大小
+   void update(const ContiguousContainer auto& data, GLintptr offset = 0){
+      buffer.setSubData(data, offset);
+   }
+};
+
+/*****************************************************/
+/*****************************************************/
+/*****************    FRAMEBUFFER    *****************/
+/*****************************************************/
+/*****************************************************/
+
+// 纹理内部格式对应的上传格式、数据类型以及每个像素占用的字节数
+struct PixelFormat{
+   GLenum format;
+   GLenum type;
+   int bytes;
+   bool depth;
+   bool stencil;
+};
+
+inline PixelFormat getPixelFormat(GLenum internalFormat){
+   switch(internalFormat){
+   case GL_R8: return {GL_RED, GL_UNSIGNED_BYTE, 1, false, false};
+   case GL_RG8: return {GL_RG, GL_UNSIGNED_BYTE, 2, false, false};
+   case GL_RGB8: return {GL_RGB, GL_UNSIGNED_BYTE, 4, false, false};
+   case GL_RGBA8: return {GL_RGBA, GL_UNSIGNED_BYTE, 4, false, false};
+   case GL_R16F: return {GL_RED, GL_HALF_FLOAT, 2, false, false};
+   case GL_RG16F: return {GL_RG, GL_HALF_FLOAT, 4, false, false};
+   case GL_RGBA16F: return {GL_RGBA, GL_HALF_FLOAT, 8, false, false};
+   case GL_R11F_G11F_B10F: return {GL_RGB, GL_FLOAT, 4, false, false};
+   case GL_R32F: return {GL_RED, GL_FLOAT, 4, false, false};
+   case GL_RGBA32F: return {GL_RGBA, GL_FLOAT, 16, false, false};
+   case GL_DEPTH_COMPONENT24: return {GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4, true, false};
+   case GL_DEPTH_COMPONENT32F: return {GL_DEPTH_COMPONENT, GL_FLOAT, 4, true, false};
+   case GL_DEPTH24_STENCIL8: return {GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4, true, true};
+   default: throwError(fmt::format("unsupported render texture format {}", internalFormat));
+   }
+   return {};
+}
+
+// 用作渲染目标的空白 2D 纹理，不生成 mipmap，边缘使用 GL_CLAMP_TO_EDGE
+// 驱动通常会把 GL_RGB8 补齐为 4 字节，所以上面按 4 字节计算
+class RenderTexture: public Texture2DRsc{
+private:
+   int width;
+   int height;
+   GLenum internalFormat;
+public:
+   RenderTexture(int width, int height, GLenum internalFormat, GLint unit = 0):
+      width(width), height(height), internalFormat(internalFormat){
+      auto pixel = getPixelFormat(internalFormat);
+      TextureUnit::getInstance().bindUnit(unit, *this);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      // 深度纹理不能线性插值
+      GLenum filter = pixel.depth ? GL_NEAREST : GL_LINEAR;
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+      glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, pixel.format, pixel.type, nullptr);
+      checkGLError();
+   }
+
+   int getWidth() const { return width; }
+   int getHeight() const { return height; }
+   GLenum getInternalFormat() const { return internalFormat; }
+};
+
+// 由若干颜色纹理和至多一个深度纹理组成的帧缓冲，纹理的生命周期需要比帧缓冲长
+class Framebuffer: public FramebufferRsc{
+public:
+   // colors 依次绑定到 GL_COLOR_ATTACHMENT0, 1, ...；depth 可以为空
+   Framebuffer(const std::vector<const RenderTexture*>& colors, const RenderTexture* depth){
+      FramebufferContext::getInstance().bindContext(*this);
+      std::vector<GLenum> drawBuffers;
+      for(int i = 0; i < colors.size(); i++){
+         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colors[i]->getId(), 0);
+         drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+      }
+      if(depth != nullptr){
+         GLenum attachment = getPixelFormat(depth->getInternalFormat()).stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+         glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, depth->getId(), 0);
+      }
+      if(drawBuffers.empty()){
+         // 只有深度的帧缓冲（如阴影贴图）
+         glDrawBuffer(GL_NONE);
+         glReadBuffer(GL_NONE);
+      }else{
+         glDrawBuffers(drawBuffers.size(), drawBuffers.data());
+      }
+      GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+      FramebufferContext::getInstance().unBind();
+      if(status != GL_FRAMEBUFFER_COMPLETE){
+         throwError(fmt::format("framebuffer is not complete, status: {:#x}", status));
+      }
+      checkGLError();
+   }
 };
 
 /*****************************************************/
@@ -670,18 +1280,40 @@ private:
 private:
    VertexBufferContext vboCtx;
    GlobalElementBufferContext eboCtx;
+   TexelBufferContext texelBufferCtx;
+   PixelPackBufferContext pixelPackCtx;
    VertexArrayContext vaoCtx;
    ProgramContext programCtx;
+   FramebufferContext framebufferCtx;
    TextureUnit textureUnit;
    void createWindow();
-   GLFWwindow* window;
+   GLFWwindow* window = nullptr;
    ObservableValue<int> width;
    ObservableValue<int> height;
 
+   // 无窗口模式：窗口不可见，绘制到和窗口大小相同的离屏帧缓冲中，startLoop 只执行 frameLimit 帧
+   bool headless;
+   int frameLimit = 300;
+   std::optional<RenderTexture> offscreenColor;
+   std::optional<RenderTexture> offscreenDepth;
+   std::optional<Framebuffer> offscreenFramebuffer;
+   std::vector<double> frameTimes;
+   void createOffscreenTarget();
+
 public:
-   Context(int width, int height)
+   // 环境变量 MINECPP_HEADLESS 不为空且不为 0 时，所有 Context 都使用无窗口模式，
+   // 帧数由 MINECPP_HEADLESS_FRAMES 指定；用于在服务器、容器中进行自动化的性能测试
+   static bool isHeadlessEnvironment(){
+      const char* value = std::getenv("MINECPP_HEADLESS");
+      return value != nullptr && *value != '\0' && std::string(value) != "0";
+   }
+
+   Context(int width, int height, bool headless = false)
    :majorVersion(3), minorVersion(3),
-   width(width),height(height){
+   width(width),height(height), headless(headless || isHeadlessEnvironment()){
+      if(const char* frames = std::getenv("MINECPP_HEADLESS_FRAMES"); frames != nullptr){
+         frameLimit = std::max(1, std::atoi(frames));
+      }
       if(glfwInit() != GLFW_TRUE){
          throwError("glfw init failed");
       }
@@ -701,15 +1333,55 @@ public:
       });
    }
    ~Context(){
+      GLTrace::stop();
+      FrameStatistics::stopCsv();
+      // 离屏资源需要在上下文销毁前释放
+      if(offscreenFramebuffer.has_value()){
+         framebufferCtx.setDefault(nullptr);
+         offscreenFramebuffer.reset();
+         offscreenColor.reset();
+         offscreenDepth.reset();
+      }
       glfwDestroyWindow(window);
       glfwTerminate();
    }
    
    void startLoop(const std::function<void(void)>& loop){
-      while (!glfwWindowShouldClose(window)){
+      if(!headless){
+         while (!glfwWindowShouldClose(window)){
+            loop();
+         }
+         return;
+      }
+      frameTimes.clear();
+      for(int i = 0; i < frameLimit && !glfwWindowShouldClose(window); i++){
+         auto start = std::chrono::steady_clock::now();
          loop();
+         frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+      }
+      printFrameTimes();
+   }
+   // 输出无窗口模式下最近一次 startLoop 的帧时间统计
+   void printFrameTimes() const {
+      if(frameTimes.empty()){
+         return;
+      }
+      auto sorted = frameTimes;
+      std::sort(sorted.begin(), sorted.end());
+      double sum = 0.0;
+      for(double time: sorted){
+         sum += time;
       }
+      auto percentile = [&sorted](double p){
+         return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()))];
+      };
+      fmt::println("headless: {} frames, average {:.3f} ms, median {:.3f} ms, p95 {:.3f} ms, p99 {:.3f} ms, max {:.3f} ms",
+         sorted.size(), sum / sorted.size(), percentile(0.5), percentile(0.95), percentile(0.99), sorted.back());
    }
+   const std::vector<double>& getFrameTimes() const { return frameTimes; }
+   bool isHeadless() const { return headless; }
+   void setFrameLimit(int frames){ frameLimit = std::max(1, frames); }
+
    GLFWwindow* getWindow(){return window;}
    ObservableValue<int>& getWidth(){return width;}
    ObservableValue<int>& getHeight(){return height;}
@@ -721,8 +1393,19 @@ public:
 inline void Context::createWindow()
 {
 
+   if(headless){
+      // 不显示窗口，优先通过 EGL 创建上下文（如 Mesa 的 llvmpipe），不支持时使用平台默认的方式
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+      glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+      this->window = glfwCreateWindow(*width, *height, "LearnOpenGL", NULL, NULL);
+      if(window == nullptr){
+         glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+      }
+   }
    // 创建窗口
-   this->window = glfwCreateWindow(*width, *height, "LearnOpenGL", NULL, NULL);
+   if(window == nullptr){
+      this->window = glfwCreateWindow(*width, *height, "LearnOpenGL", NULL, NULL);
+   }
    if (window == nullptr){
       glfwTerminate();
       throwError("Failed to create GLFW window");
@@ -743,37 +1426,604 @@ inline void Context::createWindow()
    checkGLFWError([](){
       glfwTerminate();
    });
+
+   // 在创建任何资源之前开始录制，回放时可以重建所有对象
+   if(const char* path = std::getenv("MINECPP_TRACE"); path != nullptr && *path != '\0'){
+      GLTrace::start(path, *width, *height);
+   }
+   if(const char* path = std::getenv("MINECPP_STATS_CSV"); path != nullptr && *path != '\0'){
+      FrameStatistics::startCsv(path);
+   }
+   if(headless){
+      createOffscreenTarget();
+   }
+}
+
+inline void Context::createOffscreenTarget(){
+   offscreenColor.emplace(*width, *height, GL_RGBA8);
+   offscreenDepth.emplace(*width, *height, GL_DEPTH24_STENCIL8);
+   offscreenFramebuffer.emplace(std::vector<const RenderTexture*>{&*offscreenColor}, &*offscreenDepth);
+   framebufferCtx.setDefault(&*offscreenFramebuffer);
+   // 不等待垂直同步，帧时间只取决于绘制本身
+   glfwSwapInterval(0);
+   fmt::println("headless: rendering {}x{} into an offscreen framebuffer", *width, *height);
 }
 
 /*****************************************************/
 /*****************************************************/
-/********************* DRAWUNIT **********************/
+/******************     QUERY      *******************/
 /*****************************************************/
 /*****************************************************/
 
-class DrawUnit: public AutoLoader<DrawUnit>{
-private:
-   const VertexArray* vao;
-   Program* program;
+// 查询的结果由 GPU 异步写入，在结果可用前读取会阻塞 CPU，所以一般在之后的帧中先检查 isAvailable
+template<GLenum queryType>
+class Query: public QueryRsc<queryType>{
+public:
+   void begin(){
+      glBeginQuery(queryType, this->getId());
+      checkGLError();
+   }
+   void end(){
+      glEndQuery(queryType);
+      checkGLError();
+   }
+   bool isAvailable() const {
+      GLuint available;
+      glGetQueryObjectuiv(this->getId(), GL_QUERY_RESULT_AVAILABLE, &available);
+      return available == GL_TRUE;
+   }
+   GLuint64 getResult() const {
+      GLuint64 result;
+      glGetQueryObjectui64v(this->getId(), GL_QUERY_RESULT, &result);
+      return result;
+   }
+};
 
-   using TextureData = std::tuple<GLint, std::string, const Texture2D*>;
-   std::vector<TextureData> textures;
+// 结果为 0 表示 begin 和 end 之间绘制的片段全部没有通过深度测试
+using OcclusionQuery = Query<GL_ANY_SAMPLES_PASSED>;
 
-   // 可以是指向输入参数，也可以指向constUniforms的索引（int）
-   using UniformDataPtr = Insert<MapTo<MapTo<UniformDataPack, std::add_const_t>, std::add_pointer_t>, std::size_t>::apply<std::variant>;
-   using UniformData = std::pair<std::string, UniformDataPtr>;
-   std::vector<UniformData> uniforms;
+// 记录 GPU 执行到此处时的时间戳（纳秒），不使用 begin 和 end，因此可以嵌套
+class TimestampQuery: public Query<GL_TIMESTAMP>{
+private:
+   using Query<GL_TIMESTAMP>::begin;
+   using Query<GL_TIMESTAMP>::end;
+public:
+   void record(){
+      glQueryCounter(this->getId(), GL_TIMESTAMP);
+      checkGLError();
+   }
+};
 
-   using UniformConst = UniformDataPack::apply<std::variant>;
-   std::vector<UniformConst> constUniforms;
+/*****************************************************/
+/*****************************************************/
+/****************** GPU PROFILER *********************/
+/*****************************************************/
+/*****************************************************/
 
-   GLenum mode;
+// 按名字统计一帧中各个区间的 GPU 时间，区间可以嵌套
+// 区间的开始和结束各记录一个时间戳查询，查询对象按帧轮流使用，frameLatency 帧之内结果可用时再读取，不会阻塞；
+// GPU 落后太多、查询对象还没有读取时跳过这一帧
+// 每个区间以包括父区间在内的路径区分，用最近 historySize 帧的时间计算平均值和分位数
+//
+// 使用方式：
+//    GpuProfiler profiler;
+//    drawer.setProfiler(&profiler);          // 记录 Drawer::draw 中的清除、场景、customDraw 和交换缓冲区
+//    { GpuScope scope {"shadow"}; ... }      // 在一帧中的任意位置加入区间，没有正在记录的 profiler 时什么也不做
+//    showGpuProfiler(profiler);              // 在 ImGui 窗口中显示（gui.hpp）
+// 只能在持有 gl 上下文的线程中记录，统计结果可以在其他线程中读取
+class GpuProfiler{
+public:
+   struct ScopeStatistics{
+      std::string name;
+      // 用 / 连接的父区间和自己的名字
+      std::string path;
+      int depth;
+      // 最近一帧中相对于帧开始的时间和持续时间，用于绘制火焰图
+      float start;
+      float last;
+      // 最近 historySize 帧的统计，单位均为毫秒
+      float average;
+      float median;
+      float p95;
+      float max;
+   };
+   static constexpr int historySize = 120;
+   static constexpr int frameLatency = 4;
 
-   bool isEnable;
+private:
+   struct Scope{
+      std::string name;
+      std::string path;
+      int depth;
+      int begin;
+      int end;
+   };
+   struct Frame{
+      std::vector<TimestampQuery> queries;
+      int usedQueries = 0;
+      std::vector<Scope> scopes;
+      bool pending = false;
+   };
+   struct History{
+      std::string name;
+      int depth;
+      float start;
+      std::vector<float> times;
+      int next = 0;
+      std::uint64_t lastFrame;
+   };
 
-   RefContainer<DrawUnit>& getRefContainer();
+   std::array<Frame, frameLatency> frames;
+   int frameIndex = 0;
+   Frame* recording = nullptr;
+   // 还没有结束的区间在 scopes 中的下标
+   std::vector<int> stack;
+
+   mutable std::mutex mutex;
+   std::map<std::string, History> histories;
+   // 最近读取的一帧中各区间的路径，按开始的顺序排列
+   std::vector<std::string> order;
+   std::uint64_t resolvedNumber = 0;
+   int droppedNumber = 0;
+
+   static inline GpuProfiler* active = nullptr;
+
+   int record(){
+      auto& frame = *recording;
+      if(frame.usedQueries == frame.queries.size()){
+         frame.queries.emplace_back();
+      }
+      frame.queries[frame.usedQueries].record();
+      return frame.usedQueries++;
+   }
+   void resolve(Frame& frame);
 
-   struct UniformRefVariant{
+public:
+   GpuProfiler() = default;
+   ~GpuProfiler(){
+      if(active == this){
+         active = nullptr;
+      }
+   }
+   GpuProfiler(const GpuProfiler&) = delete;
+   GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+   // 正在记录的 profiler，不在 beginFrame 和 endFrame 之间时为空
+   static GpuProfiler* getActive(){ return active; }
+
+   // 读取已经完成的帧，并开始记录新的一帧，整帧作为名为 frame 的根区间
+   void beginFrame();
+   void endFrame();
+   void push(const std::string& name);
+   void pop();
+
+   // 按最近一帧中开始的顺序排列，第一个为根区间
+   std::vector<ScopeStatistics> getStatistics() const;
+   // 因为查询结果还没有读取而没有记录的帧数
+   int getDroppedNumber() const {
+      std::lock_guard lock {mutex};
+      return droppedNumber;
+   }
+};
+
+// 在作用域内记录一个区间
+class GpuScope{
+private:
+   GpuProfiler* profiler;
+public:
+   explicit GpuScope(const std::string& name): profiler(GpuProfiler::getActive()){
+      if(profiler != nullptr){
+         profiler->push(name);
+      }
+   }
+   ~GpuScope(){
+      if(profiler != nullptr){
+         profiler->pop();
+      }
+   }
+   GpuScope(const GpuScope&) = delete;
+   GpuScope& operator=(const GpuScope&) = delete;
+};
+
+inline void GpuProfiler::beginFrame(){
+   // 时间戳按提交的顺序完成，从最早的一帧开始读取
+   for(int i = 0; i < frameLatency; i++){
+      auto& frame = frames[(frameIndex + i) % frameLatency];
+      if(!frame.pending){
+         continue;
+      }
+      if(!frame.queries[frame.usedQueries - 1].isAvailable()){
+         break;
+      }
+      resolve(frame);
+   }
+   auto& frame = frames[frameIndex];
+   if(frame.pending){
+      std::lock_guard lock {mutex};
+      droppedNumber++;
+      return;
+   }
+   recording = &frame;
+   frame.usedQueries = 0;
+   frame.scopes.clear();
+   stack.clear();
+   active = this;
+   push("frame");
+}
+
+inline void GpuProfiler::endFrame(){
+   if(recording == nullptr){
+      return;
+   }
+   pop();
+   if(!stack.empty()){
+      throwError(fmt::format("gpu profiler scope {} is not closed", recording->scopes[stack.back()].name));
+   }
+   recording->pending = true;
+   recording = nullptr;
+   active = nullptr;
+   frameIndex = (frameIndex + 1) % frameLatency;
+}
+
+inline void GpuProfiler::push(const std::string& name){
+   if(recording == nullptr){
+      return;
+   }
+   auto& scopes = recording->scopes;
+   std::string path = stack.empty() ? name : scopes[stack.back()].path + "/" + name;
+   scopes.push_back({name, std::move(path), static_cast<int>(stack.size()), record(), -1});
+   stack.push_back(scopes.size() - 1);
+}
+
+inline void GpuProfiler::pop(){
+   if(recording == nullptr || stack.empty()){
+      return;
+   }
+   recording->scopes[stack.back()].end = record();
+   stack.pop_back();
+}
+
+inline void GpuProfiler::resolve(Frame& frame){
+   frame.pending = false;
+   std::vector<GLuint64> timestamps(frame.usedQueries);
+   for(int i = 0; i < frame.usedQueries; i++){
+      timestamps[i] = frame.queries[i].getResult();
+   }
+   GLuint64 base = timestamps[frame.scopes.front().begin];
+   auto milliseconds = [](GLuint64 from, GLuint64 to){
+      return to > from ? (to - from) / 1e6f : 0.0f;
+   };
+
+   std::lock_guard lock {mutex};
+   resolvedNumber++;
+   order.clear();
+   // 同一帧中路径相同的区间（如同名的多个 pass）的时间相加
+   std::map<std::string, float> frameTimes;
+   for(auto& scope: frame.scopes){
+      float time = milliseconds(timestamps[scope.begin], timestamps[scope.end]);
+      auto [it, inserted] = frameTimes.try_emplace(scope.path, 0.0f);
+      it->second += time;
+      if(inserted){
+         order.push_back(scope.path);
+         auto& history = histories[scope.path];
+         history.name = scope.name;
+         history.depth = scope.depth;
+         history.start = milliseconds(base, timestamps[scope.begin]);
+      }
+   }
+   for(auto& [path, time]: frameTimes){
+      auto& history = histories[path];
+      if(history.times.size() < historySize){
+         history.times.push_back(time);
+      }else{
+         history.times[history.next] = time;
+      }
+      history.next = (history.next + 1) % historySize;
+      history.lastFrame = resolvedNumber;
+   }
+   // 很久没有出现的区间不再显示
+   std::erase_if(histories, [this](auto& pair){
+      return resolvedNumber - pair.second.lastFrame > historySize;
+   });
+}
+
+inline std::vector<GpuProfiler::ScopeStatistics> GpuProfiler::getStatistics() const {
+   std::lock_guard lock {mutex};
+   std::vector<ScopeStatistics> result;
+   for(auto& path: order){
+      auto& history = histories.at(path);
+      auto sorted = history.times;
+      std::sort(sorted.begin(), sorted.end());
+      float sum = 0.0f;
+      for(float time: sorted){
+         sum += time;
+      }
+      auto percentile = [&sorted](float p){
+         return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()))];
+      };
+      // 环形缓冲中最近写入的一个
+      float last = history.times[(history.next + historySize - 1) % historySize % history.times.size()];
+      result.push_back({history.name, path, history.depth, history.start, last,
+         sum / sorted.size(), percentile(0.5f), percentile(0.95f), sorted.back()});
+   }
+   return result;
+}
+
+/*****************************************************/
+/*****************************************************/
+/****************** FULLSCREEN PASS ******************/
+/*****************************************************/
+/*****************************************************/
+
+// 用一个覆盖整个视口的三角形执行片段着色器，用于合成和后处理
+// 顶点着色器为 shader/drawer/fullscreen.vertex.glsl，片段着色器的输入为 in vec2 uv（视口中的位置，范围 0 到 1）
+//
+// 使用方式：
+//    TextureUnit::getInstance().bindUnit(0, texture);
+//    auto& program = pass.use();
+//    program.setUniform("source", 0);
+//    pass.draw();
+class FullscreenPass{
+private:
+   Program program;
+   // 全屏三角形不需要顶点数据，但是 core profile 下绘制时必须绑定一个 vao
+   VertexArray emptyArray;
+
+public:
+   explicit FullscreenPass(const std::string& fragmentPath):
+      program(
+         VertexShader::fromFile("../shader/drawer/fullscreen.vertex.glsl"),
+         FragmentShader::fromFile(fragmentPath)
+      ){}
+   FullscreenPass(const FullscreenPass&) = delete;
+   FullscreenPass& operator=(const FullscreenPass&) = delete;
+
+   // 绑定 program 和 vao，返回 program 用于设置 uniform
+   Program& use(){
+      VertexArrayContext::getInstance().bindContext(emptyArray);
+      ProgramContext::getInstance().bindContext(program);
+      return program;
+   }
+   // 关闭深度测试绘制全屏三角形，结束后重新开启深度测试；混合等其他状态由调用者设置
+   void draw(){
+      glDisable(GL_DEPTH_TEST);
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+      FrameStatistics::countDraw(GL_TRIANGLES, 3);
+      glEnable(GL_DEPTH_TEST);
+      checkGLError();
+   }
+};
+
+/*****************************************************/
+/*****************************************************/
+/******************  TRANSPARENCY  *******************/
+/*****************************************************/
+/*****************************************************/
+
+// 加权混合的顺序无关透明度（weighted blended order-independent transparency）
+// 透明物体以任意顺序绘制到两个目标中，不需要按深度排序，最后一次合成到当前帧缓冲：
+//    accum（GL_RGBA16F）：rgb 累加 颜色 * alpha * 权重，alpha 从 1 开始累乘 (1 - alpha)，即背后的颜色透过的比例
+//    weight（GL_R16F）：累加 alpha * 权重
+// 合成时的颜色为 accum.rgb / weight，再按透过的比例和背后不透明物体的颜色混合；权重随深度增大而减小，离相机近的表面占比更大
+// gl 3.3 不能为每个目标单独设置混合方式，所以透过的比例放在 accum 的 alpha 中，通过 glBlendFuncSeparate 分别混合颜色和 alpha
+// 不透明物体的深度复制到自己的深度纹理中，透明物体只进行深度测试，不写入深度
+//
+// 透明物体的片段着色器需要输出两个目标，见 shader/multi_light/cube.frag.glsl 中的 OIT：
+//    layout(location = 0) out vec4 accum;
+//    layout(location = 1) out float weight;
+// 创建时需要 gl 上下文，目标纹理按视口的大小分配，视口变大时重新创建
+class WeightedBlendedOIT{
+private:
+   FullscreenPass compositePass;
+   int width = 0;
+   int height = 0;
+   // 与当前帧缓冲的深度缓冲区相同的格式，glBlitFramebuffer 复制深度时要求格式一致；为 GL_NONE 时没有深度缓冲区
+   GLenum depthFormat = GL_NONE;
+   std::optional<RenderTexture> accum;
+   std::optional<RenderTexture> weight;
+   std::optional<RenderTexture> depth;
+   std::optional<Framebuffer> framebuffer;
+
+   static GLenum queryDepthFormat(GLint framebuffer);
+   void allocate(int width, int height, GLenum depthFormat);
+
+public:
+   WeightedBlendedOIT();
+   WeightedBlendedOIT(const WeightedBlendedOIT&) = delete;
+   WeightedBlendedOIT& operator=(const WeightedBlendedOIT&) = delete;
+
+   // 在当前绑定的帧缓冲的视口中绘制透明物体，draw 中绘制所有透明的 DrawUnit
+   // 结束后恢复帧缓冲、视口、混合和深度状态
+   void render(const std::function<void(void)>& draw);
+};
+
+inline WeightedBlendedOIT::WeightedBlendedOIT():
+   compositePass("../shader/drawer/oit.composite.frag.glsl"){}
+
+inline GLenum WeightedBlendedOIT::queryDepthFormat(GLint framebuffer){
+   // 窗口的默认帧缓冲和帧缓冲对象的附件名称不同
+   bool window = framebuffer == 0;
+   GLenum depthAttachment = window ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+   GLenum stencilAttachment = window ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+   GLint depthType = GL_NONE;
+   glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &depthType);
+   if(depthType == GL_NONE){
+      return GL_NONE;
+   }
+   GLint componentType = GL_NONE;
+   glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &componentType);
+   GLint stencilType = GL_NONE;
+   glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &stencilType);
+   checkGLError();
+   if(componentType == GL_FLOAT){
+      return GL_DEPTH_COMPONENT32F;
+   }
+   return stencilType != GL_NONE ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24;
+}
+
+inline void WeightedBlendedOIT::allocate(int width, int height, GLenum depthFormat){
+   this->width = width;
+   this->height = height;
+   this->depthFormat = depthFormat;
+   // 帧缓冲引用纹理，需要先于纹理销毁
+   framebuffer.reset();
+   accum.emplace(width, height, GL_RGBA16F);
+   weight.emplace(width, height, GL_R16F);
+   if(depthFormat != GL_NONE){
+      depth.emplace(width, height, depthFormat);
+   }else{
+      depth.reset();
+   }
+   framebuffer.emplace(std::vector<const RenderTexture*>{&*accum, &*weight}, depth.has_value() ? &*depth : nullptr);
+}
+
+inline void WeightedBlendedOIT::render(const std::function<void(void)>& draw){
+   GLint previous = 0;
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+   GLint viewport[4];
+   glGetIntegerv(GL_VIEWPORT, viewport);
+   glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+   GLenum format = queryDepthFormat(previous);
+   if(!framebuffer.has_value() || viewport[2] > width || viewport[3] > height || format != depthFormat){
+      allocate(std::max(viewport[2], width), std::max(viewport[3], height), format);
+   }
+
+   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer->getId());
+   if(depth.has_value()){
+      // 目标纹理只使用左下角的一部分
+      glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+         0, 0, viewport[2], viewport[3], GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+   }
+   FramebufferContext::getInstance().bindContext(*framebuffer);
+   glViewport(0, 0, viewport[2], viewport[3]);
+   const GLfloat accumClear[] = {0.0f, 0.0f, 0.0f, 1.0f};
+   const GLfloat weightClear[] = {0.0f, 0.0f, 0.0f, 0.0f};
+   glClearBufferfv(GL_COLOR, 0, accumClear);
+   glClearBufferfv(GL_COLOR, 1, weightClear);
+
+   glEnable(GL_BLEND);
+   // 颜色（以及 weight 的 r）相加，alpha 乘以 (1 - alpha)
+   glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+   if(depth.has_value()){
+      glDepthFunc(GL_LESS);
+      glDepthMask(GL_FALSE);
+   }else{
+      glDisable(GL_DEPTH_TEST);
+   }
+   draw();
+
+   // 合成：结果 = 透明颜色 * (1 - 透过的比例) + 背后的颜色 * 透过的比例
+   glBindFramebuffer(GL_FRAMEBUFFER, previous);
+   glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+   glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+   TextureUnit::getInstance().bindUnit(0, *accum);
+   TextureUnit::getInstance().bindUnit(1, *weight);
+   auto& composite = compositePass.use();
+   composite.setUniform("accum", 0);
+   composite.setUniform("weight", 1);
+   composite.setUniform("origin", glm::vec2(viewport[0], viewport[1]));
+   compositePass.draw();
+
+   glDisable(GL_BLEND);
+   glDepthMask(GL_TRUE);
+}
+
+/*****************************************************/
+/*****************************************************/
+/********************* DRAWUNIT **********************/
+/*****************************************************/
+/*****************************************************/
+
+// 一组共享同一个 vao（同一个 vbo 和 ebo）的绘制命令
+// 每条命令绘制 ebo 中的一段索引，并且索引值会加上 baseVertex，因此各段可以保留自己从 0 开始的索引
+struct MultiDrawCommand{
+   std::vector<GLsizei> counts;
+   // 索引段在 ebo 中的字节偏移
+   std::vector<const void*> offsets;
+   std::vector<GLint> baseVertexes;
+
+   // indexOffset: 索引段在 ebo 中的起始位置（以索引个数为单位）
+   void add(GLsizei count, std::size_t indexOffset, GLint baseVertex){
+      counts.push_back(count);
+      offsets.push_back(reinterpret_cast<const void*>(indexOffset * sizeof(unsigned int)));
+      baseVertexes.push_back(baseVertex);
+   }
+   GLsizei size() const { return counts.size(); }
+};
+
+class DrawUnit: public AutoLoader<DrawUnit>{
+private:
+   const VertexArray* vao;
+   Program* program;
+   const MultiDrawCommand* multiDraw;
+
+   using TexturePtr = std::variant<const Texture2D*, const Texture2DArray*, const TextureBuffer*>;
+   using TextureData = std::tuple<GLint, std::string, TexturePtr>;
+   std::vector<TextureData> textures;
+
+   // 可以是指向输入参数，也可以指向constUniforms的索引（int）
+   using UniformDataPtr = Insert<MapTo<MapTo<UniformDataPack, std::add_const_t>, std::add_pointer_t>, std::size_t>::apply<std::variant>;
+   using UniformData = std::pair<std::string, UniformDataPtr>;
+   std::vector<UniformData> uniforms;
+
+   using UniformConst = UniformDataPack::apply<std::variant>;
+   std::vector<UniformConst> constUniforms;
+
+   GLenum mode;
+
+   bool isEnable;
+
+   // 局部空间的包围盒和对应的模型矩阵，用于剔除；为空则总是绘制
+   const BoundingBox* bounds = nullptr;
+   const glm::mat4* boundsModel = nullptr;
+   // 当前帧是否被剔除，每帧由 Drawer 重新设置，和 enable/disable 无关
+   bool culled = false;
+   // 各级细节在 vao 的 ebo 中的索引段，为空则总是绘制 vao 的全部索引
+   const MeshLod* lod = nullptr;
+   // 当前使用的等级，由 Drawer 每帧依据投影到屏幕上的大小选择
+   int lodLevel = 0;
+
+public:
+   // 遮挡查询的状态，由 Drawer 在开启遮挡剔除后创建和维护
+   struct OcclusionState{
+      OcclusionQuery query;
+      // 查询已经发出，但结果还没有读取
+      bool pending = false;
+      // 最近一次读取到的结果
+      bool occluded = false;
+   };
+private:
+   std::optional<OcclusionState> occlusion;
+   // 当前帧的可见性不确定，由 GPU 依据还未返回的查询结果决定是否绘制
+   bool conditional = false;
+
+public:
+   // 渲染线程使用的快照：主线程在提交一帧前复制 DrawUnit 依赖的所有可变状态，渲染线程只读取快照
+   struct Snapshot{
+      // 与 uniforms 一一对应的值
+      std::vector<UniformConst> uniforms;
+      glm::mat4 boundsModel;
+      bool enable;
+   };
+private:
+   // 双缓冲：主线程写入一个的同时渲染线程读取另一个
+   std::array<Snapshot, 2> snapshots;
+   // 为 -1 时直接读取 uniform 指向的值，否则读取 snapshots[snapshotSlot]
+   int snapshotSlot = -1;
+
+   // 深度预渲染使用的 program，为空则不参与深度预渲染
+   Program* depthProgram = nullptr;
+   bool depthPositionOnly = true;
+   // depthProgram 中也存在的 uniform 和纹理在 uniforms 和 textures 中的索引
+   std::vector<std::size_t> depthUniforms;
+   std::vector<std::size_t> depthTextures;
+
+   // 透明的 DrawUnit 在所有不透明的 DrawUnit 之后由 WeightedBlendedOIT 绘制，不参与深度预渲染
+   bool transparent = false;
+
+   RefContainer<DrawUnit>& getRefContainer();
+
+   struct UniformRefVariant{
       using UniformDataRef = MapTo<MapTo<UniformDataPack, std::add_const_t>, std::reference_wrapper>::apply<std::variant>;
       UniformDataRef ref;
       bool mconst;
@@ -783,20 +2033,48 @@ private:
       UniformRefVariant(Type&& b): ref(std::cref(b)), mconst(true){}
    };
 
+   struct TextureRefVariant{
+      TexturePtr ptr;
+      TextureRefVariant(const Texture2D& texture): ptr(&texture){}
+      TextureRefVariant(const Texture2DArray& texture): ptr(&texture){}
+      TextureRefVariant(const TextureBuffer& texture): ptr(&texture){}
+   };
+
 public:
 
    // 调用者可以在外部构造参数
    using UniformParam = std::pair<std::string, UniformRefVariant>;
-   using TextureParam = std::tuple<GLint, std::string, std::reference_wrapper<const Texture2D>>;
+   using TextureParam = std::tuple<GLint, std::string, TextureRefVariant>;
+
+   DrawUnit(
+      const VertexArray& vao,
+      Program& program, 
+      std::vector<UniformParam> uniforms,
+      std::vector<TextureParam> textures,
+      GLenum mode = GL_TRIANGLES
+   ): DrawUnit(vao, nullptr, program, std::move(uniforms), std::move(textures), mode){}
 
+   // 使用 multiDraw 中的命令，通过一次 glMultiDrawElementsBaseVertex 绘制 vao 中的多段索引
+   // multiDraw 的生命周期需要比 DrawUnit 长
    DrawUnit(
       const VertexArray& vao,
+      const MultiDrawCommand& multiDraw,
       Program& program, 
       std::vector<UniformParam> uniforms,
       std::vector<TextureParam> textures,
       GLenum mode = GL_TRIANGLES
+   ): DrawUnit(vao, &multiDraw, program, std::move(uniforms), std::move(textures), mode){}
+
+private:
+   DrawUnit(
+      const VertexArray& vao,
+      const MultiDrawCommand* multiDraw,
+      Program& program, 
+      std::vector<UniformParam> uniforms,
+      std::vector<TextureParam> textures,
+      GLenum mode
    ):
-      vao(&vao), program(&program), 
+      vao(&vao), multiDraw(multiDraw), program(&program), 
       mode(mode), isEnable(true),
       AutoLoader<DrawUnit>(getRefContainer())
    {
@@ -825,9 +2103,10 @@ public:
          if(unitSet.contains(unit)){
             throwError("pass multiple texture with same unit");
          }
-         this->textures.emplace_back(unit, name, &ptr.get());
+         this->textures.emplace_back(unit, name, ptr.ptr);
       }
    }
+public:
 
    DrawUnit(DrawUnit&& drawUnit) = default;
    DrawUnit& operator=(DrawUnit&& drawUnit) = default;
@@ -835,41 +2114,129 @@ public:
    DrawUnit& operator=(const DrawUnit&) = delete;
    DrawUnit(const DrawUnit&) = delete;
 
+private:
+   void setUniform(std::size_t index, Program& program){
+      auto& [name, ptr] = uniforms[index];
+      if(snapshotSlot >= 0){
+         std::visit([&name, &program](auto& value){
+            program.setUniform(name, value);
+         }, snapshots[snapshotSlot].uniforms[index]);
+         return;
+      }
+      std::visit([this, &name, &program](auto ptr){
+         if constexpr (std::same_as<decltype(ptr), std::size_t>){
+            std::visit([&name, &program](auto& value){
+               program.setUniform(name, value);
+            }, constUniforms[ptr]);
+         }else{
+            program.setUniform(name, *ptr);
+         }
+      }, ptr);
+   }
+   void setTexture(const TextureData& texture, Program& program){
+      auto& [unit, name, ptr] = texture;
+      std::visit([unit](auto ptr){
+         TextureUnit::getInstance().bindUnit(unit, *ptr);
+      }, ptr);
+      program.setUniform(name, unit);
+   }
+   // vao 和 program 需要已经绑定
+   void drawElements(const VertexArray& array){
+      if(conditional){
+         // GL_QUERY_NO_WAIT：结果还没有返回时 GPU 直接绘制，不会等待
+         glBeginConditionalRender(occlusion->query.getId(), GL_QUERY_NO_WAIT);
+      }
+      if(multiDraw != nullptr){
+         glMultiDrawElementsBaseVertex(mode, multiDraw->counts.data(), GL_UNSIGNED_INT, multiDraw->offsets.data(), multiDraw->size(), multiDraw->baseVertexes.data());
+         FrameStatistics::countDraw(mode, std::accumulate(multiDraw->counts.begin(), multiDraw->counts.end(), std::uint64_t(0)));
+      }else if(array.isBindEBO()){
+         GLsizei count = array.getNumber();
+         const void* offset = nullptr;
+         if(lod != nullptr && lodLevel > 0){
+            auto& level = lod->levels[lodLevel];
+            count = level.count;
+            offset = reinterpret_cast<const void*>(level.offset * sizeof(unsigned int));
+         }
+         // 开始渲染，绘制三角形，索引数量为6（6/3=2个三角形），偏移为0（如果vao上下文没有绑定ebo则为数据的内存指针）
+         glDrawElements(mode, count, GL_UNSIGNED_INT, offset);
+         FrameStatistics::countDraw(mode, count);
+      }else{
+         glDrawArrays(mode, 0, array.getNumber());
+         FrameStatistics::countDraw(mode, array.getNumber());
+      }
+      if(conditional){
+         glEndConditionalRender();
+      }
+   }
+public:
    void setUniforms(){
-      for(auto& [name, ptr]: uniforms){
-         std::visit([this, &name](auto ptr){
-            if constexpr (std::same_as<decltype(ptr), std::size_t>){
-               std::visit([this, &name](auto& value){
-                  program->setUniform(name, value);
-               }, constUniforms[ptr]);
-            }else{
-               program->setUniform(name, *ptr);
-            }
-         }, ptr);
+      for(std::size_t i = 0; i < uniforms.size(); i++){
+         setUniform(i, *program);
       }
    }
    void setTexture(){
-      for(auto& [unit, name, ptr]: textures){
-         TextureUnit::getInstance().bindUnit(unit, *ptr);
-         program->setUniform(name, unit);
+      for(auto& texture: textures){
+         setTexture(texture, *program);
       }
    }
    
    void draw(){
-      if(isEnable){
+      if(isEnabled() && !culled){
          VertexArrayContext::getInstance().bindContext(*vao);
          ProgramContext::getInstance().bindContext(*program);
          setUniforms();
          setTexture();
          checkGLError();
-         
-         if(vao->isBindEBO()){
-            // 开始渲染，绘制三角形，索引数量为6（6/3=2个三角形），偏移为0（如果vao上下文没有绑定ebo则为数据的内存指针）
-            glDrawElements(mode, vao->getNumber(), GL_UNSIGNED_INT, 0);
-         }else{
-            glDrawArrays(mode, 0, vao->getNumber());
+         drawElements(*vao);
+      }
+   }
+
+   // 参与深度预渲染：使用只写深度的 depthProgram 绘制，depthProgram 只会收到它自身存在的 uniform 和纹理
+   // depthProgram 计算 gl_Position 的方式需要和 program 完全一致（并声明 invariant），否则主渲染时 GL_EQUAL 会失败
+   // positionOnly 为 true 时使用 vao 的只含位置的 vao，depthProgram 需要其他顶点属性时应设为 false
+   void setDepthPrePass(Program& depthProgram, bool positionOnly = true){
+      this->depthProgram = &depthProgram;
+      depthPositionOnly = positionOnly;
+      depthUniforms.clear();
+      depthTextures.clear();
+      for(std::size_t i = 0; i < uniforms.size(); i++){
+         if(depthProgram.hasUniform(uniforms[i].first)){
+            depthUniforms.push_back(i);
          }
       }
+      for(std::size_t i = 0; i < textures.size(); i++){
+         if(depthProgram.hasUniform(std::get<1>(textures[i]))){
+            depthTextures.push_back(i);
+         }
+      }
+   }
+   bool hasDepthPrePass() const {return depthProgram != nullptr;}
+   // program 需要输出 WeightedBlendedOIT 的两个目标
+   void setTransparent(bool transparent){
+      this->transparent = transparent;
+   }
+   bool isTransparent() const {return transparent;}
+   const Program& getProgram() const {return *program;}
+   const VertexArray& getVertexArray() const {return *vao;}
+
+   void drawDepth(){
+      if(isEnabled() && !culled && depthProgram != nullptr){
+         // 深度预渲染第一次执行时才创建只含位置的 vao
+         if(depthPositionOnly){
+            vao->createPositionArray();
+         }
+         auto& array = depthPositionOnly ? vao->getPositionArray() : *vao;
+         VertexArrayContext::getInstance().bindContext(array);
+         ProgramContext::getInstance().bindContext(*depthProgram);
+         for(auto i: depthUniforms){
+            setUniform(i, *depthProgram);
+         }
+         for(auto i: depthTextures){
+            setTexture(textures[i], *depthProgram);
+         }
+         checkGLError();
+         drawElements(array);
+      }
    }
 
    void enable(){
@@ -878,11 +2245,114 @@ public:
    void disable(){
       isEnable = false;
    }
+   bool isEnabled() const {
+      return snapshotSlot >= 0 ? snapshots[snapshotSlot].enable : isEnable;
+   }
+
+   // bounds 和 model 的生命周期需要比 DrawUnit 长
+   void setBounds(const BoundingBox& bounds, const glm::mat4& model){
+      this->bounds = &bounds;
+      this->boundsModel = &model;
+   }
+   bool hasBounds() const {
+      return bounds != nullptr && !bounds->isEmpty();
+   }
+   // 世界空间的包围球
+   BoundingSphere getWorldSphere() const {
+      return BoundingSphere::fromBox(*bounds, getBoundsModel());
+   }
+   void setCulled(bool culled){
+      this->culled = culled;
+   }
+   bool isCulled() const {return culled;}
+
+   // lod 的生命周期需要比 DrawUnit 长，各级的索引需要位于 vao 绑定的 ebo 中；使用 multiDraw 时不起作用
+   void setLod(const MeshLod& lod){
+      this->lod = &lod;
+      lodLevel = 0;
+   }
+   bool hasLod() const {
+      return lod != nullptr && multiDraw == nullptr && lod->size() > 1;
+   }
+   const MeshLod& getLod() const {return *lod;}
+   void setLodLevel(int level){
+      lodLevel = level;
+   }
+   int getLodLevel() const {return lodLevel;}
+
+   const BoundingBox& getBounds() const {return *bounds;}
+   const glm::mat4& getBoundsModel() const {
+      return snapshotSlot >= 0 ? snapshots[snapshotSlot].boundsModel : *boundsModel;
+   }
+
+   OcclusionState& getOcclusionState(){
+      if(!occlusion.has_value()){
+         occlusion.emplace();
+      }
+      return *occlusion;
+   }
+   // 只有存在还未读取的查询时才能进行条件渲染
+   void setConditional(bool conditional){
+      this->conditional = conditional && occlusion.has_value() && occlusion->pending;
+   }
+
+   // 主线程：将当前的 uniform 值、模型矩阵和是否启用复制到 slot 中
+   void takeSnapshot(int slot){
+      auto& snapshot = snapshots[slot];
+      snapshot.uniforms.resize(uniforms.size());
+      for(std::size_t i = 0; i < uniforms.size(); i++){
+         std::visit([this, &snapshot, i](auto ptr){
+            if constexpr (std::same_as<decltype(ptr), std::size_t>){
+               snapshot.uniforms[i] = constUniforms[ptr];
+            }else{
+               snapshot.uniforms[i] = *ptr;
+            }
+         }, uniforms[i].second);
+      }
+      snapshot.boundsModel = boundsModel != nullptr ? *boundsModel : glm::mat4(1.0f);
+      snapshot.enable = isEnable;
+   }
+   // 渲染线程：之后的绘制读取 slot 中的快照，为 -1 时恢复读取实时的值
+   void useSnapshot(int slot){
+      snapshotSlot = slot;
+   }
+};
+
+// 软件遮挡剔除使用的遮挡物，构造时自动注册到 Drawer 中
+// 遮挡物应当是少量大而不透明的网格，三角形数量越少越好
+class Occluder: public AutoLoader<Occluder>{
+private:
+   std::vector<glm::vec3> positions;
+   std::vector<unsigned int> indices;
+   const glm::mat4* model;
+   // 渲染线程使用的模型矩阵快照，见 DrawUnit::Snapshot
+   std::array<glm::mat4, 2> snapshotModels;
+
+   RefContainer<Occluder>& getRefContainer();
+public:
+   // model 的生命周期需要比 Occluder 长
+   Occluder(std::vector<glm::vec3> positions, std::vector<unsigned int> indices, const glm::mat4& model):
+      positions(std::move(positions)), indices(std::move(indices)), model(&model),
+      AutoLoader<Occluder>(getRefContainer()){}
+
+   Occluder(Occluder&&) = default;
+   Occluder& operator=(Occluder&&) = default;
+   Occluder(const Occluder&) = delete;
+   Occluder& operator=(const Occluder&) = delete;
+
+   // slot 为 -1 时使用实时的模型矩阵
+   OccluderMesh getMesh(int slot = -1) const {
+      return {&positions, &indices, slot >= 0 ? snapshotModels[slot] : *model};
+   }
+   void takeSnapshot(int slot){
+      snapshotModels[slot] = *model;
+   }
 };
 
 class Drawer: public ProactiveSingleton<Drawer>{
 private:
    RefContainer<DrawUnit> drawUnits;
+   RefContainer<Occluder> occluders;
    // 渲染宽高
    ObservableValue<int> width;
    ObservableValue<int> height;
@@ -890,24 +2360,119 @@ private:
    std::optional<ReactiveBinder<int, int>> reactiveWidth;
    std::optional<ReactiveBinder<int, int>> reactiveHeight;
 
+   // 窗口尺寸的回调在主线程中执行，而 gl 调用可能在渲染线程中，所以只记录尺寸，在下一次绘制时再设置
+   std::atomic<int> viewportWidth;
+   std::atomic<int> viewportHeight;
+   std::atomic<bool> viewportDirty {false};
+
    class SizeObserver: public AbstractValueObserver<int, int>{
    private:
+      Drawer& drawer;
       void handle(const int& width, const int& height) override {
-         // 设置opengl渲染在窗口中的起始位置和大小
-         glViewport(0, 0, width, height);
+         drawer.viewportWidth = width;
+         drawer.viewportHeight = height;
+         drawer.viewportDirty = true;
       }
    public:
-      SizeObserver(const ObservableValue<int>& width, const ObservableValue<int>& height): 
-         AbstractValueObserver<int, int>(width, height){}
+      SizeObserver(Drawer& drawer, const ObservableValue<int>& width, const ObservableValue<int>& height): 
+         AbstractValueObserver<int, int>(width, height), drawer(drawer){}
    };
 
    SizeObserver sizeObserver;
 
+   // 视锥体剔除使用的相机
+   const glm::mat4* cullingProjection = nullptr;
+   const glm::mat4* cullingView = nullptr;
+   // 渲染线程使用的相机快照（projection, view），见 DrawUnit::Snapshot
+   std::array<std::pair<glm::mat4, glm::mat4>, 2> cameraSnapshots;
+   int snapshotSlot = -1;
+   const glm::mat4& getCullingProjection() const {
+      return snapshotSlot >= 0 ? cameraSnapshots[snapshotSlot].first : *cullingProjection;
+   }
+   const glm::mat4& getCullingView() const {
+      return snapshotSlot >= 0 ? cameraSnapshots[snapshotSlot].second : *cullingView;
+   }
+   // 开关和统计数据可能由主线程读写，而绘制在渲染线程中进行，因此使用原子变量
+   std::atomic<bool> frustumCulling = true;
+   std::atomic<int> culledNumber = 0;
+   // 依据包围球投影到屏幕上的大小为设置了 MeshLod 的 DrawUnit 选择细节等级
+   LodSelector lodSelector;
+   std::atomic<bool> lodSelection = true;
+   std::atomic<int> reducedLodNumber = 0;
+   // 每帧复用的缓冲区
+   SphereBatch cullingSpheres;
+   std::vector<DrawUnit*> cullingUnits;
+   std::vector<unsigned char> cullingVisible;
+
+   // 遮挡查询时代替 DrawUnit 绘制的包围盒，只写入查询结果，不写入颜色和深度
+   class OcclusionProxy{
+   private:
+      VertexBuffer vbo;
+      ElementBuffer ebo;
+   public:
+      VertexArray vao;
+      Program program;
+      OcclusionProxy();
+   };
+   std::optional<OcclusionProxy> occlusionProxy;
+   std::atomic<bool> occlusionCulling = false;
+   std::atomic<int> occludedNumber = 0;
+   std::atomic<int> conditionalNumber = 0;
+   // 本帧需要发出查询的 DrawUnit
+   std::vector<DrawUnit*> occlusionUnits;
+
+   // 存在透明的 DrawUnit 时才创建
+   std::optional<WeightedBlendedOIT> transparency;
+   std::atomic<int> transparentNumber = 0;
+   // 在不透明物体之后绘制本帧可见的透明 DrawUnit
+   void drawTransparent();
+
+   // 软件遮挡剔除，开启时才创建
+   std::optional<HiZCuller> hiZCuller;
+   std::atomic<bool> softwareOcclusionCulling = false;
+   std::atomic<int> softwareOccludedNumber = 0;
+   std::vector<OccluderMesh> occluderMeshes;
+   std::vector<BoundingBox> softwareCullingBounds;
+   std::vector<glm::mat4> softwareCullingModels;
+   std::vector<unsigned char> softwareCullingVisible;
+
+   std::atomic<bool> depthPrePass = false;
+   // 主渲染中通过深度测试的片段数，除以像素数即为平均每个像素着色的次数
+   // 查询结果延迟几帧读取，轮流使用多个查询对象
+   static constexpr int overdrawQueryNumber = 3;
+   std::array<Query<GL_SAMPLES_PASSED>, overdrawQueryNumber> overdrawQueries;
+   std::array<bool, overdrawQueryNumber> overdrawPending {};
+   // 发出查询时视口的像素数，pipeline 可能以不同于窗口的分辨率调用 drawScene
+   std::array<int, overdrawQueryNumber> overdrawPixels {};
+   int overdrawIndex = 0;
+   std::atomic<float> overdraw = 0.0f;
+   void readOverdraw();
+
+   // 在绘制前为每个 DrawUnit 设置本帧是否被剔除
+   void cull();
+   // 在视锥体剔除之后为可见的 DrawUnit 选择细节等级
+   void selectLod();
+   // 在 CPU 上光栅化遮挡物，剔除被挡住的 DrawUnit
+   void softwareCull();
+   // 读取之前帧的查询结果，决定本帧是否绘制
+   void updateOcclusion();
+   // 在所有 DrawUnit 绘制完成、深度缓冲区完整后绘制包围盒并发出查询，结果在之后的帧中使用
+   void issueOcclusionQueries();
+
+   // 不为空时代替 drawScene 绘制场景，见 setPipeline
+   std::function<void(int, int)> pipeline;
+
+   GpuProfiler* profiler = nullptr;
+
 public: 
+   // 每帧开始时清除窗口的颜色
+   static constexpr std::array<float, 4> clearColor {0.2f, 0.3f, 0.3f, 1.0f};
+
    Drawer():
       width(Context::getInstance().getWidth().get()),
       height(Context::getInstance().getHeight().get()),
-      sizeObserver(width, height),
+      viewportWidth(*width), viewportHeight(*height),
+      sizeObserver(*this, width, height),
       reactiveWidth(std::in_place, [](auto width){return width;}, this->width, Context::getInstance().getWidth()),
       reactiveHeight(std::in_place, [](auto height){return height;}, this->height, Context::getInstance().getHeight())
    {
@@ -918,29 +2483,433 @@ public:
       glEnable(GL_DEPTH_TEST);
    }
    void draw(const std::function<void(void)>& customDraw = []{});
+   // 在当前绑定的帧缓冲中绘制所有 DrawUnit，开启深度预渲染时先只写深度，再以 GL_EQUAL 着色
+   // 帧缓冲需要有深度缓冲区；遮挡查询的包围盒和 overdraw 的统计也在这里，因此每帧只应调用一次
+   void drawScene();
+   // 设置多 pass 的绘制流程（如 RenderGraph::execute），参数为视口的宽高
+   // 剔除之后调用 pipeline 代替直接绘制场景，pipeline 中需要自行调用 drawScene，结束时需要绑定默认帧缓冲
+   // customDraw（如 GUI）仍然在 pipeline 之后直接绘制到窗口上
+   // 设置 pipeline 后 draw 不再清除默认帧缓冲，pipeline 写入窗口的 pass 需要覆盖整个窗口
+   void setPipeline(std::function<void(int width, int height)> pipeline){
+      this->pipeline = std::move(pipeline);
+   }
+   // 不为空时每帧记录 GPU 时间，profiler 需要比 drawer 的绘制活得长，为空时停止记录
+   void setProfiler(GpuProfiler* profiler){
+      this->profiler = profiler;
+   }
 
    RefContainer<DrawUnit>& getDrawUnitContainer() { return drawUnits; }
+   RefContainer<Occluder>& getOccluderContainer() { return occluders; }
+
+   // 设置剔除使用的相机，视锥体由 projection * view 得到；矩阵的生命周期需要比 Drawer 长
+   void setCullingCamera(const glm::mat4& projection, const glm::mat4& view){
+      cullingProjection = &projection;
+      cullingView = &view;
+   }
+   void enableFrustumCulling(bool enable){
+      frustumCulling = enable;
+   }
+   // 上一帧被视锥体剔除的 DrawUnit 数量
+   int getCulledNumber() const { return culledNumber; }
+
+   // 细节等级：设置了 MeshLod 和包围盒的 DrawUnit 依据投影大小绘制更简单的索引段，需要设置剔除使用的相机
+   // 关闭时总是绘制第 0 级
+   void enableLodSelection(bool enable){
+      lodSelection = enable;
+   }
+   bool isLodSelection() const { return lodSelection; }
+   // 分界和滞后比例需要在开始绘制之前设置
+   LodSelector& getLodSelector() { return lodSelector; }
+   // 上一帧没有使用第 0 级绘制的 DrawUnit 数量
+   int getReducedLodNumber() const { return reducedLodNumber; }
+
+   // 遮挡剔除：在视锥体剔除之后，用包围盒的遮挡查询结果跳过被挡住的 DrawUnit
+   // 结果延迟一帧使用以避免等待 GPU，因此刚刚变为可见的物体会晚一帧出现
+   // 可以在主线程中调用，gl 资源在之后的绘制中创建
+   void enableOcclusionCulling(bool enable){
+      occlusionCulling = enable;
+   }
+   bool isOcclusionCulling() const { return occlusionCulling; }
+   // 上一帧依据查询结果被跳过的 DrawUnit 数量
+   int getOccludedNumber() const { return occludedNumber; }
+   // 上一帧查询结果还未返回，交给 GPU 条件渲染的 DrawUnit 数量
+   int getConditionalNumber() const { return conditionalNumber; }
+
+   // 软件遮挡剔除：在视锥体剔除之后、硬件遮挡查询之前，用 CPU 光栅化的遮挡物剔除 DrawUnit
+   // 不依赖 GPU 的结果，因此没有延迟；只有注册了 Occluder 时才有效果
+   void enableSoftwareOcclusionCulling(bool enable){
+      softwareOcclusionCulling = enable;
+   }
+   bool isSoftwareOcclusionCulling() const { return softwareOcclusionCulling; }
+   // 上一帧被软件遮挡剔除的 DrawUnit 数量
+   int getSoftwareOccludedNumber() const { return softwareOccludedNumber; }
+
+   // 深度预渲染：先用只写深度的 program 绘制设置了 setDepthPrePass 的 DrawUnit，
+   // 主渲染时这些 DrawUnit 以 GL_EQUAL 进行深度测试并关闭深度写入，每个可见像素只进行一次光照计算
+   void enableDepthPrePass(bool enable){
+      depthPrePass = enable;
+   }
+   bool isDepthPrePass() const { return depthPrePass; }
+   // 最近一次得到的主渲染中平均每个像素着色的片段数
+   float getOverdraw() const { return overdraw; }
+   // 上一帧绘制的透明 DrawUnit 数量
+   int getTransparentNumber() const { return transparentNumber; }
+
+   // 主线程：复制所有 DrawUnit、遮挡物和相机的当前状态到 slot 中，供渲染线程使用
+   // 调用时渲染线程不能正在读取同一个 slot
+   void takeSnapshot(int slot);
+   // 渲染线程：依据 slot 中的快照绘制一帧
+   void drawSnapshot(int slot, const std::function<void(void)>& customDraw = []{});
 };
 
+inline Drawer::OcclusionProxy::OcclusionProxy():
+   vbo(std::vector<glm::vec3>{
+      {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+      {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f, 1.0f},
+   }),
+   ebo(std::vector<unsigned int>{
+      0, 2, 1, 0, 3, 2,
+      4, 5, 6, 4, 6, 7,
+      0, 1, 5, 0, 5, 4,
+      3, 6, 2, 3, 7, 6,
+      0, 4, 7, 0, 7, 3,
+      1, 2, 6, 1, 6, 5,
+   }),
+   program(
+      VertexShader::fromFile("../shader/drawer/occlusion.vertex.glsl"),
+      FragmentShader::fromFile("../shader/drawer/occlusion.frag.glsl")
+   )
+{
+   vao.addAttribute<glm::vec3>(vbo, 0, sizeof(glm::vec3), 0);
+   vao.bindElementBuffer(ebo);
+}
+
+inline void Drawer::cull(){
+   cullingSpheres.clear();
+   cullingUnits.clear();
+   culledNumber = 0;
+   bool culling = frustumCulling && cullingProjection != nullptr;
+   for(auto& drawUnit: drawUnits){
+      drawUnit.setCulled(false);
+      if(culling && drawUnit.hasBounds()){
+         cullingUnits.push_back(&drawUnit);
+         cullingSpheres.add(drawUnit.getWorldSphere());
+      }
+   }
+   if(cullingUnits.empty()){
+      return;
+   }
+   cullingSpheres.cull(Frustum::fromMatrix(getCullingProjection() * getCullingView()), cullingVisible);
+   for(int i = 0; i < cullingUnits.size(); i++){
+      if(!cullingVisible[i]){
+         cullingUnits[i]->setCulled(true);
+         culledNumber++;
+      }
+   }
+}
 
 
-inline void Drawer::draw(const std::function<void(void)>& customDraw){
-   // 设置清除缓冲区的颜色并清除缓冲区
-   glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-   // 同时清除颜色缓冲区和深度缓冲区
-   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+inline void Drawer::selectLod(){
+   reducedLodNumber = 0;
+   bool selection = lodSelection && cullingProjection != nullptr;
+   for(auto& drawUnit: drawUnits){
+      if(!drawUnit.hasLod()){
+         continue;
+      }
+      if(!selection || !drawUnit.hasBounds()){
+         drawUnit.setLodLevel(0);
+         continue;
+      }
+      // 被剔除的 DrawUnit 保留原来的等级，重新可见时从这一级开始
+      if(drawUnit.isCulled()){
+         continue;
+      }
+      float size = LodSelector::projectedSize(drawUnit.getWorldSphere(), getCullingProjection(), getCullingView());
+      int level = lodSelector.select(size, drawUnit.getLodLevel(), drawUnit.getLod().size());
+      drawUnit.setLodLevel(level);
+      if(level > 0){
+         reducedLodNumber++;
+      }
+   }
+}
+
+inline void Drawer::softwareCull(){
+   softwareOccludedNumber = 0;
+   if(!softwareOcclusionCulling || cullingProjection == nullptr || occluders.size() == 0){
+      return;
+   }
+   if(!hiZCuller.has_value()){
+      hiZCuller.emplace();
+   }
+   occluderMeshes.clear();
+   for(auto& occluder: occluders){
+      occluderMeshes.push_back(occluder.getMesh(snapshotSlot));
+   }
+   hiZCuller->render(occluderMeshes, getCullingProjection() * getCullingView());
+
+   cullingUnits.clear();
+   softwareCullingBounds.clear();
+   softwareCullingModels.clear();
    for(auto& drawUnit: drawUnits){
+      if(drawUnit.isEnabled() && !drawUnit.isCulled() && drawUnit.hasBounds()){
+         cullingUnits.push_back(&drawUnit);
+         softwareCullingBounds.push_back(drawUnit.getBounds());
+         softwareCullingModels.push_back(drawUnit.getBoundsModel());
+      }
+   }
+   hiZCuller->test(softwareCullingBounds, softwareCullingModels, softwareCullingVisible);
+   for(int i = 0; i < cullingUnits.size(); i++){
+      if(!softwareCullingVisible[i]){
+         cullingUnits[i]->setCulled(true);
+         softwareOccludedNumber++;
+      }
+   }
+}
+
+inline void Drawer::updateOcclusion(){
+   occlusionUnits.clear();
+   occludedNumber = 0;
+   conditionalNumber = 0;
+   bool occlusion = occlusionCulling && cullingProjection != nullptr;
+   glm::vec3 cameraPosition {0.0f};
+   float nearPlane = 0.0f;
+   if(occlusion){
+      cameraPosition = glm::vec3(glm::inverse(getCullingView())[3]);
+      // 透视投影矩阵的近平面距离
+      nearPlane = getCullingProjection()[3][2] / (getCullingProjection()[2][2] - 1.0f);
+   }
+   for(auto& drawUnit: drawUnits){
+      drawUnit.setConditional(false);
+      if(!occlusion || !drawUnit.isEnabled() || !drawUnit.hasBounds()){
+         continue;
+      }
+      auto& state = drawUnit.getOcclusionState();
+      if(state.pending && state.query.isAvailable()){
+         state.occluded = state.query.getResult() == 0;
+         state.pending = false;
+      }
+      if(drawUnit.isCulled()){
+         // 重新进入视锥体时先视为可见，避免使用过期的结果
+         state.occluded = false;
+         continue;
+      }
+      auto sphere = drawUnit.getWorldSphere();
+      if(glm::distance(cameraPosition, sphere.center) <= sphere.radius + nearPlane){
+         // 相机在包围盒附近时包围盒的正面会被近平面裁掉，查询结果不可信，直接视为可见
+         state.occluded = false;
+         continue;
+      }
+      if(state.pending){
+         drawUnit.setConditional(true);
+         conditionalNumber++;
+         continue;
+      }
+      if(state.occluded){
+         drawUnit.setCulled(true);
+         occludedNumber++;
+      }
+      occlusionUnits.push_back(&drawUnit);
+   }
+}
+
+inline void Drawer::issueOcclusionQueries(){
+   if(occlusionUnits.empty()){
+      return;
+   }
+   if(!occlusionProxy.has_value()){
+      occlusionProxy.emplace();
+   }
+   auto& proxy = *occlusionProxy;
+   VertexArrayContext::getInstance().bindContext(proxy.vao);
+   ProgramContext::getInstance().bindContext(proxy.program);
+   proxy.program.setUniform("projectionView", getCullingProjection() * getCullingView());
+   glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+   glDepthMask(GL_FALSE);
+   // 可见物体自身已经写入了深度，包围盒和它的表面重合时也需要通过
+   glDepthFunc(GL_LEQUAL);
+   for(auto drawUnit: occlusionUnits){
+      auto& bounds = drawUnit->getBounds();
+      // 稍微放大包围盒，避免厚度为 0 以及和物体表面的深度冲突
+      glm::vec3 padding = (bounds.max - bounds.min) * 0.01f + 1e-4f;
+      glm::mat4 box = glm::translate(glm::mat4(1.0f), bounds.min - padding);
+      box = glm::scale(box, bounds.max - bounds.min + padding * 2.0f);
+      proxy.program.setUniform("model", drawUnit->getBoundsModel() * box);
+      auto& state = drawUnit->getOcclusionState();
+      state.query.begin();
+      glDrawElements(GL_TRIANGLES, proxy.vao.getNumber(), GL_UNSIGNED_INT, 0);
+      FrameStatistics::countDraw(GL_TRIANGLES, proxy.vao.getNumber());
+      state.query.end();
+      state.pending = true;
+   }
+   glDepthFunc(GL_LESS);
+   glDepthMask(GL_TRUE);
+   glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+   checkGLError();
+}
+
+inline void Drawer::readOverdraw(){
+   auto& query = overdrawQueries[overdrawIndex];
+   if(overdrawPending[overdrawIndex] && query.isAvailable()){
+      overdraw = static_cast<float>(query.getResult()) / std::max(1, overdrawPixels[overdrawIndex]);
+      overdrawPending[overdrawIndex] = false;
+   }
+}
+
+inline void Drawer::drawScene(){
+   if(depthPrePass){
+      GpuScope scope {"depth pre-pass"};
+      glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+      for(auto& drawUnit: drawUnits){
+         if(!drawUnit.isTransparent()){
+            drawUnit.drawDepth();
+         }
+      }
+      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+   }
+   // 还没有读取的查询不能重新开始，跳过这一帧的统计
+   bool measure = !overdrawPending[overdrawIndex];
+   if(measure){
+      GLint viewport[4];
+      glGetIntegerv(GL_VIEWPORT, viewport);
+      overdrawPixels[overdrawIndex] = viewport[2] * viewport[3];
+      overdrawQueries[overdrawIndex].begin();
+   }
+   // 连续使用同一个 program 的 DrawUnit 作为一个区间
+   std::optional<GpuScope> group;
+   GLuint groupProgram = 0;
+   for(auto& drawUnit: drawUnits){
+      if(drawUnit.isTransparent()){
+         continue;
+      }
+      if(GpuProfiler::getActive() != nullptr && (!group.has_value() || drawUnit.getProgram().getId() != groupProgram)){
+         group.reset();
+         groupProgram = drawUnit.getProgram().getId();
+         group.emplace(fmt::format("program {}", groupProgram));
+      }
+      if(depthPrePass && drawUnit.hasDepthPrePass()){
+         glDepthFunc(GL_EQUAL);
+         glDepthMask(GL_FALSE);
+      }else{
+         glDepthFunc(GL_LESS);
+         glDepthMask(GL_TRUE);
+      }
       drawUnit.draw();
    }
-   customDraw();
-   glfwSwapBuffers(Context::getInstance().getWindow());
+   group.reset();
+   glDepthFunc(GL_LESS);
+   glDepthMask(GL_TRUE);
+   if(measure){
+      overdrawQueries[overdrawIndex].end();
+      overdrawPending[overdrawIndex] = true;
+   }
+   overdrawIndex = (overdrawIndex + 1) % overdrawQueryNumber;
+   // 下一帧要使用的查询是 overdrawQueryNumber - 1 帧之前发出的
+   readOverdraw();
+   drawTransparent();
+   GpuScope scope {"occlusion queries"};
+   issueOcclusionQueries();
+}
+
+inline void Drawer::drawTransparent(){
+   int number = 0;
+   for(auto& drawUnit: drawUnits){
+      if(drawUnit.isTransparent() && drawUnit.isEnabled() && !drawUnit.isCulled()){
+         number++;
+      }
+   }
+   transparentNumber = number;
+   if(number == 0){
+      return;
+   }
+   if(!transparency.has_value()){
+      transparency.emplace();
+   }
+   GpuScope scope {"transparency"};
+   transparency->render([this]{
+      for(auto& drawUnit: drawUnits){
+         if(drawUnit.isTransparent()){
+            drawUnit.draw();
+         }
+      }
+   });
+}
+
+inline void Drawer::takeSnapshot(int slot){
+   for(auto& drawUnit: drawUnits){
+      drawUnit.takeSnapshot(slot);
+   }
+   for(auto& occluder: occluders){
+      occluder.takeSnapshot(slot);
+   }
+   if(cullingProjection != nullptr){
+      cameraSnapshots[slot] = {*cullingProjection, *cullingView};
+   }
+}
+
+inline void Drawer::drawSnapshot(int slot, const std::function<void(void)>& customDraw){
+   snapshotSlot = slot;
+   for(auto& drawUnit: drawUnits){
+      drawUnit.useSnapshot(slot);
+   }
+   draw(customDraw);
+}
+
+inline void Drawer::draw(const std::function<void(void)>& customDraw){
+   if(profiler != nullptr){
+      profiler->beginFrame();
+   }
+   if(viewportDirty.exchange(false)){
+      // 设置opengl渲染在窗口中的起始位置和大小
+      glViewport(0, 0, viewportWidth, viewportHeight);
+   }
+   // pipeline 自己清除它的离屏纹理并覆盖整个窗口，此时清除默认帧缓冲是多余的
+   if(!pipeline){
+      GpuScope scope {"clear"};
+      // 设置清除缓冲区的颜色并清除缓冲区
+      glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+      // 同时清除颜色缓冲区和深度缓冲区
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   }
+   cull();
+   selectLod();
+   softwareCull();
+   updateOcclusion();
+   {
+      GpuScope scope {"scene"};
+      if(pipeline){
+         pipeline(viewportWidth, viewportHeight);
+      }else{
+         drawScene();
+      }
+   }
+   {
+      GpuScope scope {"custom draw"};
+      customDraw();
+   }
+   GLTrace::frame();
+   if(!Context::getInstance().isHeadless()){
+      // 离屏绘制时总是不等待垂直同步
+      FramePacer::applySwapInterval();
+   }
+   {
+      GpuScope scope {"swap"};
+      glfwSwapBuffers(Context::getInstance().getWindow());
+   }
    checkGLError();
+   if(profiler != nullptr){
+      profiler->endFrame();
+   }
+   FrameStatistics::endFrame();
 }
 
 inline RefContainer<DrawUnit>& DrawUnit::getRefContainer() {
    return Drawer::getInstance().getDrawUnitContainer();
 }
 
+inline RefContainer<Occluder>& Occluder::getRefContainer() {
+   return Drawer::getInstance().getOccluderContainer();
+}
+
 
 
 
@@ -0,0 +1,184 @@
+#ifndef _MINECPP_SCHEDULER_H_
+#define _MINECPP_SCHEDULER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/****************** FRAME SCHEDULER ******************/
+/*****************************************************/
+/*****************************************************/
+
+// 把耗时的一次性工作（生成 DrawUnit、上传纹理和缓冲等）分摊到多帧中执行，避免单帧卡顿
+// 每帧调用一次 run，按优先级从高到低（相同优先级按加入顺序）执行任务，直到用完以毫秒计的预算，剩下的留到之后的帧
+// 任务可以分步执行：返回 false 表示还没有完成，之后会再次调用；返回 void 的任务只调用一次
+// 每帧至少执行一步，因此耗时超过预算的任务也不会一直等待
+//
+// 使用方式：
+//    FrameScheduler scheduler {2.0f};
+//    scheduler.enqueue([&]{ uploadTexture(); }, 1, 0.5f);
+//    scheduler.enqueue(lightScene.generateDrawUnitsTask(), 0, 0.2f, "draw units");
+//    ctx.startLoop([&]{ scheduler.run(); drawer.draw(); });
+// 可以在其他线程或任务中加入任务，任务本身在调用 run 的线程中执行
+class FrameScheduler{
+public:
+   // 返回以毫秒计的当前时间
+   using Clock = std::function<double(void)>;
+
+   struct Statistics{
+      // 上一次 run 的预算和实际使用的时间，单位为毫秒
+      float budget = 0.0f;
+      float usedTime = 0.0f;
+      // 上一次 run 执行的步数，分步任务的每一步都计算在内
+      int executedNumber = 0;
+      // 上一次 run 完成的任务数
+      int completedNumber = 0;
+      // 上一次 run 结束后还在队列中的任务数，以及它们下一步预计耗时之和
+      int queueDepth = 0;
+      float queuedCost = 0.0f;
+   };
+
+   static double steadyClock(){
+      using namespace std::chrono;
+      return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+   }
+
+private:
+   struct Task{
+      std::string name;
+      int priority;
+      std::uint64_t sequence;
+      // 预计每一步的耗时，执行后用实际耗时修正
+      float cost;
+      std::function<bool(void)> func;
+   };
+
+   // 按执行顺序排列
+   std::vector<Task> tasks;
+   std::uint64_t sequence = 0;
+   mutable std::mutex mutex;
+   std::atomic<float> budget;
+   Clock clock;
+   Statistics statistics;
+
+   static bool before(const Task& a, const Task& b){
+      return a.priority != b.priority ? a.priority > b.priority : a.sequence < b.sequence;
+   }
+   void insert(Task&& task){
+      auto it = std::upper_bound(tasks.begin(), tasks.end(), task, before);
+      tasks.insert(it, std::move(task));
+   }
+   bool contains(const std::string& name) const {
+      return std::any_of(tasks.begin(), tasks.end(), [&name](auto& task){return task.name == name;});
+   }
+
+public:
+   // budget：每帧可以使用的毫秒数
+   explicit FrameScheduler(float budget = 2.0f, Clock clock = steadyClock): budget(budget), clock(std::move(clock)){}
+   FrameScheduler(const FrameScheduler&) = delete;
+   FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+   void setBudget(float budget){
+      this->budget = budget;
+   }
+   float getBudget() const { return budget; }
+
+   // priority：越大越先执行
+   // cost：预计每一步的耗时（毫秒），剩余预算不足时留到之后的帧
+   // name：不为空时，队列中同名的任务会被替换（如多次触发的场景重建只需要执行最后一次）
+   template<typename Callable>
+   void enqueue(Callable&& callable, int priority = 0, float cost = 1.0f, const std::string& name = ""){
+      std::function<bool(void)> func;
+      if constexpr(std::is_void_v<std::invoke_result_t<Callable&>>){
+         func = [callable = std::forward<Callable>(callable)]() mutable {
+            callable();
+            return true;
+         };
+      }else{
+         func = std::forward<Callable>(callable);
+      }
+      std::lock_guard lock {mutex};
+      if(!name.empty()){
+         std::erase_if(tasks, [&name](auto& task){return task.name == name;});
+      }
+      insert({name, priority, sequence++, cost, std::move(func)});
+   }
+
+   // 移除队列中同名的任务，正在执行的任务不受影响
+   void cancel(const std::string& name){
+      std::lock_guard lock {mutex};
+      std::erase_if(tasks, [&name](auto& task){return task.name == name;});
+   }
+
+   std::size_t size() const {
+      std::lock_guard lock {mutex};
+      return tasks.size();
+   }
+   bool empty() const { return size() == 0; }
+
+   // 执行本帧的任务
+   void run(){
+      double start = clock();
+      float frameBudget = budget;
+      Statistics current;
+      current.budget = frameBudget;
+      while(true){
+         Task task;
+         {
+            std::lock_guard lock {mutex};
+            if(tasks.empty()){
+               break;
+            }
+            double elapsed = clock() - start;
+            if(current.executedNumber > 0 && elapsed + tasks.front().cost > frameBudget){
+               break;
+            }
+            task = std::move(tasks.front());
+            tasks.erase(tasks.begin());
+         }
+         double begin = clock();
+         bool completed = task.func();
+         float time = clock() - begin;
+         current.executedNumber++;
+         if(completed){
+            current.completedNumber++;
+            continue;
+         }
+         // 平滑地修正耗时的估计
+         task.cost += (time - task.cost) * 0.5f;
+         std::lock_guard lock {mutex};
+         // 执行期间加入了同名的任务时，以新任务为准
+         if(task.name.empty() || !contains(task.name)){
+            insert(std::move(task));
+         }
+      }
+      current.usedTime = clock() - start;
+      std::lock_guard lock {mutex};
+      current.queueDepth = tasks.size();
+      for(auto& task: tasks){
+         current.queuedCost += task.cost;
+      }
+      statistics = current;
+   }
+
+   Statistics getStatistics() const {
+      std::lock_guard lock {mutex};
+      return statistics;
+   }
+};
+
+} // namespace minecpp
+
+#endif // _MINECPP_SCHEDULER_H_
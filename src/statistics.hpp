@@ -0,0 +1,127 @@
+#ifndef _MINECPP_STATISTICS_H_
+#define _MINECPP_STATISTICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <fmt/format.h>
+#include <gl.h>
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/***************** FRAME STATISTICS ******************/
+/*****************************************************/
+/*****************************************************/
+
+// 一帧中提交给 gl 的工作量
+struct DrawCounters{
+   // glDraw* 的调用次数，glMultiDrawElementsBaseVertex 算作一次
+   int drawCalls = 0;
+   std::uint64_t triangles = 0;
+   int programBinds = 0;
+   int vertexArrayBinds = 0;
+   int textureBinds = 0;
+   int uniformUploads = 0;
+   std::uint64_t uniformBytes = 0;
+   // glBufferData 和 glBufferSubData
+   int bufferUploads = 0;
+   std::uint64_t bufferBytes = 0;
+   int glErrorChecks = 0;
+};
+
+// 每帧提交给 gl 的工作量，由 resource.hpp 中的上下文、Program、Buffer 和 Drawer 在调用 gl 时累计
+// Drawer::draw 交换缓冲区后结束一帧：本帧的计数成为 getLastFrame 的结果，并清零重新开始
+// ImGui 通过自己加载的函数指针调用 gl，不计算在内
+//
+// 使用方式：
+//    auto last = FrameStatistics::getLastFrame();
+//    ImGui::Text("draw calls: %d", last.drawCalls);
+// 设置环境变量 MINECPP_STATS_CSV=<文件> 或调用 startCsv 时每帧写入一行 csv
+// 本帧的计数不加锁，只能在持有 gl 上下文的线程中累计；上一帧的结果可以在其他线程（如构建 GUI 的主线程）中读取
+class FrameStatistics{
+private:
+   static inline DrawCounters current;
+   static inline DrawCounters last;
+   static inline std::mutex lastMutex;
+   static inline std::atomic<std::uint64_t> frameNumber = 0;
+   static inline std::unique_ptr<std::ofstream> csv;
+
+public:
+   // 本帧到目前为止的计数，用于累计
+   static DrawCounters& getCurrent(){ return current; }
+   // 上一帧完整的计数
+   static DrawCounters getLastFrame(){
+      std::lock_guard lock {lastMutex};
+      return last;
+   }
+   // 已经结束的帧数
+   static std::uint64_t getFrameNumber(){ return frameNumber; }
+
+   // 按图元类型把索引或顶点数换算为三角形数
+   static void countDraw(GLenum mode, std::uint64_t count){
+      current.drawCalls++;
+      switch(mode){
+      case GL_TRIANGLES: current.triangles += count / 3; break;
+      case GL_TRIANGLE_STRIP: case GL_TRIANGLE_FAN: current.triangles += count > 2 ? count - 2 : 0; break;
+      default: break;
+      }
+   }
+   static void countUniform(std::size_t bytes){
+      current.uniformUploads++;
+      current.uniformBytes += bytes;
+   }
+   static void countBuffer(std::size_t bytes){
+      current.bufferUploads++;
+      current.bufferBytes += bytes;
+   }
+
+   static void endFrame(){
+      DrawCounters frame = current;
+      current = {};
+      {
+         std::lock_guard lock {lastMutex};
+         last = frame;
+      }
+      if(csv != nullptr){
+         *csv << fmt::format("{},{},{},{},{},{},{},{},{},{},{}\n", frameNumber.load(),
+            frame.drawCalls, frame.triangles, frame.programBinds, frame.vertexArrayBinds, frame.textureBinds,
+            frame.uniformUploads, frame.uniformBytes, frame.bufferUploads, frame.bufferBytes, frame.glErrorChecks);
+      }
+      frameNumber++;
+   }
+
+   // 之后每帧结束时写入一行，第一行为列名
+   static void startCsv(const std::string& path);
+   static void stopCsv(){
+      csv.reset();
+   }
+   static bool isLoggingCsv(){ return csv != nullptr; }
+};
+
+} // namespace minecpp
+
+// exception.hpp 的 getGlError 需要完整的 FrameStatistics，因此在类定义之后才 include
+#include "exception.hpp"
+
+namespace minecpp
+{
+
+inline void FrameStatistics::startCsv(const std::string& path){
+   auto file = std::make_unique<std::ofstream>(path);
+   if(!*file){
+      throwError(fmt::format("can not open {} for frame statistics", path));
+   }
+   *file << "frame,drawCalls,triangles,programBinds,vertexArrayBinds,textureBinds,"
+      "uniformUploads,uniformBytes,bufferUploads,bufferBytes,glErrorChecks\n";
+   csv = std::move(file);
+}
+
+} // namespace minecpp
+
+#endif // _MINECPP_STATISTICS_H_
@@ -0,0 +1,133 @@
+#ifndef _MINECPP_THREAD_H_
+#define _MINECPP_THREAD_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace minecpp
+{
+
+// 固定数量工作线程的线程池，任务按提交顺序执行
+// 注意：不要在任务内部调用 parallelFor 并等待，所有线程都在等待时会死锁
+class ThreadPool{
+private:
+   std::vector<std::thread> workers;
+   std::queue<std::function<void(void)>> tasks;
+   std::mutex mutex;
+   std::condition_variable condition;
+   bool stopped = false;
+
+   void work(){
+      while(true){
+         std::function<void(void)> task;
+         {
+            std::unique_lock lock {mutex};
+            condition.wait(lock, [this]{return stopped || !tasks.empty();});
+            if(stopped && tasks.empty()){
+               return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+         }
+         task();
+      }
+   }
+
+public:
+   explicit ThreadPool(std::size_t number = std::max(1u, std::thread::hardware_concurrency())){
+      workers.reserve(number);
+      for(std::size_t i = 0; i < number; i++){
+         workers.emplace_back([this]{work();});
+      }
+   }
+   ~ThreadPool(){
+      {
+         std::lock_guard lock {mutex};
+         stopped = true;
+      }
+      condition.notify_all();
+      for(auto& worker: workers){
+         worker.join();
+      }
+   }
+   // 线程不能移动和拷贝
+   ThreadPool(const ThreadPool&) = delete;
+   ThreadPool& operator=(const ThreadPool&) = delete;
+
+   std::size_t size() const { return workers.size(); }
+
+   template<typename Callable>
+   std::future<std::invoke_result_t<Callable>> submit(Callable&& callable){
+      using Result = std::invoke_result_t<Callable>;
+      // std::function 要求可拷贝，packaged_task 只能移动，所以用 shared_ptr 包一层
+      auto task = std::make_shared<std::packaged_task<Result(void)>>(std::forward<Callable>(callable));
+      auto future = task->get_future();
+      {
+         std::lock_guard lock {mutex};
+         tasks.emplace([task]{(*task)();});
+      }
+      condition.notify_one();
+      return future;
+   }
+
+   // 将 [0, count) 分成若干段并行执行 func(begin, end)，所有段执行完后返回
+   // 调用线程也会执行其中一段
+   void parallelFor(std::size_t count, const std::function<void(std::size_t, std::size_t)>& func){
+      if(count == 0){
+         return;
+      }
+      std::size_t chunkNumber = std::min(count, size() + 1);
+      std::size_t chunkSize = (count + chunkNumber - 1) / chunkNumber;
+      std::vector<std::future<void>> futures;
+      for(std::size_t begin = chunkSize; begin < count; begin += chunkSize){
+         futures.push_back(submit([&func, begin, end = std::min(count, begin + chunkSize)]{
+            func(begin, end);
+         }));
+      }
+      func(0, std::min(count, chunkSize));
+      for(auto& future: futures){
+         // get 会重新抛出任务中的异常
+         future.get();
+      }
+   }
+
+   // 对 [0, count) 中的每个下标执行 func(i)，每个线程执行完一项再领取下一项
+   // 适合每一项的耗时差别很大的情况（如大小不同的 mesh），下标小的项先开始执行
+   void parallelForEach(std::size_t count, const std::function<void(std::size_t)>& func){
+      std::atomic<std::size_t> next = 0;
+      std::exception_ptr error;
+      std::mutex errorMutex;
+      parallelFor(std::min(count, size() + 1), [&](std::size_t, std::size_t){
+         for(std::size_t i = next++; i < count; i = next++){
+            try{
+               func(i);
+            }catch(...){
+               // 记录第一个异常，其余的项不再执行
+               std::lock_guard lock {errorMutex};
+               if(!error){
+                  error = std::current_exception();
+               }
+               next = count;
+            }
+         }
+      });
+      if(error){
+         std::rethrow_exception(error);
+      }
+   }
+};
+
+} // namespace minecpp
+
+#endif // _MINECPP_THREAD_H_
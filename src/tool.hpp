@@ -3,12 +3,15 @@
 
 #include <concepts>
 #include <cstddef>
+#include <filesystem>
+#include <string>
 #include <tuple>
 #include <type_traits>
 #include <vector>
 #include <functional>
 #include <set>
 #include <map>
+#include <span>
 #include "exception.hpp"
 
 namespace minecpp
@@ -659,6 +662,10 @@ struct IsContiguousContainer<std::array<DataType, N>>: std::true_type{};
 template<typename DataType>
 struct IsContiguousContainer<std::vector<DataType>>: std::true_type{};
 
+// 指向其他内存（如映射的文件）的数据，value_type 不含 const
+template<typename DataType, std::size_t N>
+struct IsContiguousContainer<std::span<DataType, N>>: std::true_type{};
+
 template<typename Container>
 concept ContiguousContainer = IsContiguousContainer<Container>::value;
 
@@ -766,6 +773,17 @@ struct AllowList: private std::integral_constant<bool, allowList<Target, Types..
    using std::integral_constant<bool, allowList<Target, Types...>()>::value;
 };
 
+// 项目中的路径字符串都是 utf-8 编码（与传给 assimp 的相同），Windows 上直接构造 path 会按照本地代码页解释
+inline std::filesystem::path utf8Path(const std::string& path){
+   return std::filesystem::path(std::u8string(path.begin(), path.end()));
+}
+
+// 用于错误信息，path::string 在 Windows 上遇到本地代码页无法表示的字符时会抛出异常
+inline std::string utf8String(const std::filesystem::path& path){
+   std::u8string string = path.u8string();
+   return {string.begin(), string.end()};
+}
+
 } // namespace minecpp
 
 #endif // _MINECPP_TOOL_H_
\ No newline at end of file
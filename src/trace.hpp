@@ -0,0 +1,895 @@
+#ifndef _MINECPP_TRACE_H_
+#define _MINECPP_TRACE_H_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <gl.h>
+#include <fmt/format.h>
+#include "exception.hpp"
+
+namespace minecpp
+{
+
+/*****************************************************/
+/*****************************************************/
+/********************* GL TRACE **********************/
+/*****************************************************/
+/*****************************************************/
+
+// 录制 gl 命令流，用于在相同的负载上复现和比较性能问题（见 tools/replay.cpp）
+// 录制时把 glad 的函数指针替换为先写入命令再调用原函数的版本，因此不需要修改调用 gl 的代码
+// 录制的是资源、绑定、数据上传、uniform、状态和绘制相关的命令；查询结果、读取像素等只读的命令不录制，
+// ImGui 通过自己加载的函数指针调用 gl，也不会被录制
+//
+// 文件格式：文件头（magic、版本、宽、高），之后是一串命令，每条命令为 16 位的 TraceOp 加上参数，
+// 参数按原函数的类型直接写入，指针参数（如 ebo 中的偏移）写为 64 位整数，数据以 32 位长度加内容的形式写入
+
+enum class TraceOp: std::uint16_t{
+   FRAME,
+   GEN_BUFFERS, GEN_VERTEX_ARRAYS, GEN_TEXTURES, GEN_QUERIES, GEN_FRAMEBUFFERS,
+   DELETE_BUFFERS, DELETE_VERTEX_ARRAYS, DELETE_TEXTURES, DELETE_QUERIES, DELETE_FRAMEBUFFERS,
+   CREATE_SHADER, CREATE_PROGRAM, DELETE_SHADER, DELETE_PROGRAM,
+   SHADER_SOURCE, COMPILE_SHADER, ATTACH_SHADER, LINK_PROGRAM, GET_UNIFORM_LOCATION,
+   USE_PROGRAM, BIND_VERTEX_ARRAY, BIND_BUFFER, BIND_TEXTURE, BIND_FRAMEBUFFER, ACTIVE_TEXTURE,
+   BUFFER_DATA, BUFFER_SUB_DATA,
+   TEX_IMAGE_2D, TEX_IMAGE_3D, TEX_SUB_IMAGE_3D, TEX_PARAMETER_I, TEX_PARAMETER_FV, GENERATE_MIPMAP, TEX_BUFFER,
+   FRAMEBUFFER_TEXTURE_2D, DRAW_BUFFER, DRAW_BUFFERS, BLIT_FRAMEBUFFER,
+   VERTEX_ATTRIB_POINTER, ENABLE_VERTEX_ATTRIB_ARRAY,
+   UNIFORM_1I, UNIFORM_1F, UNIFORM_4F, UNIFORM_2FV, UNIFORM_3FV, UNIFORM_MATRIX_3FV, UNIFORM_MATRIX_4FV,
+   VIEWPORT, CLEAR_COLOR, CLEAR, CLEAR_BUFFER_FV, CLEAR_BUFFER_FI,
+   ENABLE, DISABLE, DEPTH_FUNC, DEPTH_MASK, COLOR_MASK, POLYGON_MODE, BLEND_FUNC, BLEND_FUNC_SEPARATE,
+   DRAW_ARRAYS, DRAW_ELEMENTS, MULTI_DRAW_ELEMENTS_BASE_VERTEX,
+   BEGIN_QUERY, END_QUERY, BEGIN_CONDITIONAL_RENDER, END_CONDITIONAL_RENDER,
+   COUNT
+};
+
+inline constexpr std::array<const char*, static_cast<std::size_t>(TraceOp::COUNT)> traceOpNames {
+   "Frame",
+   "GenBuffers", "GenVertexArrays", "GenTextures", "GenQueries", "GenFramebuffers",
+   "DeleteBuffers", "DeleteVertexArrays", "DeleteTextures", "DeleteQueries", "DeleteFramebuffers",
+   "CreateShader", "CreateProgram", "DeleteShader", "DeleteProgram",
+   "ShaderSource", "CompileShader", "AttachShader", "LinkProgram", "GetUniformLocation",
+   "UseProgram", "BindVertexArray", "BindBuffer", "BindTexture", "BindFramebuffer", "ActiveTexture",
+   "BufferData", "BufferSubData",
+   "TexImage2D", "TexImage3D", "TexSubImage3D", "TexParameteri", "TexParameterfv", "GenerateMipmap", "TexBuffer",
+   "FramebufferTexture2D", "DrawBuffer", "DrawBuffers", "BlitFramebuffer",
+   "VertexAttribPointer", "EnableVertexAttribArray",
+   "Uniform1i", "Uniform1f", "Uniform4f", "Uniform2fv", "Uniform3fv", "UniformMatrix3fv", "UniformMatrix4fv",
+   "Viewport", "ClearColor", "Clear", "ClearBufferfv", "ClearBufferfi",
+   "Enable", "Disable", "DepthFunc", "DepthMask", "ColorMask", "PolygonMode", "BlendFunc", "BlendFuncSeparate",
+   "DrawArrays", "DrawElements", "MultiDrawElementsBaseVertex",
+   "BeginQuery", "EndQuery", "BeginConditionalRender", "EndConditionalRender",
+};
+
+// 参数中 gl 对象名的种类，回放时需要把录制时的名字映射为回放时创建的名字
+enum class TraceId: std::uint8_t{
+   NONE, BUFFER, VERTEXARRAY, TEXTURE, QUERY, FRAMEBUFFER, SHADER, PROGRAM,
+   // uniform 的位置，属于当前使用的 program
+   LOCATION,
+};
+
+inline constexpr std::uint32_t traceMagic = 0x5254434d; // "MCTR"
+inline constexpr std::uint32_t traceVersion = 2;
+
+class TraceWriter{
+private:
+   // 需要在 stream 之后析构
+   std::vector<char> buffer = std::vector<char>(1 << 20);
+   std::ofstream stream;
+   std::size_t bytes = 0;
+public:
+   TraceWriter(const std::string& path){
+      stream.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+      stream.open(path, std::ios::binary);
+      if(!stream){
+         throwError(fmt::format("can not open trace file {}", path));
+      }
+   }
+
+   template<typename T> requires std::is_trivially_copyable_v<T>
+   void write(const T& value){
+      stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+      bytes += sizeof(T);
+   }
+   void writeBytes(const void* data, std::size_t size){
+      write(static_cast<std::uint32_t>(size));
+      if(size > 0){
+         stream.write(static_cast<const char*>(data), size);
+      }
+      bytes += size;
+   }
+   template<typename T>
+   void writeArray(const T* data, std::size_t count){
+      writeBytes(data, data == nullptr ? 0 : count * sizeof(T));
+   }
+   std::size_t getBytes() const { return bytes; }
+};
+
+class TraceReader{
+private:
+   std::vector<char> data;
+   std::size_t position = 0;
+public:
+   TraceReader(const std::string& path){
+      std::ifstream stream {path, std::ios::binary | std::ios::ate};
+      if(!stream){
+         throwError(fmt::format("can not open trace file {}", path));
+      }
+      data.resize(stream.tellg());
+      stream.seekg(0);
+      stream.read(data.data(), data.size());
+   }
+
+   bool end() const { return position >= data.size(); }
+   std::size_t size() const { return data.size(); }
+   std::size_t getPosition() const { return position; }
+   void seek(std::size_t position){ this->position = position; }
+
+   template<typename T> requires std::is_trivially_copyable_v<T>
+   T read(){
+      if(position + sizeof(T) > data.size()){
+         throwError("trace file is truncated");
+      }
+      T value;
+      std::memcpy(&value, data.data() + position, sizeof(T));
+      position += sizeof(T);
+      return value;
+   }
+   // 返回的数据指向文件内容，没有对齐保证，按需要复制
+   std::string_view readBytes(){
+      auto size = read<std::uint32_t>();
+      if(position + size > data.size()){
+         throwError("trace file is truncated");
+      }
+      std::string_view bytes {data.data() + position, size};
+      position += size;
+      return bytes;
+   }
+   template<typename T>
+   std::vector<T> readArray(){
+      auto bytes = readBytes();
+      std::vector<T> values(bytes.size() / sizeof(T));
+      std::memcpy(values.data(), bytes.data(), values.size() * sizeof(T));
+      return values;
+   }
+};
+
+// 回放时录制的名字到实际名字的映射
+struct TraceReplayState{
+   std::array<std::unordered_map<GLuint, GLuint>, 8> ids;
+   // program 的实际名字 -> 录制时的 uniform 位置 -> 实际的位置
+   std::unordered_map<GLuint, std::unordered_map<GLint, GLint>> locations;
+   GLuint currentProgram = 0;
+
+   GLuint map(TraceId kind, GLuint id) const {
+      auto& table = ids[static_cast<int>(kind)];
+      auto it = table.find(id);
+      // 0 以及录制开始前就存在的对象保持不变
+      return it == table.end() ? id : it->second;
+   }
+   GLint mapLocation(GLint location) const {
+      auto program = locations.find(currentProgram);
+      if(location < 0 || program == locations.end()){
+         return location;
+      }
+      auto it = program->second.find(location);
+      return it == program->second.end() ? -1 : it->second;
+   }
+   template<typename T>
+   T map(TraceId kind, T value) const {
+      if constexpr(std::is_integral_v<T>){
+         if(kind == TraceId::LOCATION){
+            return mapLocation(value);
+         }else if(kind != TraceId::NONE){
+            return map(kind, static_cast<GLuint>(value));
+         }
+      }
+      return value;
+   }
+};
+
+class GLTrace{
+private:
+   static inline std::unique_ptr<TraceWriter> writer;
+   static inline int frameNumber = 0;
+   static void install();
+   static void uninstall();
+public:
+   static bool isRecording(){ return writer != nullptr; }
+   static TraceWriter& getWriter(){ return *writer; }
+
+   // 开始录制，之后调用的 gl 函数都会被记录；需要在创建任何 gl 资源之前开始，否则回放时缺少这些资源
+   // 设置环境变量 MINECPP_TRACE=<文件> 时 Context 在加载 gl 函数后自动开始录制
+   static void start(const std::string& path, int width, int height){
+      if(isRecording()){
+         throwError("gl trace is already recording");
+      }
+      writer = std::make_unique<TraceWriter>(path);
+      writer->write(traceMagic);
+      writer->write(traceVersion);
+      writer->write(static_cast<std::int32_t>(width));
+      writer->write(static_cast<std::int32_t>(height));
+      frameNumber = 0;
+      install();
+      fmt::println("gl trace: recording to {}", path);
+   }
+   static void stop(){
+      if(!isRecording()){
+         return;
+      }
+      uninstall();
+      fmt::println("gl trace: {} frames, {} bytes", frameNumber, writer->getBytes());
+      writer.reset();
+   }
+   // 一帧结束，在交换缓冲区之前调用
+   static void frame(){
+      if(isRecording()){
+         writer->write(TraceOp::FRAME);
+         frameNumber++;
+      }
+   }
+};
+
+namespace trace_detail{
+
+// 指针参数按整数存储
+template<typename T>
+using Stored = std::conditional_t<std::is_pointer_v<T>, std::uint64_t, T>;
+
+template<typename T>
+Stored<T> store(T value){
+   if constexpr(std::is_pointer_v<T>){
+      return reinterpret_cast<std::uintptr_t>(value);
+   }else{
+      return value;
+   }
+}
+template<typename T>
+T load(Stored<T> value){
+   if constexpr(std::is_pointer_v<T>){
+      return reinterpret_cast<T>(static_cast<std::uintptr_t>(value));
+   }else{
+      return value;
+   }
+}
+
+template<TraceOp op>
+void writeOp(){
+   GLTrace::getWriter().write(op);
+}
+
+// 只有标量参数的函数，ids 依次为每个参数的名字种类（全部为 NONE 时可以省略）
+template<auto* pointer, TraceOp op, typename Function, TraceId... ids>
+struct ScalarHookImpl;
+
+template<auto* pointer, TraceOp op, typename R, typename... Args, TraceId... ids>
+struct ScalarHookImpl<pointer, op, R (GLAD_API_PTR *)(Args...), ids...>{
+   static_assert(sizeof...(ids) == 0 || sizeof...(ids) == sizeof...(Args));
+   static constexpr TraceOp traceOp = op;
+   static inline R (GLAD_API_PTR *real)(Args...) = nullptr;
+
+   static R GLAD_API_PTR call(Args... args){
+      auto& writer = GLTrace::getWriter();
+      writer.write(op);
+      (writer.write(store<Args>(args)), ...);
+      return real(args...);
+   }
+   static void install(){
+      real = *pointer;
+      *pointer = &call;
+   }
+   static void uninstall(){
+      *pointer = real;
+   }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      // 花括号初始化保证从左到右读取
+      std::tuple<Stored<Args>...> values {reader.read<Stored<Args>>()...};
+      constexpr std::array<TraceId, sizeof...(Args)> kinds = [] {
+         if constexpr(sizeof...(ids) == 0){
+            return std::array<TraceId, sizeof...(Args)>{};
+         }else{
+            return std::array<TraceId, sizeof...(Args)>{ids...};
+         }
+      }();
+      [&]<std::size_t... I>(std::index_sequence<I...>){
+         (*pointer)(load<Args>(state.map(kinds[I], std::get<I>(values)))...);
+      }(std::index_sequence_for<Args...>{});
+   }
+};
+
+template<auto* pointer, TraceOp op, TraceId... ids>
+using ScalarHook = ScalarHookImpl<pointer, op, std::remove_cvref_t<decltype(*pointer)>, ids...>;
+
+// glGen*(n, ids)
+template<auto* pointer, TraceOp op, TraceId kind>
+struct GenHook{
+   static constexpr TraceOp traceOp = op;
+   static inline PFNGLGENBUFFERSPROC real = nullptr;
+   static void GLAD_API_PTR call(GLsizei n, GLuint* ids){
+      real(n, ids);
+      auto& writer = GLTrace::getWriter();
+      writer.write(op);
+      writer.writeArray(ids, n);
+   }
+   static void install(){ real = *pointer; *pointer = &call; }
+   static void uninstall(){ *pointer = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto recorded = reader.readArray<GLuint>();
+      std::vector<GLuint> ids(recorded.size());
+      (*pointer)(ids.size(), ids.data());
+      for(std::size_t i = 0; i < ids.size(); i++){
+         state.ids[static_cast<int>(kind)][recorded[i]] = ids[i];
+      }
+   }
+};
+
+// glDelete*(n, ids)
+template<auto* pointer, TraceOp op, TraceId kind>
+struct DeleteHook{
+   static constexpr TraceOp traceOp = op;
+   static inline PFNGLDELETEBUFFERSPROC real = nullptr;
+   static void GLAD_API_PTR call(GLsizei n, const GLuint* ids){
+      auto& writer = GLTrace::getWriter();
+      writer.write(op);
+      writer.writeArray(ids, n);
+      real(n, ids);
+   }
+   static void install(){ real = *pointer; *pointer = &call; }
+   static void uninstall(){ *pointer = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto recorded = reader.readArray<GLuint>();
+      auto& table = state.ids[static_cast<int>(kind)];
+      std::vector<GLuint> ids;
+      for(GLuint id: recorded){
+         ids.push_back(state.map(kind, id));
+         table.erase(id);
+      }
+      (*pointer)(ids.size(), ids.data());
+   }
+};
+
+struct CreateShaderHook{
+   static constexpr TraceOp traceOp = TraceOp::CREATE_SHADER;
+   static inline PFNGLCREATESHADERPROC real = nullptr;
+   static GLuint GLAD_API_PTR call(GLenum type){
+      GLuint id = real(type);
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(type);
+      writer.write(id);
+      return id;
+   }
+   static void install(){ real = glad_glCreateShader; glad_glCreateShader = &call; }
+   static void uninstall(){ glad_glCreateShader = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto type = reader.read<GLenum>();
+      auto id = reader.read<GLuint>();
+      state.ids[static_cast<int>(TraceId::SHADER)][id] = glad_glCreateShader(type);
+   }
+};
+
+struct CreateProgramHook{
+   static constexpr TraceOp traceOp = TraceOp::CREATE_PROGRAM;
+   static inline PFNGLCREATEPROGRAMPROC real = nullptr;
+   static GLuint GLAD_API_PTR call(){
+      GLuint id = real();
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(id);
+      return id;
+   }
+   static void install(){ real = glad_glCreateProgram; glad_glCreateProgram = &call; }
+   static void uninstall(){ glad_glCreateProgram = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto id = reader.read<GLuint>();
+      state.ids[static_cast<int>(TraceId::PROGRAM)][id] = glad_glCreateProgram();
+   }
+};
+
+struct DeleteProgramHook{
+   static constexpr TraceOp traceOp = TraceOp::DELETE_PROGRAM;
+   static inline PFNGLDELETEPROGRAMPROC real = nullptr;
+   static void GLAD_API_PTR call(GLuint program){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(program);
+      real(program);
+   }
+   static void install(){ real = glad_glDeleteProgram; glad_glDeleteProgram = &call; }
+   static void uninstall(){ glad_glDeleteProgram = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto id = reader.read<GLuint>();
+      GLuint program = state.map(TraceId::PROGRAM, id);
+      state.locations.erase(program);
+      state.ids[static_cast<int>(TraceId::PROGRAM)].erase(id);
+      glad_glDeleteProgram(program);
+   }
+};
+
+struct ShaderSourceHook{
+   static constexpr TraceOp traceOp = TraceOp::SHADER_SOURCE;
+   static inline PFNGLSHADERSOURCEPROC real = nullptr;
+   static void GLAD_API_PTR call(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths){
+      std::string source;
+      for(GLsizei i = 0; i < count; i++){
+         source += lengths != nullptr && lengths[i] >= 0 ? std::string(strings[i], lengths[i]) : std::string(strings[i]);
+      }
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(shader);
+      writer.writeBytes(source.data(), source.size());
+      real(shader, count, strings, lengths);
+   }
+   static void install(){ real = glad_glShaderSource; glad_glShaderSource = &call; }
+   static void uninstall(){ glad_glShaderSource = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      GLuint shader = state.map(TraceId::SHADER, reader.read<GLuint>());
+      std::string source {reader.readBytes()};
+      const GLchar* string = source.c_str();
+      glad_glShaderSource(shader, 1, &string, nullptr);
+   }
+};
+
+struct UseProgramHook{
+   static constexpr TraceOp traceOp = TraceOp::USE_PROGRAM;
+   static inline PFNGLUSEPROGRAMPROC real = nullptr;
+   static void GLAD_API_PTR call(GLuint program){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(program);
+      real(program);
+   }
+   static void install(){ real = glad_glUseProgram; glad_glUseProgram = &call; }
+   static void uninstall(){ glad_glUseProgram = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      state.currentProgram = state.map(TraceId::PROGRAM, reader.read<GLuint>());
+      glad_glUseProgram(state.currentProgram);
+   }
+};
+
+struct GetUniformLocationHook{
+   static constexpr TraceOp traceOp = TraceOp::GET_UNIFORM_LOCATION;
+   static inline PFNGLGETUNIFORMLOCATIONPROC real = nullptr;
+   static GLint GLAD_API_PTR call(GLuint program, const GLchar* name){
+      GLint location = real(program, name);
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(program);
+      writer.writeBytes(name, std::strlen(name));
+      writer.write(location);
+      return location;
+   }
+   static void install(){ real = glad_glGetUniformLocation; glad_glGetUniformLocation = &call; }
+   static void uninstall(){ glad_glGetUniformLocation = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      GLuint program = state.map(TraceId::PROGRAM, reader.read<GLuint>());
+      std::string name {reader.readBytes()};
+      auto location = reader.read<GLint>();
+      if(location >= 0){
+         state.locations[program][location] = glad_glGetUniformLocation(program, name.c_str());
+      }
+   }
+};
+
+// glUniform*fv(location, count, value)，每个元素 components 个 float
+template<auto* pointer, TraceOp op, int components>
+struct UniformVectorHook{
+   static constexpr TraceOp traceOp = op;
+   static inline PFNGLUNIFORM3FVPROC real = nullptr;
+   static void GLAD_API_PTR call(GLint location, GLsizei count, const GLfloat* value){
+      auto& writer = GLTrace::getWriter();
+      writer.write(op);
+      writer.write(location);
+      writer.writeArray(value, count * components);
+      real(location, count, value);
+   }
+   static void install(){ real = *pointer; *pointer = &call; }
+   static void uninstall(){ *pointer = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      GLint location = state.mapLocation(reader.read<GLint>());
+      auto value = reader.readArray<GLfloat>();
+      (*pointer)(location, value.size() / components, value.data());
+   }
+};
+
+// glUniformMatrix*fv(location, count, transpose, value)
+template<auto* pointer, TraceOp op, int components>
+struct UniformMatrixHook{
+   static constexpr TraceOp traceOp = op;
+   static inline PFNGLUNIFORMMATRIX4FVPROC real = nullptr;
+   static void GLAD_API_PTR call(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value){
+      auto& writer = GLTrace::getWriter();
+      writer.write(op);
+      writer.write(location);
+      writer.write(transpose);
+      writer.writeArray(value, count * components);
+      real(location, count, transpose, value);
+   }
+   static void install(){ real = *pointer; *pointer = &call; }
+   static void uninstall(){ *pointer = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      GLint location = state.mapLocation(reader.read<GLint>());
+      auto transpose = reader.read<GLboolean>();
+      auto value = reader.readArray<GLfloat>();
+      (*pointer)(location, value.size() / components, transpose, value.data());
+   }
+};
+
+struct BufferDataHook{
+   static constexpr TraceOp traceOp = TraceOp::BUFFER_DATA;
+   static inline PFNGLBUFFERDATAPROC real = nullptr;
+   static void GLAD_API_PTR call(GLenum target, GLsizeiptr size, const void* data, GLenum usage){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(target);
+      writer.write(static_cast<std::uint64_t>(size));
+      writer.writeBytes(data, data == nullptr ? 0 : size);
+      writer.write(usage);
+      real(target, size, data, usage);
+   }
+   static void install(){ real = glad_glBufferData; glad_glBufferData = &call; }
+   static void uninstall(){ glad_glBufferData = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto target = reader.read<GLenum>();
+      auto size = reader.read<std::uint64_t>();
+      auto data = reader.readBytes();
+      auto usage = reader.read<GLenum>();
+      glad_glBufferData(target, size, data.empty() ? nullptr : data.data(), usage);
+   }
+};
+
+struct BufferSubDataHook{
+   static constexpr TraceOp traceOp = TraceOp::BUFFER_SUB_DATA;
+   static inline PFNGLBUFFERSUBDATAPROC real = nullptr;
+   static void GLAD_API_PTR call(GLenum target, GLintptr offset, GLsizeiptr size, const void* data){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(target);
+      writer.write(static_cast<std::int64_t>(offset));
+      writer.writeBytes(data, size);
+      real(target, offset, size, data);
+   }
+   static void install(){ real = glad_glBufferSubData; glad_glBufferSubData = &call; }
+   static void uninstall(){ glad_glBufferSubData = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto target = reader.read<GLenum>();
+      auto offset = reader.read<std::int64_t>();
+      auto data = reader.readBytes();
+      glad_glBufferSubData(target, offset, data.size(), data.data());
+   }
+};
+
+// 按照当前的 GL_UNPACK_ALIGNMENT 计算上传的像素数据的字节数
+inline std::size_t pixelDataSize(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type){
+   int components = 4;
+   switch(format){
+   case GL_RED: case GL_DEPTH_COMPONENT: case GL_DEPTH_STENCIL: components = 1; break;
+   case GL_RG: components = 2; break;
+   case GL_RGB: case GL_BGR: components = 3; break;
+   default: components = 4;
+   }
+   int bytes = 1;
+   switch(type){
+   case GL_UNSIGNED_BYTE: case GL_BYTE: bytes = 1; break;
+   case GL_HALF_FLOAT: case GL_UNSIGNED_SHORT: case GL_SHORT: bytes = 2; break;
+   default: bytes = 4;
+   }
+   GLint alignment = 4;
+   glad_glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+   std::size_t row = static_cast<std::size_t>(width) * components * bytes;
+   std::size_t alignedRow = (row + alignment - 1) / alignment * alignment;
+   std::size_t rows = static_cast<std::size_t>(height) * depth;
+   // 最后一行不需要补齐
+   return rows == 0 ? 0 : alignedRow * (rows - 1) + row;
+}
+
+struct TexImage2DHook{
+   static constexpr TraceOp traceOp = TraceOp::TEX_IMAGE_2D;
+   static inline PFNGLTEXIMAGE2DPROC real = nullptr;
+   static void GLAD_API_PTR call(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(target);
+      writer.write(level);
+      writer.write(internalFormat);
+      writer.write(width);
+      writer.write(height);
+      writer.write(border);
+      writer.write(format);
+      writer.write(type);
+      writer.writeBytes(pixels, pixels == nullptr ? 0 : pixelDataSize(width, height, 1, format, type));
+      real(target, level, internalFormat, width, height, border, format, type, pixels);
+   }
+   static void install(){ real = glad_glTexImage2D; glad_glTexImage2D = &call; }
+   static void uninstall(){ glad_glTexImage2D = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto target = reader.read<GLenum>();
+      auto level = reader.read<GLint>();
+      auto internalFormat = reader.read<GLint>();
+      auto width = reader.read<GLsizei>();
+      auto height = reader.read<GLsizei>();
+      auto border = reader.read<GLint>();
+      auto format = reader.read<GLenum>();
+      auto type = reader.read<GLenum>();
+      auto pixels = reader.readBytes();
+      glad_glTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels.empty() ? nullptr : pixels.data());
+   }
+};
+
+struct TexImage3DHook{
+   static constexpr TraceOp traceOp = TraceOp::TEX_IMAGE_3D;
+   static inline PFNGLTEXIMAGE3DPROC real = nullptr;
+   static void GLAD_API_PTR call(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(target);
+      writer.write(level);
+      writer.write(internalFormat);
+      writer.write(width);
+      writer.write(height);
+      writer.write(depth);
+      writer.write(border);
+      writer.write(format);
+      writer.write(type);
+      writer.writeBytes(pixels, pixels == nullptr ? 0 : pixelDataSize(width, height, depth, format, type));
+      real(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+   }
+   static void install(){ real = glad_glTexImage3D; glad_glTexImage3D = &call; }
+   static void uninstall(){ glad_glTexImage3D = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto target = reader.read<GLenum>();
+      auto level = reader.read<GLint>();
+      auto internalFormat = reader.read<GLint>();
+      auto width = reader.read<GLsizei>();
+      auto height = reader.read<GLsizei>();
+      auto depth = reader.read<GLsizei>();
+      auto border = reader.read<GLint>();
+      auto format = reader.read<GLenum>();
+      auto type = reader.read<GLenum>();
+      auto pixels = reader.readBytes();
+      glad_glTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, pixels.empty() ? nullptr : pixels.data());
+   }
+};
+
+struct TexSubImage3DHook{
+   static constexpr TraceOp traceOp = TraceOp::TEX_SUB_IMAGE_3D;
+   static inline PFNGLTEXSUBIMAGE3DPROC real = nullptr;
+   static void GLAD_API_PTR call(GLenum target, GLint level, GLint x, GLint y, GLint z, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      for(GLint value: {static_cast<GLint>(target), level, x, y, z, width, height, depth, static_cast<GLint>(format), static_cast<GLint>(type)}){
+         writer.write(value);
+      }
+      writer.writeBytes(pixels, pixelDataSize(width, height, depth, format, type));
+      real(target, level, x, y, z, width, height, depth, format, type, pixels);
+   }
+   static void install(){ real = glad_glTexSubImage3D; glad_glTexSubImage3D = &call; }
+   static void uninstall(){ glad_glTexSubImage3D = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      GLint values[10];
+      for(auto& value: values){
+         value = reader.read<GLint>();
+      }
+      auto pixels = reader.readBytes();
+      glad_glTexSubImage3D(values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7], values[8], values[9], pixels.data());
+   }
+};
+
+struct TexParameterfvHook{
+   static constexpr TraceOp traceOp = TraceOp::TEX_PARAMETER_FV;
+   static inline PFNGLTEXPARAMETERFVPROC real = nullptr;
+   static void GLAD_API_PTR call(GLenum target, GLenum name, const GLfloat* params){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(target);
+      writer.write(name);
+      // 目前只用于 GL_TEXTURE_BORDER_COLOR
+      writer.writeArray(params, name == GL_TEXTURE_BORDER_COLOR ? 4 : 1);
+      real(target, name, params);
+   }
+   static void install(){ real = glad_glTexParameterfv; glad_glTexParameterfv = &call; }
+   static void uninstall(){ glad_glTexParameterfv = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto target = reader.read<GLenum>();
+      auto name = reader.read<GLenum>();
+      auto params = reader.readArray<GLfloat>();
+      glad_glTexParameterfv(target, name, params.data());
+   }
+};
+
+struct DrawBuffersHook{
+   static constexpr TraceOp traceOp = TraceOp::DRAW_BUFFERS;
+   static inline PFNGLDRAWBUFFERSPROC real = nullptr;
+   static void GLAD_API_PTR call(GLsizei n, const GLenum* buffers){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.writeArray(buffers, n);
+      real(n, buffers);
+   }
+   static void install(){ real = glad_glDrawBuffers; glad_glDrawBuffers = &call; }
+   static void uninstall(){ glad_glDrawBuffers = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto buffers = reader.readArray<GLenum>();
+      glad_glDrawBuffers(buffers.size(), buffers.data());
+   }
+};
+
+struct ClearBufferfvHook{
+   static constexpr TraceOp traceOp = TraceOp::CLEAR_BUFFER_FV;
+   static inline PFNGLCLEARBUFFERFVPROC real = nullptr;
+   static void GLAD_API_PTR call(GLenum buffer, GLint drawBuffer, const GLfloat* value){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(buffer);
+      writer.write(drawBuffer);
+      writer.writeArray(value, buffer == GL_COLOR ? 4 : 1);
+      real(buffer, drawBuffer, value);
+   }
+   static void install(){ real = glad_glClearBufferfv; glad_glClearBufferfv = &call; }
+   static void uninstall(){ glad_glClearBufferfv = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto buffer = reader.read<GLenum>();
+      auto drawBuffer = reader.read<GLint>();
+      auto value = reader.readArray<GLfloat>();
+      glad_glClearBufferfv(buffer, drawBuffer, value.data());
+   }
+};
+
+struct MultiDrawElementsBaseVertexHook{
+   static constexpr TraceOp traceOp = TraceOp::MULTI_DRAW_ELEMENTS_BASE_VERTEX;
+   static inline PFNGLMULTIDRAWELEMENTSBASEVERTEXPROC real = nullptr;
+   static void GLAD_API_PTR call(GLenum mode, const GLsizei* count, GLenum type, const void* const* indices, GLsizei drawCount, const GLint* baseVertex){
+      auto& writer = GLTrace::getWriter();
+      writer.write(traceOp);
+      writer.write(mode);
+      writer.write(type);
+      writer.writeArray(count, drawCount);
+      std::vector<std::uint64_t> offsets(drawCount);
+      for(GLsizei i = 0; i < drawCount; i++){
+         offsets[i] = store(indices[i]);
+      }
+      writer.writeArray(offsets.data(), drawCount);
+      writer.writeArray(baseVertex, drawCount);
+      real(mode, count, type, indices, drawCount, baseVertex);
+   }
+   static void install(){ real = glad_glMultiDrawElementsBaseVertex; glad_glMultiDrawElementsBaseVertex = &call; }
+   static void uninstall(){ glad_glMultiDrawElementsBaseVertex = real; }
+   static void replay(TraceReader& reader, TraceReplayState& state){
+      auto mode = reader.read<GLenum>();
+      auto type = reader.read<GLenum>();
+      auto count = reader.readArray<GLsizei>();
+      auto offsets = reader.readArray<std::uint64_t>();
+      auto baseVertex = reader.readArray<GLint>();
+      std::vector<const void*> indices(offsets.size());
+      for(std::size_t i = 0; i < offsets.size(); i++){
+         indices[i] = load<const void*>(offsets[i]);
+      }
+      glad_glMultiDrawElementsBaseVertex(mode, count.data(), type, indices.data(), count.size(), baseVertex.data());
+   }
+};
+
+constexpr auto NONE = TraceId::NONE;
+
+using Hooks = std::tuple<
+   GenHook<&glad_glGenBuffers, TraceOp::GEN_BUFFERS, TraceId::BUFFER>,
+   GenHook<&glad_glGenVertexArrays, TraceOp::GEN_VERTEX_ARRAYS, TraceId::VERTEXARRAY>,
+   GenHook<&glad_glGenTextures, TraceOp::GEN_TEXTURES, TraceId::TEXTURE>,
+   GenHook<&glad_glGenQueries, TraceOp::GEN_QUERIES, TraceId::QUERY>,
+   GenHook<&glad_glGenFramebuffers, TraceOp::GEN_FRAMEBUFFERS, TraceId::FRAMEBUFFER>,
+   DeleteHook<&glad_glDeleteBuffers, TraceOp::DELETE_BUFFERS, TraceId::BUFFER>,
+   DeleteHook<&glad_glDeleteVertexArrays, TraceOp::DELETE_VERTEX_ARRAYS, TraceId::VERTEXARRAY>,
+   DeleteHook<&glad_glDeleteTextures, TraceOp::DELETE_TEXTURES, TraceId::TEXTURE>,
+   DeleteHook<&glad_glDeleteQueries, TraceOp::DELETE_QUERIES, TraceId::QUERY>,
+   DeleteHook<&glad_glDeleteFramebuffers, TraceOp::DELETE_FRAMEBUFFERS, TraceId::FRAMEBUFFER>,
+   CreateShaderHook,
+   CreateProgramHook,
+   ScalarHook<&glad_glDeleteShader, TraceOp::DELETE_SHADER, TraceId::SHADER>,
+   DeleteProgramHook,
+   ShaderSourceHook,
+   ScalarHook<&glad_glCompileShader, TraceOp::COMPILE_SHADER, TraceId::SHADER>,
+   ScalarHook<&glad_glAttachShader, TraceOp::ATTACH_SHADER, TraceId::PROGRAM, TraceId::SHADER>,
+   ScalarHook<&glad_glLinkProgram, TraceOp::LINK_PROGRAM, TraceId::PROGRAM>,
+   GetUniformLocationHook,
+   UseProgramHook,
+   ScalarHook<&glad_glBindVertexArray, TraceOp::BIND_VERTEX_ARRAY, TraceId::VERTEXARRAY>,
+   ScalarHook<&glad_glBindBuffer, TraceOp::BIND_BUFFER, NONE, TraceId::BUFFER>,
+   ScalarHook<&glad_glBindTexture, TraceOp::BIND_TEXTURE, NONE, TraceId::TEXTURE>,
+   ScalarHook<&glad_glBindFramebuffer, TraceOp::BIND_FRAMEBUFFER, NONE, TraceId::FRAMEBUFFER>,
+   ScalarHook<&glad_glActiveTexture, TraceOp::ACTIVE_TEXTURE>,
+   BufferDataHook,
+   BufferSubDataHook,
+   TexImage2DHook,
+   TexImage3DHook,
+   TexSubImage3DHook,
+   ScalarHook<&glad_glTexParameteri, TraceOp::TEX_PARAMETER_I>,
+   TexParameterfvHook,
+   ScalarHook<&glad_glGenerateMipmap, TraceOp::GENERATE_MIPMAP>,
+   ScalarHook<&glad_glTexBuffer, TraceOp::TEX_BUFFER, NONE, NONE, TraceId::BUFFER>,
+   ScalarHook<&glad_glFramebufferTexture2D, TraceOp::FRAMEBUFFER_TEXTURE_2D, NONE, NONE, NONE, TraceId::TEXTURE, NONE>,
+   ScalarHook<&glad_glDrawBuffer, TraceOp::DRAW_BUFFER>,
+   DrawBuffersHook,
+   ScalarHook<&glad_glBlitFramebuffer, TraceOp::BLIT_FRAMEBUFFER>,
+   ScalarHook<&glad_glVertexAttribPointer, TraceOp::VERTEX_ATTRIB_POINTER>,
+   ScalarHook<&glad_glEnableVertexAttribArray, TraceOp::ENABLE_VERTEX_ATTRIB_ARRAY>,
+   ScalarHook<&glad_glUniform1i, TraceOp::UNIFORM_1I, TraceId::LOCATION, NONE>,
+   ScalarHook<&glad_glUniform1f, TraceOp::UNIFORM_1F, TraceId::LOCATION, NONE>,
+   ScalarHook<&glad_glUniform4f, TraceOp::UNIFORM_4F, TraceId::LOCATION, NONE, NONE, NONE, NONE>,
+   UniformVectorHook<&glad_glUniform2fv, TraceOp::UNIFORM_2FV, 2>,
+   UniformVectorHook<&glad_glUniform3fv, TraceOp::UNIFORM_3FV, 3>,
+   UniformMatrixHook<&glad_glUniformMatrix3fv, TraceOp::UNIFORM_MATRIX_3FV, 9>,
+   UniformMatrixHook<&glad_glUniformMatrix4fv, TraceOp::UNIFORM_MATRIX_4FV, 16>,
+   ScalarHook<&glad_glViewport, TraceOp::VIEWPORT>,
+   ScalarHook<&glad_glClearColor, TraceOp::CLEAR_COLOR>,
+   ScalarHook<&glad_glClear, TraceOp::CLEAR>,
+   ClearBufferfvHook,
+   ScalarHook<&glad_glClearBufferfi, TraceOp::CLEAR_BUFFER_FI>,
+   ScalarHook<&glad_glEnable, TraceOp::ENABLE>,
+   ScalarHook<&glad_glDisable, TraceOp::DISABLE>,
+   ScalarHook<&glad_glDepthFunc, TraceOp::DEPTH_FUNC>,
+   ScalarHook<&glad_glDepthMask, TraceOp::DEPTH_MASK>,
+   ScalarHook<&glad_glColorMask, TraceOp::COLOR_MASK>,
+   ScalarHook<&glad_glPolygonMode, TraceOp::POLYGON_MODE>,
+   ScalarHook<&glad_glBlendFunc, TraceOp::BLEND_FUNC>,
+   ScalarHook<&glad_glBlendFuncSeparate, TraceOp::BLEND_FUNC_SEPARATE>,
+   ScalarHook<&glad_glDrawArrays, TraceOp::DRAW_ARRAYS>,
+   ScalarHook<&glad_glDrawElements, TraceOp::DRAW_ELEMENTS>,
+   MultiDrawElementsBaseVertexHook,
+   ScalarHook<&glad_glBeginQuery, TraceOp::BEGIN_QUERY, NONE, TraceId::QUERY>,
+   ScalarHook<&glad_glEndQuery, TraceOp::END_QUERY>,
+   ScalarHook<&glad_glBeginConditionalRender, TraceOp::BEGIN_CONDITIONAL_RENDER, TraceId::QUERY, NONE>,
+   ScalarHook<&glad_glEndConditionalRender, TraceOp::END_CONDITIONAL_RENDER>
+>;
+
+using ReplayFunction = void(*)(TraceReader&, TraceReplayState&);
+
+// 以 TraceOp 为下标的回放函数表
+inline const std::array<ReplayFunction, static_cast<std::size_t>(TraceOp::COUNT)>& getReplayTable(){
+   static const auto table = []{
+      std::array<ReplayFunction, static_cast<std::size_t>(TraceOp::COUNT)> table {};
+      [&]<typename... Hook>(std::type_identity<std::tuple<Hook...>>){
+         ((table[static_cast<std::size_t>(Hook::traceOp)] = &Hook::replay), ...);
+      }(std::type_identity<Hooks>{});
+      return table;
+   }();
+   return table;
+}
+
+} // namespace trace_detail
+
+inline void GLTrace::install(){
+   []<typename... Hook>(std::type_identity<std::tuple<Hook...>>){
+      (Hook::install(), ...);
+   }(std::type_identity<trace_detail::Hooks>{});
+}
+
+inline void GLTrace::uninstall(){
+   []<typename... Hook>(std::type_identity<std::tuple<Hook...>>){
+      (Hook::uninstall(), ...);
+   }(std::type_identity<trace_detail::Hooks>{});
+}
+
+// 回放一条命令，返回命令的种类；FRAME 不调用 gl，由调用者处理
+inline TraceOp replayTraceCommand(TraceReader& reader, TraceReplayState& state){
+   auto op = reader.read<TraceOp>();
+   if(op >= TraceOp::COUNT){
+      throwError(fmt::format("unknown trace command {} at byte {}", static_cast<int>(op), reader.getPosition()));
+   }
+   if(op != TraceOp::FRAME){
+      trace_detail::getReplayTable()[static_cast<std::size_t>(op)](reader, state);
+   }
+   return op;
+}
+
+} // namespace minecpp
+
+#endif // _MINECPP_TRACE_H_
@@ -163,25 +163,27 @@ private:
    std::vector<KeyHoldHandler> handlerSetters;
    ModelController viewModelController;
    void createSetters(){
-      auto add = [this](int key, const std::function<void()>& handler){
-         this->handlerSetters.emplace_back(key, [handler](auto _){handler();});
+      // 变化量按模拟的时间缩放，速度与帧率无关
+      auto add = [this](int key, const std::function<void(float)>& handler){
+         this->handlerSetters.emplace_back(key, [handler](int, float delta){handler(delta);});
       };
-      add(GLFW_KEY_A, [this](){this->viewModelController.translateX(moveSpeed);});
-      add(GLFW_KEY_D, [this](){this->viewModelController.translateX(-moveSpeed);});
-      add(GLFW_KEY_Z, [this](){this->viewModelController.translateY(-moveSpeed);});
-      add(GLFW_KEY_X, [this](){this->viewModelController.translateY(moveSpeed);});
-      add(GLFW_KEY_W, [this](){this->viewModelController.translateZ(moveSpeed);});
-      add(GLFW_KEY_S, [this](){this->viewModelController.translateZ(-moveSpeed);});
-      add(GLFW_KEY_L, [this](){this->viewModelController.rotateY(rotateSpeed);});
-      add(GLFW_KEY_J, [this](){this->viewModelController.rotateY(-rotateSpeed);});
-      add(GLFW_KEY_I, [this](){this->viewModelController.rotateX(-rotateSpeed);});
-      add(GLFW_KEY_K, [this](){this->viewModelController.rotateX(rotateSpeed);});
-      add(GLFW_KEY_U, [this](){this->viewModelController.rotateZ(-rotateSpeed);});
-      add(GLFW_KEY_O, [this](){this->viewModelController.rotateZ(rotateSpeed);});
+      add(GLFW_KEY_A, [this](float delta){this->viewModelController.translateX(moveSpeed * delta);});
+      add(GLFW_KEY_D, [this](float delta){this->viewModelController.translateX(-moveSpeed * delta);});
+      add(GLFW_KEY_Z, [this](float delta){this->viewModelController.translateY(-moveSpeed * delta);});
+      add(GLFW_KEY_X, [this](float delta){this->viewModelController.translateY(moveSpeed * delta);});
+      add(GLFW_KEY_W, [this](float delta){this->viewModelController.translateZ(moveSpeed * delta);});
+      add(GLFW_KEY_S, [this](float delta){this->viewModelController.translateZ(-moveSpeed * delta);});
+      add(GLFW_KEY_L, [this](float delta){this->viewModelController.rotateY(rotateSpeed * delta);});
+      add(GLFW_KEY_J, [this](float delta){this->viewModelController.rotateY(-rotateSpeed * delta);});
+      add(GLFW_KEY_I, [this](float delta){this->viewModelController.rotateX(-rotateSpeed * delta);});
+      add(GLFW_KEY_K, [this](float delta){this->viewModelController.rotateX(rotateSpeed * delta);});
+      add(GLFW_KEY_U, [this](float delta){this->viewModelController.rotateZ(-rotateSpeed * delta);});
+      add(GLFW_KEY_O, [this](float delta){this->viewModelController.rotateZ(rotateSpeed * delta);});
    }
 public:
-   float moveSpeed = 0.05f;
-   float rotateSpeed = 1.0f;
+   // 每秒移动的距离和旋转的角度
+   float moveSpeed = 3.0f;
+   float rotateSpeed = 60.0f;
    ModelMoveSetter(ObservableValue<glm::mat4>& viewModel, bool isSelf = false):viewModelController(viewModel, isSelf){
       createSetters();
    }
@@ -1,9 +1,15 @@
 #ifndef _MINECPP_VERTEX_H_
 #define _MINECPP_VERTEX_H_
 
+#include <array>
+#include <cstring>
+#include <optional>
+#include <span>
 #include <tuple>
+#include <utility>
 #include <vector>
 #include "resource.hpp"
+#include "culling.hpp"
 
 namespace minecpp {
 
@@ -22,6 +28,23 @@ struct VertexMeta<true, DataTypes...>{
     std::vector<unsigned int> indices;
 };
 
+// 按属性分开存放（SoA）的带索引的顶点数据，每个属性是一个连续的数组
+// 与 VertexMeta 相比，可以从 assimp 的数组整块复制，也可以由 VertexLayout 直接打包进 vbo，不需要逐个顶点构造 tuple
+template<typename... DataTypes>
+struct VertexStreams{
+    std::tuple<std::vector<DataTypes>...> attributes;
+    std::vector<unsigned int> indices;
+
+    template<std::size_t I>
+    auto& get(){ return std::get<I>(attributes); }
+    template<std::size_t I>
+    const auto& get() const { return std::get<I>(attributes); }
+    std::size_t size() const { return std::get<0>(attributes).size(); }
+    void resize(std::size_t number){
+        std::apply([number](auto&... attribute){ (attribute.resize(number), ...); }, attributes);
+    }
+};
+
 // c++ 17 fold expression
 template<typename... DataTypes>
 consteval std::size_t getTotalDataSize(){
@@ -36,17 +59,43 @@ void fillVertexData(char *arr, DataTypes... dataTypes){
 
 // std::tuple 中成员的内存布局并不是声明时的顺序，因此需要转换一下
 template<bool index, typename... DataTypes>
-VertexBuffer createVBO(const VertexMeta<index, DataTypes...>& meta){
+std::vector<char> packVertexMeta(const VertexMeta<index, DataTypes...>& meta){
     std::vector<char> vertexes;
     std::size_t stride = getTotalDataSize<DataTypes...>();
     vertexes.resize(meta.vertexes.size() * stride);
     for(int i = 0, j = 0; i < meta.vertexes.size(); i++, j += stride){
         std::apply(fillVertexData<DataTypes...>, std::tuple_cat(std::tuple{vertexes.data() + j}, meta.vertexes[i]));
     }
-    glm::vec3 xColor = glm::vec3{1.0f, 0.0f, 0.0f};
-    glm::vec3 yColor = glm::vec3{0.0f, 1.0f, 0.0f};
-    glm::vec3 zColor = glm::vec3{0.0f, 0.0f, 1.0f};
-    return {vertexes};
+    return vertexes;
+}
+
+template<bool index, typename... DataTypes>
+VertexBuffer createVBO(const VertexMeta<index, DataTypes...>& meta){
+    return {packVertexMeta(meta)};
+}
+
+// 将 src 的顶点和索引追加到 dst 之后，src 的索引会加上 dst 原有的顶点数
+template<typename... DataTypes>
+void appendVertexMeta(VertexMeta<true, DataTypes...>& dst, const VertexMeta<true, DataTypes...>& src){
+    unsigned int base = dst.vertexes.size();
+    dst.vertexes.insert(dst.vertexes.end(), src.vertexes.begin(), src.vertexes.end());
+    dst.indices.reserve(dst.indices.size() + src.indices.size());
+    for(auto index: src.indices){
+        dst.indices.push_back(index + base);
+    }
+}
+
+// 同 appendVertexMeta，每个属性各自整块追加
+template<typename... DataTypes>
+void appendVertexStreams(VertexStreams<DataTypes...>& dst, const VertexStreams<DataTypes...>& src){
+    unsigned int base = dst.size();
+    [&]<std::size_t... I>(std::index_sequence<I...>){
+        ((dst.template get<I>().insert(dst.template get<I>().end(), src.template get<I>().begin(), src.template get<I>().end())), ...);
+    }(std::index_sequence_for<DataTypes...>{});
+    dst.indices.reserve(dst.indices.size() + src.indices.size());
+    for(auto index: src.indices){
+        dst.indices.push_back(index + base);
+    }
 }
 
 template<typename... DataTypes>
@@ -70,21 +119,158 @@ void addAttributes(VertexArray& vao, const VertexBuffer& vbo){
     ((vao.addAttribute<DataTypes>(vbo, index++, stride, offset), offset += sizeof(DataTypes)), ...);
 }
 
+// 顶点属性的来源数组：从 data 开始每隔 stride 字节一个元素，取每个元素开头的 sizeof(T) 个字节
+// 元素可以比属性大，如 aiMesh::mTextureCoords 中的 aiVector3D 可以作为 glm::vec2 的来源
+// data 为空时（如模型没有纹理坐标）属性填充为 0
+template<typename T>
+struct VertexSource{
+    static_assert(std::is_trivially_copyable_v<T>);
+    const char* data;
+    std::size_t stride;
+
+    VertexSource(const T* data): data(reinterpret_cast<const char*>(data)), stride(sizeof(T)){}
+    template<typename U>
+    requires (!std::same_as<U, T> && sizeof(U) >= sizeof(T) && std::is_trivially_copyable_v<U>)
+    VertexSource(const U* data): data(reinterpret_cast<const char*>(data)), stride(sizeof(U)){}
+    VertexSource(const std::vector<T>& data): VertexSource(data.data()){}
+
+    // 复制 number 个元素到每隔 dstStride 字节一个元素的 dst 中，两边都是紧密排列时整块复制
+    // 逐个元素复制的大小是编译期常量，编译器会展开为几条（向量）移动指令
+    void copyTo(char* dst, std::size_t dstStride, std::size_t number) const {
+        if(data == nullptr){
+            for(std::size_t i = 0; i < number; i++, dst += dstStride){
+                std::memset(dst, 0, sizeof(T));
+            }
+        }else if(stride == sizeof(T) && dstStride == sizeof(T)){
+            std::memcpy(dst, data, sizeof(T) * number);
+        }else{
+            const char* src = data;
+            for(std::size_t i = 0; i < number; i++, dst += dstStride, src += stride){
+                std::memcpy(dst, src, sizeof(T));
+            }
+        }
+    }
+};
+
+enum class VertexPacking{
+    // 每个顶点的所有属性排列在一起：位置 法线 纹理坐标 位置 法线 纹理坐标 ...
+    INTERLEAVED,
+    // 每个属性的所有顶点排列在一起：位置 位置 ... 法线 法线 ... 纹理坐标 纹理坐标 ...
+    PLANAR,
+};
+
+// 编译期的顶点布局：属性的类型依次对应着色器中 location 为 0, 1, 2... 的输入
+// 直接从各属性的来源数组打包成 gpu 中的格式，不经过 VertexMeta 的 tuple 和中间数组
+//
+// 使用方式：
+//    using Layout = VertexLayout<VertexPacking::INTERLEAVED, glm::vec3, glm::vec3, glm::vec2>;
+//    VertexBuffer vbo = Layout::createVBO(mesh->mNumVertices, mesh->mVertices, mesh->mNormals, mesh->mTextureCoords[0]);
+//    Layout::addAttributes(vao, vbo, mesh->mNumVertices);
+template<VertexPacking packing, typename... Attributes>
+struct VertexLayout{
+    template<std::size_t I>
+    using Attribute = std::tuple_element_t<I, std::tuple<Attributes...>>;
+
+    // 一个顶点所有属性的字节数
+    static constexpr std::size_t vertexSize = getTotalDataSize<Attributes...>();
+
+    // 第 I 个属性相邻两个顶点之间的字节数
+    template<std::size_t I>
+    static constexpr std::size_t stride = packing == VertexPacking::INTERLEAVED ? vertexSize : sizeof(Attribute<I>);
+
+    // 第 I 个属性第一个元素在 buffer 中的字节偏移
+    template<std::size_t I>
+    static constexpr std::size_t offset(std::size_t vertexNumber){
+        constexpr std::array<std::size_t, sizeof...(Attributes)> sizes {sizeof(Attributes)...};
+        std::size_t before = 0;
+        for(std::size_t i = 0; i < I; i++){
+            before += sizes[i];
+        }
+        return packing == VertexPacking::INTERLEAVED ? before : before * vertexNumber;
+    }
+
+    static constexpr std::size_t size(std::size_t vertexNumber){
+        return vertexSize * vertexNumber;
+    }
+
+    // 把各属性的 vertexNumber 个元素写入 dst，dst 至少有 size(vertexNumber) 字节，可以是映射的 buffer
+    // 逐个属性复制而不是逐个顶点，每次都是顺序读取同一个来源数组
+    static void pack(void* dst, std::size_t vertexNumber, VertexSource<Attributes>... sources){
+        [&]<std::size_t... I>(std::index_sequence<I...>){
+            (sources.copyTo(static_cast<char*>(dst) + offset<I>(vertexNumber), stride<I>, vertexNumber), ...);
+        }(std::index_sequence_for<Attributes...>{});
+    }
+
+    // 分配 vbo 并映射后直接打包进去
+    static VertexBuffer createVBO(std::size_t vertexNumber, VertexSource<Attributes>... sources){
+        VertexBuffer vbo {static_cast<GLsizeiptr>(size(vertexNumber))};
+        if(vertexNumber == 0){
+            return vbo;
+        }
+        // 录制 gl 命令时不会记录写入映射内存的数据，改为经过数组上传
+        if(!GLTrace::isRecording()){
+            void* data = vbo.map(0, size(vertexNumber), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if(data != nullptr){
+                pack(data, vertexNumber, sources...);
+                if(vbo.unmap()){
+                    return vbo;
+                }
+            }
+        }
+        std::vector<char> data(size(vertexNumber));
+        pack(data.data(), vertexNumber, sources...);
+        vbo.setSubData(data);
+        return vbo;
+    }
+
+    // vbo 中的顶点数需要和打包时相同，PLANAR 布局的偏移与顶点数有关
+    static void addAttributes(VertexArray& vao, const VertexBuffer& vbo, std::size_t vertexNumber){
+        [&]<std::size_t... I>(std::index_sequence<I...>){
+            (vao.addAttribute<Attribute<I>>(vbo, I, stride<I>, offset<I>(vertexNumber)), ...);
+        }(std::index_sequence_for<Attributes...>{});
+    }
+};
+
 template<bool index>
 struct VertexData;
 
+// bounds: 局部空间的包围盒，仅当第一个属性是 glm::vec3（位置）时才会计算
 template<>
 struct VertexData<false>{
     VertexBuffer vbo;
     VertexArray vao;
+    BoundingBox bounds;
 };
 template<>
 struct VertexData<true>{
     VertexBuffer vbo;
     ElementBuffer ebo;
     VertexArray vao;
+    BoundingBox bounds;
 };
 
+template<bool index, typename... DataTypes>
+BoundingBox computeBounds(const VertexMeta<index, DataTypes...>& meta){
+    BoundingBox bounds;
+    if constexpr (std::same_as<std::tuple_element_t<0, std::tuple<DataTypes...>>, glm::vec3>){
+        for(auto& vertex: meta.vertexes){
+            bounds.extend(std::get<0>(vertex));
+        }
+    }
+    return bounds;
+}
+
+template<typename... DataTypes>
+BoundingBox computeBounds(const VertexStreams<DataTypes...>& streams){
+    BoundingBox bounds;
+    if constexpr (std::same_as<std::tuple_element_t<0, std::tuple<DataTypes...>>, glm::vec3>){
+        for(auto& position: streams.template get<0>()){
+            bounds.extend(position);
+        }
+    }
+    return bounds;
+}
+
 template<bool index, typename... DataTypes>
 VertexData<index> createVertexData(const VertexMeta<index, DataTypes...>& meta){
     VertexArray vao;
@@ -93,11 +279,50 @@ VertexData<index> createVertexData(const VertexMeta<index, DataTypes...>& meta){
     if constexpr (index){
         ElementBuffer ebo {createEBO(meta)};
         vao.bindElementBuffer(ebo);
-        return {std::move(vbo), std::move(ebo), std::move(vao)};
+        return {std::move(vbo), std::move(ebo), std::move(vao), computeBounds(meta)};
     }else{
         vao.setNumber(meta.vertexes.size());
-        return {std::move(vbo), std::move(vao)};
+        return {std::move(vbo), std::move(vao), computeBounds(meta)};
+    }
+}
+
+// 按照交错的布局直接把各属性打包进 vbo
+// extraIndices 追加在 ebo 中 streams.indices 之后（如 MeshLod 的各级索引），vao 的数量仍然只包括 streams.indices
+template<typename... DataTypes>
+VertexData<true> createVertexData(const VertexStreams<DataTypes...>& streams, const std::vector<unsigned int>& extraIndices = {}){
+    using Layout = VertexLayout<VertexPacking::INTERLEAVED, DataTypes...>;
+    VertexArray vao;
+    VertexBuffer vbo = std::apply([&streams](auto&... attribute){
+        return Layout::createVBO(streams.size(), attribute.data()...);
+    }, streams.attributes);
+    Layout::addAttributes(vao, vbo, streams.size());
+    std::vector<unsigned int> indices;
+    if(!extraIndices.empty()){
+        indices.reserve(streams.indices.size() + extraIndices.size());
+        indices.insert(indices.end(), streams.indices.begin(), streams.indices.end());
+        indices.insert(indices.end(), extraIndices.begin(), extraIndices.end());
     }
+    ElementBuffer ebo {extraIndices.empty() ? streams.indices : indices};
+    vao.bindElementBuffer(ebo);
+    vao.setNumber(streams.indices.size());
+    return {std::move(vbo), std::move(ebo), std::move(vao), computeBounds(streams)};
+}
+
+// 由已经按照 Layout 打包好的数据（如烘焙文件中映射的数组）直接创建，不再经过 CPU 上的打包
+// Layout 的第一个属性需要是位置；indices 中 vao 只绘制前 number 个，之后可以存放其他索引（如 MeshLod 的各级索引）
+template<typename Layout>
+VertexData<true> createPackedVertexData(std::span<const char> vertexes, std::span<const glm::vec3> positions,
+    std::span<const unsigned int> indices, std::size_t number, const BoundingBox& bounds){
+    if(vertexes.size() != Layout::size(positions.size()) || number > indices.size()){
+        throwError("packed vertex data does not match the layout");
+    }
+    VertexArray vao;
+    VertexBuffer vbo {vertexes};
+    Layout::addAttributes(vao, vbo, positions.size());
+    ElementBuffer ebo {indices};
+    vao.bindElementBuffer(ebo);
+    vao.setNumber(number);
+    return {std::move(vbo), std::move(ebo), std::move(vao), bounds};
 }
 
 }// minecpp
@@ -0,0 +1,67 @@
+#include "../src/cook.hpp"
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::filesystem::path temporaryPath(const std::string& name){
+    return std::filesystem::temp_directory_path() / name;
+}
+
+}
+
+TEST(cook, roundTrip) {
+    using namespace minecpp;
+    auto path = temporaryPath("minecpp_cook_test.cooked");
+    std::vector<float> floats {1.0f, 2.0f, 3.0f};
+    std::vector<std::uint16_t> shorts {7, 8, 9};
+    {
+        CookWriter writer {42};
+        writer.write<std::uint32_t>(5);
+        writer.writeString("../model/可莉/颜.png");
+        // 奇数长度的数组之后，下一个数组仍然对齐
+        writer.writeBlock(shorts);
+        writer.writeBlock(floats);
+        writer.writeBlock(std::vector<int>{});
+        writer.save(path);
+    }
+    {
+        MappedFile file {path};
+        CookReader reader {file};
+        ASSERT_TRUE(reader.matches(42));
+        EXPECT_EQ(reader.read<std::uint32_t>(), 5);
+        EXPECT_EQ(reader.readString(), "../model/可莉/颜.png");
+        auto readShorts = reader.readBlock<std::uint16_t>();
+        EXPECT_EQ(std::vector<std::uint16_t>(readShorts.begin(), readShorts.end()), shorts);
+        auto readFloats = reader.readBlock<float>();
+        // 数组直接指向映射的内存
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(readFloats.data()) % CookWriter::blockAlignment, 0);
+        EXPECT_GT(reinterpret_cast<const unsigned char*>(readFloats.data()), file.getData());
+        EXPECT_EQ(std::vector<float>(readFloats.begin(), readFloats.end()), floats);
+        EXPECT_TRUE(reader.readBlock<int>().empty());
+        EXPECT_THROW(reader.read<std::uint32_t>(), std::string);
+
+        CookReader other {file};
+        EXPECT_FALSE(other.matches(43));
+    }
+    std::filesystem::remove(path);
+    EXPECT_THROW(MappedFile {path}, std::string);
+}
+
+TEST(cook, hasher) {
+    using namespace minecpp;
+    std::string content = "v 0.0 1.0 2.0\nf 1 2 3\n";
+    std::uint64_t hash = Hasher{}.add(content).get();
+    EXPECT_EQ(Hasher{}.add(content).get(), hash);
+    std::string changed = content;
+    changed.back() = ' ';
+    EXPECT_NE(Hasher{}.add(changed).get(), hash);
+    // 导入参数也是 key 的一部分
+    EXPECT_NE(Hasher{}.add(content).add(true).get(), Hasher{}.add(content).add(false).get());
+    // 长度不同而内容为前缀时也不同
+    EXPECT_NE(Hasher{}.add(content.data(), 9).get(), Hasher{}.add(content.data(), 10).get());
+}
@@ -0,0 +1,66 @@
+#include "../src/culling.hpp"
+
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+minecpp::Frustum createFrustum(){
+    auto projection = glm::perspective(glm::radians(45.0f), 1920.0f / 1080.0f, 0.1f, 100.0f);
+    auto view = glm::lookAt(glm::vec3(3.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return minecpp::Frustum::fromMatrix(projection * view);
+}
+
+minecpp::SphereBatch createSpheres(int number){
+    std::mt19937 random {42};
+    std::uniform_real_distribution<float> position {-100.0f, 100.0f};
+    std::uniform_real_distribution<float> radius {0.1f, 5.0f};
+    minecpp::SphereBatch batch;
+    batch.reserve(number);
+    for(int i = 0; i < number; i++){
+        batch.add({{position(random), position(random), position(random)}, radius(random)});
+    }
+    return batch;
+}
+
+}
+
+TEST(culling, frustum) {
+    using namespace minecpp;
+    auto frustum = createFrustum();
+    // 相机在 (3, 0, 3) 看向原点
+    EXPECT_TRUE(frustum.isVisible({glm::vec3(0.0f), 0.5f}));
+    // 相机背后
+    EXPECT_FALSE(frustum.isVisible({glm::vec3(10.0f, 0.0f, 10.0f), 0.5f}));
+    // 超过远平面
+    EXPECT_FALSE(frustum.isVisible({glm::vec3(-100.0f, 0.0f, -100.0f), 0.5f}));
+    // 球心在视锥体外但与之相交
+    EXPECT_TRUE(frustum.isVisible({glm::vec3(10.0f, 0.0f, 10.0f), 20.0f}));
+}
+
+TEST(culling, boundingBox) {
+    using namespace minecpp;
+    BoundingBox box;
+    EXPECT_TRUE(box.isEmpty());
+    box.extend(glm::vec3(-1.0f));
+    box.extend(glm::vec3(1.0f));
+    auto transformed = box.transform(glm::translate(glm::mat4(1.0f), glm::vec3(2.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)));
+    EXPECT_EQ(transformed.min, glm::vec3(0.0f));
+    EXPECT_EQ(transformed.max, glm::vec3(4.0f));
+    auto sphere = BoundingSphere::fromBox(box, glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 3.0f, 1.0f)));
+    EXPECT_FLOAT_EQ(sphere.radius, glm::sqrt(3.0f) * 3.0f);
+}
+
+// SIMD 的结果需要和逐个检测的结果完全一致
+TEST(culling, simdMatchesScalar) {
+    using namespace minecpp;
+    auto frustum = createFrustum();
+    // 不是 8 的倍数，覆盖剩余部分的处理
+    auto batch = createSpheres(10007);
+    std::vector<unsigned char> simd;
+    std::vector<unsigned char> scalar;
+    batch.cull(frustum, simd);
+    batch.cullScalar(frustum, scalar);
+    EXPECT_EQ(simd, scalar);
+}
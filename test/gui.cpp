@@ -0,0 +1,37 @@
+#include "../src/gui.hpp"
+
+#include <gtest/gtest.h>
+
+TEST(gui, refreshLimiter) {
+    using namespace minecpp;
+    // 60 帧每秒，面板中的统计数字每帧都在变化
+    GuiRefreshLimiter limiter;
+    int rendered = 0;
+    for(int i = 0; i < 120; i++){
+        rendered += limiter.update(1.0f / 60.0f, 0.25f, true, i == 0);
+    }
+    // 两秒内只按间隔重新绘制，其余帧复用缓存
+    EXPECT_LE(rendered, 9);
+    EXPECT_GE(rendered, 8);
+
+    // 有输入时每帧都重新绘制
+    int withInput = 0;
+    for(int i = 0; i < 10; i++){
+        withInput += limiter.update(1.0f / 60.0f, 0.25f, true, true);
+    }
+    EXPECT_EQ(withInput, 10);
+
+    // 绘制数据不变时不重新绘制
+    int unchanged = 0;
+    for(int i = 0; i < 60; i++){
+        unchanged += limiter.update(1.0f / 60.0f, 0.25f, false, false);
+    }
+    EXPECT_EQ(unchanged, 0);
+
+    // 间隔为 0 时每次变化都重新绘制
+    int unlimited = 0;
+    for(int i = 0; i < 10; i++){
+        unlimited += limiter.update(1.0f / 60.0f, 0.0f, true, false);
+    }
+    EXPECT_EQ(unlimited, 10);
+}
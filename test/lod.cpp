@@ -0,0 +1,127 @@
+#include "../src/lod.hpp"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+
+// size x size 个格子的平面网格；seam 为 true 时 x = size / 2 的一列顶点复制一份，右半边使用复制的顶点，相当于纹理坐标的接缝
+struct Grid{
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+};
+
+Grid createGrid(unsigned int size, bool seam = false){
+    Grid grid;
+    for(unsigned int y = 0; y <= size; y++){
+        for(unsigned int x = 0; x <= size; x++){
+            grid.positions.push_back(glm::vec3{x, y, 0.0f});
+        }
+    }
+    std::vector<unsigned int> copies(grid.positions.size());
+    for(unsigned int i = 0; i < copies.size(); i++){
+        copies[i] = i;
+        if(seam && i % (size + 1) == size / 2){
+            copies[i] = grid.positions.size();
+            grid.positions.push_back(grid.positions[i]);
+        }
+    }
+    for(unsigned int y = 0; y < size; y++){
+        for(unsigned int x = 0; x < size; x++){
+            unsigned int i = y * (size + 1) + x;
+            auto index = [&](unsigned int v){ return x >= size / 2 ? copies[v] : v; };
+            grid.indices.insert(grid.indices.end(), {index(i), index(i + 1), index(i + size + 2)});
+            grid.indices.insert(grid.indices.end(), {index(i), index(i + size + 2), index(i + size + 1)});
+        }
+    }
+    return grid;
+}
+
+minecpp::BoundingBox usedBounds(const Grid& grid, const std::vector<unsigned int>& indices){
+    minecpp::BoundingBox bounds;
+    for(auto index: indices){
+        EXPECT_LT(index, grid.positions.size());
+        bounds.extend(grid.positions[index]);
+    }
+    return bounds;
+}
+
+}
+
+TEST(lod, simplify) {
+    using namespace minecpp;
+    Grid grid = createGrid(16);
+    float error = -1.0f;
+    auto result = MeshSimplifier::simplify(grid.positions, grid.indices, grid.indices.size() / 4, 0.01f, &error);
+    // 平面上的合并没有误差，边界沿着边界合并，轮廓不变
+    EXPECT_LE(result.size(), grid.indices.size() / 4);
+    EXPECT_EQ(result.size() % 3, 0);
+    EXPECT_NEAR(error, 0.0f, 1e-4f);
+    BoundingBox bounds = usedBounds(grid, result);
+    EXPECT_EQ(bounds.min, glm::vec3(0.0f));
+    EXPECT_EQ(bounds.max, glm::vec3(16.0f, 16.0f, 0.0f));
+
+    // 接缝两侧的顶点成对合并，两侧仍然各自使用自己的顶点
+    Grid seam = createGrid(16, true);
+    result = MeshSimplifier::simplify(seam.positions, seam.indices, seam.indices.size() / 4, 0.01f);
+    EXPECT_LE(result.size(), seam.indices.size() / 4);
+    for(std::size_t i = 0; i < result.size(); i += 3){
+        bool copied = false, original = false;
+        for(int j = 0; j < 3; j++){
+            auto& position = seam.positions[result[i + j]];
+            if(position.x == 8.0f){
+                (result[i + j] >= 17 * 17 ? copied : original) = true;
+            }
+        }
+        EXPECT_FALSE(copied && original);
+    }
+}
+
+TEST(lod, generateLods) {
+    using namespace minecpp;
+    // 起伏的网格，简化会产生误差
+    Grid grid = createGrid(32);
+    for(auto& position: grid.positions){
+        position.z = std::sin(position.x * 0.3f) * std::cos(position.y * 0.3f);
+    }
+    std::vector<unsigned int> lodIndices;
+    MeshLod lod = MeshSimplifier::generateLods(grid.positions, grid.indices, lodIndices);
+    ASSERT_GE(lod.size(), 3);
+    EXPECT_EQ(lod.levels[0].offset, 0);
+    EXPECT_EQ(lod.levels[0].count, grid.indices.size());
+    std::size_t offset = grid.indices.size();
+    for(std::size_t i = 1; i < lod.size(); i++){
+        EXPECT_EQ(lod.levels[i].offset, offset);
+        EXPECT_LT(lod.levels[i].count, lod.levels[i - 1].count);
+        EXPECT_GE(lod.levels[i].error, lod.levels[i - 1].error);
+        offset += lod.levels[i].count;
+    }
+    EXPECT_EQ(offset, grid.indices.size() + lodIndices.size());
+    usedBounds(grid, lodIndices);
+}
+
+TEST(lod, select) {
+    using namespace minecpp;
+    LodSelector selector;
+    selector.setScreenSizes({0.5f, 0.25f});
+    selector.setHysteresis(0.1f);
+    EXPECT_EQ(selector.select(1.0f, 0, 3), 0);
+    EXPECT_EQ(selector.select(0.1f, 0, 3), 2);
+    // 分界附近保持当前的等级
+    EXPECT_EQ(selector.select(0.48f, 0, 3), 0);
+    EXPECT_EQ(selector.select(0.52f, 1, 3), 1);
+    EXPECT_EQ(selector.select(0.44f, 0, 3), 1);
+    EXPECT_EQ(selector.select(0.56f, 1, 3), 0);
+    // 不超过 mesh 的等级数
+    EXPECT_EQ(selector.select(0.1f, 0, 2), 1);
+    EXPECT_EQ(selector.select(0.1f, 0, 1), 0);
+
+    BoundingSphere sphere {glm::vec3(0.0f, 0.0f, -10.0f), 1.0f};
+    glm::mat4 projection {1.0f};
+    projection[1][1] = 2.0f;
+    projection[2][3] = -1.0f;
+    projection[3][3] = 0.0f;
+    EXPECT_FLOAT_EQ(LodSelector::projectedSize(sphere, projection, glm::mat4(1.0f)), 0.2f);
+    sphere.radius = 20.0f;
+    EXPECT_TRUE(std::isinf(LodSelector::projectedSize(sphere, projection, glm::mat4(1.0f))));
+}
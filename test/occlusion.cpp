@@ -0,0 +1,79 @@
+#include "../src/occlusion.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+// 位于 z = 0 平面上、边长为 size 的正方形
+struct Quad{
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices {0, 1, 2, 0, 2, 3};
+    Quad(float size){
+        float half = size / 2;
+        positions = {{-half, -half, 0.0f}, {half, -half, 0.0f}, {half, half, 0.0f}, {-half, half, 0.0f}};
+    }
+};
+
+glm::mat4 createProjectionView(){
+    auto projection = glm::perspective(glm::radians(45.0f), 2.0f, 0.1f, 100.0f);
+    auto view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return projection * view;
+}
+
+minecpp::BoundingBox createBox(const glm::vec3& center, float half){
+    minecpp::BoundingBox box;
+    box.extend(center - half);
+    box.extend(center + half);
+    return box;
+}
+
+}
+
+TEST(occlusion, hiz) {
+    using namespace minecpp;
+    Quad quad {4.0f};
+    HiZCuller culler {128, 64};
+    culler.render({{&quad.positions, &quad.indices, glm::mat4(1.0f)}}, createProjectionView());
+
+    // 正方形之后
+    EXPECT_FALSE(culler.isVisible(createBox(glm::vec3(0.0f, 0.0f, -3.0f), 0.5f), glm::mat4(1.0f)));
+    // 正方形之前
+    EXPECT_TRUE(culler.isVisible(createBox(glm::vec3(0.0f, 0.0f, 2.0f), 0.5f), glm::mat4(1.0f)));
+    // 在正方形之后，但从旁边露出来
+    EXPECT_TRUE(culler.isVisible(createBox(glm::vec3(6.0f, 0.0f, -3.0f), 0.5f), glm::mat4(1.0f)));
+    // 包围盒比遮挡物大
+    EXPECT_TRUE(culler.isVisible(createBox(glm::vec3(0.0f, 0.0f, -3.0f), 5.0f), glm::mat4(1.0f)));
+    // 穿过近平面
+    EXPECT_TRUE(culler.isVisible(createBox(glm::vec3(0.0f, 0.0f, 5.0f), 0.5f), glm::mat4(1.0f)));
+}
+
+// 多线程光栅化与单线程的结果一致
+TEST(occlusion, multithread) {
+    using namespace minecpp;
+    Quad quad {2.0f};
+    std::vector<OccluderMesh> occluders;
+    for(int i = 0; i < 16; i++){
+        auto model = glm::translate(glm::mat4(1.0f), glm::vec3(i % 4 - 1.5f, i / 4 - 1.5f, -i * 0.5f));
+        model = glm::rotate(model, glm::radians(i * 20.0f), glm::vec3(0.0f, 1.0f, 1.0f));
+        occluders.push_back({&quad.positions, &quad.indices, model});
+    }
+    HiZCuller single {256, 128, 0};
+    HiZCuller multiple {256, 128, 4};
+    single.render(occluders, createProjectionView());
+    multiple.render(occluders, createProjectionView());
+    EXPECT_EQ(single.getDepth(), multiple.getDepth());
+    EXPECT_EQ(single.getDepth(3), multiple.getDepth(3));
+
+    std::vector<BoundingBox> bounds;
+    std::vector<glm::mat4> models;
+    for(int i = 0; i < 1000; i++){
+        bounds.push_back(createBox(glm::vec3(i % 10 - 5.0f, i / 100 - 5.0f, -(i / 10 % 10)), 0.2f));
+        models.push_back(glm::mat4(1.0f));
+    }
+    std::vector<unsigned char> visible;
+    multiple.test(bounds, models, visible);
+    for(int i = 0; i < bounds.size(); i++){
+        EXPECT_EQ(visible[i], single.isVisible(bounds[i], models[i]));
+    }
+}
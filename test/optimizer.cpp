@@ -0,0 +1,101 @@
+#include "../src/optimizer.hpp"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <random>
+
+namespace {
+
+// size x size 个格子的平面网格，三角形按随机顺序排列
+minecpp::VertexStreams<glm::vec3> createGrid(unsigned int size){
+    minecpp::VertexStreams<glm::vec3> grid;
+    for(unsigned int y = 0; y <= size; y++){
+        for(unsigned int x = 0; x <= size; x++){
+            grid.get<0>().push_back(glm::vec3{x, y, 0.0f});
+        }
+    }
+    std::vector<std::array<unsigned int, 3>> triangles;
+    for(unsigned int y = 0; y < size; y++){
+        for(unsigned int x = 0; x < size; x++){
+            unsigned int i = y * (size + 1) + x;
+            triangles.push_back({i, i + 1, i + size + 2});
+            triangles.push_back({i, i + size + 2, i + size + 1});
+        }
+    }
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937 {1});
+    for(auto& triangle: triangles){
+        grid.indices.insert(grid.indices.end(), triangle.begin(), triangle.end());
+    }
+    return grid;
+}
+
+// 以三角形为单位比较，忽略三角形的顺序
+std::vector<std::array<glm::vec3, 3>> sortedTriangles(const minecpp::VertexStreams<glm::vec3>& mesh){
+    std::vector<std::array<glm::vec3, 3>> triangles;
+    for(std::size_t i = 0; i < mesh.indices.size(); i += 3){
+        triangles.push_back({mesh.get<0>()[mesh.indices[i]], mesh.get<0>()[mesh.indices[i + 1]], mesh.get<0>()[mesh.indices[i + 2]]});
+    }
+    auto less = [](const glm::vec3& a, const glm::vec3& b){
+        return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z);
+    };
+    std::sort(triangles.begin(), triangles.end(), [&less](const auto& a, const auto& b){
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), less);
+    });
+    return triangles;
+}
+
+}
+
+TEST(optimizer, optimize) {
+    using namespace minecpp;
+    VertexStreams<glm::vec3> grid = createGrid(32);
+    // 一个没有被引用的顶点会被去掉
+    grid.get<0>().push_back(glm::vec3{-1.0f});
+    auto expected = sortedTriangles(grid);
+
+    MeshOptimizer::Report report = MeshOptimizer::optimize(grid);
+    EXPECT_EQ(report.before.triangles, 32 * 32 * 2);
+    EXPECT_EQ(report.after.triangles, 32 * 32 * 2);
+    EXPECT_LT(report.after.acmr, report.before.acmr * 0.5f);
+    EXPECT_LT(report.after.atvr, 1.5f);
+    EXPECT_EQ(grid.size(), 33 * 33);
+    // 三角形本身（包括顶点的顺序，即朝向）不变
+    EXPECT_EQ(sortedTriangles(grid), expected);
+    // 顶点按第一次引用的顺序排列
+    unsigned int next = 0;
+    for(auto index: grid.indices){
+        EXPECT_LE(index, next);
+        next = std::max(next, index + 1);
+    }
+}
+
+TEST(optimizer, analyzeVertexCache) {
+    using namespace minecpp;
+    // 两个共边的三角形：第二个三角形只有一个顶点未命中
+    auto statistics = MeshOptimizer::analyzeVertexCache({0, 1, 2, 2, 1, 3}, 4, 16);
+    EXPECT_EQ(statistics.misses, 4);
+    EXPECT_FLOAT_EQ(statistics.acmr, 2.0f);
+    EXPECT_FLOAT_EQ(statistics.atvr, 1.0f);
+    // 缓存只有 3 个时，之后再用到 0 会重新变换
+    statistics = MeshOptimizer::analyzeVertexCache({0, 1, 2, 2, 1, 3, 3, 1, 0}, 4, 3);
+    EXPECT_EQ(statistics.misses, 5);
+}
+
+TEST(optimizer, optimizeOverdrawDegenerate) {
+    using namespace minecpp;
+    // 第一个三角形是退化的，没有三个顶点都未命中的三角形，所有三角形仍然保留
+    std::vector<unsigned int> indices {0, 0, 1, 1, 2, 3, 2, 3, 4};
+    std::vector<glm::vec3> positions {{0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {2.0f, 1.0f, 0.0f}};
+    auto result = MeshOptimizer::optimizeOverdraw(indices, positions);
+    ASSERT_EQ(result.size(), indices.size());
+    std::vector<std::array<unsigned int, 3>> expected;
+    std::vector<std::array<unsigned int, 3>> actual;
+    for(std::size_t i = 0; i < indices.size(); i += 3){
+        expected.push_back({indices[i], indices[i + 1], indices[i + 2]});
+        actual.push_back({result[i], result[i + 1], result[i + 2]});
+    }
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    EXPECT_EQ(actual, expected);
+}
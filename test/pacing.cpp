@@ -0,0 +1,88 @@
+#include "../src/pacing.hpp"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// 由测试推进的时钟，单位为毫秒
+struct FakeClock{
+    double now = 0.0;
+    minecpp::FramePacer::Clock get(){
+        return [this]{return now;};
+    }
+};
+
+}
+
+TEST(pacing, fixedTimestep) {
+    using namespace minecpp;
+    FakeClock clock;
+    FramePacer pacer {FramePacingMode::FIXED_TIMESTEP, 0.01, clock.get()};
+    int steps = 0;
+    auto step = [&](float delta){ EXPECT_FLOAT_EQ(delta, 0.01f); steps++; };
+    pacer.simulate(step);
+    EXPECT_EQ(steps, 0);
+
+    clock.now += 25.0;
+    pacer.simulate(step);
+    EXPECT_EQ(steps, 2);
+    EXPECT_NEAR(pacer.getStatistics().alpha, 0.5f, 1e-4f);
+
+    clock.now += 5.0;
+    pacer.simulate(step);
+    EXPECT_EQ(steps, 3);
+    EXPECT_NEAR(pacer.getStatistics().alpha, 0.0f, 1e-4f);
+
+    // 每帧最多推进 maxSteps 次，多出的时间被丢弃
+    pacer.setMaxSteps(3);
+    clock.now += 100.0;
+    pacer.simulate(step);
+    EXPECT_EQ(steps, 6);
+    EXPECT_NEAR(pacer.getStatistics().droppedTime, 70.0f, 1e-3f);
+}
+
+TEST(pacing, variable) {
+    using namespace minecpp;
+    FakeClock clock;
+    FramePacer pacer {FramePacingMode::UNCAPPED, 0.01, clock.get()};
+    std::vector<float> deltas;
+    auto step = [&](float delta){ deltas.push_back(delta); };
+    pacer.simulate(step);
+    clock.now += 7.0;
+    pacer.simulate(step);
+    EXPECT_EQ(deltas, (std::vector<float>{0.0f, 0.007f}));
+
+    pacer.setDeterministic(true);
+    clock.now += 30.0;
+    pacer.simulate(step);
+    EXPECT_FLOAT_EQ(deltas.back(), 0.01f);
+}
+
+TEST(pacing, interpolation) {
+    using namespace minecpp;
+    FakeClock clock;
+    FramePacer pacer {FramePacingMode::FIXED_TIMESTEP, 0.01, clock.get()};
+    ObservableValue<glm::mat4> model {glm::mat4(1.0f)};
+    InterpolatedTransform transform {model, pacer};
+    auto step = [&](float){ model.get()[3].x += 1.0f; };
+    pacer.simulate(step);
+
+    // 两步之后还剩半步：显示在第一步和第二步的中间
+    clock.now += 25.0;
+    pacer.simulate(step);
+    EXPECT_FLOAT_EQ(model.get()[3].x, 1.5f);
+
+    // 模拟从上一步的结果继续，而不是从插值后的值
+    clock.now += 5.0;
+    pacer.simulate(step);
+    EXPECT_FLOAT_EQ(model.get()[3].x, 2.0f);
+
+    // 模拟之外的修改直接生效
+    model.get()[3].x = 10.0f;
+    clock.now += 10.0;
+    pacer.simulate(step);
+    EXPECT_FLOAT_EQ(model.get()[3].x, 10.0f);
+    clock.now += 10.0;
+    pacer.simulate(step);
+    EXPECT_FLOAT_EQ(model.get()[3].x, 11.0f);
+}
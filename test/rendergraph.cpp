@@ -0,0 +1,99 @@
+#include "../src/rendergraph.hpp"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+void noop(minecpp::RenderGraph::PassContext&){}
+
+}
+
+TEST(rendergraph, order) {
+    using namespace minecpp;
+    RenderGraph graph;
+    auto backbuffer = graph.importBackbuffer();
+    auto color = graph.createTexture("color", {GL_RGBA16F});
+    auto depth = graph.createTexture("depth", {GL_DEPTH_COMPONENT24});
+    auto bloom = graph.createTexture("bloom", {GL_RGBA16F, 0.5f});
+    // 故意倒序声明
+    graph.addPass("composite", [&](auto& builder){ builder.read(color); builder.read(bloom); builder.write(backbuffer); }, noop);
+    graph.addPass("bloom", [&](auto& builder){ builder.read(color); builder.write(bloom); }, noop);
+    graph.addPass("scene", [&](auto& builder){ builder.write(color); builder.write(depth); }, noop);
+    // 混合到 scene 的结果上，需要在 scene 之后
+    graph.addPass("transparent", [&](auto& builder){ builder.read(depth); builder.write(color); }, noop);
+    graph.compile(1920, 1080);
+
+    std::vector<std::string> expected {"scene", "transparent", "bloom", "composite"};
+    EXPECT_EQ(graph.getPassOrder(), expected);
+    EXPECT_TRUE(graph.getCulledPasses().empty());
+}
+
+TEST(rendergraph, cull) {
+    using namespace minecpp;
+    RenderGraph graph;
+    auto backbuffer = graph.importBackbuffer();
+    auto color = graph.createTexture("color", {GL_RGBA8});
+    auto debug = graph.createTexture("debug", {GL_RGBA8});
+    auto shadow = graph.createTexture("shadow", {GL_DEPTH_COMPONENT24, 1.0f, 1024, 1024});
+    graph.addPass("scene", [&](auto& builder){ builder.write(color); }, noop);
+    // 没有被读取，应当被剔除
+    graph.addPass("debug", [&](auto& builder){ builder.read(color); builder.write(debug); }, noop);
+    graph.addPass("present", [&](auto& builder){ builder.read(color); builder.write(backbuffer); }, noop);
+    graph.compile(800, 600);
+    EXPECT_EQ(graph.getCulledPasses(), std::vector<std::string>{"debug"});
+    EXPECT_EQ(graph.getPhysicalIndex(debug), -1);
+
+    // 标记为输出后不再剔除
+    graph.addPass("shadow", [&](auto& builder){ builder.write(shadow); }, noop);
+    graph.markOutput(shadow);
+    graph.compile(800, 600);
+    EXPECT_EQ(graph.getCulledPasses(), std::vector<std::string>{"debug"});
+    EXPECT_EQ(graph.getStatistics().passNumber, 3);
+    EXPECT_GE(graph.getPhysicalIndex(shadow), 0);
+}
+
+TEST(rendergraph, alias) {
+    using namespace minecpp;
+    RenderGraph graph;
+    auto backbuffer = graph.importBackbuffer();
+    auto scene = graph.createTexture("scene", {GL_RGBA16F});
+    auto blurX = graph.createTexture("blurX", {GL_RGBA16F});
+    auto blurY = graph.createTexture("blurY", {GL_RGBA16F});
+    auto small = graph.createTexture("small", {GL_RGBA16F, 0.5f});
+    graph.addPass("scene", [&](auto& builder){ builder.write(scene); }, noop);
+    graph.addPass("blurX", [&](auto& builder){ builder.read(scene); builder.write(blurX); }, noop);
+    graph.addPass("blurY", [&](auto& builder){ builder.read(blurX); builder.write(blurY); }, noop);
+    graph.addPass("down", [&](auto& builder){ builder.read(blurY); builder.write(small); }, noop);
+    graph.addPass("present", [&](auto& builder){ builder.read(small); builder.write(backbuffer); }, noop);
+    graph.compile(100, 100);
+
+    // scene 在 blurX 之后不再使用，blurY 可以复用它
+    EXPECT_EQ(graph.getPhysicalIndex(blurY), graph.getPhysicalIndex(scene));
+    EXPECT_NE(graph.getPhysicalIndex(blurX), graph.getPhysicalIndex(scene));
+    // 大小不同不能共用
+    EXPECT_NE(graph.getPhysicalIndex(small), graph.getPhysicalIndex(blurX));
+    EXPECT_EQ(graph.getPhysicalIndex(backbuffer), -1);
+
+    auto& statistics = graph.getStatistics();
+    EXPECT_EQ(statistics.textureNumber, 4);
+    EXPECT_EQ(statistics.physicalTextureNumber, 3);
+    EXPECT_EQ(statistics.requiredBytes, 100 * 100 * 8 * 3 + 50 * 50 * 8);
+    EXPECT_EQ(statistics.getSavedBytes(), 100 * 100 * 8);
+}
+
+TEST(rendergraph, invalid) {
+    using namespace minecpp;
+    RenderGraph graph;
+    auto backbuffer = graph.importBackbuffer();
+    auto a = graph.createTexture("a", {});
+    auto b = graph.createTexture("b", {});
+    graph.addPass("first", [&](auto& builder){ builder.read(b); builder.write(a); }, noop);
+    graph.addPass("second", [&](auto& builder){ builder.read(a); builder.write(b); }, noop);
+    graph.addPass("present", [&](auto& builder){ builder.read(b); builder.write(backbuffer); }, noop);
+    EXPECT_THROW(graph.compile(100, 100), std::string);
+
+    RenderGraph unwritten;
+    auto c = unwritten.createTexture("c", {});
+    unwritten.addPass("present", [&](auto& builder){ builder.read(c); builder.write(unwritten.importBackbuffer()); }, noop);
+    EXPECT_THROW(unwritten.compile(100, 100), std::string);
+}
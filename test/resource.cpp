@@ -118,4 +118,32 @@ TEST(resource, 1) {
     }catch(std::string a){
         fmt::println("{}", a);
     }
-}
\ No newline at end of file
+}
+TEST(resource, classifyAlpha) {
+    using namespace minecpp;
+    auto image = [](std::vector<unsigned char> alphas){
+        std::vector<unsigned char> rgba;
+        for(unsigned char alpha: alphas){
+            rgba.insert(rgba.end(), {255, 255, 255, alpha});
+        }
+        return rgba;
+    };
+    auto classify = [](const std::vector<unsigned char>& rgba){
+        return classifyAlpha(rgba.data(), rgba.size() / 4);
+    };
+    EXPECT_EQ(classify(image({255, 255, 255, 255})), AlphaMode::NONE);
+    // 只有一个像素不是完全不透明也不会作为透明物体绘制
+    std::vector<unsigned char> edge(100, 255);
+    edge[0] = 254;
+    EXPECT_EQ(classify(image(edge)), AlphaMode::CUTOUT);
+    // 镂空贴图：完全透明和不透明的像素，以及边缘少量抗锯齿的半透明像素
+    std::vector<unsigned char> cutout(100, 0);
+    std::fill(cutout.begin(), cutout.begin() + 60, 255);
+    cutout[60] = 128;
+    cutout[61] = 64;
+    EXPECT_EQ(classify(image(cutout)), AlphaMode::CUTOUT);
+    // 半透明贴图
+    std::vector<unsigned char> glass(100, 128);
+    glass[0] = 255;
+    EXPECT_EQ(classify(image(glass)), AlphaMode::TRANSLUCENT);
+}
@@ -0,0 +1,89 @@
+#include "../src/scheduler.hpp"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// 由任务推进的时钟，使测试不依赖实际的耗时
+struct FakeClock{
+    double now = 0.0;
+    minecpp::FrameScheduler::Clock get(){
+        return [this]{return now;};
+    }
+};
+
+}
+
+TEST(scheduler, budget) {
+    using namespace minecpp;
+    FakeClock clock;
+    FrameScheduler scheduler {5.0f, clock.get()};
+    int executed = 0;
+    for(int i = 0; i < 5; i++){
+        scheduler.enqueue([&]{ clock.now += 2.0; executed++; }, 0, 2.0f);
+    }
+    scheduler.run();
+    EXPECT_EQ(executed, 2);
+    auto statistics = scheduler.getStatistics();
+    EXPECT_EQ(statistics.executedNumber, 2);
+    EXPECT_EQ(statistics.queueDepth, 3);
+    EXPECT_FLOAT_EQ(statistics.usedTime, 4.0f);
+    EXPECT_FLOAT_EQ(statistics.queuedCost, 6.0f);
+
+    scheduler.run();
+    scheduler.run();
+    EXPECT_EQ(executed, 5);
+    EXPECT_TRUE(scheduler.empty());
+
+    // 超过预算的任务每帧也至少执行一个
+    scheduler.enqueue([&]{ clock.now += 10.0; executed++; }, 0, 10.0f);
+    scheduler.enqueue([&]{ clock.now += 10.0; executed++; }, 0, 10.0f);
+    scheduler.run();
+    EXPECT_EQ(executed, 6);
+}
+
+TEST(scheduler, priority) {
+    using namespace minecpp;
+    FakeClock clock;
+    FrameScheduler scheduler {100.0f, clock.get()};
+    std::vector<int> order;
+    scheduler.enqueue([&]{ order.push_back(0); }, 0);
+    scheduler.enqueue([&]{ order.push_back(1); }, 2);
+    scheduler.enqueue([&]{ order.push_back(2); }, 1);
+    scheduler.enqueue([&]{ order.push_back(3); }, 2);
+    scheduler.run();
+    EXPECT_EQ(order, (std::vector<int>{1, 3, 2, 0}));
+}
+
+TEST(scheduler, incremental) {
+    using namespace minecpp;
+    FakeClock clock;
+    FrameScheduler scheduler {2.5f, clock.get()};
+    int steps = 0;
+    scheduler.enqueue([&]{
+        clock.now += 1.0;
+        return ++steps == 5;
+    }, 0, 1.0f);
+    scheduler.run();
+    EXPECT_EQ(steps, 2);
+    EXPECT_EQ(scheduler.getStatistics().completedNumber, 0);
+    scheduler.run();
+    scheduler.run();
+    EXPECT_EQ(steps, 5);
+    EXPECT_EQ(scheduler.getStatistics().completedNumber, 1);
+    EXPECT_TRUE(scheduler.empty());
+}
+
+TEST(scheduler, replace) {
+    using namespace minecpp;
+    FakeClock clock;
+    FrameScheduler scheduler {100.0f, clock.get()};
+    int first = 0;
+    int second = 0;
+    scheduler.enqueue([&]{ first++; }, 0, 1.0f, "rebuild");
+    scheduler.enqueue([&]{ second++; }, 0, 1.0f, "rebuild");
+    EXPECT_EQ(scheduler.size(), 1);
+    scheduler.run();
+    EXPECT_EQ(first, 0);
+    EXPECT_EQ(second, 1);
+}
@@ -0,0 +1,54 @@
+#include "../src/statistics.hpp"
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <sstream>
+
+TEST(statistics, frame) {
+    using namespace minecpp;
+    FrameStatistics::endFrame();
+    FrameStatistics::countDraw(GL_TRIANGLES, 36);
+    FrameStatistics::countDraw(GL_TRIANGLE_STRIP, 4);
+    FrameStatistics::countDraw(GL_LINES, 8);
+    FrameStatistics::countUniform(64);
+    FrameStatistics::countUniform(12);
+    FrameStatistics::countBuffer(1024);
+    FrameStatistics::getCurrent().programBinds++;
+    auto frame = FrameStatistics::getFrameNumber();
+    FrameStatistics::endFrame();
+
+    auto last = FrameStatistics::getLastFrame();
+    EXPECT_EQ(FrameStatistics::getFrameNumber(), frame + 1);
+    EXPECT_EQ(last.drawCalls, 3);
+    EXPECT_EQ(last.triangles, 14u);
+    EXPECT_EQ(last.uniformUploads, 2);
+    EXPECT_EQ(last.uniformBytes, 76u);
+    EXPECT_EQ(last.bufferUploads, 1);
+    EXPECT_EQ(last.bufferBytes, 1024u);
+    EXPECT_EQ(last.programBinds, 1);
+    EXPECT_EQ(FrameStatistics::getCurrent().drawCalls, 0);
+}
+
+TEST(statistics, csv) {
+    using namespace minecpp;
+    auto path = std::filesystem::temp_directory_path() / "minecpp_statistics_test.csv";
+    FrameStatistics::startCsv(path.string());
+    FrameStatistics::countDraw(GL_TRIANGLES, 6);
+    FrameStatistics::endFrame();
+    FrameStatistics::endFrame();
+    FrameStatistics::stopCsv();
+    EXPECT_FALSE(FrameStatistics::isLoggingCsv());
+
+    std::ifstream file {path};
+    std::string header;
+    std::string first;
+    std::string second;
+    std::getline(file, header);
+    std::getline(file, first);
+    std::getline(file, second);
+    EXPECT_EQ(header.substr(0, 25), "frame,drawCalls,triangles");
+    EXPECT_EQ(first.substr(first.find(',')), ",1,2,0,0,0,0,0,0,0,0");
+    EXPECT_EQ(second.substr(second.find(',')), ",0,0,0,0,0,0,0,0,0,0");
+    file.close();
+    std::filesystem::remove(path);
+}
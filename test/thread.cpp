@@ -0,0 +1,29 @@
+#include "../src/thread.hpp"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+TEST(thread, parallelForEach) {
+    using namespace minecpp;
+    ThreadPool pool {3};
+    std::vector<std::atomic<int>> visited(100);
+    pool.parallelForEach(visited.size(), [&visited](std::size_t i){
+        visited[i]++;
+    });
+    for(auto& count: visited){
+        EXPECT_EQ(count, 1);
+    }
+    pool.parallelForEach(0, [](std::size_t){ FAIL(); });
+
+    // 任务中的异常在所有线程结束后由调用线程重新抛出
+    std::atomic<int> executed = 0;
+    EXPECT_THROW(pool.parallelForEach(100, [&executed](std::size_t i){
+        executed++;
+        if(i == 10){
+            throw std::string("failed");
+        }
+    }), std::string);
+    EXPECT_LT(executed, 100);
+}
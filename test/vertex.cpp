@@ -0,0 +1,68 @@
+#include "../src/vertex.hpp"
+
+#include <gtest/gtest.h>
+
+TEST(vertex, appendVertexMeta) {
+    using namespace minecpp;
+    VertexMeta<true, glm::vec3> a {
+        .vertexes {{glm::vec3{0.0f}}, {glm::vec3{1.0f}}, {glm::vec3{2.0f}}},
+        .indices {0, 1, 2},
+    };
+    VertexMeta<true, glm::vec3> b {
+        .vertexes {{glm::vec3{3.0f}}, {glm::vec3{4.0f}}, {glm::vec3{5.0f}}},
+        .indices {2, 1, 0},
+    };
+    appendVertexMeta(a, b);
+    ASSERT_EQ(a.vertexes.size(), 6);
+    ASSERT_EQ(a.indices.size(), 6);
+    EXPECT_EQ(a.indices[3], 5);
+    EXPECT_EQ(a.indices[5], 3);
+    // 追加后的索引仍然指向原来的顶点
+    for(int i = 0; i < 3; i++){
+        EXPECT_EQ(a.vertexes[a.indices[3 + i]], b.vertexes[b.indices[i]]);
+    }
+}
+
+TEST(vertex, layoutPack) {
+    using namespace minecpp;
+    // 来源的元素比属性大（如 assimp 中作为纹理坐标的 aiVector3D），只取开头的部分
+    std::vector<glm::vec3> positions {{1.0f, 2.0f, 3.0f}, {4.0f, 5.0f, 6.0f}};
+    std::vector<glm::vec3> coords {{0.1f, 0.2f, 9.0f}, {0.3f, 0.4f, 9.0f}};
+    VertexMeta<false, glm::vec3, glm::vec2> meta {
+        .vertexes {{positions[0], glm::vec2{0.1f, 0.2f}}, {positions[1], glm::vec2{0.3f, 0.4f}}},
+    };
+
+    using Interleaved = VertexLayout<VertexPacking::INTERLEAVED, glm::vec3, glm::vec2>;
+    std::vector<char> interleaved(Interleaved::size(2));
+    Interleaved::pack(interleaved.data(), 2, positions, coords.data());
+    // 与 createVBO 的结果相同
+    EXPECT_EQ(interleaved, packVertexMeta(meta));
+
+    using Planar = VertexLayout<VertexPacking::PLANAR, glm::vec3, glm::vec2>;
+    static_assert(Planar::stride<1> == sizeof(glm::vec2));
+    static_assert(Planar::offset<1>(2) == 2 * sizeof(glm::vec3));
+    std::vector<char> planar(Planar::size(2));
+    Planar::pack(planar.data(), 2, positions, static_cast<const glm::vec2*>(nullptr));
+    EXPECT_EQ(std::memcmp(planar.data(), positions.data(), 2 * sizeof(glm::vec3)), 0);
+    // 没有来源的属性填充为 0
+    for(std::size_t i = 2 * sizeof(glm::vec3); i < planar.size(); i++){
+        EXPECT_EQ(planar[i], 0);
+    }
+}
+
+TEST(vertex, appendVertexStreams) {
+    using namespace minecpp;
+    VertexStreams<glm::vec3, float> a {
+        .attributes {std::vector{glm::vec3{0.0f}, glm::vec3{1.0f}}, std::vector{0.0f, 1.0f}},
+        .indices {0, 1, 1},
+    };
+    VertexStreams<glm::vec3, float> b {
+        .attributes {std::vector{glm::vec3{2.0f}}, std::vector{2.0f}},
+        .indices {0, 0, 0},
+    };
+    appendVertexStreams(a, b);
+    ASSERT_EQ(a.size(), 3);
+    ASSERT_EQ(a.get<1>().size(), 3);
+    EXPECT_EQ(a.get<0>()[2], glm::vec3{2.0f});
+    EXPECT_EQ(a.indices, (std::vector<unsigned int>{0, 1, 1, 2, 2, 2}));
+}
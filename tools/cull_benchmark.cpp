@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "../src/culling.hpp"
+#include "fmt/core.h"
+
+// 比较 SphereBatch 逐个检测和 SIMD 检测视锥体剔除的耗时
+// 用法：cull_benchmark [球的数量]
+
+using namespace minecpp;
+
+namespace {
+
+constexpr int repeat = 100;
+
+Frustum createFrustum(){
+   auto projection = glm::perspective(glm::radians(45.0f), 1920.0f / 1080.0f, 0.1f, 100.0f);
+   auto view = glm::lookAt(glm::vec3(3.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+   return Frustum::fromMatrix(projection * view);
+}
+
+SphereBatch createSpheres(std::size_t number){
+   std::mt19937 random {42};
+   std::uniform_real_distribution<float> position {-100.0f, 100.0f};
+   std::uniform_real_distribution<float> radius {0.1f, 5.0f};
+   SphereBatch batch;
+   batch.reserve(number);
+   for(std::size_t i = 0; i < number; i++){
+      batch.add({{position(random), position(random), position(random)}, radius(random)});
+   }
+   return batch;
+}
+
+// 返回 repeat 次中的中位数，单位为微秒
+template<typename Func>
+double measure(Func&& func){
+   std::vector<double> times;
+   for(int i = 0; i < repeat; i++){
+      auto begin = std::chrono::steady_clock::now();
+      func();
+      auto end = std::chrono::steady_clock::now();
+      times.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+   }
+   std::sort(times.begin(), times.end());
+   return times[times.size() / 2];
+}
+
+}
+
+int main(int argc, char** argv)
+{
+   std::size_t number = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+   if(number == 0){
+      fmt::println("usage: cull_benchmark [sphere number]");
+      return 1;
+   }
+   auto frustum = createFrustum();
+   auto batch = createSpheres(number);
+   std::vector<unsigned char> scalar;
+   std::vector<unsigned char> simd;
+   double scalarTime = measure([&]{ batch.cullScalar(frustum, scalar); });
+   double simdTime = measure([&]{ batch.cull(frustum, simd); });
+   if(scalar != simd){
+      fmt::println("simd result differs from scalar");
+      return 1;
+   }
+   fmt::println("cull {} spheres, median of {} runs: scalar {:.1f} us, simd {:.1f} us, visible {}",
+      number, repeat, scalarTime, simdTime, std::count(simd.begin(), simd.end(), 1));
+   return 0;
+}
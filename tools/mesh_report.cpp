@@ -0,0 +1,92 @@
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include "../src/optimizer.hpp"
+#include "../src/thread.hpp"
+
+// 对目录下所有 assimp 能导入的模型运行 MeshOptimizer，输出优化前后的 ACMR/ATVR，不需要 gl 上下文
+// 用法：mesh_report [目录，默认为 ../model] [--cache <缓存大小>]
+
+using namespace minecpp;
+
+namespace {
+
+// 与 Model::processMesh 相同，只需要位置和索引
+VertexStreams<glm::vec3> createStreams(const aiMesh* mesh){
+   VertexStreams<glm::vec3> streams;
+   streams.resize(mesh->mNumVertices);
+   VertexSource<glm::vec3>{mesh->mVertices}.copyTo(reinterpret_cast<char*>(streams.get<0>().data()), sizeof(glm::vec3), mesh->mNumVertices);
+   streams.indices.reserve(mesh->mNumFaces * 3);
+   for(unsigned int i = 0; i < mesh->mNumFaces; i++){
+      const aiFace& face = mesh->mFaces[i];
+      // 点和线没有三角形
+      if(face.mNumIndices == 3){
+         streams.indices.insert(streams.indices.end(), face.mIndices, face.mIndices + 3);
+      }
+   }
+   return streams;
+}
+
+void report(const std::filesystem::path& path, std::size_t cacheSize, ThreadPool& pool){
+   Assimp::Importer importer;
+   const aiScene* scene = importer.ReadFile(path.string(), aiProcess_Triangulate);
+   if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE){
+      fmt::println("{}: import failed: {}", path.string(), importer.GetErrorString());
+      return;
+   }
+   std::vector<VertexStreams<glm::vec3>> meshes;
+   for(unsigned int i = 0; i < scene->mNumMeshes; i++){
+      meshes.push_back(createStreams(scene->mMeshes[i]));
+   }
+   std::vector<MeshOptimizer::Report> reports(meshes.size());
+   auto start = std::chrono::steady_clock::now();
+   pool.parallelFor(meshes.size(), [&](std::size_t begin, std::size_t end){
+      for(std::size_t i = begin; i < end; i++){
+         reports[i] = MeshOptimizer::optimize(meshes[i], cacheSize);
+      }
+   });
+   auto finish = std::chrono::steady_clock::now();
+   MeshOptimizer::Report total;
+   for(auto& meshReport: reports){
+      total.before.add(meshReport.before);
+      total.after.add(meshReport.after);
+   }
+   fmt::println("{}: {} meshes, {} triangles, {} vertexes, optimized in {:.1f} ms",
+      path.string(), meshes.size(), total.before.triangles, total.before.vertexes,
+      std::chrono::duration<double, std::milli>(finish - start).count());
+   fmt::println("   ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+      total.before.acmr, total.after.acmr, total.before.atvr, total.after.atvr);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+   std::filesystem::path directory = "../model";
+   std::size_t cacheSize = MeshOptimizer::defaultCacheSize;
+   for(int i = 1; i < argc; i++){
+      std::string option = argv[i];
+      if(option == "--cache" && i + 1 < argc){
+         cacheSize = std::stoul(argv[++i]);
+      }else{
+         directory = option;
+      }
+   }
+   if(!std::filesystem::is_directory(directory) || cacheSize == 0){
+      fmt::println("usage: mesh_report [directory] [--cache <cache size>]");
+      return 1;
+   }
+   fmt::println("vertex cache: {} entries fifo", cacheSize);
+   ThreadPool pool;
+   Assimp::Importer importer;
+   for(auto& entry: std::filesystem::recursive_directory_iterator(directory)){
+      if(entry.is_regular_file() && importer.IsExtensionSupported(entry.path().extension().string())){
+         report(entry.path(), cacheSize, pool);
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "../src/resource.hpp"
+#include "../src/trace.hpp"
+
+// 回放 GLTrace 录制的命令流：不等待垂直同步，尽可能快地重新执行所有命令，输出每帧的 CPU 和 GPU 时间
+// 用法：replay <trace 文件> [--headless] [--frames]
+//    --headless  以无窗口模式回放（也可以设置 MINECPP_HEADLESS）
+//    --frames    输出每一帧的时间
+// 录制：运行示例时设置环境变量 MINECPP_TRACE=<trace 文件>
+
+using namespace minecpp;
+
+namespace {
+
+struct FrameTime{
+   double cpu;
+   double gpu;
+};
+
+void printSummary(const char* name, std::vector<double> times){
+   if(times.empty()){
+      return;
+   }
+   std::sort(times.begin(), times.end());
+   double sum = 0.0;
+   for(double time: times){
+      sum += time;
+   }
+   auto percentile = [&times](double p){
+      return times[std::min(times.size() - 1, static_cast<std::size_t>(p * times.size()))];
+   };
+   fmt::println("{}: average {:.3f} ms, median {:.3f} ms, p95 {:.3f} ms, max {:.3f} ms",
+      name, sum / times.size(), percentile(0.5), percentile(0.95), times.back());
+}
+
+int replay(const std::string& path, bool headless, bool printFrames){
+   TraceReader reader {path};
+   if(reader.read<std::uint32_t>() != traceMagic){
+      throwError(fmt::format("{} is not a gl trace", path));
+   }
+   if(auto version = reader.read<std::uint32_t>(); version != traceVersion){
+      throwError(fmt::format("unsupported trace version {}", version));
+   }
+   int width = reader.read<std::int32_t>();
+   int height = reader.read<std::int32_t>();
+   Context ctx {width, height, headless};
+   glfwSwapInterval(0);
+
+   TraceReplayState state;
+   std::array<std::size_t, static_cast<std::size_t>(TraceOp::COUNT)> counts {};
+   std::vector<FrameTime> frames;
+   // 每帧的 GPU 时间在回放结束后统一读取，为相邻两帧开始时的时间戳之差
+   // 录制的命令流中可能有 GL_TIME_ELAPSED 查询（如 DynamicResolution 的计时），它不能嵌套，因此这里使用时间戳
+   std::vector<TimestampQuery> timestamps;
+   std::size_t beginPosition = reader.getPosition();
+
+   auto begin = std::chrono::steady_clock::now();
+   auto frameBegin = begin;
+   timestamps.emplace_back().record();
+   while(!reader.end() && !glfwWindowShouldClose(ctx.getWindow())){
+      TraceOp op = replayTraceCommand(reader, state);
+      counts[static_cast<std::size_t>(op)]++;
+      if(op != TraceOp::FRAME){
+         continue;
+      }
+      timestamps.emplace_back().record();
+      glfwSwapBuffers(ctx.getWindow());
+      glfwPollEvents();
+      auto now = std::chrono::steady_clock::now();
+      frames.push_back({std::chrono::duration<double, std::milli>(now - frameBegin).count(), 0.0});
+      frameBegin = now;
+   }
+   glFinish();
+   auto end = std::chrono::steady_clock::now();
+   checkGLError();
+   for(std::size_t i = 0; i < frames.size(); i++){
+      frames[i].gpu = (timestamps[i + 1].getResult() - timestamps[i].getResult()) / 1e6;
+   }
+
+   fmt::println("replayed {} ({} bytes of commands) in {:.3f} ms, {} frames",
+      path, reader.size() - beginPosition, std::chrono::duration<double, std::milli>(end - begin).count(), frames.size());
+   std::vector<double> cpuTimes;
+   std::vector<double> gpuTimes;
+   for(std::size_t i = 0; i < frames.size(); i++){
+      cpuTimes.push_back(frames[i].cpu);
+      gpuTimes.push_back(frames[i].gpu);
+      if(printFrames){
+         fmt::println("frame {}: cpu {:.3f} ms, gpu {:.3f} ms", i, frames[i].cpu, frames[i].gpu);
+      }
+   }
+   printSummary("cpu", cpuTimes);
+   printSummary("gpu", gpuTimes);
+   fmt::println("commands:");
+   for(std::size_t i = 0; i < counts.size(); i++){
+      if(counts[i] > 0){
+         fmt::println("   {:<32}{}", traceOpNames[i], counts[i]);
+      }
+   }
+   return 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+   if(argc < 2){
+      fmt::println("usage: replay <trace file> [--headless] [--frames]");
+      return 1;
+   }
+   bool headless = false;
+   bool printFrames = false;
+   for(int i = 2; i < argc; i++){
+      std::string option = argv[i];
+      if(option == "--headless"){
+         headless = true;
+      }else if(option == "--frames"){
+         printFrames = true;
+      }else{
+         fmt::println("unknown option {}", option);
+         return 1;
+      }
+   }
+   try{
+      return replay(argv[1], headless, printFrames);
+   }catch(const std::string& e){
+      fmt::println("{}", e);
+      return 1;
+   }
+}
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "../src/vertex.hpp"
+
+// 比较两种打包顶点数据的方式在 CPU 上的耗时：
+//    tuple   从按属性分开的数组构造 VertexMeta，再由 createVBO 逐个顶点打包（原来导入模型的方式）
+//    layout  VertexLayout 从按属性分开的数组直接打包
+// 用法：vertex_benchmark [顶点数] [--gl]
+//    --gl  同时比较包括上传在内的 createVBO 和 VertexLayout::createVBO（以无窗口模式创建 gl 上下文）
+
+using namespace minecpp;
+
+namespace {
+
+constexpr int repeat = 20;
+
+// 与 aiMesh 相同：位置、法线和纹理坐标都是三个 float
+struct SourceMesh{
+   std::vector<glm::vec3> positions;
+   std::vector<glm::vec3> normals;
+   std::vector<glm::vec3> coords;
+};
+
+SourceMesh createSource(std::size_t number){
+   std::mt19937 random {42};
+   std::uniform_real_distribution<float> distribution {-1.0f, 1.0f};
+   auto next = [&]{ return glm::vec3{distribution(random), distribution(random), distribution(random)}; };
+   SourceMesh mesh;
+   for(std::size_t i = 0; i < number; i++){
+      mesh.positions.push_back(next());
+      mesh.normals.push_back(next());
+      mesh.coords.push_back(next());
+   }
+   return mesh;
+}
+
+VertexMeta<false, glm::vec3, glm::vec3, glm::vec2> createMeta(const SourceMesh& mesh){
+   VertexMeta<false, glm::vec3, glm::vec3, glm::vec2> meta;
+   meta.vertexes.reserve(mesh.positions.size());
+   for(std::size_t i = 0; i < mesh.positions.size(); i++){
+      meta.vertexes.push_back({mesh.positions[i], mesh.normals[i], glm::vec2{mesh.coords[i]}});
+   }
+   return meta;
+}
+
+// 返回 repeat 次中的中位数，单位为毫秒
+template<typename Func>
+double measure(Func&& func){
+   std::vector<double> times;
+   for(int i = 0; i < repeat; i++){
+      auto begin = std::chrono::steady_clock::now();
+      func();
+      auto end = std::chrono::steady_clock::now();
+      times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+   }
+   std::sort(times.begin(), times.end());
+   return times[times.size() / 2];
+}
+
+void print(const char* name, double time, std::size_t bytes){
+   fmt::println("   {:<24}{:>10.3f} ms {:>10.2f} GB/s", name, time, bytes / time / 1e6);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+   std::size_t number = 1 << 20;
+   bool gl = false;
+   for(int i = 1; i < argc; i++){
+      std::string option = argv[i];
+      if(option == "--gl"){
+         gl = true;
+      }else{
+         number = std::strtoull(argv[i], nullptr, 10);
+      }
+   }
+   if(number == 0){
+      fmt::println("usage: vertex_benchmark [vertex number] [--gl]");
+      return 1;
+   }
+   using Interleaved = VertexLayout<VertexPacking::INTERLEAVED, glm::vec3, glm::vec3, glm::vec2>;
+   using Planar = VertexLayout<VertexPacking::PLANAR, glm::vec3, glm::vec3, glm::vec2>;
+   SourceMesh mesh = createSource(number);
+   std::size_t bytes = Interleaved::size(number);
+
+   try{
+      fmt::println("{} vertexes, {} bytes, median of {} runs", number, bytes, repeat);
+      std::vector<char> dst(bytes);
+      std::vector<char> reference;
+      print("tuple + createVBO", measure([&]{ reference = packVertexMeta(createMeta(mesh)); }), bytes);
+      print("layout interleaved", measure([&]{
+         Interleaved::pack(dst.data(), number, mesh.positions, mesh.normals, mesh.coords.data());
+      }), bytes);
+      if(dst != reference){
+         throwError("interleaved layout differs from createVBO");
+      }
+      print("layout planar", measure([&]{
+         Planar::pack(dst.data(), number, mesh.positions, mesh.normals, mesh.coords.data());
+      }), bytes);
+
+      if(gl){
+         Context ctx {800, 600, true};
+         fmt::println("with upload:");
+         print("tuple + createVBO", measure([&]{ createVBO(createMeta(mesh)); glFinish(); }), bytes);
+         print("layout createVBO", measure([&]{
+            Interleaved::createVBO(number, mesh.positions, mesh.normals, mesh.coords.data());
+            glFinish();
+         }), bytes);
+      }
+   }catch(const std::string& e){
+      fmt::println("{}", e);
+      return 1;
+   }
+   return 0;
+}